@@ -1,30 +1,86 @@
 #version 450
 #extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_nonuniform_qualifier : enable
 
 #include "shader_structs.h"
 
+#define PI 3.14159265359
+
 layout(set=0, binding = 0) uniform _ULighting {
 	ULighting lighting;
 };
 
-layout(set = 1, binding = 0)  uniform _UMaterial {
-	UMaterial material;
+// clustered point lights, see LightCuller
+layout(set=0, binding = 1) uniform _UClusterParams {
+	UClusterParams cluster_params;
+};
+layout(set=0, binding = 2) readonly buffer _PointLights {
+	UPointLight point_lights[];
+};
+layout(set=0, binding = 3) readonly buffer _ClusterRanges {
+	uvec2 cluster_ranges[]; // (offset, count) in light_indices
+};
+layout(set=0, binding = 4) readonly buffer _LightIndices {
+	uint light_indices[];
 };
 
-layout(set = 1, binding = 1) uniform sampler2D albedo_map;
-layout(set = 1, binding = 2) uniform sampler2D normal_map;
-layout(set = 1, binding = 3) uniform sampler2D emissive_map;
-layout(set = 1, binding = 4) uniform sampler2D metallic_roughness_occlusion_map;
+// bindless materials, see ResourceBindingMgr
+layout(set = 1, binding = 0) readonly buffer _Materials {
+	MaterialData materials[];
+};
+layout(set = 1, binding = 1) uniform sampler2D textures[];
 
 layout(location = 0) in vec2 uv;
 layout(location=1) in vec3 normal;
 layout(location=2) in vec3 pos;
+layout(location=3) flat in uint material_index;
 layout(location = 0) out vec4 o_color;
 
+uint clusterIndex()
+{
+	uvec2 tile = min(uvec2(gl_FragCoord.xy / cluster_params.tile_size.xy),
+	                 uvec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+	float depth = max(-dot(cluster_params.view_z, vec4(pos, 1.0)), cluster_params.depth_slice.x);
+	int slice = int(floor(log(depth) * cluster_params.depth_slice.z + cluster_params.depth_slice.w));
+	slice = clamp(slice, 0, CLUSTER_Z - 1);
+	return (uint(slice) * CLUSTER_Y + tile.y) * CLUSTER_X + tile.x;
+}
+
+// illuminance(lx) on the surface
+vec3 calcIlluminance(vec3 n)
+{
+	vec3 e = vec3(0.0);
+	for (uint i = 0; i < lighting.light_num[LIGHT_DIRECTIONAL]; ++i) {
+		UDirectionalLight light = lighting.directional_lights[i];
+		e += light.illuminance.rgb * max(dot(n, -normalize(light.direction.xyz)), 0.0);
+	}
+	// only the lights of this fragment's cluster
+	uvec2 range = cluster_ranges[clusterIndex()];
+	for (uint i = 0; i < range.y; ++i) {
+		UPointLight light = point_lights[light_indices[range.x + i]];
+		vec3 l = light.position.xyz - pos;
+		float d2 = max(dot(l, l), 1e-4);
+		// smooth window, falls to 0 at the light range
+		float factor = d2 / (light.position.w * light.position.w);
+		float window = clamp(1.0 - factor * factor, 0.0, 1.0);
+		e += light.luminous_intensity.rgb * (window * window / d2) * max(dot(n, l * inversesqrt(d2)), 0.0);
+	}
+	return e;
+}
+
 void main()
 {
 	//MaterialInfo mat_info = calc_material_info();
 	//o_color = calc_pbr(mat_info);
-	o_color = texture(albedo_map, uv);
-	//o_color = vec4(1.0, 0.0, 0.0, 1.0);
-}
\ No newline at end of file
+	// the material index is uniform per draw, but draws of different
+	// materials may share a subgroup
+	uint albedo_texture = materials[material_index].albedo_texture;
+	vec4 albedo = albedo_texture == INVALID_BINDLESS_INDEX ? vec4(0.0)
+		: texture(textures[nonuniformEXT(albedo_texture)], uv);
+	if (lighting.light_num[LIGHT_DIRECTIONAL] + cluster_params.point_light_num == 0) {
+		o_color = albedo; // unlit without lights
+		return;
+	}
+	// lambert diffuse until the pbr brdf is implemented
+	o_color = vec4(albedo.rgb * calcIlluminance(normalize(normal)) / PI, albedo.a);
+}
@@ -3,7 +3,7 @@
 
 /**
  * set-0 for engine-global resource
- * set-1 for material resource, for material only store this set
+ * set-1 for material resource, the bindless material buffer and texture array
  * set-2 for per-object resource.
  */
 #define GLOBAL_SET_INDEX 0
@@ -11,7 +11,20 @@
 #define PER_OBJECT_SET_INDEX 2
 
 #define MAX_DIRECTIONAL_LIGHT_NUM 8
-#define MAX_POINT_LIGHT_NUM 8
+// point lights are stored in a storage buffer and culled per cluster, the
+// limit comes from the 16 bit light index of LightComponent
+#define MAX_POINT_LIGHT_NUM 65535
+
+// clustered forward shading: CLUSTER_X * CLUSTER_Y screen tiles, CLUSTER_Z
+// exponential depth slices
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+
+// bindless materials: MaterialData of all materials live in one storage
+// buffer, textures in one partially bound sampler array
+#define MAX_BINDLESS_TEXTURE_NUM 16384
+#define INVALID_BINDLESS_INDEX 0xFFFFFFFFu
 
 #ifdef __cplusplus
 #include <Eigen/Dense>
@@ -13,13 +13,23 @@ struct UMaterial {
   vec4 metallic_roughness_occlution;
 };
 
+// element of the bindless material buffer, texture indices are into the
+// bindless texture array, INVALID_BINDLESS_INDEX if the material has none
+struct MaterialData {
+  UMaterial params;
+  uint albedo_texture;
+  uint normal_texture;
+  uint emissive_texture;
+  uint metallic_roughness_occlusion_texture;
+};
+
 struct UDirectionalLight {
   vec4 direction; //!< direction, last float for padding
   vec4 illuminance; //!< lux(lm/m^2), last float for padding
 };
 
 struct UPointLight {
-  vec4 position; //!< position, last float for padding
+  vec4 position; //!< position, w: range, no light beyond it
   vec4 luminous_intensity; //!< candela(cd), last float for padding
 };
 
@@ -37,9 +47,8 @@ enum LightType {
 #endif
 
 struct ULighting {
-  // lights
+  // lights, point lights are in the point light buffer of the clusters
   UDirectionalLight directional_lights[MAX_DIRECTIONAL_LIGHT_NUM];
-  UPointLight point_lights[MAX_POINT_LIGHT_NUM];
 
   uint light_num[LIGHT_TYPE_NUM];
   float ev100;
@@ -48,6 +57,17 @@ struct ULighting {
   // int shader_debug_option;
 };
 
+// clustered forward shading, see LightCuller
+struct UClusterParams {
+  vec4 view_z; //!< 3rd row of the view matrix, view depth = -dot(view_z, p)
+  vec4 tile_size; //!< xy: cluster tile size in pixels
+  vec4 depth_slice; //!< x: near, y: far, z: scale = CLUSTER_Z / log(far / near), w: bias = -log(near) * scale
+  uint point_light_num; //!< point lights in the point light buffer
+  uint padding0;
+  uint padding1;
+  uint padding2;
+};
+
 // struct ShadowCascadeUBO {
 //   mat4 cascade_view_projs[SHADOW_CASCADE_NUM];
 // };
@@ -56,11 +76,45 @@ struct ULighting {
 //   mat4 face_view_projs[SHADOW_FACE_NUM];
 // };
 
-struct TransformPCO {
-  mat4 m;  // model matrix
-  mat4 nm; // normal matrix, model matrix may have non-uniform scaling, so nm =
-           // transpose(inverse(m))
-  mat4 mvp;
+// per object data of static meshes, persistent, written when the object's
+// transform changes
+struct ObjectData {
+  mat4 m;     // model matrix
+  vec4 nm[3]; // columns of the 3x3 normal matrix, model matrix may have
+              // non-uniform scaling, so nm = transpose(inverse(mat3(m)))
+};
+
+struct MeshPCO {
+  mat4 view_proj; //!< pushed once per pass
+  uint instance_base; //!< base of the draw's instances in the instance object
+                      //!< list, pushed per group, or per phase of occlusion
+                      //!< culled draws
+  uint material_index; //!< in the bindless material buffer, pushed per group
+  uint padding1;
+  uint padding2;
+};
+
+// gpu occlusion culling, one object per static mesh instance
+struct CullObject {
+  vec4 aabb_min; //!< world space aabb min, w = 1 if the aabb is valid
+  vec4 aabb_max; //!< world space aabb max
+  uint first_command; //!< first draw command(sub mesh) of the object's group
+  uint command_count; //!< sub meshes of the group
+  uint object_index; //!< in the object buffer, appended to the instance list
+  uint group; //!< static mesh render data the instance belongs to
+};
+
+struct OcclusionCullPCO {
+  mat4 view_proj; //!< view projection the objects are tested with
+  vec4 pyramid_size; //!< xy: depth pyramid level 0 size, z: levels, w: 1 if the pyramid is valid
+  uint object_count;
+  uint phase; //!< 0: test with last frame's pyramid, 1: retest the occluded ones with this frame's pyramid
+  uint command_base; //!< offset of this phase's draw commands
+  uint count_base; //!< offset of this phase's draw counts
+  uint instance_base; //!< offset of this phase's visible instance list
+  uint padding0;
+  uint padding1;
+  uint padding2;
 };
 
 #endif // SHADERS_UBO_STRUCTURES_H
\ No newline at end of file
@@ -11,13 +11,26 @@ layout(location=2) in vec2 uv;
 layout(location=0) out vec2 out_uv;
 layout(location=1) out vec3 out_normal; // world space normal
 layout(location=2) out vec3 out_pos; // world space position
+layout(location=3) flat out uint out_material; // in the bindless material buffer
 
-layout(push_constant) uniform _TransformPCO { TransformPCO transform_pco; };
+// persistent per object transforms
+layout(set=PER_OBJECT_SET_INDEX, binding=0) readonly buffer _Objects { ObjectData objects[]; };
+// object index per instance of the frame, a draw reads [instance_base + first_instance, + instance_count).
+// Occlusion culled draws bind the culler's visible instance lists here instead
+layout(set=PER_OBJECT_SET_INDEX, binding=1) readonly buffer _Instances { uint instance_objects[]; };
+
+layout(push_constant) uniform _MeshPCO { MeshPCO mesh_pco; };
 
 void main()
 {
+    // gl_InstanceIndex includes first_instance, 0 for direct draws and the
+    // group's offset for culled ones
+    ObjectData object = objects[instance_objects[mesh_pco.instance_base + gl_InstanceIndex]];
     out_uv = uv;
-    out_normal = normalize(mat3x3(transform_pco.nm) * normal);
-    out_pos = (transform_pco.m * vec4(vpos, 1.0)).xyz;
-    gl_Position = transform_pco.mvp * vec4(vpos, 1.0);
+    out_material = mesh_pco.material_index;
+    mat3 nm = mat3(object.nm[0].xyz, object.nm[1].xyz, object.nm[2].xyz);
+    out_normal = normalize(nm * normal);
+    vec4 world_pos = object.m * vec4(vpos, 1.0);
+    out_pos = world_pos.xyz;
+    gl_Position = mesh_pco.view_proj * world_pos;
 }
@@ -41,6 +41,8 @@ void EditorUI::updateWindowRegion() {
 
 std::shared_ptr<ImGuiImage> EditorUI::loadImGuiImageFromFile(const URL &url) {
   std::shared_ptr<AssetTexture> texture = std::make_shared<AssetTexture>();
+  // drawn by imgui with their view, never streamed
+  texture->setTextureType(ETextureType::UI);
   texture->load(url);
   return loadImGuiImageFromTexture(texture);
 }
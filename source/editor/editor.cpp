@@ -12,6 +12,7 @@
 #include <engine/utils/base/macro.h>
 #include <engine/utils/event/event_system.h>
 #include <engine/utils/vk/commands.h>
+#include <engine/utils/vk/upload_scheduler.h>
 #include <engine/utils/vk/vk_driver.h>
 
 namespace mango {
@@ -48,6 +49,10 @@ void Editor::init() {
   auto driver = g_engine.getDriver();
   driver->getThreadLocalCommandBufferManager().commitExecutableCommandBuffers(
       driver->getGraphicsQueue(), nullptr);
+  // ui icons are drawn by the ui pass, which doesn't track upload tickets.
+  // Once done, the first frame acquires them with all completed uploads.
+  auto upload_scheduler = driver->getUploadScheduler();
+  upload_scheduler->wait(upload_scheduler->flush());
 
   // set construct ui function to UIPass through RenderSystem
   g_engine.getEventSystem()->addListener(
@@ -58,6 +63,7 @@ void Editor::init() {
 void Editor::destroy() {
   // wait all gpu operations done
   auto driver = g_engine.getDriver();
+  g_engine.renderSync();
   driver->getGraphicsQueue()->waitIdle();
   editor_uis_.clear();
   simulation_ui_.reset();
@@ -73,8 +79,10 @@ void Editor::run(std::function<bool()> exit_check) {
     window->processEvents();
     g_engine.newTick();
     float delta_time = g_engine.calcDeltaTime();
-    g_engine.gcTick(delta_time);
+    // runs while the render thread records the last frame
     g_engine.logicTick(delta_time);
+    g_engine.renderSync();
+    g_engine.gcTick(delta_time);
     g_engine.renderTick(delta_time);    
     g_engine.threadSync();
     if (exit_check && exit_check()) break;
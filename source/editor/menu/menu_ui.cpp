@@ -227,29 +227,30 @@ void MenuUI::construct() {
       ImGui::InputText("##world_name", world_name, IM_ARRAYSIZE(world_name));
       ImGui::EndChild();
 
-      // ImGui::BeginChild("new_world_bottom",
-      //                   ImVec2(content_size.x, k_bottom_height), false);
-      // float button_width = 60.0f;
-      // float button_offset_x =
-      //     (ImGui::GetContentRegionAvail().x - button_width * 2 - k_spacing) /
-      //     2.0f;
-      // ImGui::SetCursorPosX(ImGui::GetCursorPosX() + button_offset_x);
-      // ImGui::SetCursorPosY(ImGui::GetCursorPosY() + 6);
-      // if (ImGui::Button("save", ImVec2(button_width, 0))) {
-      //   std::string world_name_str = world_name;
-      //   if (!m_selected_folder.empty() && !world_name_str.empty()) {
-      //     std::string url = m_selected_folder + "/" + world_name_str +
-      //     ".world"; g_engine.getWorld()->saveAsWorld(url);
-
-      //     showing_save_as_world_popup = false;
-      //   }
-      // }
+      ImGui::BeginChild("new_world_bottom",
+                        ImVec2(content_size.x, k_bottom_height), false);
+      float button_width = 60.0f;
+      float button_offset_x =
+          (ImGui::GetContentRegionAvail().x - button_width * 2 - k_spacing) /
+          2.0f;
+      ImGui::SetCursorPosX(ImGui::GetCursorPosX() + button_offset_x);
+      ImGui::SetCursorPosY(ImGui::GetCursorPosY() + 6);
+      if (ImGui::Button("save", ImVec2(button_width, 0))) {
+        std::string world_name_str = world_name;
+        if (!m_selected_folder.empty() && !world_name_str.empty()) {
+          std::string url =
+              m_selected_folder + "/" + world_name_str + ".world";
+          g_engine.getWorld()->saveAsWorld(url);
+
+          showing_save_as_world_popup = false;
+        }
+      }
 
-      // ImGui::SameLine();
-      // if (ImGui::Button("cancel", ImVec2(button_width, 0))) {
-      //   showing_save_as_world_popup = false;
-      // }
-      // ImGui::EndChild();
+      ImGui::SameLine();
+      if (ImGui::Button("cancel", ImVec2(button_width, 0))) {
+        showing_save_as_world_popup = false;
+      }
+      ImGui::EndChild();
 
       ImGui::EndPopup();
     }
@@ -261,7 +262,7 @@ void MenuUI::construct() {
     IGFD::FileDialogConfig config;
     config.path = g_engine.getFileSystem()->relative("");
     ImGuiFileDialog::Instance()->OpenDialog("ChooseFileDlgKey", "choose scene file",
-                                            "scene files (*.glb *.gltf *.obj){.glb, .gltf, .obj}", config);
+                                            "scene files (*.glb *.gltf *.obj *.world){.glb, .gltf, .obj, .world}", config);
     // display
     if (ImGuiFileDialog::Instance()->Display("ChooseFileDlgKey")) {
       if (ImGuiFileDialog::Instance()->IsOk()) { // action if OK
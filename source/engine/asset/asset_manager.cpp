@@ -23,7 +23,7 @@ void AssetManager::init() {
                           {EAssetType::STATICMESH, EArchiveType::BINARY},
                           {EAssetType::SKELETALMESH, EArchiveType::BINARY},
                           {EAssetType::ANIMATION, EArchiveType::BINARY},
-                          {EAssetType::WORLD, EArchiveType::JSON}};
+                          {EAssetType::WORLD, EArchiveType::BINARY}};
 
   for (const auto &iter : asset_type_exts_) {
     ext_asset_types_[iter.second] = iter.first;
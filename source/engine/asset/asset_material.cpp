@@ -1,77 +1,53 @@
 #include <engine/asset/asset_material.h>
+
+#include <algorithm>
+
 #include <engine/functional/global/engine_context.h>
 #include <engine/functional/global/resource_binding_mgr.h>
-#include <engine/utils/vk/buffer.h>
-#include <engine/utils/vk/image.h>
-#include <engine/utils/vk/resource_cache.h>
-#include <engine/utils/vk/sampler.h>
 
 namespace mango {
-void Material::inflate() {
-  auto resource_binding_mgr = g_engine.getResourceBindingMgr();
-  auto [des_set, material_buffer, offset] =
-      resource_binding_mgr->requestStandardMaterial();
-  descriptor_set_ = des_set;
-  material_buffer_ = material_buffer;
-  offset_ = offset;
-  material_buffer_->update(&material_, sizeof(UMaterial), offset_);
+std::atomic<uint32_t> Material::s_sort_id_counter_{0};
+
+static uint32_t getBindlessIndex(const std::shared_ptr<AssetTexture> &texture) {
+  return texture == nullptr ? INVALID_BINDLESS_INDEX
+                            : texture->getBindlessIndex();
+}
 
-  VkDescriptorBufferInfo desc_buffer_info{.buffer =
-                                              material_buffer_->getHandle(),
-                                          .offset = offset_,
-                                          .range = sizeof(UMaterial)};
-  auto driver = g_engine.getDriver();
-  auto sampler =
-      g_engine.getResourceCache()
-          ->requestSampler(driver, VkFilter::VK_FILTER_LINEAR,
-                           VkFilter::VK_FILTER_LINEAR,
-                           VkSamplerMipmapMode::VK_SAMPLER_MIPMAP_MODE_LINEAR,
-                           VkSamplerAddressMode::VK_SAMPLER_ADDRESS_MODE_REPEAT,
-                           VkSamplerAddressMode::VK_SAMPLER_ADDRESS_MODE_REPEAT)
-          ->getHandle();
+static UploadTicket getUploadTicket(const std::shared_ptr<AssetTexture> &texture) {
+  return texture == nullptr ? 0 : texture->getUploadTicket();
+}
+
+Material::~Material() {
+  // the binding manager is gone if the material outlives the engine
+  const auto &resource_binding_mgr = g_engine.getResourceBindingMgr();
+  if (material_index_ != INVALID_BINDLESS_INDEX && resource_binding_mgr)
+    resource_binding_mgr->releaseMaterial(material_index_);
+}
 
-  VkDescriptorImageInfo desc_image_infos[] = {
-      {.sampler = sampler,
-       .imageView = albedo_texture_ == nullptr
-                        ? VK_NULL_HANDLE
-                        : albedo_texture_->getImageView()->getHandle(),
-       .imageLayout =
-           VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}, // binding point 1
-      {.sampler = sampler,
-       .imageView = normal_texture_ == nullptr
-                        ? VK_NULL_HANDLE
-                        : normal_texture_->getImageView()->getHandle(),
-       .imageLayout =
-           VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}, // binding point 2
-      {.sampler = sampler,
-       .imageView = emissive_texture_ == nullptr
-                        ? VK_NULL_HANDLE
-                        : emissive_texture_->getImageView()->getHandle(),
-       .imageLayout =
-           VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}, // binding point 3
-      {.sampler = sampler,
-       .imageView = metallic_roughness_occlution_texture_ == nullptr
-                        ? VK_NULL_HANDLE
-                        : metallic_roughness_occlution_texture_->getImageView()
-                              ->getHandle(),
-       .imageLayout =
-           VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL} // binding point 4
-  };
+void Material::inflate() {
+  MaterialData data{
+      .params = material_,
+      .albedo_texture = getBindlessIndex(albedo_texture_),
+      .normal_texture = getBindlessIndex(normal_texture_),
+      .emissive_texture = getBindlessIndex(emissive_texture_),
+      .metallic_roughness_occlusion_texture =
+          getBindlessIndex(metallic_roughness_occlution_texture_)};
+  upload_ticket_ = std::max(
+      {getUploadTicket(albedo_texture_), getUploadTicket(normal_texture_),
+       getUploadTicket(emissive_texture_),
+       getUploadTicket(metallic_roughness_occlution_texture_)});
+  auto resource_binding_mgr = g_engine.getResourceBindingMgr();
+  if (material_index_ == INVALID_BINDLESS_INDEX)
+    material_index_ = resource_binding_mgr->registerMaterial(data);
+  else
+    resource_binding_mgr->updateMaterial(material_index_, data);
+}
 
-  driver->update({
-      VkWriteDescriptorSet{.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-                           .dstSet = descriptor_set_->getHandle(),
-                           .dstBinding = 0,
-                           .descriptorCount = 1,
-                           .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                           .pBufferInfo = &desc_buffer_info},
-      VkWriteDescriptorSet{.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-                           .dstSet = descriptor_set_->getHandle(),
-                           .dstBinding = 1,
-                           .descriptorCount = 4,
-                           .descriptorType =
-                               VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                           .pImageInfo = desc_image_infos},
-  });
+void Material::requestMips(float uv_per_pixel) const {
+  for (auto *texture :
+       {albedo_texture_.get(), normal_texture_.get(), emissive_texture_.get(),
+        metallic_roughness_occlution_texture_.get()})
+    if (texture != nullptr)
+      texture->requestMip(uv_per_pixel);
 }
-} // namespace mango
\ No newline at end of file
+} // namespace mango
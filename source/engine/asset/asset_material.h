@@ -1,5 +1,6 @@
 #pragma once
 #include <Eigen/Dense>
+#include <atomic>
 #include <engine/asset/asset_texture.h>
 #include <shaders/include/shader_structs.h>
 
@@ -7,11 +8,14 @@ namespace mango {
 
 enum class ParamType : uint32_t { CONSTANT_VALUE = 0, Texture = 1 };
 
-class DescriptorSet;
-class Buffer;
-
 class Material {
 public:
+  Material() = default;
+  ~Material();
+
+  Material(const Material &) = delete;
+  Material &operator=(const Material &) = delete;
+
   UMaterial &getUMaterial() { return material_; }
   void setAlbedoTexture(const std::shared_ptr<AssetTexture> &texture) {
     albedo_texture_ = texture;
@@ -27,21 +31,53 @@ public:
     metallic_roughness_occlution_texture_ = texture;
   }
 
+  const std::shared_ptr<AssetTexture> &getAlbedoTexture() const {
+    return albedo_texture_;
+  }
+  const std::shared_ptr<AssetTexture> &getNormalTexture() const {
+    return normal_texture_;
+  }
+  const std::shared_ptr<AssetTexture> &getEmissiveTexture() const {
+    return emissive_texture_;
+  }
+  const std::shared_ptr<AssetTexture> &
+  getMetallicRoughnessOcclutionTexture() const {
+    return metallic_roughness_occlution_texture_;
+  }
+
+  /**
+   * @brief write the material and its texture indices to the bindless
+   * material buffer, textures should be inflated before
+   */
   void inflate();
 
-  std::shared_ptr<DescriptorSet> getDescriptorSet() const {
-    return descriptor_set_;
-  }
+  //! index in the bindless material buffer, INVALID_BINDLESS_INDEX before
+  //! inflate
+  uint32_t getMaterialIndex() const { return material_index_; }
+
+  //! small unique id, part of draw sort keys
+  uint32_t getSortId() const { return sort_id_; }
+
+  //! latest upload of its textures as of inflate, see UploadScheduler
+  UploadTicket getUploadTicket() const { return upload_ticket_; }
+
+  /**
+   * @brief render thread: request the texture mips sampled where one pixel
+   * covers uv_per_pixel uv units, see AssetTexture::requestMip
+   */
+  void requestMips(float uv_per_pixel) const;
 
 private:
+  static std::atomic<uint32_t> s_sort_id_counter_;
+  uint32_t sort_id_{s_sort_id_counter_.fetch_add(1, std::memory_order_relaxed)};
+
   UMaterial material_;
   std::shared_ptr<AssetTexture> albedo_texture_;
   std::shared_ptr<AssetTexture> normal_texture_;
   std::shared_ptr<AssetTexture> emissive_texture_;
   std::shared_ptr<AssetTexture> metallic_roughness_occlution_texture_;
 
-  std::shared_ptr<DescriptorSet> descriptor_set_;
-  std::shared_ptr<Buffer> material_buffer_; // uniform buffer
-  uint32_t offset_{0};
+  uint32_t material_index_{INVALID_BINDLESS_INDEX};
+  UploadTicket upload_ticket_{0};
 };
 } // namespace mango
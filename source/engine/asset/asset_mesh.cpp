@@ -1,8 +1,11 @@
 #include "asset_mesh.h"
 #include <engine/functional/global/engine_context.h>
 #include <engine/utils/vk/commands.h>
+#include <cmath>
 
 namespace mango {
+std::atomic<uint32_t> Mesh::s_sort_id_counter_{0};
+
 void StaticMesh::calcBoundingBox() {
   bounding_box_.setEmpty();
   for (auto &vertex : vertices_) {
@@ -10,8 +13,29 @@ void StaticMesh::calcBoundingBox() {
   }
 }
 
+void StaticMesh::calcUVDensity() {
+  // ratio of the summed triangle areas, the factors 1/2 cancel
+  double world_area = 0.0;
+  double uv_area = 0.0;
+  for (size_t i = 0; i + 2 < indices_.size(); i += 3) {
+    const auto &v0 = vertices_[indices_[i]];
+    const auto &v1 = vertices_[indices_[i + 1]];
+    const auto &v2 = vertices_[indices_[i + 2]];
+    world_area += (v1.position - v0.position)
+                      .cross(v2.position - v0.position)
+                      .norm();
+    const Eigen::Vector2f e1 = v1.uv - v0.uv;
+    const Eigen::Vector2f e2 = v2.uv - v0.uv;
+    uv_area += std::abs(e1.x() * e2.y() - e1.y() * e2.x());
+  }
+  world_per_uv_ = uv_area > 0.0
+                      ? static_cast<float>(std::sqrt(world_area / uv_area))
+                      : 0.0f;
+}
+
 void StaticMesh::inflate() {
   calcBoundingBox();
+  calcUVDensity();
   // upload to gpu
   auto driver = g_engine.getDriver();
   static_assert(sizeof(StaticVertex) == 8 * sizeof(float) && sizeof(float) == 4,
@@ -21,22 +45,26 @@ void StaticMesh::inflate() {
       VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
       0,
       0,
-      VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+      VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, MemoryClass::Mesh);
 
-  auto cmd_buffer = driver->getThreadLocalCommandBufferManager().requestCommandBuffer(
-      VK_COMMAND_BUFFER_LEVEL_PRIMARY);
-  vertex_buffer_->updateByStaging(vertices_.data(), vertices_.size() * sizeof(StaticVertex),
-                      0, cmd_buffer);
+  auto recorder = driver->getUploadScheduler()->record();
+  recorder.uploadBuffer(*vertex_buffer_, vertices_.data(),
+                        vertices_.size() * sizeof(StaticVertex));
+  recorder.releaseBuffer(*vertex_buffer_, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                         VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
 
   // buffer: indices data triangle faces
   index_buffer_ = std::make_shared<Buffer>(
       driver, indices_.size() * sizeof(uint32_t),
       VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 0,
       0,
-      VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+      VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, MemoryClass::Mesh);
   // upload data to buffer
-  index_buffer_->updateByStaging(indices_.data(), indices_.size() * sizeof(uint32_t), 0,
-                      cmd_buffer);
+  recorder.uploadBuffer(*index_buffer_, indices_.data(),
+                        indices_.size() * sizeof(uint32_t));
+  recorder.releaseBuffer(*index_buffer_, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                         VK_ACCESS_INDEX_READ_BIT);
+  upload_ticket_ = recorder.getTicket();
 }
 
 void StaticMesh::load(const URL &url) {
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <Eigen/Geometry>
+#include <atomic>
 #include <engine/asset/asset.h>
 #include <engine/utils/vk/buffer.h>
+#include <engine/utils/vk/upload_scheduler.h>
 
 namespace mango {
 class CommandBuffer;
@@ -22,8 +24,12 @@ public:
 
   virtual void calcBoundingBox() = 0;
 
-  std::shared_ptr<Buffer> getVertexBuffer() const { return vertex_buffer_; }
-  std::shared_ptr<Buffer> getIndexBuffer() const { return index_buffer_; }
+  const std::shared_ptr<Buffer> &getVertexBuffer() const {
+    return vertex_buffer_;
+  }
+  const std::shared_ptr<Buffer> &getIndexBuffer() const {
+    return index_buffer_;
+  }
   const std::vector<SubMesh> &getSubMeshs() const { return sub_meshes_; }
 
   void setSubMeshs(const std::vector<SubMesh> &sub_meshes) {
@@ -32,8 +38,16 @@ public:
 
   void setIndices(const std::vector<uint32_t> &indices) { indices_ = indices; }
 
+  const std::vector<uint32_t> &getIndices() const { return indices_; }
+
   const Eigen::AlignedBox3f &getBoundingBox() const { return bounding_box_; }
 
+  //! small unique id, part of draw sort keys
+  uint32_t getSortId() const { return sort_id_; }
+
+  //! upload of the vertex and index buffers, see UploadScheduler
+  UploadTicket getUploadTicket() const { return upload_ticket_; }
+
 protected:
   std::vector<SubMesh> sub_meshes_; //!< submesh: index offset, index
                                     // count, vertex offset, vertex count
@@ -43,6 +57,11 @@ protected:
   // gpu data
   std::shared_ptr<Buffer> vertex_buffer_;
   std::shared_ptr<Buffer> index_buffer_;
+  UploadTicket upload_ticket_{0};
+
+private:
+  static std::atomic<uint32_t> s_sort_id_counter_;
+  uint32_t sort_id_{s_sort_id_counter_.fetch_add(1, std::memory_order_relaxed)};
 };
 struct StaticVertex {
   Eigen::Vector3f position;
@@ -63,10 +82,21 @@ public:
     vertices_ = std::move(vertices);
   }
 
+  const std::vector<StaticVertex> &getVertices() const { return vertices_; }
+
+  /**
+   * @brief mean object space length of one uv unit, 0 if the mesh has no uv
+   * area. Drives texture mip requests, see TextureStreamer.
+   */
+  float getWorldPerUV() const { return world_per_uv_; }
+
   void inflate() override;
 
 private:
+  void calcUVDensity();
+
   std::vector<StaticVertex> vertices_;
+  float world_per_uv_{0.0f};
 };
 
 } // namespace mango
\ No newline at end of file
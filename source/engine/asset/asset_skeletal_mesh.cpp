@@ -5,25 +5,27 @@
 namespace mango {
 void SkeletalMesh::inflate() {
   auto driver = g_engine.getDriver();
-  auto cmd_buffer = driver->getThreadLocalCommandBufferManager().requestCommandBuffer(
-      VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+  auto recorder = driver->getUploadScheduler()->record();
   vertex_buffer_ = std::make_shared<Buffer>(
       driver,
       vertices_.size() * sizeof(SkeletalVertex),
       VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
       0, 0,
-      VMA_MEMORY_USAGE_GPU_ONLY);
-  vertex_buffer_->updateByStaging(vertices_.data(),
-                                  vertices_.size() * sizeof(SkeletalVertex), 0,
-                                  cmd_buffer);
+      VMA_MEMORY_USAGE_GPU_ONLY, MemoryClass::Mesh);
+  recorder.uploadBuffer(*vertex_buffer_, vertices_.data(),
+                        vertices_.size() * sizeof(SkeletalVertex));
+  recorder.releaseBuffer(*vertex_buffer_, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                         VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
   index_buffer_ = std::make_shared<Buffer>(
       driver,
       indices_.size() * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
       0, 0,
-      VMA_MEMORY_USAGE_GPU_ONLY);
-  index_buffer_->updateByStaging(indices_.data(),
-                                 indices_.size() * sizeof(uint32_t), 0,
-                                 cmd_buffer);
+      VMA_MEMORY_USAGE_GPU_ONLY, MemoryClass::Mesh);
+  recorder.uploadBuffer(*index_buffer_, indices_.data(),
+                        indices_.size() * sizeof(uint32_t));
+  recorder.releaseBuffer(*index_buffer_, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                         VK_ACCESS_INDEX_READ_BIT);
+  upload_ticket_ = recorder.getTicket();
 }
 
 void SkeletalMesh::calcBoundingBox() {
@@ -1,13 +1,159 @@
 #include <engine/asset/asset_texture.h>
 #include <engine/functional/global/engine_context.h>
+#include <engine/functional/global/resource_binding_mgr.h>
+#include <engine/functional/render/render_system.h>
 #include <engine/utils/base/macro.h>
-#include <engine/utils/vk/commands.h>
 #include <engine/utils/vk/data_uploader.hpp>
 #include <engine/utils/vk/image.h>
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <fstream>
 #include <stb_image.h>
 
 namespace mango {
 
+static float srgbToLinear(uint8_t value) {
+  static const auto table = [] {
+    std::array<float, 256> table;
+    for (uint32_t i = 0; i < 256; ++i) {
+      const float c = i / 255.0f;
+      table[i] = c <= 0.04045f ? c / 12.92f
+                               : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+    return table;
+  }();
+  return table[value];
+}
+
+static uint8_t linearToSrgb(float value) {
+  // 4096 steps keep dark values exact in 8 bits
+  static const auto table = [] {
+    std::array<uint8_t, 4096> table;
+    for (uint32_t i = 0; i < 4096; ++i) {
+      const float c = i / 4095.0f;
+      const float s = c <= 0.0031308f
+                          ? c * 12.92f
+                          : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+      table[i] = static_cast<uint8_t>(std::lround(s * 255.0f));
+    }
+    return table;
+  }();
+  return table[std::clamp(static_cast<int>(value * 4095.0f + 0.5f), 0, 4095)];
+}
+
+/**
+ * @brief 2x2 box filter of an rgba8 image, srgb colors are averaged in linear
+ * space. Odd sizes repeat the last row or column.
+ */
+static std::vector<uint8_t> downsampleRGBA8(const uint8_t *src, uint32_t width,
+                                            uint32_t height, bool srgb) {
+  const uint32_t dst_width = std::max(width >> 1, 1u);
+  const uint32_t dst_height = std::max(height >> 1, 1u);
+  std::vector<uint8_t> dst(static_cast<size_t>(dst_width) * dst_height * 4);
+  for (uint32_t y = 0; y < dst_height; ++y) {
+    const uint8_t *rows[2] = {
+        src + static_cast<size_t>(std::min(2 * y, height - 1)) * width * 4,
+        src + static_cast<size_t>(std::min(2 * y + 1, height - 1)) * width * 4};
+    uint8_t *out = dst.data() + static_cast<size_t>(y) * dst_width * 4;
+    for (uint32_t x = 0; x < dst_width; ++x, out += 4) {
+      const uint32_t x0 = std::min(2 * x, width - 1) * 4;
+      const uint32_t x1 = std::min(2 * x + 1, width - 1) * 4;
+      for (uint32_t c = 0; c < 4; ++c) {
+        const uint8_t texels[4] = {rows[0][x0 + c], rows[0][x1 + c],
+                                   rows[1][x0 + c], rows[1][x1 + c]};
+        if (srgb && c < 3) {
+          out[c] = linearToSrgb(
+              0.25f * (srgbToLinear(texels[0]) + srgbToLinear(texels[1]) +
+                       srgbToLinear(texels[2]) + srgbToLinear(texels[3])));
+        } else {
+          out[c] = static_cast<uint8_t>(
+              (texels[0] + texels[1] + texels[2] + texels[3] + 2) / 4);
+        }
+      }
+    }
+  }
+  return dst;
+}
+
+/**
+ * @brief levels [first_mip, last_mip) of the box filtered mip chain of an rgba8
+ * image, first_mip >= 1
+ */
+static std::vector<std::vector<uint8_t>>
+buildMips(const uint8_t *level0, uint32_t width, uint32_t height, bool srgb,
+          uint32_t first_mip, uint32_t last_mip) {
+  std::vector<std::vector<uint8_t>> levels;
+  levels.reserve(last_mip > first_mip ? last_mip - first_mip : 0);
+  std::vector<uint8_t> skipped; //!< last level below first_mip
+  const uint8_t *src = level0;
+  for (uint32_t level = 1; level < last_mip; ++level) {
+    auto dst = downsampleRGBA8(src, std::max(width >> (level - 1), 1u),
+                               std::max(height >> (level - 1), 1u), srgb);
+    if (level >= first_mip) {
+      levels.emplace_back(std::move(dst));
+      src = levels.back().data();
+    } else {
+      skipped = std::move(dst);
+      src = skipped.data();
+    }
+  }
+  return levels;
+}
+
+//! 64 bit FNV-1a
+static uint64_t hashPixels(const std::vector<uint8_t> &pixels) {
+  uint64_t hash = 14695981039346656037ull;
+  for (const uint8_t byte : pixels) {
+    hash ^= byte;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+bool TextureSource::read(uint32_t width, uint32_t height,
+                         std::vector<uint8_t> &pixels) const {
+  const size_t pixel_bytes = static_cast<size_t>(width) * height * 4;
+  if (size != 0) {
+    // raw pixels in a world file
+    std::ifstream file(path, std::ios::binary);
+    pixels.resize(pixel_bytes);
+    if (size != pixel_bytes || !file.seekg(static_cast<std::streamoff>(offset)) ||
+        !file.read(reinterpret_cast<char *>(pixels.data()), pixel_bytes))
+      return false;
+  } else {
+    int w = 0, h = 0, channels = 0;
+    stbi_uc *data =
+        path.empty()
+            ? stbi_load_from_memory(encoded.data(),
+                                    static_cast<int>(encoded.size()), &w, &h,
+                                    &channels, STBI_rgb_alpha)
+            : stbi_load(path.c_str(), &w, &h, &channels, STBI_rgb_alpha);
+    if (data == nullptr)
+      return false;
+    const bool match = static_cast<uint32_t>(w) == width &&
+                       static_cast<uint32_t>(h) == height;
+    if (match)
+      pixels.assign(data, data + pixel_bytes);
+    stbi_image_free(data);
+    if (!match)
+      return false;
+  }
+  return hashPixels(pixels) == hash;
+}
+
+AssetTexture::~AssetTexture() {
+  // the binding manager and render system are gone if the texture outlives
+  // the engine
+  const auto &render_system = g_engine.getRenderSystem();
+  if (streamed_ && render_system)
+    render_system->getTextureStreamer().remove(this);
+  const auto &resource_binding_mgr = g_engine.getResourceBindingMgr();
+  if (bindless_index_ != INVALID_BINDLESS_INDEX && resource_binding_mgr)
+    resource_binding_mgr->releaseTexture(bindless_index_);
+}
+
 void AssetTexture::load(const URL &url) {
   url_ = url;
   std::string extension = url.getExtension();
@@ -25,13 +171,18 @@ void AssetTexture::load(const URL &url) {
     image_data_.resize(width_ * height_ * 4);
     memcpy(image_data_.data(), img_data, image_data_.size());
     stbi_image_free(img_data);
+    auto source = std::make_shared<TextureSource>();
+    source->path = absolute_path;
+    source->hash = hashPixels(image_data_);
+    source_ = std::move(source);
   } else {
     throw std::runtime_error("unsupported texture file format");
   }
   inflate();
 }
 
-void AssetTexture::load(uint32_t width, uint32_t height, stbi_uc *data) {
+void AssetTexture::load(uint32_t width, uint32_t height, stbi_uc *data,
+                        TextureSource source) {
   if (data == nullptr) {
     throw std::runtime_error("failed to load texture");
   }
@@ -39,34 +190,194 @@ void AssetTexture::load(uint32_t width, uint32_t height, stbi_uc *data) {
   width_  = width; height_ = height;
   image_data_.resize(width_ * height_ * 4);
   memcpy(image_data_.data(), data, image_data_.size());
+  source_ = nullptr;
+  if (source.isValid()) {
+    source.hash = hashPixels(image_data_);
+    source_ = std::make_shared<const TextureSource>(std::move(source));
+  }
   inflate();
 }
 
+void AssetTexture::setSource(TextureSource source) {
+  // same pixels, only where they are read from changed
+  source.hash = source_ != nullptr ? source_->hash : hashPixels(image_data_);
+  source_ = std::make_shared<const TextureSource>(std::move(source));
+}
+
+bool AssetTexture::readImageData(std::vector<uint8_t> &pixels) const {
+  if (!image_data_.empty()) {
+    pixels = image_data_;
+    return true;
+  }
+  return source_ != nullptr && source_->read(width_, height_, pixels);
+}
+
 void AssetTexture::inflate() {
-  auto pixel_format = getFormat();
+  // a streamed texture starts over from its mip tail
+  const auto &render_system = g_engine.getRenderSystem();
+  if (streamed_) {
+    render_system->getTextureStreamer().remove(this);
+    streamed_ = false;
+  }
   if (compression_mode_ == ETextureCompressionMode::None) {
-    auto &cmd_buffer_mgr =
-        g_engine.getDriver()->getThreadLocalCommandBufferManager();
-    auto cmd_buffer = cmd_buffer_mgr.requestCommandBuffer(
-        VkCommandBufferLevel::VK_COMMAND_BUFFER_LEVEL_PRIMARY);
-    image_view_ = uploadImage(image_data_.data(), width_, height_, mip_levels_,
-                              layers_, pixel_format, cmd_buffer);
+    // the first level was dropped by an earlier inflate
+    if (image_data_.empty() && source_ != nullptr &&
+        !source_->read(width_, height_, image_data_))
+      LOGW("texture source {} can't be read", source_->path);
+    generateMips();
+    // without a streamer all levels are resident
+    if (!render_system)
+      mip_tail_ = 0;
+    auto recorder = g_engine.getDriver()->getUploadScheduler()->record();
+    image_view_ = uploadMips(mip_tail_, recorder);
+    resident_mip_ = mip_tail_;
+    upload_ticket_ = recorder.getTicket();
+    // only the mip tail stays on cpu, finer levels are read from the source
+    // when they are streamed in
+    if (mip_tail_ != 0 && source_ != nullptr) {
+      std::vector<uint8_t>().swap(image_data_);
+      for (uint32_t level = 1; level < mip_tail_; ++level)
+        std::vector<uint8_t>().swap(mip_data_[level - 1]);
+    }
   } else {
     // compress image data to GPU
   }
+  if (image_view_ == nullptr)
+    return;
+  auto resource_binding_mgr = g_engine.getResourceBindingMgr();
+  if (bindless_index_ == INVALID_BINDLESS_INDEX)
+    bindless_index_ = resource_binding_mgr->registerTexture(image_view_);
+  else
+    resource_binding_mgr->updateTexture(bindless_index_, image_view_);
+  if (mip_tail_ != 0) {
+    render_system->getTextureStreamer().add(this);
+    streamed_ = true;
+  }
+}
+
+uint64_t AssetTexture::getMipBytes(uint32_t first_mip) const {
+  const uint64_t texel_size = getTexelSize(getFormat());
+  uint64_t bytes = 0;
+  for (uint32_t level = first_mip; level < mip_levels_; ++level)
+    bytes += texel_size * std::max(width_ >> level, 1u) *
+             std::max(height_ >> level, 1u);
+  return bytes;
+}
+
+void AssetTexture::requestMip(float uv_per_pixel) {
+  const float texels_per_pixel =
+      uv_per_pixel * static_cast<float>(std::max(width_, height_));
+  const uint32_t mip =
+      texels_per_pixel > 1.0f
+          ? static_cast<uint32_t>(std::min(std::log2(texels_per_pixel), 31.0f))
+          : 0;
+  uint32_t requested = requested_mip_.load(std::memory_order_relaxed);
+  while (mip < requested &&
+         !requested_mip_.compare_exchange_weak(requested, mip,
+                                               std::memory_order_relaxed))
+    ;
+}
+
+bool AssetTexture::isStreamable() const {
+  if (pixel_type_ != EPixelType::RGBA8 ||
+      image_data_.size() != static_cast<size_t>(width_) * height_ * 4 ||
+      std::max(width_, height_) <= TextureStreamer::kMipTailSize)
+    return false;
+  switch (texture_type_) {
+  case ETextureType::BaseColor:
+  case ETextureType::MetallicRoughnessOcclusion:
+  case ETextureType::Normal:
+  case ETextureType::Emissive:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void AssetTexture::generateMips() {
+  mip_data_.clear();
+  layers_ = mip_levels_ = 1;
+  mip_tail_ = 0;
+  if (!isStreamable())
+    return;
+  while (std::max(width_, height_) >> mip_levels_ != 0)
+    ++mip_levels_;
+  mip_data_ = buildMips(image_data_.data(), width_, height_, isSRGB(), 1,
+                        mip_levels_);
+  while (std::max(width_, height_) >> mip_tail_ > TextureStreamer::kMipTailSize)
+    ++mip_tail_;
+}
+
+bool AssetTexture::hasHostMips(uint32_t first_mip) const {
+  return first_mip >= mip_tail_ || !image_data_.empty();
+}
+
+std::shared_ptr<TextureMipLoad>
+AssetTexture::loadMips(uint32_t first_mip) const {
+  auto load = std::make_shared<TextureMipLoad>();
+  load->first_mip = first_mip;
+  g_engine.getJobSystem()->run(
+      [load, source = source_, width = width_, height = height_,
+       srgb = isSRGB(), tail = mip_tail_]() {
+        std::vector<uint8_t> pixels;
+        if (source == nullptr || !source->read(width, height, pixels)) {
+          LOGW("texture source {} can't be read",
+               source ? source->path : std::string());
+          return;
+        }
+        load->levels = buildMips(pixels.data(), width, height, srgb,
+                                 std::max(load->first_mip, 1u), tail);
+        if (load->first_mip == 0)
+          load->levels.insert(load->levels.begin(), std::move(pixels));
+      },
+      &load->done);
+  return load;
+}
+
+std::shared_ptr<ImageView>
+AssetTexture::uploadMips(uint32_t first_mip,
+                         UploadScheduler::Recorder &recorder,
+                         const TextureMipLoad *load) {
+  std::vector<const uint8_t *> mips;
+  for (uint32_t level = first_mip; level < mip_levels_; ++level) {
+    if (hasHostMips(level)) {
+      mips.emplace_back(level == 0 ? image_data_.data()
+                                   : mip_data_[level - 1].data());
+      continue;
+    }
+    assert(load != nullptr && load->first_mip <= level &&
+           level - load->first_mip < load->levels.size());
+    mips.emplace_back(load->levels[level - load->first_mip].data());
+  }
+  // ui textures are bound by their view handle outside the bindless array,
+  // so they are never moved
+  return uploadImage(mips, std::max(width_ >> first_mip, 1u),
+                     std::max(height_ >> first_mip, 1u), getFormat(),
+                     recorder,
+                     texture_type_ == ETextureType::UI ? MemoryClass::Default
+                                                       : MemoryClass::Texture);
+}
+
+void AssetTexture::setResidentMips(std::shared_ptr<ImageView> image_view,
+                                   uint32_t first_mip) {
+  image_view_ = std::move(image_view);
+  resident_mip_ = first_mip;
+  g_engine.getResourceBindingMgr()->updateTexture(bindless_index_,
+                                                  image_view_);
 }
 
-bool AssetTexture::isSRGB() {
+bool AssetTexture::isSRGB() const {
   switch (texture_type_) {
   case ETextureType::BaseColor:
   case ETextureType::Emissive:
+  case ETextureType::UI:
     return true;
   default:
     return false;
   }
 }
 
-VkFormat AssetTexture::getFormat() {
+VkFormat AssetTexture::getFormat() const {
   bool is_srgb = isSRGB();
   switch (pixel_type_) {
   case EPixelType::RGBA8:
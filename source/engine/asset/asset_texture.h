@@ -1,10 +1,16 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <string>
 #include <vector>
 #include <volk.h>
 #include <stbi/stb_image.h>
 #include <cereal/access.hpp>
 #include <engine/asset/asset.h>
+#include <engine/utils/job/job_system.h>
+#include <engine/utils/vk/upload_scheduler.h>
+#include <shaders/include/constants.h>
 
 namespace mango {
 class ImageView;
@@ -20,10 +26,42 @@ enum class ETextureType {
 };
 enum class EPixelType { RGBA8, RGBA16, RGBA32, RG16, R16, R32 };
 
+/**
+ * @brief where the rgba8 pixels of a texture's first level can be read again.
+ * Streamed textures keep only their mip tail in host memory and read the finer
+ * levels from it when they are streamed in.
+ */
+struct TextureSource {
+  std::string path; //!< image file, or world file if size != 0
+  uint64_t offset{0}; //!< raw pixels in the world file
+  uint64_t size{0};
+  std::vector<uint8_t> encoded; //!< png/jpg file content if path is empty
+  uint64_t hash{0}; //!< of the pixels, catches a changed file
+
+  bool isValid() const { return !path.empty() || !encoded.empty(); }
+
+  /**
+   * @brief decode the first level, false if the source is gone or changed
+   */
+  bool read(uint32_t width, uint32_t height,
+            std::vector<uint8_t> &pixels) const;
+};
+
+/**
+ * @brief levels of a texture read from its source by a job, see
+ * AssetTexture::loadMips
+ */
+struct TextureMipLoad {
+  JobCounter done;
+  uint32_t first_mip{0};
+  //! levels first_mip up to the mip tail, empty if the source can't be read
+  std::vector<std::vector<uint8_t>> levels;
+};
+
 class AssetTexture final : public Asset {
 public:
   AssetTexture() = default;
-  ~AssetTexture() = default;
+  ~AssetTexture();
 
   void setAddressMode(VkSamplerAddressMode address_mode) {
     address_mode_u_ = address_mode;
@@ -33,21 +71,99 @@ public:
 
   void load(const URL &url) override;
 
-  void load(uint32_t width, uint32_t height, stbi_uc *data);
+  /**
+   * @param source to read the pixels again, without one they are kept in
+   * memory
+   */
+  void load(uint32_t width, uint32_t height, stbi_uc *data,
+            TextureSource source = {});
+
+  /**
+   * @brief read the pixels from source from now on, e.g. the world file the
+   * texture was saved to
+   */
+  void setSource(TextureSource source);
 
   void setTextureType(ETextureType texture_type) {
     texture_type_ = texture_type;
   }
 
+  ETextureType getTextureType() const { return texture_type_; }
+
+  uint32_t getWidth() const { return width_; }
+
+  uint32_t getHeight() const { return height_; }
+
+  /**
+   * @brief rgba8 pixels of the first level, read from the source if they
+   * aren't kept on cpu. False if there are none.
+   */
+  bool readImageData(std::vector<uint8_t> &pixels) const;
+
   std::shared_ptr<ImageView> getImageView() { return image_view_; }
 
+  //! index in the bindless texture array, INVALID_BINDLESS_INDEX before inflate
+  uint32_t getBindlessIndex() const { return bindless_index_; }
+
+  //! upload of the image, see UploadScheduler
+  UploadTicket getUploadTicket() const { return upload_ticket_; }
+
+  //! levels of the full mip chain, 1 if the texture isn't streamed
+  uint32_t getMipLevels() const { return mip_levels_; }
+
+  //! first level of the mip tail, which stays resident
+  uint32_t getMipTail() const { return mip_tail_; }
+
+  //! first level resident on the gpu
+  uint32_t getResidentMip() const { return resident_mip_; }
+
+  //! bytes of the levels from first_mip on
+  uint64_t getMipBytes(uint32_t first_mip) const;
+
+  /**
+   * @brief render thread: request the level sampled where one pixel covers
+   * uv_per_pixel uv units. The finest request of a frame is streamed in, see
+   * TextureStreamer.
+   */
+  void requestMip(float uv_per_pixel);
+
   void inflate() override;
   
 private:
+  static constexpr uint32_t kNoMipRequest = UINT32_MAX;
+
+  bool isSRGB() const;
+
+  VkFormat getFormat() const;
+
+  //! rgba8 color textures are streamed, data and ui textures stay resident
+  bool isStreamable() const;
 
-  bool isSRGB();
+  //! box filtered mip chain of streamable textures, a single level for
+  //! others
+  void generateMips();
 
-  VkFormat getFormat();
+  //! levels from first_mip on are kept on cpu
+  bool hasHostMips(uint32_t first_mip) const;
+
+  //! read the levels from first_mip up to the mip tail from the source in a
+  //! job, the job doesn't refer to the texture
+  std::shared_ptr<TextureMipLoad> loadMips(uint32_t first_mip) const;
+
+  //! new image holding the levels from first_mip on, levels not kept on cpu
+  //! are taken from load
+  std::shared_ptr<ImageView>
+  uploadMips(uint32_t first_mip, UploadScheduler::Recorder &recorder,
+             const TextureMipLoad *load = nullptr);
+
+  //! swap in an image uploaded by uploadMips once its upload completed
+  void setResidentMips(std::shared_ptr<ImageView> image_view,
+                       uint32_t first_mip);
+
+  //! finest level requested since the last call, kNoMipRequest if none
+  uint32_t takeRequestedMip() {
+    return requested_mip_.exchange(kNoMipRequest, std::memory_order_relaxed);
+  }
 
   uint32_t width_{0}, height_{0};
   uint32_t mip_levels_{0};
@@ -62,14 +178,29 @@ private:
                                 //!< strategy and for pixel format
   EPixelType pixel_type_{EPixelType::RGBA8};
 
+  //! first level, dropped after inflate if the texture is streamed from a
+  //! source
   std::vector<uint8_t> image_data_;
+  //! levels 1.., levels below the mip tail are dropped like image_data_, not
+  //! serialized
+  std::vector<std::vector<uint8_t>> mip_data_;
+  std::shared_ptr<const TextureSource> source_;
 
   std::shared_ptr<class ImageView> image_view_;
+  uint32_t bindless_index_{INVALID_BINDLESS_INDEX};
+  UploadTicket upload_ticket_{0};
+
+  // streaming
+  bool streamed_{false}; //!< added to the render system's TextureStreamer
+  uint32_t mip_tail_{0};
+  uint32_t resident_mip_{0};
+  std::atomic<uint32_t> requested_mip_{kNoMipRequest};
 
   void uploadKtxTexture(void *p_ktx_texture,
                         VkFormat format = VK_FORMAT_UNDEFINED);
 
 private:
+  friend class TextureStreamer;
   friend class cereal::access;
   template <class Archive> void serialize(Archive &ar) {
     ar(cereal::make_nvp("width", width_));
@@ -70,7 +70,12 @@ std::shared_ptr<AssetTexture> loadTexture(const aiTexture *a_texture,
       throw std::runtime_error("Failed to load texture: " +
                                std::string(texture_path));
     }
-    ret_texture->load(width, height, data);
+    // the file content is kept, far smaller than the decoded mips a
+    // streamed texture drops
+    TextureSource source;
+    const auto *encoded = reinterpret_cast<const uint8_t *>(a_texture->pcData);
+    source.encoded.assign(encoded, encoded + a_texture->mWidth);
+    ret_texture->load(width, height, data, std::move(source));
     stbi_image_free(data);
   }
   return ret_texture;
@@ -145,9 +150,20 @@ processMaterials(const aiScene *a_scene, const std::string &dir) {
   return ret_mats;
 }
 
-std::pair<ULighting, std::vector<std::tuple<const char *, uint16_t, uint16_t>>>
+/**
+ * @brief range of a point light, where its illuminance falls below
+ * kPointLightCutoff lux
+ */
+static float pointLightRange(const Eigen::Vector3f &intensity) {
+  constexpr float kPointLightCutoff = 0.01f;
+  return std::sqrt(std::max(intensity.maxCoeff(), 0.0f) / kPointLightCutoff);
+}
+
+std::tuple<ULighting, std::vector<UPointLight>,
+           std::vector<std::tuple<const char *, uint16_t, uint16_t>>>
 processLights(const aiScene *a_scene) {
   ULighting lights;
+  std::vector<UPointLight> point_lights;
   std::vector<std::tuple<const char *, uint16_t, uint16_t>> light_nodes_info;
   light_nodes_info.reserve(a_scene->mNumLights);
   for (auto i = 0; i < a_scene->mNumLights; ++i) {
@@ -172,19 +188,20 @@ processLights(const aiScene *a_scene) {
       }
     } break;
     case aiLightSource_POINT: {
-      auto &light_num = lights.light_num[LightType::LIGHT_POINT];
-      if (light_num < MAX_POINT_LIGHT_NUM) {
-        auto &l = lights.point_lights[light_num];
+      if (point_lights.size() < MAX_POINT_LIGHT_NUM) {
+        const auto light_num = static_cast<uint16_t>(point_lights.size());
+        auto &l = point_lights.emplace_back();
+        Eigen::Vector3f intensity(a_light->mColorDiffuse[0],
+                                  a_light->mColorDiffuse[1],
+                                  a_light->mColorDiffuse[2]);
         l.position =
             Eigen::Vector4f(a_light->mPosition[0], a_light->mPosition[1],
-                            a_light->mPosition[2], 1.0f);
-        l.luminous_intensity = Eigen::Vector4f(a_light->mColorDiffuse[0],
-                                               a_light->mColorDiffuse[1],
-                                               a_light->mColorDiffuse[2], 1.0f);
+                            a_light->mPosition[2], pointLightRange(intensity));
+        l.luminous_intensity = Eigen::Vector4f(intensity.x(), intensity.y(),
+                                               intensity.z(), 1.0f);
         light_nodes_info.emplace_back(a_light->mName.C_Str(),
                                       static_cast<uint16_t>(LightType::LIGHT_POINT),
                                       light_num);
-        ++light_num;
       } else {
         LOGW("Point light number in imported scene exceeds the limit.");
       }
@@ -194,7 +211,9 @@ processLights(const aiScene *a_scene) {
       break;
     }
   }
-  return {lights, light_nodes_info};
+  lights.light_num[LightType::LIGHT_POINT] =
+      static_cast<uint>(point_lights.size());
+  return {lights, std::move(point_lights), light_nodes_info};
 }
 
 std::pair<std::vector<MeshEntityData>, std::vector<LightEntityData>>
@@ -267,13 +286,14 @@ bool AssimpImporter::import(const URL &url, World *world) {
 
   std::vector<std::shared_ptr<Material>> materials =
       processMaterials(a_scene, dir);
-  auto [lights, light_nodes_info] = processLights(a_scene);
+  auto [lights, point_lights, light_nodes_info] = processLights(a_scene);
 
   auto scene_tr = std::make_shared<TransformRelationship>();
   auto [mesh_entity_datas, light_entity_datas] =
       processNode(scene_tr, a_scene, meshes, materials, light_nodes_info);
   world->enqueue(scene_tr, std::move(mesh_entity_datas),
-                 std::move(light_entity_datas), lights);
+                 std::move(light_entity_datas), lights,
+                 std::move(point_lights));
   // load the default camera if have
   LOGI("load scene: {}", path.c_str());
   return true;
@@ -97,6 +97,12 @@ public:
     dirty_proj_ = true;
   }
 
+  //! near clipping plane in camera coordinate, < 0
+  float getNear() const noexcept { return near_; }
+
+  //! far clipping plane in camera coordinate, < 0
+  float getFar() const noexcept { return far_; }
+
   /**
    * @brief set the fovy  in radians
    */
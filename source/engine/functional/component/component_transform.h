@@ -2,6 +2,9 @@
 
 #include <Eigen/Dense>
 #include <Eigen/Geometry>
+#include <cstdint>
+#include <memory>
+#include <vector>
 
 namespace mango {
 struct TransformRelationship {
@@ -14,5 +17,11 @@ struct TransformRelationship {
       Eigen::Matrix4f::Identity()}; // global transformation
   Eigen::AlignedBox3f
       aabb; // aabb of meshes in this node, not including children
+  Eigen::AlignedBox3f
+      waabb; // world space aabb, updated together with gtransform
+  uint64_t version{0}; // changes whenever gtransform changes, unique over all
+                       // nodes of a world, 0 before the first update
+  std::vector<uint32_t>
+      spatial_entities; // entities in World's spatial tree placed by this node
 };
 } // namespace mango
\ No newline at end of file
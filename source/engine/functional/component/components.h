@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
 
 namespace mango {
@@ -12,4 +13,27 @@ using StaticMeshComponent = std::shared_ptr<StaticMesh>;
 using MaterialComponent = std::shared_ptr<Material>;
 using TransformComponent = std::shared_ptr<TransformRelationship>;
 
+/**
+ * @brief name of the entity, id in World's NameTable
+ */
+struct NameComponent {
+  uint32_t id{0};
+};
+
+/**
+ * @brief light of the entity, index into World's ULighting directional lights
+ * or World's point lights
+ */
+struct LightComponent {
+  uint16_t light_type{0}; //!< LightType
+  uint16_t light_index{0};
+};
+
+/**
+ * @brief proxy of the entity in World's spatial tree
+ */
+struct SpatialProxyComponent {
+  int32_t proxy_id{-1};
+};
+
 } // namespace mango
\ No newline at end of file
@@ -7,9 +7,11 @@
 #include <engine/platform/glfw_window.h>
 #include <engine/utils/base/timer.h>
 #include <engine/utils/event/event_system.h>
+#include <engine/utils/job/job_system.h>
 #include <engine/utils/log/log_system.h>
 #include <engine/utils/vk/resource_cache.h>
 #include <engine/utils/vk/stage_pool.h>
+#include <engine/utils/vk/upload_scheduler.h>
 #include <engine/utils/vk/vk_driver.h>
 #include <engine/utils/base/macro.h>
 #include <cstdio>
@@ -44,6 +46,9 @@ static void parse_window_size_from_ini(int &width, int &height) {
 
 bool EngineContext::init(const std::shared_ptr<class VkConfig> &vk_config,
                          const std::string &window_title) {
+  // job system, the calling(main) thread is worker 0
+  job_system_ = std::make_shared<JobSystem>();
+
   // file system
   file_system_ = std::make_shared<FileSystem>();
   file_system_->init();
@@ -87,28 +92,24 @@ bool EngineContext::init(const std::shared_ptr<class VkConfig> &vk_config,
   // world manager
   world_ = std::make_shared<World>();
 
+  // main thread, event thread, render thread
   driver_->initThreadLocalCommandBufferManagers(
-      { driver_->getGraphicsQueue()->getFamilyIndex(), driver_->getTransferQueue()->getFamilyIndex() });
+      { driver_->getGraphicsQueue()->getFamilyIndex(), driver_->getTransferQueue()->getFamilyIndex(),
+        driver_->getGraphicsQueue()->getFamilyIndex() });
   
   driver_->setThreadLocalCommandBufferManagerTid(0, std::this_thread::get_id());
+  render_system_->startRenderThread(2);
   // animation & physics manager
   event_process_thread_ = new std::thread([this]() {
     driver_->setThreadLocalCommandBufferManagerTid(1, std::this_thread::get_id());
-    auto &cmd_buffer_mgr = driver_->getThreadLocalCommandBufferManager();
     // wait cv from main thread and do tick once
     while (!is_exit_) {
       sem_event_process_start_.acquire();
       if(is_exit_) break;
-      cmd_buffer_mgr.getCommandBufferAvailableFence()->wait();
       event_system_->tick();
-      // commit command buffer if have
-      if(cmd_buffer_mgr.needCommit())
-      {
-        auto render_system = g_engine.getRenderSystem();
-        auto semaphore = render_system->getFreeSemaphore();
-        cmd_buffer_mgr.commitExecutableCommandBuffers(driver_->getTransferQueue(), semaphore);
-        render_system->addPendingSemaphore(driver_->getCurFrameIndex(), semaphore);
-      }
+      // uploads recorded by the tick, e.g. loading a world, go to the transfer
+      // queue now. Frames draw them once submitted, without waiting here.
+      driver_->getUploadScheduler()->flush();
       sem_event_process_finish_.release();
     }
   });
@@ -122,6 +123,8 @@ void EngineContext::destroy() {
     sem_event_process_start_.release();
     event_process_thread_->join();
   }  
+  render_system_->stopRenderThread();
+  resource_cache_->savePipelineCache();
   resource_cache_.reset();
   render_system_.reset();
   world_.reset();
@@ -131,6 +134,7 @@ void EngineContext::destroy() {
   event_system_.reset();
   file_system_.reset();
   log_system_.reset();
+  job_system_.reset();
 }
 
 float EngineContext::calcDeltaTime() {
@@ -153,6 +157,8 @@ void EngineContext::gcTick(float delta_time) {
 void EngineContext::logicTick(float delta_time) {
   world_->tick(delta_time);
 }
+void EngineContext::renderSync() { render_system_->sync(); }
+
 void EngineContext::renderTick(float delta_time) {
   render_system_->tick(delta_time);
 }
@@ -3,6 +3,7 @@
 #include <Eigen/Dense>
 #include <chrono>
 #include <engine/utils/vk/vk_config.h>
+#include <engine/utils/vk/vk_constants.h>
 #include <memory>
 #include <vector>
 #include <thread>
@@ -27,11 +28,34 @@ public:
     sem_event_process_finish_.acquire();
   }
 
-  void newTick() { sem_event_process_start_.release(); }
+  void newTick() {
+    ++tick_index_;
+    sem_event_process_start_.release();
+  }
+
+  /**
+   * @brief slot of the current tick in per tick ring buffers, data written by
+   * the event thread in this slot is consumed by the main thread next tick.
+   * Unlike the driver's frame index, it doesn't change while a tick runs.
+   */
+  uint32_t getTickSlot() const { return tick_index_ % MAX_FRAMES_IN_FLIGHT; }
+
+  uint32_t getPrevTickSlot() const {
+    return (tick_index_ + MAX_FRAMES_IN_FLIGHT - 1) % MAX_FRAMES_IN_FLIGHT;
+  }
 
   float calcDeltaTime();
   void gcTick(float delta_time);
   void logicTick(float delta_time);
+
+  /**
+   * @brief wait for the render thread to finish the last frame
+   */
+  void renderSync();
+
+  /**
+   * @brief build ui and hand the world's render snapshot to the render thread
+   */
   void renderTick(float delta_time);
 
   const auto &getWindow() const { return window_; }
@@ -45,6 +69,7 @@ public:
   const auto &getWorld() const { return world_; }
   const auto &getRenderSystem() const { return render_system_; }
   const auto &getResourceBindingMgr() const { return resource_binding_mgr_; }
+  const auto &getJobSystem() const { return job_system_; }
 
 #ifdef IMGUI_ENABLE_TEST_ENGINE
   void* getTestEngine() const;
@@ -63,7 +88,9 @@ private:
   std::shared_ptr<class AssetManager> asset_manager_;
   std::shared_ptr<class World> world_;
   std::shared_ptr<class ResourceBindingMgr> resource_binding_mgr_;
+  std::shared_ptr<class JobSystem> job_system_;
   std::chrono::steady_clock::time_point last_tick_time_point_;
+  uint64_t tick_index_{0};
   std::thread *event_process_thread_ {nullptr};
 
   std::binary_semaphore sem_event_process_finish_{0};
@@ -1,121 +1,314 @@
+#include <engine/functional/global/engine_context.h>
 #include <engine/functional/global/resource_binding_mgr.h>
 #include <engine/utils/vk/buffer.h>
+#include <engine/utils/vk/image.h>
+#include <engine/utils/vk/resource_cache.h>
+#include <engine/utils/vk/sampler.h>
 #include <engine/utils/vk/vk_driver.h>
-#include <shaders/include/shader_structs.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
 
 namespace mango {
-constexpr uint32_t kMaxMaterialCount = 100;
-ShaderResource kStandardMaterialResources[] = {
+//! frame slots a released slot waits for
+constexpr uint32_t kAllFrames = (1u << MAX_FRAMES_IN_FLIGHT) - 1;
+
+ShaderResource kMaterialResources[] = {
   {
     .stages = VK_SHADER_STAGE_FRAGMENT_BIT,
-    .type = ShaderResourceType::BufferUniform,
+    .type = ShaderResourceType::BufferStorage,
     .mode = ShaderResourceMode::Static,
-    .set = 1,
+    .set = MATERIAL_SET_INDEX,
     .binding = 0,
-    .name = "material_ubo"
+    .name = "materials"
   },
   {
     .stages = VK_SHADER_STAGE_FRAGMENT_BIT,
     .type = ShaderResourceType::ImageSampler,
-    .mode = ShaderResourceMode::Static,
-    .set = 1,
+    .mode = ShaderResourceMode::UpdateAfterBind,
+    .set = MATERIAL_SET_INDEX,
     .binding = 1,
-    .name = "albedo_sampler"
+    .array_size = MAX_BINDLESS_TEXTURE_NUM,
+    .name = "textures"
+  }
+};
+
+ShaderResource kGlobResources[] = {
+  {
+    .stages = VK_SHADER_STAGE_FRAGMENT_BIT,
+    .type = ShaderResourceType::BufferUniform,
+    .mode = ShaderResourceMode::Dynamic,
+    .set = 0,
+    .binding = 0,
+    .name = "lighting_ubo"
   },
   {
     .stages = VK_SHADER_STAGE_FRAGMENT_BIT,
-    .type = ShaderResourceType::ImageSampler,
-    .mode = ShaderResourceMode::Static,
-    .set = 1,
-    .binding = 2,
-    .name = "normal_sampler"
+    .type = ShaderResourceType::BufferUniform,
+    .mode = ShaderResourceMode::Dynamic,
+    .set = 0,
+    .binding = 1,
+    .name = "cluster_params_ubo"
   },
   {
     .stages = VK_SHADER_STAGE_FRAGMENT_BIT,
-    .type = ShaderResourceType::ImageSampler,
+    .type = ShaderResourceType::BufferStorage,
     .mode = ShaderResourceMode::Static,
-    .set = 1,
-    .binding = 3,
-    .name = "emissive_sampler"    
+    .set = 0,
+    .binding = 2,
+    .name = "point_lights"
   },
   {
     .stages = VK_SHADER_STAGE_FRAGMENT_BIT,
-    .type = ShaderResourceType::ImageSampler,
+    .type = ShaderResourceType::BufferStorage,
     .mode = ShaderResourceMode::Static,
-    .set = 1,
-    .binding = 4,
-    .name = "metallic_roughness_occlusion_sampler"
-  }  
-};
-
-ShaderResource kGlobResources[] = {
+    .set = 0,
+    .binding = 3,
+    .name = "cluster_ranges"
+  },
   {
     .stages = VK_SHADER_STAGE_FRAGMENT_BIT,
-    .type = ShaderResourceType::BufferUniform,
+    .type = ShaderResourceType::BufferStorage,
     .mode = ShaderResourceMode::Static,
     .set = 0,
-    .binding = 0,
-    .name = "lighting_ubo"
+    .binding = 4,
+    .name = "light_indices"
   }
 };
 
 ResourceBindingMgr::ResourceBindingMgr(const std::shared_ptr<VkDriver> &driver)
     : driver_(driver),
-      standard_material_layout_(driver, kStandardMaterialResources,
-                               sizeof(kStandardMaterialResources) /
-                                   sizeof(ShaderResource)),
       glob_desc_set_layout_(driver, kGlobResources,
-                            sizeof(kGlobResources) / sizeof(ShaderResource)) {
-  VkDescriptorPoolSize pool_sizes[] = {
-      {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, kMaxMaterialCount+1}, // add one for lighting ubo
-      {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4*kMaxMaterialCount}, // albedo, normal, metallic_roughness_occlusion, emissive
-  };
-  desc_pool_ = std::make_unique<DescriptorPool>(
-      driver, VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT, pool_sizes,
-      sizeof(pool_sizes)/sizeof(pool_sizes[0]), kMaxMaterialCount);
-  auto min_ubo_align = driver->getMinUboAlignSize();
-  standard_material_align_size_ = (sizeof(UMaterial) + min_ubo_align - 1) & ~(min_ubo_align - 1);
-  umaterial_buffer_ = std::make_shared<Buffer>(
-      driver, standard_material_align_size_ * kMaxMaterialCount,
-      VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-      0, VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
-      VMA_MEMORY_USAGE_AUTO_PREFER_HOST);
-  lighting_buffer_ = std::make_shared<Buffer>(
-      driver, sizeof(ULighting),
-      VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-      0, VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
-      VMA_MEMORY_USAGE_AUTO_PREFER_HOST);
-  glob_desc_set_ = desc_pool_->requestDescriptorSet(glob_desc_set_layout_);
-  
-  VkDescriptorBufferInfo buffer_info{
-      .buffer = lighting_buffer_->getHandle(),
-      .offset = 0,
-      .range = sizeof(ULighting)
-  };
-  VkWriteDescriptorSet write_desc_set{
-      .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-      .dstSet = glob_desc_set_->getHandle(),
-      .dstBinding = 0,
-      .descriptorCount = 1,
-      .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-      .pBufferInfo = &buffer_info
+                            sizeof(kGlobResources) / sizeof(ShaderResource)),
+      material_desc_set_layout_(driver, kMaterialResources,
+                                sizeof(kMaterialResources) /
+                                    sizeof(ShaderResource)) {
+  // pools are sized from the layouts, the sets live as long as the manager
+  desc_allocator_ = std::make_unique<DescriptorAllocator>(
+      driver, 0, MAX_FRAMES_IN_FLIGHT);
+  transient_desc_allocator_ =
+      std::make_unique<TransientDescriptorAllocator>(driver);
+  material_desc_allocator_ = std::make_unique<DescriptorAllocator>(
+      driver, VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+      MAX_FRAMES_IN_FLIGHT);
+  for (auto &material_desc_set : material_desc_sets_)
+    material_desc_set =
+        material_desc_allocator_->allocate(material_desc_set_layout_);
+  sampler_ = g_engine.getResourceCache()->requestSampler(
+      driver, VkFilter::VK_FILTER_LINEAR, VkFilter::VK_FILTER_LINEAR,
+      VkSamplerMipmapMode::VK_SAMPLER_MIPMAP_MODE_LINEAR,
+      VkSamplerAddressMode::VK_SAMPLER_ADDRESS_MODE_REPEAT,
+      VkSamplerAddressMode::VK_SAMPLER_ADDRESS_MODE_REPEAT);
+
+  uniform_allocator_ = std::make_unique<UniformAllocator>(driver);
+  uniform_ring_ = std::make_unique<UniformRing>(driver);
+  // one global set per frame slot, the lighting ubo (binding 0) and cluster
+  // params (binding 1) are pushed to the uniform ring each frame and bound
+  // with their dynamic offsets, cluster buffers (binding 2-4) are bound by
+  // LightCuller
+  VkDescriptorBufferInfo buffer_infos[] = {
+      {.buffer = uniform_ring_->getHandle(),
+       .offset = 0,
+       .range = sizeof(ULighting)},
+      {.buffer = uniform_ring_->getHandle(),
+       .offset = 0,
+       .range = sizeof(UClusterParams)}};
+  for (auto &glob_desc_set : glob_desc_sets_) {
+    glob_desc_set = desc_allocator_->allocate(glob_desc_set_layout_);
+    std::vector<VkWriteDescriptorSet> writes;
+    for (uint32_t i = 0; i < 2; ++i)
+      writes.emplace_back(VkWriteDescriptorSet{
+          .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+          .dstSet = glob_desc_set,
+          .dstBinding = i,
+          .descriptorCount = 1,
+          .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+          .pBufferInfo = &buffer_infos[i]});
+    driver_->update(writes);
+  }
+}
+
+VkDescriptorSet ResourceBindingMgr::getGlobalDescSet() noexcept {
+  return glob_desc_sets_[driver_->getCurFrameIndex()];
+}
+
+uint32_t ResourceBindingMgr::registerTexture(
+    const std::shared_ptr<ImageView> &image_view) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  uint32_t index;
+  if (!free_textures_.empty()) {
+    index = free_textures_.back();
+    free_textures_.pop_back();
+  } else {
+    if (textures_.size() >= MAX_BINDLESS_TEXTURE_NUM)
+      throw std::runtime_error("bindless texture array is full");
+    index = static_cast<uint32_t>(textures_.size());
+    textures_.emplace_back();
+  }
+  textures_[index] = image_view;
+  markTexture(index);
+  return index;
+}
+
+void ResourceBindingMgr::updateTexture(
+    uint32_t index, const std::shared_ptr<ImageView> &image_view) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  // frames in flight may still sample the old view
+  released_textures_.emplace_back(PendingRelease{
+      INVALID_BINDLESS_INDEX, kAllFrames, std::move(textures_[index])});
+  textures_[index] = image_view;
+  markTexture(index);
+}
+
+void ResourceBindingMgr::releaseTexture(uint32_t index) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  released_textures_.emplace_back(
+      PendingRelease{index, kAllFrames, std::move(textures_[index])});
+}
+
+void ResourceBindingMgr::refreshTextures(
+    const std::vector<ImageView *> &image_views) {
+  if (image_views.empty())
+    return;
+  std::lock_guard<std::mutex> lock(mtx_);
+  for (uint32_t index = 0; index < textures_.size(); ++index)
+    if (textures_[index] != nullptr &&
+        std::find(image_views.begin(), image_views.end(),
+                  textures_[index].get()) != image_views.end())
+      markTexture(index);
+}
+
+uint32_t ResourceBindingMgr::registerMaterial(const MaterialData &data) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  uint32_t index;
+  if (!free_materials_.empty()) {
+    index = free_materials_.back();
+    free_materials_.pop_back();
+  } else {
+    index = static_cast<uint32_t>(materials_.size());
+    materials_.emplace_back();
+  }
+  materials_[index] = data;
+  markMaterial(index);
+  return index;
+}
+
+void ResourceBindingMgr::updateMaterial(uint32_t index,
+                                        const MaterialData &data) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  materials_[index] = data;
+  markMaterial(index);
+}
+
+void ResourceBindingMgr::releaseMaterial(uint32_t index) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  released_materials_.emplace_back(PendingRelease{index, kAllFrames});
+}
+
+void ResourceBindingMgr::syncMaterials(uint32_t frame_index) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto &changes = frame_changes_[frame_index];
+  auto &material_buffer = material_buffers_[frame_index];
+  const auto material_desc_set = material_desc_sets_[frame_index];
+  const auto material_count = static_cast<uint32_t>(materials_.size());
+
+  std::vector<VkWriteDescriptorSet> writes;
+  VkDescriptorBufferInfo buffer_info{};
+  if (material_buffer == nullptr ||
+      material_count > material_capacities_[frame_index]) {
+    // grow by 1.5x, every material is copied to the new buffer
+    const uint32_t capacity =
+        std::max(material_count + material_count / 2, 64u);
+    material_buffer = std::make_shared<Buffer>(
+        driver_, capacity * sizeof(MaterialData),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 0,
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+            VMA_ALLOCATION_CREATE_MAPPED_BIT,
+        VMA_MEMORY_USAGE_AUTO_PREFER_HOST, MemoryClass::PerFrame);
+    material_capacities_[frame_index] = capacity;
+    std::memcpy(material_buffer->getMappedData(), materials_.data(),
+                material_count * sizeof(MaterialData));
+    material_buffer->flush();
+    changes.materials.clear();
+    buffer_info = {.buffer = material_buffer->getHandle(),
+                   .offset = 0,
+                   .range = VK_WHOLE_SIZE};
+    writes.emplace_back(VkWriteDescriptorSet{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = material_desc_set,
+        .dstBinding = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &buffer_info});
+  } else if (!changes.materials.empty()) {
+    auto *data = reinterpret_cast<MaterialData *>(material_buffer->getMappedData());
+    for (auto index : changes.materials)
+      data[index] = materials_[index];
+    material_buffer->flush(0, material_count * sizeof(MaterialData));
+    changes.materials.clear();
+  }
+
+  // one write per changed texture, the array element is the texture index
+  std::vector<VkDescriptorImageInfo> image_infos;
+  image_infos.reserve(changes.textures.size());
+  for (auto index : changes.textures) {
+    // released before this slot saw it
+    if (textures_[index] == nullptr)
+      continue;
+    image_infos.emplace_back(VkDescriptorImageInfo{
+        .sampler = sampler_->getHandle(),
+        .imageView = textures_[index]->getHandle(),
+        .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL});
+    writes.emplace_back(VkWriteDescriptorSet{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = material_desc_set,
+        .dstBinding = 1,
+        .dstArrayElement = index,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        .pImageInfo = &image_infos.back()});
+  }
+  changes.textures.clear();
+  if (!writes.empty())
+    driver_->update(writes);
+
+  // the last frame of this slot is done, slots released before it can no
+  // longer be in use by it
+  auto retire = [frame_index](std::vector<PendingRelease> &releases,
+                              std::vector<uint32_t> &free_list) {
+    for (auto &release : releases) {
+      release.frame_mask &= ~(1u << frame_index);
+      if (release.frame_mask == 0 && release.index != INVALID_BINDLESS_INDEX)
+        free_list.emplace_back(release.index);
+    }
+    releases.erase(std::remove_if(releases.begin(), releases.end(),
+                                  [](const PendingRelease &release) {
+                                    return release.frame_mask == 0;
+                                  }),
+                   releases.end());
   };
-  driver_->update({write_desc_set});
+  retire(released_materials_, free_materials_);
+  retire(released_textures_, free_textures_);
+}
+
+void ResourceBindingMgr::markMaterial(uint32_t index) {
+  for (auto &changes : frame_changes_)
+    changes.materials.emplace_back(index);
 }
 
-std::tuple<std::shared_ptr<DescriptorSet>, std::shared_ptr<Buffer>, uint32_t>
-ResourceBindingMgr::requestStandardMaterial() {  
-  auto standard_material_set = desc_pool_->requestDescriptorSet(standard_material_layout_);
-  auto ret = std::make_tuple(standard_material_set, umaterial_buffer_, offset_);
-  offset_ += standard_material_align_size_;
-  return ret;
+void ResourceBindingMgr::markTexture(uint32_t index) {
+  for (auto &changes : frame_changes_)
+    changes.textures.emplace_back(index);
 }
 
 ResourceBindingMgr::~ResourceBindingMgr()
 {
-  glob_desc_set_.reset();
-  lighting_buffer_.reset();
-  umaterial_buffer_.reset();
-  desc_pool_.reset();
+  for (auto &material_buffer : material_buffers_)
+    material_buffer.reset();
+  uniform_allocator_.reset();
+  uniform_ring_.reset();
+  transient_desc_allocator_.reset();
+  desc_allocator_.reset();
+  material_desc_allocator_.reset();
 }
 } // namespace mango
\ No newline at end of file
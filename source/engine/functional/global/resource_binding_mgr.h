@@ -1,11 +1,36 @@
 #pragma once
 
-#include <engine/utils/vk/descriptor_set.h>
+#include <mutex>
+#include <vector>
+
+#include <engine/utils/vk/descriptor_allocator.h>
+#include <engine/utils/vk/descriptor_set_layout.h>
+#include <engine/utils/vk/uniform_allocator.h>
+#include <engine/utils/vk/uniform_ring.h>
+#include <engine/utils/vk/vk_constants.h>
+#include <shaders/include/shader_structs.h>
 
 
 namespace mango {
 class VkDriver;
 class Buffer;
+class ImageView;
+class Sampler;
+
+/**
+ * @brief engine global descriptor sets.
+ *
+ * Materials are bindless: MaterialData of all materials are packed into one
+ * storage buffer and the textures they use into one partially bound, update
+ * after bind sampler array, both in set MATERIAL_SET_INDEX. A draw only
+ * pushes its material index, so the number of materials is limited by memory
+ * only and the material set is bound once per pass.
+ *
+ * Registration may happen on any thread. Changes are recorded per frame slot
+ * and applied to the slot's buffer and descriptor set by syncMaterials once
+ * its fence is waited, so sets in flight are never written. Released slots
+ * are reused after every frame slot has seen the release.
+ */
 class ResourceBindingMgr final {
 public:
   ResourceBindingMgr(const std::shared_ptr<VkDriver> &driver);
@@ -15,30 +40,127 @@ public:
   ResourceBindingMgr &operator=(const ResourceBindingMgr &) = delete;
   ResourceBindingMgr(ResourceBindingMgr &&) = delete;
 
-  std::tuple<std::shared_ptr<DescriptorSet>, std::shared_ptr<Buffer>, uint32_t> requestStandardMaterial();
+  /**
+   * @brief add a texture to the bindless texture array
+   * @return index in the array, sampled with the linear repeat sampler
+   */
+  uint32_t registerTexture(const std::shared_ptr<ImageView> &image_view);
+
+  void updateTexture(uint32_t index,
+                     const std::shared_ptr<ImageView> &image_view);
+
+  void releaseTexture(uint32_t index);
+
+  /**
+   * @brief rewrite the slots of views recreated by defragmentation moves in
+   * every frame slot's set, called before syncMaterials
+   */
+  void refreshTextures(const std::vector<ImageView *> &image_views);
+
+  /**
+   * @brief add a material to the bindless material buffer
+   * @return index in the buffer, pushed by draws using the material
+   */
+  uint32_t registerMaterial(const MaterialData &data);
 
-  std::shared_ptr<Buffer> getLightingUbo() noexcept
+  void updateMaterial(uint32_t index, const MaterialData &data);
+
+  void releaseMaterial(uint32_t index);
+
+  /**
+   * @brief apply material and texture changes to the material buffer and
+   * descriptor set of frame slot. Should be called on the render thread after
+   * the frame fence is waited.
+   */
+  void syncMaterials(uint32_t frame_index);
+
+  /**
+   * @brief bindless material set of frame slot, set MATERIAL_SET_INDEX
+   */
+  VkDescriptorSet getMaterialDescSet(uint32_t frame_index) const noexcept {
+    return material_desc_sets_[frame_index];
+  }
+
+  /**
+   * @brief sub-allocator of uniform blocks living longer than a frame,
+   * retired by the render thread after each frame fence wait
+   */
+  const std::unique_ptr<UniformAllocator> &getUniformAllocator() noexcept
   {
-    return lighting_buffer_;    
+    return uniform_allocator_;
   }
 
-  std::shared_ptr<DescriptorSet> getGlobalDescSet() noexcept
+  /**
+   * @brief per frame uniform data, its buffer is bound to binding 0 (lighting
+   * ubo) and 1 (cluster params) of every global set, both dynamic. Reset by
+   * the render thread after each frame fence wait.
+   */
+  const std::unique_ptr<UniformRing> &getUniformRing() noexcept
   {
-    return glob_desc_set_;
+    return uniform_ring_;
+  }
+
+  /**
+   * @brief sets living for one frame, reset by the render thread after each
+   * frame fence wait
+   */
+  const std::unique_ptr<TransientDescriptorAllocator> &
+  getTransientDescAllocator() noexcept {
+    return transient_desc_allocator_;
+  }
+
+  /**
+   * @brief global descriptor set of current frame slot
+   */
+  VkDescriptorSet getGlobalDescSet() noexcept;
+
+  VkDescriptorSet getGlobalDescSet(uint32_t frame_index) const noexcept
+  {
+    return glob_desc_sets_[frame_index];
   }
 
 private:
+  //! a released slot, reused once all frame slots synced the release
+  struct PendingRelease {
+    uint32_t index; //!< INVALID_BINDLESS_INDEX if only a view is retired
+    uint32_t frame_mask; //!< frame slots which haven't synced yet
+    std::shared_ptr<ImageView> view; //!< kept alive until then
+  };
+
+  //! changes not yet applied to a frame slot
+  struct FrameChanges {
+    std::vector<uint32_t> materials;
+    std::vector<uint32_t> textures;
+  };
+
+  void markMaterial(uint32_t index);
+
+  void markTexture(uint32_t index);
+
   std::shared_ptr<VkDriver> driver_;
-  
-  // used for static standard material
-  std::unique_ptr<DescriptorPool> desc_pool_;
-  DescriptorSetLayout standard_material_layout_;
+
+  std::unique_ptr<DescriptorAllocator> desc_allocator_;
+  std::unique_ptr<TransientDescriptorAllocator> transient_desc_allocator_;
   DescriptorSetLayout glob_desc_set_layout_;
-  std::shared_ptr<Buffer> umaterial_buffer_; //!< support 100 materials
-  std::shared_ptr<Buffer> lighting_buffer_; //!< support lighting ubo
-  std::shared_ptr<DescriptorSet> glob_desc_set_; //!< global descriptor set, including lighting ubo
-  uint32_t standard_material_align_size_{0};
-  uint32_t offset_{0};
+  std::unique_ptr<UniformAllocator> uniform_allocator_;
+  std::unique_ptr<UniformRing> uniform_ring_;
+  VkDescriptorSet glob_desc_sets_[MAX_FRAMES_IN_FLIGHT]{}; //!< global descriptor set per frame slot, lighting ubo and light clusters
+
+  // bindless materials
+  std::unique_ptr<DescriptorAllocator> material_desc_allocator_; //!< update after bind
+  DescriptorSetLayout material_desc_set_layout_;
+  VkDescriptorSet material_desc_sets_[MAX_FRAMES_IN_FLIGHT]{};
+  std::shared_ptr<Buffer> material_buffers_[MAX_FRAMES_IN_FLIGHT]; //!< MaterialData, host visible, mapped
+  uint32_t material_capacities_[MAX_FRAMES_IN_FLIGHT]{};
+  std::shared_ptr<Sampler> sampler_;
 
+  std::mutex mtx_; //!< guards the members below
+  std::vector<MaterialData> materials_;
+  std::vector<uint32_t> free_materials_;
+  std::vector<PendingRelease> released_materials_;
+  std::vector<std::shared_ptr<ImageView>> textures_; //!< kept alive until released
+  std::vector<uint32_t> free_textures_;
+  std::vector<PendingRelease> released_textures_;
+  FrameChanges frame_changes_[MAX_FRAMES_IN_FLIGHT];
 };
-} // namespace mango
\ No newline at end of file
+} // namespace mango
@@ -0,0 +1,24 @@
+#include <engine/functional/render/frame_allocator.h>
+
+#include <algorithm>
+
+namespace mango {
+
+FrameAllocator::FrameAllocator(size_t initial_size) {
+  for (auto &arena : arenas_)
+    arena = std::make_unique<Arena>("frame", initial_size);
+}
+
+void FrameAllocator::beginFrame(uint32_t frame_index, size_t size) {
+  cur_ = frame_index;
+  auto &arena = arenas_[cur_];
+  const size_t capacity = arena->getArea().size();
+  if (size > capacity) {
+    // leave headroom, a scene being loaded grows a little every frame
+    arena = std::make_unique<Arena>("frame",
+                                    std::max(size + size / 2, capacity * 2));
+    return;
+  }
+  arena->reset();
+}
+} // namespace mango
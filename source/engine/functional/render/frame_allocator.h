@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <type_traits>
+
+#include <engine/utils/base/memory.h>
+#include <engine/utils/vk/vk_constants.h>
+
+namespace mango {
+
+/**
+ * @brief linear allocator for render packets living one frame in flight.
+ *
+ * Each frame slot owns an arena which is rewound when the slot is reused, i.e.
+ * after its fence is waited. Allocations are never freed individually and no
+ * destructor is called, so only trivially destructible types are allowed.
+ * The caller tells beginFrame() how much memory the frame needs, the arena
+ * only grows (and hits the heap) when that exceeds its capacity.
+ */
+class FrameAllocator final {
+public:
+  explicit FrameAllocator(size_t initial_size = 1 << 20);
+
+  /**
+   * @brief rewind the arena of frame slot, grow it if it's smaller than size
+   * @param size bytes needed by the frame, see arraySize()
+   */
+  void beginFrame(uint32_t frame_index, size_t size);
+
+  /**
+   * @brief default initialized array in the current frame's arena
+   */
+  template <typename T> std::span<T> allocArray(size_t count) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "frame allocations are never destroyed");
+    if (count == 0)
+      return {};
+    auto *p = static_cast<T *>(arenas_[cur_]->alloc(count * sizeof(T),
+                                                    alignof(T)));
+    assert(p != nullptr && "frame size underestimated");
+    std::uninitialized_default_construct_n(p, count);
+    return {p, count};
+  }
+
+  /**
+   * @brief upper bound of bytes taken by allocArray<T>(count)
+   */
+  template <typename T> static constexpr size_t arraySize(size_t count) {
+    return count * sizeof(T) + alignof(T) - 1;
+  }
+
+  size_t getCapacity() const { return arenas_[cur_]->getArea().size(); }
+
+  size_t getUsed() {
+    return static_cast<uint8_t *>(arenas_[cur_]->getCurrent()) -
+           static_cast<uint8_t *>(arenas_[cur_]->getArea().data());
+  }
+
+  FrameAllocator(const FrameAllocator &) = delete;
+  FrameAllocator &operator=(const FrameAllocator &) = delete;
+
+private:
+  using Arena = utils::Arena<utils::LinearAllocator,
+                             utils::LockingPolicy::NoLock>;
+
+  std::unique_ptr<Arena> arenas_[MAX_FRAMES_IN_FLIGHT];
+  uint32_t cur_{0};
+};
+} // namespace mango
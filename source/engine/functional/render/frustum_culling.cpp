@@ -0,0 +1,182 @@
+#include <engine/functional/render/frustum_culling.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MANGO_CULL_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) ||                                  \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MANGO_CULL_SSE
+#endif
+
+namespace mango {
+
+#if defined(MANGO_CULL_AVX2)
+constexpr size_t kCullBatchSize = 8;
+#elif defined(MANGO_CULL_SSE)
+constexpr size_t kCullBatchSize = 4;
+#else
+constexpr size_t kCullBatchSize = 1;
+#endif
+
+void Frustum::extract(const Eigen::Matrix4f &proj_view) {
+  // clip = M * p, inside: -w <= x <= w, -w <= y <= w, 0 <= z <= w
+  const Eigen::Vector4f r0 = proj_view.row(0).transpose();
+  const Eigen::Vector4f r1 = proj_view.row(1).transpose();
+  const Eigen::Vector4f r2 = proj_view.row(2).transpose();
+  const Eigen::Vector4f r3 = proj_view.row(3).transpose();
+  planes[0] = r3 + r0;
+  planes[1] = r3 - r0;
+  planes[2] = r3 + r1;
+  planes[3] = r3 - r1;
+  planes[4] = r2;
+  planes[5] = r3 - r2;
+  for (auto &plane : planes) {
+    float len = plane.head<3>().norm();
+    if (len > 0.0f)
+      plane /= len;
+  }
+}
+
+void FrustumCuller::clear() {
+  count_ = 0;
+  cx_.clear();
+  cy_.clear();
+  cz_.clear();
+  ex_.clear();
+  ey_.clear();
+  ez_.clear();
+  versions_.clear();
+}
+
+bool FrustumCuller::update(uint32_t slot, uint64_t version,
+                           const Eigen::AlignedBox3f &box) {
+  if (slot >= count_) {
+    count_ = slot + 1;
+    const size_t padded =
+        (count_ + kCullBatchSize - 1) / kCullBatchSize * kCullBatchSize;
+    if (padded > cx_.size()) {
+      // negative extents put new slots outside of every frustum
+      cx_.resize(padded, 0.0f);
+      cy_.resize(padded, 0.0f);
+      cz_.resize(padded, 0.0f);
+      ex_.resize(padded, -FLT_MAX);
+      ey_.resize(padded, -FLT_MAX);
+      ez_.resize(padded, -FLT_MAX);
+      versions_.resize(padded, 0);
+    }
+  }
+  if (versions_[slot] == version)
+    return false;
+  versions_[slot] = version;
+
+  if (box.isEmpty()) {
+    // unknown bounds, never cull
+    cx_[slot] = cy_[slot] = cz_[slot] = 0.0f;
+    ex_[slot] = ey_[slot] = ez_[slot] = FLT_MAX;
+    return true;
+  }
+  const Eigen::Vector3f c = box.center();
+  const Eigen::Vector3f e = box.sizes() * 0.5f;
+  cx_[slot] = c.x();
+  cy_[slot] = c.y();
+  cz_[slot] = c.z();
+  ex_[slot] = e.x();
+  ey_[slot] = e.y();
+  ez_[slot] = e.z();
+  return true;
+}
+
+uint32_t FrustumCuller::cull(const Frustum &frustum,
+                             std::vector<uint8_t> &visible) {
+  visible.resize(count_);
+  if (count_ == 0)
+    return 0;
+
+  // slots are padded to batch size, results of padded lanes are dropped
+  const size_t padded =
+      (count_ + kCullBatchSize - 1) / kCullBatchSize * kCullBatchSize;
+
+  // box is outside if dot(n, c) + d + dot(|n|, e) < 0 for any plane
+  float pn[6][3], pa[6][3], pd[6];
+  for (int p = 0; p < 6; ++p) {
+    for (int k = 0; k < 3; ++k) {
+      pn[p][k] = frustum.planes[p][k];
+      pa[p][k] = std::abs(frustum.planes[p][k]);
+    }
+    pd[p] = frustum.planes[p][3];
+  }
+
+  uint32_t visible_count = 0;
+  for (size_t i = 0; i < padded; i += kCullBatchSize) {
+    const size_t n = std::min(kCullBatchSize, count_ - i);
+#if defined(MANGO_CULL_AVX2)
+    const __m256 cx = _mm256_loadu_ps(cx_.data() + i);
+    const __m256 cy = _mm256_loadu_ps(cy_.data() + i);
+    const __m256 cz = _mm256_loadu_ps(cz_.data() + i);
+    const __m256 ex = _mm256_loadu_ps(ex_.data() + i);
+    const __m256 ey = _mm256_loadu_ps(ey_.data() + i);
+    const __m256 ez = _mm256_loadu_ps(ez_.data() + i);
+    const __m256 zero = _mm256_setzero_ps();
+    __m256 outside = zero;
+    for (int p = 0; p < 6; ++p) {
+      __m256 d = _mm256_add_ps(
+          _mm256_add_ps(_mm256_mul_ps(cx, _mm256_set1_ps(pn[p][0])),
+                        _mm256_mul_ps(cy, _mm256_set1_ps(pn[p][1]))),
+          _mm256_add_ps(_mm256_mul_ps(cz, _mm256_set1_ps(pn[p][2])),
+                        _mm256_set1_ps(pd[p])));
+      __m256 r = _mm256_add_ps(
+          _mm256_add_ps(_mm256_mul_ps(ex, _mm256_set1_ps(pa[p][0])),
+                        _mm256_mul_ps(ey, _mm256_set1_ps(pa[p][1]))),
+          _mm256_mul_ps(ez, _mm256_set1_ps(pa[p][2])));
+      outside = _mm256_or_ps(
+          outside, _mm256_cmp_ps(_mm256_add_ps(d, r), zero, _CMP_LT_OQ));
+    }
+    const int mask = _mm256_movemask_ps(outside);
+#elif defined(MANGO_CULL_SSE)
+    const __m128 cx = _mm_loadu_ps(cx_.data() + i);
+    const __m128 cy = _mm_loadu_ps(cy_.data() + i);
+    const __m128 cz = _mm_loadu_ps(cz_.data() + i);
+    const __m128 ex = _mm_loadu_ps(ex_.data() + i);
+    const __m128 ey = _mm_loadu_ps(ey_.data() + i);
+    const __m128 ez = _mm_loadu_ps(ez_.data() + i);
+    const __m128 zero = _mm_setzero_ps();
+    __m128 outside = zero;
+    for (int p = 0; p < 6; ++p) {
+      __m128 d =
+          _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(pn[p][0])),
+                                _mm_mul_ps(cy, _mm_set1_ps(pn[p][1]))),
+                     _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(pn[p][2])),
+                                _mm_set1_ps(pd[p])));
+      __m128 r =
+          _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(pa[p][0])),
+                                _mm_mul_ps(ey, _mm_set1_ps(pa[p][1]))),
+                     _mm_mul_ps(ez, _mm_set1_ps(pa[p][2])));
+      outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, r), zero));
+    }
+    const int mask = _mm_movemask_ps(outside);
+#else
+    int mask = 0;
+    for (int p = 0; p < 6; ++p) {
+      float d = cx_[i] * pn[p][0] + cy_[i] * pn[p][1] + cz_[i] * pn[p][2] +
+                pd[p];
+      float r = ex_[i] * pa[p][0] + ey_[i] * pa[p][1] + ez_[i] * pa[p][2];
+      if (d + r < 0.0f) {
+        mask = 1;
+        break;
+      }
+    }
+#endif
+    for (size_t k = 0; k < n; ++k) {
+      const uint8_t v = ((mask >> k) & 1) == 0 ? 1 : 0;
+      visible[i + k] = v;
+      visible_count += v;
+    }
+  }
+  return visible_count;
+}
+
+} // namespace mango
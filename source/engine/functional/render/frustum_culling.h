@@ -0,0 +1,79 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+#include <cstdint>
+#include <vector>
+
+namespace mango {
+
+/**
+ * @brief world space view frustum, plane is (n, d), point p is inside when
+ * dot(n, p) + d >= 0 for all 6 planes.
+ */
+struct Frustum {
+  Eigen::Vector4f planes[6]; //!< left, right, bottom, top, near, far
+
+  /**
+   * @brief extract planes from proj * view matrix, vulkan clip space depth
+   * [0, 1]
+   */
+  void extract(const Eigen::Matrix4f &proj_view);
+};
+
+struct CullingStats {
+  uint32_t tested{0}; //!< number of objects tested this frame
+  uint32_t culled{0}; //!< number of objects outside the frustum
+  uint32_t uploading{0}; //!< visible but skipped, uploads not submitted yet
+  uint32_t updated{0}; //!< bounds rewritten this frame
+};
+
+/**
+ * @brief batch frustum culler over persistent slots. Bounds are stored as SoA
+ * (center, extent), and tested 8(AVX2) or 4(SSE) boxes at a time. A slot
+ * keeps its bounds across frames and is only rewritten when the version
+ * passed with them changes, slots never written are never visible.
+ */
+class FrustumCuller final {
+public:
+  FrustumCuller() = default;
+
+  /**
+   * @brief drop all slots
+   */
+  void clear();
+
+  /**
+   * @brief set the world space aabb of slot, grows to slot + 1 slots. Empty
+   * box is treated as always visible.
+   *
+   * @param version the bounds are only written if it differs from the version
+   * of the last write
+   * @return true if the bounds were written
+   */
+  bool update(uint32_t slot, uint64_t version,
+              const Eigen::AlignedBox3f &box);
+
+  size_t size() const { return count_; }
+
+  /**
+   * @brief test all slots against the frustum
+   *
+   * @param visible output, visible[i] = 1 if the bounds of slot i intersect
+   * the frustum
+   * @return number of visible slots
+   */
+  uint32_t cull(const Frustum &frustum, std::vector<uint8_t> &visible);
+
+  FrustumCuller(const FrustumCuller &) = delete;
+  FrustumCuller &operator=(const FrustumCuller &) = delete;
+
+private:
+  size_t count_{0};
+  //! padded to the batch size
+  std::vector<float> cx_, cy_, cz_; //!< box centers
+  std::vector<float> ex_, ey_, ez_; //!< box half extents
+  std::vector<uint64_t> versions_; //!< version of the last write per slot
+};
+
+} // namespace mango
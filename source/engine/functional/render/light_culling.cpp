@@ -0,0 +1,376 @@
+#include <engine/functional/render/light_culling.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <engine/functional/global/engine_context.h>
+#include <engine/functional/global/resource_binding_mgr.h>
+#include <engine/utils/job/job_system.h>
+#include <engine/utils/vk/buffer.h>
+#include <engine/utils/vk/vk_driver.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MANGO_LIGHT_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) ||                                  \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MANGO_LIGHT_SSE
+#endif
+
+namespace mango {
+
+constexpr uint32_t kClusterCount = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+constexpr size_t kParallelLightThreshold = 2048; //!< fewer lights are binned on the calling thread
+constexpr size_t kLightGrain = 512; //!< min lights per range job
+
+// lane wise float ops, the range kernel is written once for all widths
+namespace {
+#if defined(MANGO_LIGHT_AVX2)
+constexpr size_t kLightBatchSize = 8;
+using vfloat = __m256;
+inline vfloat vload(const float *p) { return _mm256_loadu_ps(p); }
+inline void vstore(float *p, vfloat v) { _mm256_storeu_ps(p, v); }
+inline vfloat vset(float v) { return _mm256_set1_ps(v); }
+inline vfloat vadd(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+inline vfloat vsub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+inline vfloat vmul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+inline vfloat vdiv(vfloat a, vfloat b) { return _mm256_div_ps(a, b); }
+inline vfloat vmin(vfloat a, vfloat b) { return _mm256_min_ps(a, b); }
+inline vfloat vmax(vfloat a, vfloat b) { return _mm256_max_ps(a, b); }
+// a < 0 ? b : c
+inline vfloat vselectNeg(vfloat a, vfloat b, vfloat c) {
+  return _mm256_blendv_ps(c, b, _mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_LT_OQ));
+}
+#elif defined(MANGO_LIGHT_SSE)
+constexpr size_t kLightBatchSize = 4;
+using vfloat = __m128;
+inline vfloat vload(const float *p) { return _mm_loadu_ps(p); }
+inline void vstore(float *p, vfloat v) { _mm_storeu_ps(p, v); }
+inline vfloat vset(float v) { return _mm_set1_ps(v); }
+inline vfloat vadd(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+inline vfloat vsub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+inline vfloat vmul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+inline vfloat vdiv(vfloat a, vfloat b) { return _mm_div_ps(a, b); }
+inline vfloat vmin(vfloat a, vfloat b) { return _mm_min_ps(a, b); }
+inline vfloat vmax(vfloat a, vfloat b) { return _mm_max_ps(a, b); }
+inline vfloat vselectNeg(vfloat a, vfloat b, vfloat c) {
+  const vfloat mask = _mm_cmplt_ps(a, _mm_setzero_ps());
+  return _mm_or_ps(_mm_and_ps(mask, b), _mm_andnot_ps(mask, c));
+}
+#else
+constexpr size_t kLightBatchSize = 1;
+using vfloat = float;
+inline vfloat vload(const float *p) { return *p; }
+inline void vstore(float *p, vfloat v) { *p = v; }
+inline vfloat vset(float v) { return v; }
+inline vfloat vadd(vfloat a, vfloat b) { return a + b; }
+inline vfloat vsub(vfloat a, vfloat b) { return a - b; }
+inline vfloat vmul(vfloat a, vfloat b) { return a * b; }
+inline vfloat vdiv(vfloat a, vfloat b) { return a / b; }
+inline vfloat vmin(vfloat a, vfloat b) { return std::min(a, b); }
+inline vfloat vmax(vfloat a, vfloat b) { return std::max(a, b); }
+inline vfloat vselectNeg(vfloat a, vfloat b, vfloat c) {
+  return a < 0.0f ? b : c;
+}
+#endif
+} // namespace
+
+static uint32_t taskCount(size_t work) {
+  if (work < kParallelLightThreshold)
+    return 1;
+  return g_engine.getJobSystem()->getThreadCount();
+}
+
+void LightCuller::cull(const std::vector<UPointLight> &lights,
+                       const Eigen::Matrix4f &view,
+                       const Eigen::Matrix4f &proj, float near_plane,
+                       float far_plane, uint32_t width, uint32_t height) {
+  view_ = view;
+  p00_ = proj(0, 0);
+  p11_ = proj(1, 1);
+  near_ = near_plane;
+  far_ = far_plane;
+
+  const float log_scale = CLUSTER_Z / std::log(far_ / near_);
+  params_.view_z = view.row(2).transpose();
+  params_.tile_size =
+      Eigen::Vector4f(std::max(width, 1u) / static_cast<float>(CLUSTER_X),
+                      std::max(height, 1u) / static_cast<float>(CLUSTER_Y),
+                      0.0f, 0.0f);
+  params_.depth_slice = Eigen::Vector4f(near_, far_, log_scale,
+                                        -std::log(near_) * log_scale);
+
+  // SoA light bounds, padded to batch size
+  const size_t count = lights.size();
+  const size_t padded =
+      (count + kLightBatchSize - 1) / kLightBatchSize * kLightBatchSize;
+  px_.resize(padded);
+  py_.resize(padded);
+  pz_.resize(padded);
+  radius_.resize(padded);
+  for (size_t i = 0; i < count; ++i) {
+    px_[i] = lights[i].position.x();
+    py_[i] = lights[i].position.y();
+    pz_[i] = lights[i].position.z();
+    radius_[i] = lights[i].position.w();
+  }
+  std::fill(radius_.begin() + count, radius_.end(), -1.0f);
+  x0_.resize(padded);
+  x1_.resize(padded);
+  y0_.resize(padded);
+  y1_.resize(padded);
+  z0_.resize(padded);
+  z1_.resize(padded);
+
+  // cluster range per light, chunks of lights in parallel
+  if (taskCount(count) == 1) {
+    computeLightRanges(0, padded);
+  } else {
+    g_engine.getJobSystem()->parallelFor(
+        0, padded / kLightBatchSize, kLightGrain / kLightBatchSize,
+        [this](size_t begin, size_t end) {
+          computeLightRanges(begin * kLightBatchSize, end * kLightBatchSize);
+        });
+  }
+
+  // compact visible lights
+  visible_lights_.clear();
+  remap_.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    if (x0_[i] > x1_[i])
+      continue;
+    remap_[i] = static_cast<uint32_t>(visible_lights_.size());
+    visible_lights_.emplace_back(lights[i]);
+  }
+
+  // fill clusters, each task owns a contiguous group of depth slices so the
+  // lists are written without synchronization
+  cluster_ranges_.resize(2 * kClusterCount);
+  light_indices_.clear();
+  const uint32_t fill_tasks =
+      std::min<uint32_t>(taskCount(visible_lights_.size()), CLUSTER_Z);
+  if (fill_tasks == 1) {
+    fillSlices(0, CLUSTER_Z, light_indices_);
+  } else {
+    // members, the lists keep their capacity across frames
+    if (task_indices_.size() < fill_tasks)
+      task_indices_.resize(fill_tasks);
+    auto job_system = g_engine.getJobSystem();
+    JobCounter fill_done;
+    for (uint32_t t = 0; t < fill_tasks; ++t) {
+      const uint32_t z_begin = CLUSTER_Z * t / fill_tasks;
+      const uint32_t z_end = CLUSTER_Z * (t + 1) / fill_tasks;
+      job_system->run(
+          [this, z_begin, z_end, t]() {
+            fillSlices(z_begin, z_end, task_indices_[t]);
+          },
+          &fill_done);
+    }
+    job_system->wait(fill_done);
+    // offsets of the tasks' lists are local, rebase while concatenating
+    for (uint32_t t = 0; t < fill_tasks; ++t) {
+      const uint32_t base = static_cast<uint32_t>(light_indices_.size());
+      const uint32_t first_cluster = CLUSTER_Z * t / fill_tasks * CLUSTER_X *
+                                     CLUSTER_Y;
+      const uint32_t last_cluster = CLUSTER_Z * (t + 1) / fill_tasks *
+                                    CLUSTER_X * CLUSTER_Y;
+      for (uint32_t c = first_cluster; c < last_cluster; ++c)
+        cluster_ranges_[2 * c] += base;
+      light_indices_.insert(light_indices_.end(), task_indices_[t].begin(),
+                            task_indices_[t].end());
+    }
+  }
+
+  params_.point_light_num = static_cast<uint32_t>(visible_lights_.size());
+  stats_.lights = static_cast<uint32_t>(count);
+  stats_.visible = static_cast<uint32_t>(visible_lights_.size());
+  stats_.light_indices = static_cast<uint32_t>(light_indices_.size());
+  stats_.max_cluster_lights = 0;
+  for (uint32_t c = 0; c < kClusterCount; ++c)
+    stats_.max_cluster_lights =
+        std::max(stats_.max_cluster_lights, cluster_ranges_[2 * c + 1]);
+}
+
+void LightCuller::computeLightRanges(size_t begin, size_t end) {
+  // view space: vx = dot(view.row(0), p), view depth d = -dot(view.row(2), p)
+  const vfloat v00 = vset(view_(0, 0)), v01 = vset(view_(0, 1)),
+               v02 = vset(view_(0, 2)), v03 = vset(view_(0, 3));
+  const vfloat v10 = vset(view_(1, 0)), v11 = vset(view_(1, 1)),
+               v12 = vset(view_(1, 2)), v13 = vset(view_(1, 3));
+  const vfloat v20 = vset(-view_(2, 0)), v21 = vset(-view_(2, 1)),
+               v22 = vset(-view_(2, 2)), v23 = vset(-view_(2, 3));
+  const vfloat p00 = vset(p00_), p11 = vset(p11_);
+  const vfloat near_plane = vset(near_), far_plane = vset(far_);
+
+  alignas(32) float nx0[kLightBatchSize], nx1[kLightBatchSize];
+  alignas(32) float ny0[kLightBatchSize], ny1[kLightBatchSize];
+  alignas(32) float dmin[kLightBatchSize], dmax[kLightBatchSize];
+  const float log_scale = params_.depth_slice.z();
+  const float log_bias = params_.depth_slice.w();
+  for (size_t i = begin; i < end; i += kLightBatchSize) {
+    const vfloat px = vload(px_.data() + i);
+    const vfloat py = vload(py_.data() + i);
+    const vfloat pz = vload(pz_.data() + i);
+    const vfloat r = vload(radius_.data() + i);
+    const vfloat vx =
+        vadd(vadd(vmul(v00, px), vmul(v01, py)), vadd(vmul(v02, pz), v03));
+    const vfloat vy =
+        vadd(vadd(vmul(v10, px), vmul(v11, py)), vadd(vmul(v12, pz), v13));
+    const vfloat d =
+        vadd(vadd(vmul(v20, px), vmul(v21, py)), vadd(vmul(v22, pz), v23));
+    // depth range of the sphere clipped to [near, far]
+    const vfloat d0 = vmax(vsub(d, r), near_plane);
+    const vfloat d1 = vmin(vadd(d, r), far_plane);
+    // ndc bounds of the view space box, x / d is extreme at the nearest
+    // depth when x is away from the axis, otherwise at the farthest
+    const vfloat x0 = vsub(vx, r), x1 = vadd(vx, r);
+    const vfloat y0 = vsub(vy, r), y1 = vadd(vy, r);
+    const vfloat neg_x1 = vsub(vset(0.0f), x1);
+    const vfloat neg_y1 = vsub(vset(0.0f), y1);
+    vstore(nx0, vdiv(vmul(p00, x0), vselectNeg(x0, d0, d1)));
+    vstore(nx1, vdiv(vmul(p00, x1), vselectNeg(neg_x1, d0, d1)));
+    vstore(ny0, vdiv(vmul(p11, y0), vselectNeg(y0, d0, d1)));
+    vstore(ny1, vdiv(vmul(p11, y1), vselectNeg(neg_y1, d0, d1)));
+    vstore(dmin, d0);
+    vstore(dmax, d1);
+
+    for (size_t k = 0; k < kLightBatchSize; ++k) {
+      const size_t l = i + k;
+      if (radius_[l] <= 0.0f || dmin[k] > dmax[k] || nx1[k] < -1.0f ||
+          nx0[k] > 1.0f || ny1[k] < -1.0f || ny0[k] > 1.0f) {
+        x0_[l] = 1;
+        x1_[l] = 0; // invisible
+        continue;
+      }
+      // framebuffer y is flipped: y = 0.5 - 0.5 * ndc_y
+      auto tile = [](float v, int n) {
+        return static_cast<uint8_t>(
+            std::clamp(static_cast<int>(std::floor(v * n)), 0, n - 1));
+      };
+      x0_[l] = tile(0.5f + 0.5f * nx0[k], CLUSTER_X);
+      x1_[l] = tile(0.5f + 0.5f * nx1[k], CLUSTER_X);
+      y0_[l] = tile(0.5f - 0.5f * ny1[k], CLUSTER_Y);
+      y1_[l] = tile(0.5f - 0.5f * ny0[k], CLUSTER_Y);
+      auto slice = [log_scale, log_bias](float depth) {
+        return static_cast<uint8_t>(std::clamp(
+            static_cast<int>(std::floor(std::log(depth) * log_scale +
+                                        log_bias)),
+            0, CLUSTER_Z - 1));
+      };
+      z0_[l] = slice(dmin[k]);
+      z1_[l] = slice(dmax[k]);
+    }
+  }
+}
+
+void LightCuller::fillSlices(uint32_t z_begin, uint32_t z_end,
+                             std::vector<uint32_t> &indices) {
+  const uint32_t first_cluster = z_begin * CLUSTER_X * CLUSTER_Y;
+  const uint32_t last_cluster = z_end * CLUSTER_X * CLUSTER_Y;
+  for (uint32_t c = first_cluster; c < last_cluster; ++c)
+    cluster_ranges_[2 * c + 1] = 0;
+
+  // count, then prefix sum, then fill in light order
+  const size_t count = remap_.size();
+  auto for_each_cluster = [&](auto &&f) {
+    for (size_t l = 0; l < count; ++l) {
+      if (x0_[l] > x1_[l] || z1_[l] < z_begin || z0_[l] >= z_end)
+        continue;
+      const uint32_t z0 = std::max<uint32_t>(z0_[l], z_begin);
+      const uint32_t z1 = std::min<uint32_t>(z1_[l], z_end - 1);
+      for (uint32_t z = z0; z <= z1; ++z)
+        for (uint32_t y = y0_[l]; y <= y1_[l]; ++y)
+          for (uint32_t x = x0_[l]; x <= x1_[l]; ++x)
+            f((z * CLUSTER_Y + y) * CLUSTER_X + x, remap_[l]);
+    }
+  };
+  for_each_cluster(
+      [this](uint32_t c, uint32_t) { ++cluster_ranges_[2 * c + 1]; });
+  uint32_t offset = 0;
+  for (uint32_t c = first_cluster; c < last_cluster; ++c) {
+    cluster_ranges_[2 * c] = offset;
+    offset += cluster_ranges_[2 * c + 1];
+  }
+  indices.resize(offset);
+  for (uint32_t c = first_cluster; c < last_cluster; ++c)
+    cluster_ranges_[2 * c + 1] = 0;
+  for_each_cluster([this, &indices](uint32_t c, uint32_t light) {
+    indices[cluster_ranges_[2 * c] + cluster_ranges_[2 * c + 1]++] = light;
+  });
+}
+
+uint32_t LightCuller::upload() {
+  auto driver = g_engine.getDriver();
+  const uint32_t slot = driver->getCurFrameIndex();
+  auto &frame = frames_[slot];
+  const auto light_count = static_cast<uint32_t>(visible_lights_.size());
+  const auto index_count = static_cast<uint32_t>(light_indices_.size());
+
+  bool rebind = false;
+  auto make_buffer = [&driver](VkDeviceSize size, VkBufferUsageFlags usage) {
+    return std::make_shared<Buffer>(
+        driver, size, usage, 0,
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+            VMA_ALLOCATION_CREATE_MAPPED_BIT,
+        VMA_MEMORY_USAGE_AUTO_PREFER_HOST, MemoryClass::PerFrame);
+  };
+  const auto &resource_binding_mgr = g_engine.getResourceBindingMgr();
+  if (frame.cluster_ranges == nullptr) {
+    frame.cluster_ranges = make_buffer(2 * kClusterCount * sizeof(uint32_t),
+                                       VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    rebind = true;
+  }
+  // grow by 1.5x to avoid reallocating while lights are added
+  if (frame.point_lights == nullptr || light_count > frame.light_capacity) {
+    frame.light_capacity = std::max(light_count + light_count / 2, 64u);
+    frame.point_lights =
+        make_buffer(frame.light_capacity * sizeof(UPointLight),
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    rebind = true;
+  }
+  if (frame.light_indices == nullptr || index_count > frame.index_capacity) {
+    frame.index_capacity = std::max(index_count + index_count / 2, 1024u);
+    frame.light_indices =
+        make_buffer(frame.index_capacity * sizeof(uint32_t),
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    rebind = true;
+  }
+
+  // changes with the view each frame, bound with its dynamic offset
+  const uint32_t params_offset =
+      resource_binding_mgr->getUniformRing()->push(&params_,
+                                                   sizeof(UClusterParams));
+  frame.cluster_ranges->update(cluster_ranges_.data(),
+                               cluster_ranges_.size() * sizeof(uint32_t));
+  if (light_count > 0)
+    frame.point_lights->update(visible_lights_.data(),
+                               light_count * sizeof(UPointLight));
+  if (index_count > 0)
+    frame.light_indices->update(light_indices_.data(),
+                                index_count * sizeof(uint32_t));
+  if (!rebind)
+    return params_offset;
+
+  // binding 1 (cluster params) points at the uniform ring, written once by
+  // ResourceBindingMgr
+  auto glob_set = resource_binding_mgr->getGlobalDescSet(slot);
+  const std::shared_ptr<Buffer> *buffers[] = {
+      &frame.point_lights, &frame.cluster_ranges, &frame.light_indices};
+  VkDescriptorBufferInfo buffer_infos[3];
+  std::vector<VkWriteDescriptorSet> writes;
+  for (uint32_t i = 0; i < 3; ++i) {
+    buffer_infos[i] = VkDescriptorBufferInfo{
+        .buffer = (*buffers[i])->getHandle(), .offset = 0, .range = VK_WHOLE_SIZE};
+    writes.emplace_back(VkWriteDescriptorSet{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = glob_set,
+        .dstBinding = i + 2,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &buffer_infos[i]});
+  }
+  driver->update(writes);
+  return params_offset;
+}
+} // namespace mango
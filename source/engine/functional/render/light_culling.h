@@ -0,0 +1,118 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <engine/utils/vk/vk_constants.h>
+#include <shaders/include/shader_structs.h>
+
+namespace mango {
+class Buffer;
+
+struct LightCullingStats {
+  uint32_t lights{0};             //!< point lights tested
+  uint32_t visible{0};            //!< point lights touching any cluster
+  uint32_t light_indices{0};      //!< entries of all cluster light lists
+  uint32_t max_cluster_lights{0}; //!< longest cluster light list
+};
+
+/**
+ * @brief clustered forward light culling.
+ *
+ * The view frustum is divided into CLUSTER_X * CLUSTER_Y screen tiles and
+ * CLUSTER_Z exponential depth slices. Point lights are bound by spheres of
+ * their range (UPointLight::position.w), the cluster range of each sphere is
+ * computed 8(AVX2) or 4(SSE) lights at a time, and clusters are filled in
+ * parallel on the job system, one job per group of depth slices. forward_lighting.frag only
+ * iterates the light list of the fragment's cluster.
+ */
+class LightCuller final {
+public:
+  LightCuller() = default;
+
+  /**
+   * @brief bin point lights into clusters
+   * @param view world to view matrix
+   * @param proj projection matrix, right handed, depth [0, 1]
+   * @param near_plane distance to the near plane > 0
+   * @param far_plane distance to the far plane > near_plane
+   * @param width, height viewport size in pixels
+   */
+  void cull(const std::vector<UPointLight> &lights,
+            const Eigen::Matrix4f &view, const Eigen::Matrix4f &proj,
+            float near_plane, float far_plane, uint32_t width,
+            uint32_t height);
+
+  /**
+   * @brief upload visible lights and cluster lists of the last cull to the
+   * buffers of current frame slot, and bind them to the global descriptor set
+   * of the slot. Should be called after the frame fence is waited.
+   * @return dynamic offset of UClusterParams, pushed to the uniform ring
+   */
+  uint32_t upload();
+
+  const LightCullingStats &getStats() const { return stats_; }
+
+  //! (offset, count) in getLightIndices() per cluster,
+  //! cluster index = (z * CLUSTER_Y + y) * CLUSTER_X + x
+  const std::vector<uint32_t> &getClusterRanges() const {
+    return cluster_ranges_;
+  }
+
+  //! index into getVisibleLights()
+  const std::vector<uint32_t> &getLightIndices() const {
+    return light_indices_;
+  }
+
+  const std::vector<UPointLight> &getVisibleLights() const {
+    return visible_lights_;
+  }
+
+  LightCuller(const LightCuller &) = delete;
+  LightCuller &operator=(const LightCuller &) = delete;
+
+private:
+  struct FrameResources {
+    std::shared_ptr<Buffer> point_lights;   //!< visible UPointLights
+    std::shared_ptr<Buffer> cluster_ranges; //!< (offset, count) per cluster
+    std::shared_ptr<Buffer> light_indices;
+    uint32_t light_capacity{0};
+    uint32_t index_capacity{0};
+  };
+
+  /**
+   * @brief compute cluster ranges of lights [begin, end), begin is a multiple
+   * of the batch size
+   */
+  void computeLightRanges(size_t begin, size_t end);
+
+  /**
+   * @brief fill the light lists of depth slices [z_begin, z_end)
+   */
+  void fillSlices(uint32_t z_begin, uint32_t z_end,
+                  std::vector<uint32_t> &indices);
+
+  FrameResources frames_[MAX_FRAMES_IN_FLIGHT];
+
+  // light bounds, SoA, world space position and range
+  std::vector<float> px_, py_, pz_, radius_;
+  // cluster range per light, inclusive, x0 > x1 if the light is invisible
+  std::vector<uint8_t> x0_, x1_, y0_, y1_, z0_, z1_;
+
+  Eigen::Matrix4f view_;
+  float p00_{1.0f}; //!< proj(0, 0)
+  float p11_{1.0f}; //!< proj(1, 1)
+  float near_{0.1f};
+  float far_{1000.0f};
+
+  UClusterParams params_;
+  std::vector<uint32_t> cluster_ranges_;
+  std::vector<uint32_t> light_indices_;
+  std::vector<std::vector<uint32_t>> task_indices_; //!< per fill task
+  std::vector<UPointLight> visible_lights_;
+  std::vector<uint32_t> remap_; //!< light index -> visible light index
+  LightCullingStats stats_;
+};
+} // namespace mango
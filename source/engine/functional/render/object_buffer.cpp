@@ -0,0 +1,67 @@
+#include <engine/functional/render/object_buffer.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include <engine/functional/global/engine_context.h>
+#include <engine/utils/job/job_system.h>
+#include <engine/utils/vk/buffer.h>
+#include <engine/utils/vk/vk_driver.h>
+
+namespace mango {
+
+constexpr size_t kObjectGrain = 4096; //!< min objects per job
+
+ObjectBuffer::~ObjectBuffer() = default;
+
+void ObjectBuffer::update(const std::vector<StaticMeshSnapshot> &static_meshes,
+                          uint32_t frame_index) {
+  auto &frame = frames_[frame_index];
+  uint32_t object_count = 0;
+  for (const auto &item : static_meshes)
+    object_count = std::max(object_count, item.object_index + 1);
+  if (frame.buffer == nullptr || object_count > frame.versions.size()) {
+    // grow by 1.5x to avoid reallocating every frame while loading, every
+    // object is written to the new buffer
+    const uint32_t capacity = std::max(object_count + object_count / 2, 64u);
+    frame.buffer = std::make_shared<Buffer>(
+        g_engine.getDriver(), capacity * sizeof(ObjectData),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 0,
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+            VMA_ALLOCATION_CREATE_MAPPED_BIT,
+        VMA_MEMORY_USAGE_AUTO_PREFER_HOST, MemoryClass::PerFrame);
+    frame.versions.assign(capacity, 0);
+  }
+
+  // object indices are unique, jobs write disjoint slots
+  auto *objects = reinterpret_cast<ObjectData *>(frame.buffer->getMappedData());
+  std::atomic<uint32_t> written{0};
+  g_engine.getJobSystem()->parallelFor(
+      0, static_meshes.size(), kObjectGrain, [&](size_t begin, size_t end) {
+        uint32_t count = 0;
+        for (size_t i = begin; i < end; ++i) {
+          const auto &item = static_meshes[i];
+          auto &version = frame.versions[item.object_index];
+          if (version == item.transform_version)
+            continue;
+          version = item.transform_version;
+          auto &object = objects[item.object_index];
+          object.m = item.transform;
+          const Eigen::Matrix3f nm =
+              item.transform.topLeftCorner<3, 3>().inverse().transpose();
+          for (int c = 0; c < 3; ++c)
+            object.nm[c] << nm.col(c), 0.0f;
+          ++count;
+        }
+        written.fetch_add(count, std::memory_order_relaxed);
+      });
+  written_count_ = written.load(std::memory_order_relaxed);
+  if (written_count_ > 0)
+    frame.buffer->flush(0, object_count * sizeof(ObjectData));
+}
+
+VkBuffer ObjectBuffer::getHandle(uint32_t frame_index) const {
+  const auto &buffer = frames_[frame_index].buffer;
+  return buffer != nullptr ? buffer->getHandle() : VK_NULL_HANDLE;
+}
+} // namespace mango
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <engine/functional/render/render_snapshot.h>
+#include <engine/utils/vk/vk_constants.h>
+#include <volk.h>
+
+namespace mango {
+class Buffer;
+
+/**
+ * @brief persistent per-object transforms, set PER_OBJECT_SET_INDEX binding 0
+ * of static_mesh.vert.
+ *
+ * Each static mesh entity owns the ObjectData slot of its object index. The
+ * buffers are persistently mapped, one per frame slot, and an object is only
+ * written when its transform version differs from the one last written to
+ * that slot, i.e. a moved object is written once by each of the next
+ * MAX_FRAMES_IN_FLIGHT frames and static objects cost nothing.
+ */
+class ObjectBuffer final {
+public:
+  ObjectBuffer() = default;
+
+  ~ObjectBuffer();
+
+  /**
+   * @brief write the objects of snapshot whose transform changed to the
+   * buffer of frame slot, the buffer grows when needed. Should be called
+   * after the frame fence is waited.
+   */
+  void update(const std::vector<StaticMeshSnapshot> &static_meshes,
+              uint32_t frame_index);
+
+  //! buffer of frame slot, recreated when it grows
+  VkBuffer getHandle(uint32_t frame_index) const;
+
+  //! objects written by the last update
+  uint32_t getWrittenCount() const { return written_count_; }
+
+  ObjectBuffer(const ObjectBuffer &) = delete;
+  ObjectBuffer &operator=(const ObjectBuffer &) = delete;
+
+private:
+  struct FrameResources {
+    std::shared_ptr<Buffer> buffer; //!< ObjectData, host visible, mapped
+    std::vector<uint64_t> versions; //!< transform version per slot, 0: never
+  };
+  FrameResources frames_[MAX_FRAMES_IN_FLIGHT];
+  uint32_t written_count_{0};
+};
+} // namespace mango
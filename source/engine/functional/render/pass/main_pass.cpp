@@ -8,8 +8,21 @@
 #include <engine/utils/vk/pipeline.h>
 #include <engine/utils/vk/resource_cache.h>
 #include <engine/utils/vk/shader_module.h>
+#include <engine/utils/base/macro.h>
+#include <engine/utils/job/job_system.h>
+#include <algorithm>
+#include <cstddef>
+#include <limits>
 
 namespace mango {
+//! phase of draws without occlusion culling
+constexpr uint32_t kDirectDraw = std::numeric_limits<uint32_t>::max();
+//! draws recorded by one secondary command buffer at least, smaller draw lists
+//! are recorded inline
+constexpr uint32_t kDrawsPerChunk = 1024;
+
+MainPass::~MainPass() = default;
+
 void MainPass::init() {
   // create pipeline state
   auto pipeline_state = std::make_unique<GPipelineState>();
@@ -32,6 +45,9 @@ void MainPass::init() {
   auto fs = std::make_shared<ShaderModule>();
   vs->load("shaders/static_mesh.vert");
   fs->load("shaders/forward_lighting.frag");
+  // per frame data from the uniform ring, see ResourceBindingMgr
+  fs->setResourceMode("_ULighting", ShaderResourceMode::Dynamic);
+  fs->setResourceMode("_UClusterParams", ShaderResourceMode::Dynamic);
   pipeline_state->setShaderModules({vs, fs});
 
   pipeline_state->setViewportState(ViewPortState{
@@ -71,26 +87,135 @@ void MainPass::init() {
   pipeline_ = std::make_shared<GraphicsPipeline>(
       driver, resource_cache, render_pass_, std::move(pipeline_state));
 
-  // using default color blend state: not blend
-  // create descriptor set
-  const auto &mat_set = pipeline_->getPipelineLayout()->getDescriptorSetLayout(1);
-  
+  // compatible render pass, loads the results of culling phase 0
+  load_render_pass_ = resource_cache->requestRenderPass(
+      driver,
+      {Attachment{.format = VK_FORMAT_R8G8B8A8_SRGB,
+                  .initial_layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL},
+       Attachment{.format = VK_FORMAT_D24_UNORM_S8_UINT,
+                  .initial_layout =
+                      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL}},
+      {LoadStoreInfo{.load_op = VK_ATTACHMENT_LOAD_OP_LOAD},
+       LoadStoreInfo{.load_op = VK_ATTACHMENT_LOAD_OP_LOAD}},
+      {SubpassInfo{.output_attachments = {0}, .depth_stencil_attachment = 1}});
+
+  // culled draws start at their group's instances, firstInstance != 0
+  occlusion_culling_enabled_ =
+      driver->isDeviceExtensionEnabled(
+          VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) &&
+      driver->getEnabledFeatures().drawIndirectFirstInstance;
+  if (occlusion_culling_enabled_)
+    occlusion_culler_.init();
+  else
+    LOGW("VK_KHR_draw_indirect_count or drawIndirectFirstInstance not "
+         "supported, gpu occlusion culling disabled");
 }
 
-void MainPass::render(const std::shared_ptr<CommandBuffer> &cmd_buffer) {
-  // assert(p_render_data_ != nullptr);
-  auto color_img_view = frame_buffer_->getRenderTarget()->getImageViews()[0];
-  color_img_view->transitionLayout(cmd_buffer->getHandle(),
-                                   VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-  cmd_buffer->beginRenderPass(render_pass_, frame_buffer_);
+void MainPass::prepareInstances() {
+  instance_slot_ = g_engine.getDriver()->getCurFrameIndex();
+  auto &instance_buffer = instance_buffers_[instance_slot_];
+  const auto &instances = render_data_->instances;
+  const auto instance_count = static_cast<uint32_t>(instances.size());
+  if (instance_buffer.buffer == nullptr ||
+      instance_count > instance_buffer.capacity) {
+    // grow by 1.5x to avoid reallocating every frame while loading
+    instance_buffer.capacity =
+        std::max(instance_count + instance_count / 2, 64u);
+    instance_buffer.buffer = std::make_shared<Buffer>(
+        g_engine.getDriver(), instance_buffer.capacity * sizeof(uint32_t),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 0,
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+            VMA_ALLOCATION_CREATE_MAPPED_BIT,
+        VMA_MEMORY_USAGE_AUTO_PREFER_HOST, MemoryClass::PerFrame);
+  }
+  if (instance_count > 0)
+    instance_buffer.buffer->update(instances.data(),
+                                   instance_count * sizeof(uint32_t));
+
+  // set 2 lives for this frame only, an unchanged object and instance buffer
+  // pair reuses the set of an earlier request in the frame
+  VkDescriptorBufferInfo buffer_infos[] = {
+      {.buffer = render_data_->object_buffer, .offset = 0, .range = VK_WHOLE_SIZE},
+      {.buffer = instance_buffer.buffer->getHandle(), .offset = 0, .range = VK_WHOLE_SIZE}};
+  std::vector<VkWriteDescriptorSet> writes;
+  // without objects there is no object buffer and nothing is drawn
+  for (uint32_t i = buffer_infos[0].buffer != VK_NULL_HANDLE ? 0 : 1; i < 2; ++i)
+    writes.emplace_back(VkWriteDescriptorSet{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstBinding = i,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &buffer_infos[i]});
+  auto desc_allocator =
+      g_engine.getResourceBindingMgr()->getTransientDescAllocator();
+  const auto &set_layout =
+      pipeline_->getPipelineLayout()->getDescriptorSetLayout(
+          PER_OBJECT_SET_INDEX);
+  instance_set_ = desc_allocator->request(set_layout, writes);
+  if (occlusion_culling_enabled_ && occlusion_culler_.isReady()) {
+    buffer_infos[1].buffer =
+        occlusion_culler_.getVisibleInstanceBuffer()->getHandle();
+    culled_instance_set_ = desc_allocator->request(set_layout, writes);
+  }
+}
+
+void MainPass::setFrameBuffer(const std::shared_ptr<FrameBuffer> &frame_buffer,
+                              const int width, const int height) {
+  frame_buffer_ = frame_buffer;
+  width_ = width;
+  height_ = height;
+  if (occlusion_culling_enabled_)
+    occlusion_culler_.setRenderTarget(frame_buffer_->getRenderTarget());
+}
+
+void MainPass::beginRenderPass(const std::shared_ptr<CommandBuffer> &cmd_buffer,
+                               const std::shared_ptr<RenderPass> &render_pass,
+                               VkSubpassContents contents) {
+  cmd_buffer->beginRenderPass(render_pass, frame_buffer_, contents);
+  if (contents == VK_SUBPASS_CONTENTS_INLINE)
+    setViewportScissor(cmd_buffer);
+}
+
+void MainPass::setViewportScissor(
+    const std::shared_ptr<CommandBuffer> &cmd_buffer) {
   cmd_buffer->setViewPort({VkViewport{0, static_cast<float>(height_), static_cast<float>(width_),
                                       -static_cast<float>(height_), 0.f, 1.f}});
   // cmd_buffer->setViewPort({VkViewport{0, 0, static_cast<float>(width_),
   //                                     static_cast<float>(height_), 0.f, 1.f}});  
   cmd_buffer->setScissor({VkRect2D{{0, 0}, {width_, height_}}});
-  if (render_data_ != nullptr)
-    draw(cmd_buffer, render_data_->static_mesh_render_data);
-  cmd_buffer->endRenderPass();
+}
+
+void MainPass::render(const std::shared_ptr<CommandBuffer> &cmd_buffer) {
+  // assert(p_render_data_ != nullptr);
+  auto color_img_view = frame_buffer_->getRenderTarget()->getImageViews()[0];
+  color_img_view->transitionLayout(cmd_buffer->getHandle(),
+                                   VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+  draw_stats_ = DrawStats{};
+  const CommandBufferStats cmd_stats = cmd_buffer->getStats();
+  // the culler's buffers are (re)allocated before the instance sets bind them
+  if (occlusion_culling_enabled_ && render_data_ != nullptr)
+    occlusion_culler_.prepare(*render_data_);
+  if (render_data_ != nullptr) {
+    prepareInstances();
+    draw_stats_.instances =
+        static_cast<uint32_t>(render_data_->instances.size());
+    draw_stats_.groups =
+        static_cast<uint32_t>(render_data_->static_mesh_render_data.size());
+    for (const auto &data : render_data_->static_mesh_render_data)
+      draw_stats_.draw_calls_uninstanced +=
+          data.instance_count * static_cast<uint32_t>(data.index_counts.size());
+  }
+  if (occlusion_culling_enabled_ && occlusion_culler_.isReady()) {
+    renderOcclusionCulled(cmd_buffer);
+  } else {
+    if (render_data_ != nullptr) {
+      drawGroups(cmd_buffer, render_pass_, kDirectDraw);
+    } else {
+      beginRenderPass(cmd_buffer, render_pass_, VK_SUBPASS_CONTENTS_INLINE);
+      cmd_buffer->endRenderPass();
+    }
+  }
+  draw_stats_.addCommandStats(cmd_buffer->getStats(), cmd_stats);
   // add image barrier
   color_img_view->transitionLayout(cmd_buffer->getHandle(),
                                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
@@ -108,23 +233,171 @@ void MainPass::render(const std::shared_ptr<CommandBuffer> &cmd_buffer) {
   //       frame_buffer_->getRenderTarget()->getImageViews()[0]);
 }
 
-void MainPass::draw(
-    const std::shared_ptr<CommandBuffer> &cmd_buffer,
-    const std::vector<StaticMeshRenderData> &static_meshe_datas) {
+void MainPass::renderOcclusionCulled(
+    const std::shared_ptr<CommandBuffer> &cmd_buffer) {
+  auto depth_img_view = frame_buffer_->getRenderTarget()->getImageViews().back();
+  depth_img_view->transitionLayout(
+      cmd_buffer->getHandle(), VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
 
+  // phase 0: draw objects visible in last frame's depth pyramid
+  occlusion_culler_.cull(cmd_buffer, 0);
+  drawGroups(cmd_buffer, render_pass_, 0);
+
+  // rebuild depth pyramid, retest the rejected objects
+  depth_img_view->transitionLayout(
+      cmd_buffer->getHandle(), VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+  occlusion_culler_.buildPyramid(cmd_buffer);
+  occlusion_culler_.cull(cmd_buffer, 1);
+  depth_img_view->transitionLayout(
+      cmd_buffer->getHandle(), VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+
+  // phase 1: draw the disoccluded objects on top of phase 0's color
+  cmd_buffer->memoryBarrier(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                            VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+                                VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+  drawGroups(cmd_buffer, load_render_pass_, 1);
+}
+
+void MainPass::bindPipeline(const std::shared_ptr<CommandBuffer> &cmd_buffer,
+                            uint32_t phase) {
+  const auto &resource_binding_mgr = g_engine.getResourceBindingMgr();
   cmd_buffer->bindPipeline(pipeline_);
-  cmd_buffer->bindDescriptorSets(pipeline_, {g_engine.getResourceBindingMgr()->getGlobalDescSet()}, {}, 0);
-  for (auto &data : static_meshe_datas) {
-    // descriptor set layout compatibility: https://registry.khronos.org/vulkan/specs/1.3-extensions/html/vkspec.html#descriptorsets-compatibility
-    cmd_buffer->bindDescriptorSets(pipeline_, {data.material_descriptor_set}, {}, 1);
-    cmd_buffer->pushConstants(pipeline_, VK_SHADER_STAGE_VERTEX_BIT, 0,
-                              sizeof(TransformPCO), &data.transform_pco);
+  // dynamic offsets in binding order
+  cmd_buffer->bindDescriptorSets(pipeline_, {resource_binding_mgr->getGlobalDescSet()},
+                                 {render_data_->lighting_offset,
+                                  render_data_->cluster_params_offset},
+                                 0);
+  cmd_buffer->bindDescriptorSets(pipeline_, {resource_binding_mgr->getMaterialDescSet(instance_slot_)}, {}, 1);
+  // culled draws read the phase's visible instance list, their firstInstance
+  // is the group's offset in it
+  const bool culled = phase != kDirectDraw;
+  cmd_buffer->bindDescriptorSets(
+      pipeline_, {culled ? culled_instance_set_ : instance_set_}, {}, 2);
+  MeshPCO pco{.view_proj = render_data_->proj_view,
+              .instance_base =
+                  culled ? occlusion_culler_.getInstanceBase(phase) : 0};
+  cmd_buffer->pushConstants(pipeline_, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                            sizeof(MeshPCO), &pco);
+}
+
+void MainPass::drawGroups(const std::shared_ptr<CommandBuffer> &cmd_buffer,
+                          const std::shared_ptr<RenderPass> &render_pass,
+                          uint32_t phase) {
+  const auto &datas = render_data_->static_mesh_render_data;
+  const size_t group_count = datas.size();
+  // a direct draw per sub mesh, or an indirect command per sub mesh
+  draw_offsets_.resize(group_count + 1);
+  draw_offsets_[0] = 0;
+  for (size_t i = 0; i < group_count; ++i)
+    draw_offsets_[i + 1] =
+        draw_offsets_[i] + static_cast<uint32_t>(datas[i].index_counts.size());
+
+  auto job_system = g_engine.getJobSystem();
+  const uint32_t draw_count = draw_offsets_.back();
+  const uint32_t chunk_count =
+      std::min(job_system->getThreadCount(), draw_count / kDrawsPerChunk);
+  if (chunk_count <= 1) {
+    beginRenderPass(cmd_buffer, render_pass, VK_SUBPASS_CONTENTS_INLINE);
+    recordGroups(cmd_buffer, 0, group_count, phase, draw_stats_);
+    cmd_buffer->endRenderPass();
+    return;
+  }
+
+  // chunk c records the groups whose first draw is in
+  // [draw_count * c / chunk_count, draw_count * (c + 1) / chunk_count)
+  auto chunkGroupBegin = [&](size_t c) -> size_t {
+    const uint32_t first_draw = static_cast<uint32_t>(
+        static_cast<uint64_t>(draw_count) * c / chunk_count);
+    return std::lower_bound(draw_offsets_.begin(), draw_offsets_.end() - 1,
+                            first_draw) -
+           draw_offsets_.begin();
+  };
+  auto &cmd_buffer_mgr =
+      g_engine.getDriver()->getThreadLocalCommandBufferManager();
+  cmd_buffer_mgr.reserveSecondarySlots(chunk_count);
+  secondary_cmd_buffers_.assign(chunk_count, nullptr);
+  chunk_stats_.assign(chunk_count, DrawStats{});
+  job_system->parallelFor(0, chunk_count, 1, [&](size_t begin, size_t end) {
+    for (size_t c = begin; c < end; ++c) {
+      const size_t group_begin = chunkGroupBegin(c);
+      const size_t group_end =
+          c + 1 == chunk_count ? group_count : chunkGroupBegin(c + 1);
+      if (group_begin == group_end)
+        continue;
+      auto secondary = cmd_buffer_mgr.requestSecondaryCommandBuffer(
+          static_cast<uint32_t>(c), render_pass, 0, frame_buffer_);
+      setViewportScissor(secondary);
+      recordGroups(secondary, group_begin, group_end, phase, chunk_stats_[c]);
+      secondary->end();
+      chunk_stats_[c].addCommandStats(secondary->getStats());
+      secondary_cmd_buffers_[c] = std::move(secondary);
+    }
+  });
+  secondary_cmd_buffers_.erase(std::remove(secondary_cmd_buffers_.begin(),
+                                           secondary_cmd_buffers_.end(),
+                                           nullptr),
+                               secondary_cmd_buffers_.end());
+  for (const auto &chunk_stats : chunk_stats_)
+    draw_stats_.addRecorded(chunk_stats);
+  draw_stats_.secondary_cmd_buffers +=
+      static_cast<uint32_t>(secondary_cmd_buffers_.size());
+
+  beginRenderPass(cmd_buffer, render_pass,
+                  VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+  cmd_buffer->executeCommands(secondary_cmd_buffers_);
+  cmd_buffer->endRenderPass();
+  secondary_cmd_buffers_.clear();
+}
+
+void MainPass::recordGroups(const std::shared_ptr<CommandBuffer> &cmd_buffer,
+                            size_t begin, size_t end, uint32_t phase,
+                            DrawStats &stats) {
+  const auto &datas = render_data_->static_mesh_render_data;
+  bindPipeline(cmd_buffer, phase);
+  // materials are bindless, a group only pushes its material index. Redundant
+  // binds between groups sharing material or mesh are filtered by the command
+  // buffer
+  auto bindStaticMesh = [&](const StaticMeshRenderData &data) {
+    cmd_buffer->pushConstants(pipeline_, VK_SHADER_STAGE_VERTEX_BIT,
+                              offsetof(MeshPCO, material_index),
+                              sizeof(uint32_t), &data.material_index);
     cmd_buffer->bindVertexBuffers({data.vertex_buffer}, {0}, 0);
     cmd_buffer->bindIndexBuffer(data.index_buffer, 0, VK_INDEX_TYPE_UINT32);
-    for (auto i = 0; i < data.index_counts.size(); ++i) {
-      cmd_buffer->drawIndexed(data.index_counts[i], 1, data.first_index[i], 0,
-                              0);
+  };
+
+  if (phase == kDirectDraw) {
+    for (size_t g = begin; g < end; ++g) {
+      const auto &data = datas[g];
+      bindStaticMesh(data);
+      cmd_buffer->pushConstants(pipeline_, VK_SHADER_STAGE_VERTEX_BIT,
+                                offsetof(MeshPCO, instance_base),
+                                sizeof(uint32_t), &data.first_instance);
+      for (size_t i = 0; i < data.index_counts.size(); ++i) {
+        cmd_buffer->drawIndexed(data.index_counts[i], data.instance_count,
+                                data.first_index[i], 0, 0);
+        ++stats.draw_calls;
+      }
     }
+    return;
+  }
+
+  const auto &command_buffer = occlusion_culler_.getDrawCommandBuffer();
+  const auto &count_buffer = occlusion_culler_.getDrawCountBuffer();
+  for (size_t g = begin; g < end; ++g) {
+    const auto &data = datas[g];
+    const auto command_count = static_cast<uint32_t>(data.index_counts.size());
+    bindStaticMesh(data);
+    // the visible instances of the group are compacted by the culler, the
+    // draw count is 0 if all are culled
+    cmd_buffer->drawIndexedIndirectCount(
+        command_buffer,
+        occlusion_culler_.getDrawCommandOffset(phase, draw_offsets_[g]),
+        count_buffer,
+        occlusion_culler_.getDrawCountOffset(phase, static_cast<uint32_t>(g)),
+        command_count, sizeof(VkDrawIndexedIndirectCommand));
+    ++stats.draw_calls;
   }
 }
 
@@ -1,34 +1,104 @@
 #pragma once
 
+#include <engine/functional/render/pass/occlusion_culling.h>
 #include <engine/functional/render/pass/render_data.h>
 #include <engine/functional/render/pass/render_pass.h>
 namespace mango {
-class RenderData;
 class FrameBuffer;
 class MainPass final : public CustomRenderPass {
 public:
   MainPass() = default;
-  ~MainPass() override = default;
+  ~MainPass() override;
 
   void init() override;
 
   void render(const std::shared_ptr<CommandBuffer> &cmd_buffer) override;
 
-  void setRenderData(const std::shared_ptr<RenderData> &render_data) {
+  /**
+   * @brief render data of the frame, lives until the frame slot is reused
+   */
+  void setRenderData(const RenderData *render_data) {
     render_data_ = render_data;
   }
 
   void setFrameBuffer(const std::shared_ptr<FrameBuffer> &frame_buffer,
-                      const int width, const int height) {
-    frame_buffer_ = frame_buffer;
-    width_ = width;
-    height_ = height;
+                      const int width, const int height);
+
+  const OcclusionStats &getOcclusionStats() const {
+    return occlusion_culler_.getStats();
   }
 
+  const DrawStats &getDrawStats() const { return draw_stats_; }
+
 protected:
-  void draw(const std::shared_ptr<CommandBuffer> &cmd_buffer,
-            const std::vector<StaticMeshRenderData> &static_meshs);
-  std::shared_ptr<RenderData> render_data_;
+  /**
+   * @brief upload instance object indices of the render data to the instance
+   * buffer of current frame slot, the buffer grows when needed, and bind the
+   * frame slot's object buffer. With occlusion culling a second set binds the
+   * culler's visible instance lists instead.
+   */
+  void prepareInstances();
+
+  /**
+   * @brief bind pipeline, global set, bindless material set and the instance
+   * set of phase, push view projection
+   */
+  void bindPipeline(const std::shared_ptr<CommandBuffer> &cmd_buffer,
+                    uint32_t phase);
+
+  /**
+   * @brief draw all groups in render_pass. Large draw lists are split into
+   * chunks of groups with about the same number of draws, each chunk is
+   * recorded into a secondary command buffer on the job system and executed
+   * from cmd_buffer.
+   * @param phase occlusion culling phase, kDirectDraw without occlusion culling
+   */
+  void drawGroups(const std::shared_ptr<CommandBuffer> &cmd_buffer,
+                  const std::shared_ptr<RenderPass> &render_pass,
+                  uint32_t phase);
+
+  /**
+   * @brief record the draws of groups [begin, end) in their sorted order
+   * @param stats draw calls are added to it
+   */
+  void recordGroups(const std::shared_ptr<CommandBuffer> &cmd_buffer,
+                    size_t begin, size_t end, uint32_t phase,
+                    DrawStats &stats);
+
+  /**
+   * @brief two phase occlusion culled rendering, see OcclusionCuller
+   */
+  void renderOcclusionCulled(const std::shared_ptr<CommandBuffer> &cmd_buffer);
+
+  void beginRenderPass(const std::shared_ptr<CommandBuffer> &cmd_buffer,
+                       const std::shared_ptr<RenderPass> &render_pass,
+                       VkSubpassContents contents);
+
+  void setViewportScissor(const std::shared_ptr<CommandBuffer> &cmd_buffer);
+
+  const RenderData *render_data_{nullptr};
   std::shared_ptr<FrameBuffer> frame_buffer_;
+
+  std::shared_ptr<RenderPass> load_render_pass_; //!< keep phase 0's results
+  OcclusionCuller occlusion_culler_;
+  //! VK_KHR_draw_indirect_count and drawIndirectFirstInstance
+  bool occlusion_culling_enabled_{false};
+
+  struct InstanceBuffer {
+    std::shared_ptr<Buffer> buffer; //!< object indices, host visible
+    uint32_t capacity{0};
+  };
+  InstanceBuffer instance_buffers_[MAX_FRAMES_IN_FLIGHT];
+  uint32_t instance_slot_{0};
+  //! set 2 of static_mesh.vert, transient: object buffer + instance buffer
+  VkDescriptorSet instance_set_{VK_NULL_HANDLE};
+  //! set 2 of occlusion culled draws: object buffer + visible instance lists
+  VkDescriptorSet culled_instance_set_{VK_NULL_HANDLE};
+  DrawStats draw_stats_;
+
+  //! prefix sum of draws per group, also the first indirect command of groups
+  std::vector<uint32_t> draw_offsets_;
+  std::vector<std::shared_ptr<CommandBuffer>> secondary_cmd_buffers_;
+  std::vector<DrawStats> chunk_stats_;
 };
 } // namespace mango
\ No newline at end of file
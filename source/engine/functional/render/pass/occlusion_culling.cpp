@@ -0,0 +1,396 @@
+#include <engine/functional/render/pass/occlusion_culling.h>
+
+#include <engine/functional/global/engine_context.h>
+#include <engine/utils/vk/commands.h>
+#include <engine/utils/vk/descriptor_set.h>
+#include <engine/utils/vk/framebuffer.h>
+#include <engine/utils/vk/image.h>
+#include <engine/utils/vk/pipeline.h>
+#include <engine/utils/vk/resource_cache.h>
+#include <engine/utils/vk/sampler.h>
+#include <engine/utils/vk/shader_module.h>
+#include <algorithm>
+
+namespace mango {
+constexpr uint32_t kMaxPyramidLevels = 16;
+constexpr uint32_t kCullGroupSize = 64; // local_size_x of occlusion_cull.comp
+constexpr uint32_t kHizGroupSize = 8;   // local_size_x/y of hiz_reduce.comp
+
+struct HizReducePCO {
+  int32_t src_size[2];
+  int32_t dst_size[2];
+};
+
+static uint32_t previousPow2(uint32_t v) {
+  uint32_t r = 1;
+  while (r * 2 <= v)
+    r *= 2;
+  return r;
+}
+
+OcclusionCuller::~OcclusionCuller() {
+  // descriptor sets should be freed before the pool
+  hiz_sets_.clear();
+  for (auto &frame : frames_)
+    frame.cull_set.reset();
+  desc_pool_.reset();
+}
+
+void OcclusionCuller::init() {
+  auto driver = g_engine.getDriver();
+  auto resource_cache = g_engine.getResourceCache();
+  auto hiz_cs = std::make_shared<ShaderModule>();
+  hiz_cs->load("shaders/hiz_reduce.comp");
+  hiz_pipeline_ =
+      std::make_shared<ComputePipeline>(driver, resource_cache, hiz_cs);
+  auto cull_cs = std::make_shared<ShaderModule>();
+  cull_cs->load("shaders/occlusion_cull.comp");
+  cull_pipeline_ =
+      std::make_shared<ComputePipeline>(driver, resource_cache, cull_cs);
+
+  VkDescriptorPoolSize pool_sizes[] = {
+      {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+       kMaxPyramidLevels + MAX_FRAMES_IN_FLIGHT},
+      {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, kMaxPyramidLevels},
+      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 7 * MAX_FRAMES_IN_FLIGHT},
+  };
+  desc_pool_ = std::make_unique<DescriptorPool>(
+      driver, VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT, pool_sizes,
+      sizeof(pool_sizes) / sizeof(pool_sizes[0]),
+      kMaxPyramidLevels + MAX_FRAMES_IN_FLIGHT);
+  sampler_ = resource_cache->requestSampler(
+      driver, VK_FILTER_NEAREST, VK_FILTER_NEAREST,
+      VK_SAMPLER_MIPMAP_MODE_NEAREST, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+      VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+}
+
+void OcclusionCuller::setRenderTarget(
+    const std::shared_ptr<RenderTarget> &render_target) {
+  auto driver = g_engine.getDriver();
+  // the last image view is the depth stencil attachment
+  auto ds_view = render_target->getImageViews().back();
+  depth_width_ = render_target->getWidth();
+  depth_height_ = render_target->getHeight();
+  depth_view_ = std::make_shared<ImageView>(
+      ds_view->getImage(), VK_IMAGE_VIEW_TYPE_2D,
+      render_target->getDSFormat(), VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, 1, 1);
+
+  // level 0 is the previous power of 2 of depth size, so each level halves
+  pyramid_width_ = previousPow2(depth_width_);
+  pyramid_height_ = previousPow2(depth_height_);
+  uint32_t levels = 1;
+  while (levels < kMaxPyramidLevels &&
+         (std::max(pyramid_width_, pyramid_height_) >> levels) > 0)
+    ++levels;
+
+  hiz_sets_.clear();
+  pyramid_mip_views_.clear();
+  pyramid_view_.reset();
+  pyramid_ = std::make_shared<Image>(
+      driver, 0, VK_FORMAT_R32_SFLOAT,
+      VkExtent3D{pyramid_width_, pyramid_height_, 1}, levels, 1,
+      VK_SAMPLE_COUNT_1_BIT,
+      VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+      VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+  pyramid_view_ = std::make_shared<ImageView>(
+      pyramid_, VK_IMAGE_VIEW_TYPE_2D, VK_FORMAT_R32_SFLOAT,
+      VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, levels, 1);
+  pyramid_valid_ = false;
+
+  const auto &set_layout =
+      hiz_pipeline_->getPipelineLayout()->getDescriptorSetLayout(0);
+  std::vector<VkWriteDescriptorSet> writes;
+  std::vector<VkDescriptorImageInfo> image_infos(2 * levels);
+  for (uint32_t i = 0; i < levels; ++i) {
+    pyramid_mip_views_.emplace_back(std::make_shared<ImageView>(
+        pyramid_, VK_IMAGE_VIEW_TYPE_2D, VK_FORMAT_R32_SFLOAT,
+        VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1, 1));
+    hiz_sets_.emplace_back(desc_pool_->requestDescriptorSet(set_layout));
+
+    auto &src_info = image_infos[2 * i];
+    src_info.sampler = sampler_->getHandle();
+    src_info.imageView = (i == 0) ? depth_view_->getHandle()
+                                  : pyramid_mip_views_[i - 1]->getHandle();
+    src_info.imageLayout = (i == 0)
+                               ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+                               : VK_IMAGE_LAYOUT_GENERAL;
+    auto &dst_info = image_infos[2 * i + 1];
+    dst_info.sampler = VK_NULL_HANDLE;
+    dst_info.imageView = pyramid_mip_views_[i]->getHandle();
+    dst_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    writes.emplace_back(VkWriteDescriptorSet{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = hiz_sets_[i]->getHandle(),
+        .dstBinding = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        .pImageInfo = &src_info});
+    writes.emplace_back(VkWriteDescriptorSet{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = hiz_sets_[i]->getHandle(),
+        .dstBinding = 1,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+        .pImageInfo = &dst_info});
+  }
+  driver->update(writes);
+
+  // cull sets reference the old pyramid
+  for (auto &frame : frames_) {
+    if (frame.cull_set != nullptr)
+      updateCullSet(frame);
+  }
+}
+
+void OcclusionCuller::reserve(FrameResources &frame, uint32_t object_count,
+                              uint32_t group_count, uint32_t command_count) {
+  if (object_count <= frame.object_capacity &&
+      group_count <= frame.group_capacity &&
+      command_count <= frame.command_capacity && frame.cull_set != nullptr)
+    return;
+  auto driver = g_engine.getDriver();
+  // grow by 1.5x to avoid reallocating every frame while loading
+  if (object_count > frame.object_capacity)
+    frame.object_capacity = std::max(object_count + object_count / 2, 64u);
+  if (group_count > frame.group_capacity)
+    frame.group_capacity = std::max(group_count + group_count / 2, 64u);
+  if (command_count > frame.command_capacity)
+    frame.command_capacity = std::max(command_count + command_count / 2, 64u);
+  const VkDeviceSize command_size = sizeof(VkDrawIndexedIndirectCommand);
+  frame.objects = std::make_shared<Buffer>(
+      driver, frame.object_capacity * sizeof(CullObject),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 0,
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+          VMA_ALLOCATION_CREATE_MAPPED_BIT,
+      VMA_MEMORY_USAGE_AUTO_PREFER_HOST, MemoryClass::PerFrame);
+  frame.templates = std::make_shared<Buffer>(
+      driver, frame.command_capacity * command_size,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 0,
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+          VMA_ALLOCATION_CREATE_MAPPED_BIT,
+      VMA_MEMORY_USAGE_AUTO_PREFER_HOST, MemoryClass::PerFrame);
+  frame.draw_commands = std::make_shared<Buffer>(
+      driver, 2 * frame.command_capacity * command_size,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+          VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      0, 0, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+  frame.draw_counts = std::make_shared<Buffer>(
+      driver, 2 * frame.group_capacity * sizeof(uint32_t),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+          VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      0, 0, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+  frame.visible_instances = std::make_shared<Buffer>(
+      driver, 2 * frame.object_capacity * sizeof(uint32_t),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 0, 0,
+      VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+  frame.visibility = std::make_shared<Buffer>(
+      driver, frame.object_capacity * sizeof(uint32_t),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 0, 0,
+      VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+  if (frame.stats == nullptr)
+    frame.stats = std::make_shared<Buffer>(
+        driver, 4 * sizeof(uint32_t),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        0,
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT |
+            VMA_ALLOCATION_CREATE_MAPPED_BIT,
+        VMA_MEMORY_USAGE_AUTO_PREFER_HOST);
+  if (frame.cull_set == nullptr)
+    frame.cull_set = desc_pool_->requestDescriptorSet(
+        cull_pipeline_->getPipelineLayout()->getDescriptorSetLayout(0));
+  updateCullSet(frame);
+}
+
+void OcclusionCuller::updateCullSet(FrameResources &frame) {
+  if (pyramid_view_ == nullptr || frame.objects == nullptr)
+    return;
+  VkDescriptorImageInfo pyramid_info{.sampler = sampler_->getHandle(),
+                                     .imageView = pyramid_view_->getHandle(),
+                                     .imageLayout = VK_IMAGE_LAYOUT_GENERAL};
+  const std::shared_ptr<Buffer> *buffers[] = {
+      &frame.objects,     &frame.templates,  &frame.draw_commands,
+      &frame.draw_counts, &frame.visibility, &frame.stats,
+      &frame.visible_instances};
+  constexpr uint32_t buffer_count = sizeof(buffers) / sizeof(buffers[0]);
+  VkDescriptorBufferInfo buffer_infos[buffer_count];
+  std::vector<VkWriteDescriptorSet> writes;
+  writes.emplace_back(VkWriteDescriptorSet{
+      .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+      .dstSet = frame.cull_set->getHandle(),
+      .dstBinding = 0,
+      .descriptorCount = 1,
+      .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+      .pImageInfo = &pyramid_info});
+  for (uint32_t i = 0; i < buffer_count; ++i) {
+    buffer_infos[i] = VkDescriptorBufferInfo{
+        .buffer = (*buffers[i])->getHandle(), .offset = 0, .range = VK_WHOLE_SIZE};
+    writes.emplace_back(VkWriteDescriptorSet{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = frame.cull_set->getHandle(),
+        .dstBinding = i + 1,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &buffer_infos[i]});
+  }
+  g_engine.getDriver()->update(writes);
+}
+
+void OcclusionCuller::prepare(const RenderData &render_data) {
+  cur_slot_ = g_engine.getDriver()->getCurFrameIndex();
+  auto &frame = frames_[cur_slot_];
+  // the frame fence of this slot is waited, stats are ready
+  if (frame.stats_pending) {
+    uint32_t stats[4];
+    frame.stats->read(stats, sizeof(stats));
+    stats_.tested = stats[0];
+    stats_.occluded = stats[1];
+    stats_.disoccluded = stats[2];
+    frame.stats_pending = false;
+  }
+
+  cull_objects_.clear();
+  command_templates_.clear();
+  uint32_t group = 0;
+  for (const auto &data : render_data.static_mesh_render_data) {
+    const auto first_command = static_cast<uint32_t>(command_templates_.size());
+    const auto command_count = static_cast<uint32_t>(data.index_counts.size());
+    // instanceCount is counted by the shader
+    for (uint32_t j = 0; j < command_count; ++j) {
+      command_templates_.emplace_back(VkDrawIndexedIndirectCommand{
+          .indexCount = data.index_counts[j],
+          .instanceCount = 0,
+          .firstIndex = data.first_index[j],
+          .vertexOffset = 0,
+          .firstInstance = data.first_instance});
+    }
+    for (uint32_t i = 0; i < data.instance_count; ++i) {
+      const auto &world_aabb =
+          render_data.instance_aabbs[data.first_instance + i];
+      CullObject obj;
+      const bool valid = !world_aabb.isEmpty();
+      obj.aabb_min.head<3>() =
+          valid ? world_aabb.min() : Eigen::Vector3f::Zero();
+      obj.aabb_min.w() = valid ? 1.0f : 0.0f;
+      obj.aabb_max.head<3>() =
+          valid ? world_aabb.max() : Eigen::Vector3f::Zero();
+      obj.aabb_max.w() = 0.0f;
+      obj.first_command = first_command;
+      obj.command_count = command_count;
+      obj.object_index = render_data.instances[data.first_instance + i];
+      obj.group = group;
+      cull_objects_.emplace_back(obj);
+    }
+    ++group;
+  }
+  object_count_ = static_cast<uint32_t>(cull_objects_.size());
+  group_count_ = group;
+  proj_view_ = render_data.proj_view;
+  if (object_count_ == 0)
+    return;
+
+  const auto command_count = static_cast<uint32_t>(command_templates_.size());
+  reserve(frame, object_count_, group_count_, command_count);
+  frame.objects->update(cull_objects_.data(),
+                        object_count_ * sizeof(CullObject));
+  if (command_count > 0)
+    frame.templates->update(command_templates_.data(),
+                            command_count *
+                                sizeof(VkDrawIndexedIndirectCommand));
+}
+
+void OcclusionCuller::cull(const std::shared_ptr<CommandBuffer> &cmd_buffer,
+                           uint32_t phase) {
+  auto &frame = frames_[cur_slot_];
+  pyramid_view_->transitionLayout(cmd_buffer->getHandle(),
+                                  VK_IMAGE_LAYOUT_GENERAL);
+  if (phase == 0)
+    cmd_buffer->fillBuffer(frame.stats, 0, VK_WHOLE_SIZE, 0);
+  // the shader counts instances into the commands and sets the counts of
+  // groups with visible instances
+  const VkDeviceSize command_size = sizeof(VkDrawIndexedIndirectCommand);
+  const auto command_count = static_cast<uint32_t>(command_templates_.size());
+  if (command_count > 0)
+    cmd_buffer->copyBuffer(frame.templates, 0, frame.draw_commands,
+                           phase * frame.command_capacity * command_size,
+                           command_count * command_size);
+  cmd_buffer->fillBuffer(frame.draw_counts,
+                         phase * frame.group_capacity * sizeof(uint32_t),
+                         group_count_ * sizeof(uint32_t), 0);
+  cmd_buffer->memoryBarrier(
+      VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_ACCESS_TRANSFER_WRITE_BIT,
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+  OcclusionCullPCO pco;
+  pco.view_proj = proj_view_;
+  pco.pyramid_size =
+      Eigen::Vector4f(static_cast<float>(pyramid_width_),
+                      static_cast<float>(pyramid_height_),
+                      static_cast<float>(pyramid_mip_views_.size()),
+                      pyramid_valid_ ? 1.0f : 0.0f);
+  pco.object_count = object_count_;
+  pco.phase = phase;
+  pco.command_base = phase * frame.command_capacity;
+  pco.count_base = phase * frame.group_capacity;
+  pco.instance_base = phase * frame.object_capacity;
+  pco.padding0 = pco.padding1 = pco.padding2 = 0;
+
+  cmd_buffer->bindPipeline(cull_pipeline_);
+  cmd_buffer->bindDescriptorSets(cull_pipeline_, {frame.cull_set}, {}, 0);
+  cmd_buffer->pushConstants(cull_pipeline_, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                            sizeof(OcclusionCullPCO), &pco);
+  cmd_buffer->dispatch((object_count_ + kCullGroupSize - 1) / kCullGroupSize,
+                       1, 1);
+  // commands and counts are read by the indirect draws, the instance lists by
+  // static_mesh.vert
+  cmd_buffer->memoryBarrier(
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+      VK_ACCESS_SHADER_WRITE_BIT,
+      VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+  if (phase == 1) {
+    cmd_buffer->memoryBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                              VK_PIPELINE_STAGE_HOST_BIT,
+                              VK_ACCESS_SHADER_WRITE_BIT,
+                              VK_ACCESS_HOST_READ_BIT);
+    frame.stats_pending = true;
+  }
+}
+
+void OcclusionCuller::buildPyramid(
+    const std::shared_ptr<CommandBuffer> &cmd_buffer) {
+  pyramid_view_->transitionLayout(cmd_buffer->getHandle(),
+                                  VK_IMAGE_LAYOUT_GENERAL);
+  // phase 0 reads the pyramid and writes visibility
+  cmd_buffer->memoryBarrier(
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+  cmd_buffer->bindPipeline(hiz_pipeline_);
+  uint32_t src_width = depth_width_;
+  uint32_t src_height = depth_height_;
+  for (uint32_t i = 0; i < pyramid_mip_views_.size(); ++i) {
+    const uint32_t dst_width = std::max(pyramid_width_ >> i, 1u);
+    const uint32_t dst_height = std::max(pyramid_height_ >> i, 1u);
+    HizReducePCO pco{{static_cast<int32_t>(src_width),
+                      static_cast<int32_t>(src_height)},
+                     {static_cast<int32_t>(dst_width),
+                      static_cast<int32_t>(dst_height)}};
+    cmd_buffer->bindDescriptorSets(hiz_pipeline_, {hiz_sets_[i]}, {}, 0);
+    cmd_buffer->pushConstants(hiz_pipeline_, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                              sizeof(HizReducePCO), &pco);
+    cmd_buffer->dispatch((dst_width + kHizGroupSize - 1) / kHizGroupSize,
+                         (dst_height + kHizGroupSize - 1) / kHizGroupSize, 1);
+    cmd_buffer->memoryBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                              VK_ACCESS_SHADER_WRITE_BIT,
+                              VK_ACCESS_SHADER_READ_BIT);
+    src_width = dst_width;
+    src_height = dst_height;
+  }
+  pyramid_valid_ = true;
+}
+} // namespace mango
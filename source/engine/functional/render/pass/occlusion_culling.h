@@ -0,0 +1,167 @@
+#pragma once
+
+#include <engine/functional/render/pass/render_data.h>
+#include <engine/utils/vk/vk_constants.h>
+#include <memory>
+#include <vector>
+
+namespace mango {
+class Image;
+class ImageView;
+class RenderTarget;
+class CommandBuffer;
+class ComputePipeline;
+class DescriptorPool;
+class DescriptorSet;
+class Sampler;
+
+struct OcclusionStats {
+  uint32_t tested{0};      //!< objects tested in phase 0
+  uint32_t occluded{0};    //!< objects drawn in neither phase
+  uint32_t disoccluded{0}; //!< occluded by last frame's depth, drawn in phase 1
+};
+
+/**
+ * @brief two phase gpu occlusion culling with a hierarchical depth pyramid.
+ *
+ * phase 0: test objects against last frame's depth pyramid, visible ones are
+ * drawn. Then the pyramid is rebuilt from the new depth buffer.
+ * phase 1: retest the rejected objects against the new pyramid, the ones
+ * turned visible are drawn on top.
+ *
+ * Objects are tested one by one, visible ones are compacted into the instance
+ * list of their group (static mesh render data). Each group has one
+ * VkDrawIndexedIndirectCommand per sub mesh, the shader counts the visible
+ * instances into instanceCount, firstInstance is the group's first instance,
+ * and writes a draw count per group (0 if no instance is visible), so a group
+ * is one vkCmdDrawIndexedIndirectCount per phase.
+ */
+class OcclusionCuller final {
+public:
+  OcclusionCuller() = default;
+
+  ~OcclusionCuller();
+
+  void init();
+
+  /**
+   * @brief recreate depth pyramid and its descriptor sets, called after the
+   * render target is resized. The device should be idle.
+   */
+  void setRenderTarget(const std::shared_ptr<RenderTarget> &render_target);
+
+  /**
+   * @brief upload cull objects and draw command templates of current frame,
+   * and read back the stats of the last frame using the same frame slot.
+   * Objects are the instances of render data, object i is instance i, commands
+   * are the sub meshes of the groups in order.
+   * Should be called after the frame fence is waited.
+   */
+  void prepare(const RenderData &render_data);
+
+  /**
+   * @brief reset the phase's commands and counts, dispatch culling of phase 0
+   * or 1, followed by a barrier for indirect draws
+   */
+  void cull(const std::shared_ptr<CommandBuffer> &cmd_buffer, uint32_t phase);
+
+  /**
+   * @brief build depth pyramid from the depth buffer, depth image should be
+   * in VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+   */
+  void buildPyramid(const std::shared_ptr<CommandBuffer> &cmd_buffer);
+
+  bool isReady() const { return pyramid_ != nullptr && object_count_ > 0; }
+
+  const std::shared_ptr<Buffer> &getDrawCommandBuffer() const {
+    return frames_[cur_slot_].draw_commands;
+  }
+
+  const std::shared_ptr<Buffer> &getDrawCountBuffer() const {
+    return frames_[cur_slot_].draw_counts;
+  }
+
+  /**
+   * @brief object indices of the visible instances of both phases, read by
+   * static_mesh.vert instead of the instance buffer
+   */
+  const std::shared_ptr<Buffer> &getVisibleInstanceBuffer() const {
+    return frames_[cur_slot_].visible_instances;
+  }
+
+  /**
+   * @brief instance_base of the phase's draws, firstInstance of the commands
+   * is relative to it
+   */
+  uint32_t getInstanceBase(uint32_t phase) const {
+    return phase * frames_[cur_slot_].object_capacity;
+  }
+
+  VkDeviceSize getDrawCommandOffset(uint32_t phase,
+                                    uint32_t first_command) const {
+    return (phase * frames_[cur_slot_].command_capacity + first_command) *
+           sizeof(VkDrawIndexedIndirectCommand);
+  }
+
+  VkDeviceSize getDrawCountOffset(uint32_t phase, uint32_t group) const {
+    return (phase * frames_[cur_slot_].group_capacity + group) *
+           sizeof(uint32_t);
+  }
+
+  /**
+   * @brief stats read back from gpu, MAX_FRAMES_IN_FLIGHT frames latency
+   */
+  const OcclusionStats &getStats() const { return stats_; }
+
+  OcclusionCuller(const OcclusionCuller &) = delete;
+  OcclusionCuller &operator=(const OcclusionCuller &) = delete;
+
+private:
+  struct FrameResources {
+    std::shared_ptr<Buffer> objects;       //!< CullObject, host visible
+    std::shared_ptr<Buffer> templates;     //!< draw commands of all groups
+    std::shared_ptr<Buffer> draw_commands; //!< output commands of 2 phases
+    std::shared_ptr<Buffer> draw_counts;   //!< output group counts of 2 phases
+    std::shared_ptr<Buffer> visible_instances; //!< instance lists of 2 phases
+    std::shared_ptr<Buffer> visibility;    //!< phase 0 result per object
+    std::shared_ptr<Buffer> stats;         //!< OcclusionStats read back
+    std::shared_ptr<DescriptorSet> cull_set;
+    uint32_t object_capacity{0};
+    uint32_t group_capacity{0};
+    uint32_t command_capacity{0};
+    bool stats_pending{false};
+  };
+
+  void reserve(FrameResources &frame, uint32_t object_count,
+               uint32_t group_count, uint32_t command_count);
+
+  void updateCullSet(FrameResources &frame);
+
+  std::shared_ptr<ComputePipeline> hiz_pipeline_;
+  std::shared_ptr<ComputePipeline> cull_pipeline_;
+  std::unique_ptr<DescriptorPool> desc_pool_;
+  std::shared_ptr<Sampler> sampler_; //!< nearest, clamp to edge
+
+  std::shared_ptr<ImageView> depth_view_; //!< depth aspect only
+  std::shared_ptr<Image> pyramid_;        //!< R32_SFLOAT, max depth
+  std::shared_ptr<ImageView> pyramid_view_; //!< all mips
+  std::vector<std::shared_ptr<ImageView>> pyramid_mip_views_;
+  std::vector<std::shared_ptr<DescriptorSet>> hiz_sets_; //!< one per mip
+  uint32_t depth_width_{0};
+  uint32_t depth_height_{0};
+  uint32_t pyramid_width_{0};
+  uint32_t pyramid_height_{0};
+  bool pyramid_valid_{false}; //!< pyramid has been built at least once
+
+  FrameResources frames_[MAX_FRAMES_IN_FLIGHT];
+  uint32_t cur_slot_{0};
+
+  std::vector<CullObject> cull_objects_;
+  std::vector<VkDrawIndexedIndirectCommand> command_templates_;
+  uint32_t object_count_{0};
+  uint32_t group_count_{0};
+  Eigen::Matrix4f proj_view_;
+
+  OcclusionStats stats_;
+};
+} // namespace mango
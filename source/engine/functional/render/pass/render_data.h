@@ -1,23 +1,118 @@
 #pragma once
 
+#include <Eigen/Geometry>
+#include <span>
 #include <engine/utils/vk/buffer.h>
+#include <engine/utils/vk/commands.h>
 #include <shaders/include/shader_structs.h>
 
 namespace mango {
-class DescriptorSet;
+
+/**
+ * @brief visible instances sharing the same mesh and material, drawn with one
+ * instanced draw per sub mesh. Allocated from the frame allocator, holds raw
+ * handles and spans only, the buffers and materials are kept alive by the
+ * render snapshot.
+ */
 struct StaticMeshRenderData {
-  std::shared_ptr<Buffer> vertex_buffer; //!< vertex buffer 3 float position | 3
-                                         //!< float normal | 2 float uv
-  std::shared_ptr<Buffer> index_buffer;  //!< index buffer uint32_t  
-  std::shared_ptr<DescriptorSet> material_descriptor_set;
+  VkBuffer vertex_buffer; //!< vertex buffer 3 float position | 3
+                          //!< float normal | 2 float uv
+  VkBuffer index_buffer;  //!< index buffer uint32_t
+  uint32_t material_index; //!< in the bindless material buffer
   VkPrimitiveTopology topology;
-  TransformPCO transform_pco;
-  std::vector<uint32_t> index_counts;
-  std::vector<uint32_t> first_index;
+  std::span<const uint32_t> index_counts;
+  std::span<const uint32_t> first_index;
+  uint32_t first_instance{0}; //!< in RenderData::instances
+  uint32_t instance_count{0};
+};
+
+/**
+ * @brief world aabb of an instance. Unlike Eigen::AlignedBox3f it's trivially
+ * destructible, so it can be put in the frame allocator.
+ */
+struct InstanceBounds {
+  Eigen::Vector3f lower;
+  Eigen::Vector3f upper;
+
+  InstanceBounds &operator=(const Eigen::AlignedBox3f &box) {
+    lower = box.min();
+    upper = box.max();
+    return *this;
+  }
+
+  bool isEmpty() const { return (lower.array() > upper.array()).any(); }
+  const Eigen::Vector3f &min() const { return lower; }
+  const Eigen::Vector3f &max() const { return upper; }
 };
 
+/**
+ * @brief render packets of one frame, the arrays live in the frame allocator
+ * until the frame slot is reused
+ */
 struct RenderData {
-  std::vector<StaticMeshRenderData> static_mesh_render_data;
+  std::span<const StaticMeshRenderData> static_mesh_render_data;
+  //! object index per instance, grouped by static mesh render data
+  std::span<const uint32_t> instances;
+  std::span<const InstanceBounds>
+      instance_aabbs; //!< world aabb per instance, empty if unknown
+  VkBuffer object_buffer; //!< ObjectData of the frame slot, see ObjectBuffer
+  uint32_t lighting_offset; //!< dynamic offset of ULighting in the uniform ring
+  uint32_t cluster_params_offset; //!< dynamic offset of UClusterParams
+  Eigen::Matrix4f proj_view;
+};
+
+/**
+ * @brief draw call counters of the main pass
+ */
+struct DrawStats {
+  uint32_t instances{0};           //!< visible static mesh instances
+  uint32_t groups{0};              //!< (mesh, material) groups
+  uint32_t draw_calls{0};          //!< draw calls issued
+  uint32_t draw_calls_uninstanced{0}; //!< draw calls without instancing
+  uint32_t secondary_cmd_buffers{0}; //!< recorded in parallel, 0 if inline
+
+  // state changes issued, summed over command buffers
+  uint32_t pipeline_binds{0};
+  uint32_t descriptor_set_binds{0};
+  uint32_t vertex_buffer_binds{0};
+  uint32_t index_buffer_binds{0};
+  uint32_t push_constants{0};
+  uint32_t binds_skipped{0}; //!< redundant state changes filtered
+
+  /**
+   * @brief add state changes a command buffer recorded between two snapshots
+   * of its stats
+   */
+  void addCommandStats(const CommandBufferStats &end,
+                       const CommandBufferStats &begin = {}) {
+    pipeline_binds += end.pipelines.issued - begin.pipelines.issued;
+    descriptor_set_binds +=
+        end.descriptor_sets.issued - begin.descriptor_sets.issued;
+    vertex_buffer_binds +=
+        end.vertex_buffers.issued - begin.vertex_buffers.issued;
+    index_buffer_binds += end.index_buffers.issued - begin.index_buffers.issued;
+    push_constants += end.push_constants.issued - begin.push_constants.issued;
+    binds_skipped +=
+        end.pipelines.skipped + end.descriptor_sets.skipped +
+        end.vertex_buffers.skipped + end.index_buffers.skipped +
+        end.push_constants.skipped -
+        (begin.pipelines.skipped + begin.descriptor_sets.skipped +
+         begin.vertex_buffers.skipped + begin.index_buffers.skipped +
+         begin.push_constants.skipped);
+  }
+
+  /**
+   * @brief add draw calls and state changes of a chunk recorded separately
+   */
+  void addRecorded(const DrawStats &rhs) {
+    draw_calls += rhs.draw_calls;
+    pipeline_binds += rhs.pipeline_binds;
+    descriptor_set_binds += rhs.descriptor_set_binds;
+    vertex_buffer_binds += rhs.vertex_buffer_binds;
+    index_buffer_binds += rhs.index_buffer_binds;
+    push_constants += rhs.push_constants;
+    binds_skipped += rhs.binds_skipped;
+  }
 };
 
-} // namespace mango
\ No newline at end of file
+} // namespace mango
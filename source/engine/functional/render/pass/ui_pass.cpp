@@ -24,6 +24,8 @@
 #include <iostream>
 
 namespace mango {
+//! combined image sampler sets of the imgui pool, one per texture shown
+constexpr uint32_t kUITextureSets = 1024;
 
 void check_vk_result(VkResult err) { VK_ASSERT(err, "Imgui init error"); }
 
@@ -34,14 +36,15 @@ void UIPass::init() {
 }
 
 void UIPass::createDescriptorPool() {
-  // descriptor pool
-  VkDescriptorPoolSize pool_size[] = {
-      {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 100},
-      {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 100},
-      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 100}};
+  // imgui allocates from a single pool and only one combined image sampler
+  // set per texture (font and ImGui_ImplVulkan_AddTexture), so the pool can't
+  // be chained by DescriptorAllocator. Size it for the textures shown by the
+  // editor, sets are freed by ImGui_ImplVulkan_RemoveTexture.
+  VkDescriptorPoolSize pool_size{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                 kUITextureSets};
   desc_pool_ = std::make_shared<DescriptorPool>(
       g_engine.getDriver(), VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
-      pool_size, sizeof(pool_size) / sizeof(pool_size[0]), MAX_GLOBAL_DESC_SET);
+      &pool_size, 1, kUITextureSets);
 }
 
 UIPass::~UIPass() {
@@ -218,6 +221,8 @@ void UIPass::render(const std::shared_ptr<CommandBuffer> &cmd_buffer) {
 
   ImDrawData *draw_data = ImGui::GetDrawData();
   ImGui_ImplVulkan_RenderDrawData(draw_data, cmd_buffer->getHandle());
+  // imgui binds its own pipeline and buffers behind the wrapper's back
+  cmd_buffer->invalidateState();
 
   cmd_buffer->endRenderPass();
 
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <shaders/include/shader_structs.h>
+
+namespace mango {
+class StaticMesh;
+class Material;
+
+/**
+ * @brief plain pointers, publishing a snapshot touches no reference counts.
+ * World keeps the assets of destroyed entities alive, see RenderSnapshot.
+ */
+struct StaticMeshSnapshot {
+  const StaticMesh *mesh;
+  const Material *material;
+  Eigen::Matrix4f transform; //!< global transform
+  Eigen::AlignedBox3f waabb;
+  uint32_t object_index; //!< slot in the object buffer, stable per entity
+  uint64_t transform_version; //!< changes whenever transform changes
+};
+
+/**
+ * @brief everything the render thread reads from the world for one frame.
+ * Written by World at the end of its tick and never modified afterwards, so
+ * the next tick can run while the render thread records this frame. Meshes
+ * and materials of entities destroyed after a snapshot was written are
+ * handed to the next one in retired_assets, the render thread keeps them
+ * alive until the fence of the frame drawing that snapshot is waited.
+ */
+struct RenderSnapshot {
+  uint64_t frame{0}; //!< world tick which produced the snapshot
+
+  Eigen::Matrix4f view{Eigen::Matrix4f::Identity()};
+  Eigen::Matrix4f proj{Eigen::Matrix4f::Identity()};
+  float near_plane{0.1f}; //!< distance to the near plane > 0
+  float far_plane{1000.0f};
+
+  ULighting lighting;
+  uint64_t lighting_version{0}; //!< changes when lighting changes
+  std::vector<UPointLight> point_lights; //!< world space
+
+  std::vector<StaticMeshSnapshot> static_meshes;
+
+  //! assets of entities destroyed since the previous snapshot, not referred
+  //! to by this one but maybe by frames still in flight
+  std::vector<std::shared_ptr<void>> retired_assets;
+};
+} // namespace mango
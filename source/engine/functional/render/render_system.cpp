@@ -5,14 +5,69 @@
 #include <engine/functional/render/render_system.h>
 #include <engine/asset/asset_mesh.h>
 #include <engine/asset/asset_material.h>
+#include <engine/utils/base/radix_sort.h>
 #include <engine/utils/event/event_system.h>
 #include <engine/utils/vk/commands.h>
+#include <engine/utils/vk/memory_pools.h>
 #include <engine/functional/world/world.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
 #ifdef IMGUI_ENABLE_TEST_ENGINE
 #include <imgui_te_engine.h>
 #endif
 
 namespace mango {
+constexpr uint32_t kSortDepthBits = 20;
+constexpr uint32_t kSortMeshBits = 20;
+constexpr uint32_t kSortMaterialBits = 20;
+constexpr uint32_t kSortPipelineBits = 4;
+static_assert(kSortDepthBits + kSortMeshBits + kSortMaterialBits +
+                  kSortPipelineBits == 64);
+
+/**
+ * @brief 64 bit draw sort key, from high to low bits: pipeline | material |
+ * mesh | depth. Ids are truncated, instances are still grouped by pointer so
+ * a truncated id colliding only costs extra binds.
+ * @param depth view space distance, front to back
+ */
+static uint64_t makeDrawSortKey(uint32_t pipeline, uint32_t material,
+                                uint32_t mesh, float depth) {
+  constexpr auto mask = [](uint32_t bits) { return (1ull << bits) - 1; };
+  // bits of a non negative float are ordered as the float, keep the high ones
+  uint32_t depth_bits;
+  depth = std::max(depth, 0.0f);
+  std::memcpy(&depth_bits, &depth, sizeof(float));
+  depth_bits >>= 31 - kSortDepthBits;
+  return ((pipeline & mask(kSortPipelineBits))
+          << (kSortMaterialBits + kSortMeshBits + kSortDepthBits)) |
+         ((material & mask(kSortMaterialBits))
+          << (kSortMeshBits + kSortDepthBits)) |
+         ((mesh & mask(kSortMeshBits)) << kSortDepthBits) |
+         (depth_bits & mask(kSortDepthBits));
+}
+
+/**
+ * @brief uv units covered by one pixel at the point of an instance closest to
+ * the camera, 0 if the mesh has no uv density
+ * @param pixels_per_unit pixels covered by one world unit at distance 1
+ */
+static float calcUVPerPixel(const StaticMeshSnapshot &item,
+                            const StaticMesh &mesh,
+                            const Eigen::RowVector4f &view_z,
+                            float near_plane, float pixels_per_unit) {
+  const float scale =
+      item.transform.block<3, 3>(0, 0).colwise().norm().maxCoeff();
+  const float world_per_uv = mesh.getWorldPerUV() * scale;
+  if (!(world_per_uv > 0.0f))
+    return 0.0f;
+  const float distance = std::max(
+      -view_z.dot(item.waabb.center().homogeneous().transpose()) -
+          0.5f * item.waabb.sizes().norm(),
+      near_plane);
+  return distance / (world_per_uv * pixels_per_unit);
+}
 
 void RenderSystem::init() {
   // init render pass
@@ -36,73 +91,286 @@ void RenderSystem::onCreateSwapchainObjects(
   ui_pass_->onCreateSwapchainObject(p_event->width, p_event->height);
 }
 
-void RenderSystem::collectRenderDatas() {
-  auto world = g_engine.getWorld();
-  auto &default_camera_comp = world->getDefaultCameraComp();
-  auto static_meshes_view = world->getStaticMeshes();
-  auto render_data = std::make_shared<RenderData>();
-  auto & static_mesh_data = render_data->static_mesh_render_data;
-  static_mesh_data.reserve(static_meshes_view.size_hint());
-  auto poj_mat = default_camera_comp.getProjMatrix();
-  auto view_mat = default_camera_comp.getViewMatrix();
-  auto proj_view_mat = poj_mat * view_mat;
-  // std::cout << "--------------------------------" << std::endl;  
-  // std::cout << "poj_mat:" << poj_mat << std::endl;
-  // std::cout << "view_mat:" << view_mat << std::endl;
-  // std::cout << "proj_view_mat:" << proj_view_mat << std::endl;
-  // std::cout << "--------------------------------" << std::endl;
-  for (auto [entity, name, tr, mesh, material] : static_meshes_view.each()) {
-    assert(mesh != nullptr);
-    TransformPCO transform_pco{
-      .m = tr->gtransform,
-      .nm = tr->gtransform.inverse().transpose(), // normal matrix
-      .mvp = proj_view_mat * tr->gtransform
-    };
+void RenderSystem::collectRenderDatas(const RenderSnapshot &snapshot) {
+  const auto cur_frame_index = g_engine.getDriver()->getCurFrameIndex();
+  auto &render_data = render_datas_[cur_frame_index];
+  const auto &poj_mat = snapshot.proj;
+  const auto &view_mat = snapshot.view;
+  Eigen::Matrix4f proj_view_mat = poj_mat * view_mat;
+  render_data.proj_view = proj_view_mat;
+
+  // frustum culling, world aabbs persist as SoA in the culler's slot of each
+  // object and are only rewritten when the transform changed, all slots are
+  // tested in batch
+  const auto &static_meshes = snapshot.static_meshes;
+  Frustum frustum;
+  frustum.extract(proj_view_mat);
+  culling_stats_.updated = 0;
+  for (const auto &item : static_meshes)
+    culling_stats_.updated += frustum_culler_.update(
+        item.object_index, item.transform_version, item.waabb);
+  auto visible_count = frustum_culler_.cull(frustum, cull_visibility_);
+  culling_stats_.tested = static_cast<uint32_t>(static_meshes.size());
+  culling_stats_.culled = 0;
+
+  // sort visible instances by draw key, instances of a (material, mesh) group
+  // become contiguous and each group is drawn with one instanced draw per sub
+  // mesh. Groups sharing a material are adjacent, so the material index is
+  // pushed once for them.
+  const Eigen::RowVector4f view_z = view_mat.row(2);
+  unsorted_instances_.clear();
+  unsorted_instances_.reserve(visible_count);
+  sort_keys_.clear();
+  sort_values_.clear();
+  // instances whose uploads are not submitted yet are skipped until they are,
+  // the frame waits only for the uploads of what it draws
+  const auto *upload_scheduler = g_engine.getDriver()->getUploadScheduler();
+  upload_ticket_ = texture_streamer_.getCommittedTicket();
+  culling_stats_.uploading = 0;
+  for (size_t i = 0; i < static_meshes.size(); ++i) {
+    const auto &item = static_meshes[i];
+    if (!cull_visibility_[item.object_index]) {
+      ++culling_stats_.culled;
+      continue;
+    }
+    assert(item.mesh != nullptr);
+    const auto ticket = std::max(item.mesh->getUploadTicket(),
+                                 item.material->getUploadTicket());
+    if (!upload_scheduler->isSubmitted(ticket)) {
+      ++culling_stats_.uploading;
+      continue;
+    }
+    upload_ticket_ = std::max(upload_ticket_, ticket);
+    // view space looks down -z
+    const float depth =
+        -view_z.dot(item.waabb.center().homogeneous().transpose());
+    sort_keys_.emplace_back(makeDrawSortKey(0, item.material->getSortId(),
+                                            item.mesh->getSortId(), depth));
+    sort_values_.emplace_back(static_cast<uint32_t>(unsorted_instances_.size()));
+    unsorted_instances_.emplace_back(
+        VisibleInstance{item.material, item.mesh, &item});
+  }
+  radixSort(sort_keys_, sort_values_, sort_keys_tmp_, sort_values_tmp_);
+  visible_instances_.resize(unsorted_instances_.size());
+  for (size_t i = 0; i < sort_values_.size(); ++i)
+    visible_instances_[i] = unsorted_instances_[sort_values_[i]];
+
+  // count groups and sub meshes, then all packets of the frame are allocated
+  // from the frame allocator at once
+  size_t group_count = 0;
+  size_t sub_mesh_count = 0;
+  for (size_t i = 0; i < visible_instances_.size();) {
+    const auto *mesh = visible_instances_[i].mesh;
+    const auto *material = visible_instances_[i].material;
+    while (i < visible_instances_.size() &&
+           visible_instances_[i].mesh == mesh &&
+           visible_instances_[i].material == material)
+      ++i;
+    ++group_count;
+    sub_mesh_count += mesh->getSubMeshs().size();
+  }
+  const size_t instance_count = visible_instances_.size();
+  frame_allocator_.beginFrame(
+      cur_frame_index,
+      FrameAllocator::arraySize<uint32_t>(instance_count) +
+          FrameAllocator::arraySize<InstanceBounds>(instance_count) +
+          FrameAllocator::arraySize<StaticMeshRenderData>(group_count) +
+          2 * FrameAllocator::arraySize<uint32_t>(sub_mesh_count));
+  auto instances = frame_allocator_.allocArray<uint32_t>(instance_count);
+  auto instance_aabbs =
+      frame_allocator_.allocArray<InstanceBounds>(instance_count);
+  auto static_mesh_data =
+      frame_allocator_.allocArray<StaticMeshRenderData>(group_count);
+  auto index_counts = frame_allocator_.allocArray<uint32_t>(sub_mesh_count);
+  auto first_indices = frame_allocator_.allocArray<uint32_t>(sub_mesh_count);
 
-    auto data = StaticMeshRenderData{
-      .vertex_buffer = mesh->getVertexBuffer(),
-      .index_buffer = mesh->getIndexBuffer(),
-      .material_descriptor_set = material->getDescriptorSet(),
+  // transforms live in the persistent object buffer, instances only refer to
+  // their objects
+  object_buffer_.update(static_meshes, cur_frame_index);
+  for (size_t i = 0; i < instance_count; ++i) {
+    const auto *item = visible_instances_[i].item;
+    instances[i] = item->object_index;
+    instance_aabbs[i] = item->waabb;
+  }
+
+  // the closest instance of a group decides the texture mips it requests
+  const uint32_t width = frame_buffer_ ? frame_buffer_->getWidth() : 1;
+  const uint32_t height = frame_buffer_ ? frame_buffer_->getHeight() : 1;
+  // y may be flipped by the projection
+  const float pixels_per_unit =
+      0.5f * static_cast<float>(height) * std::abs(poj_mat(1, 1));
+  size_t group = 0;
+  size_t sub_mesh = 0;
+  for (size_t i = 0; i < instance_count; ++group) {
+    const auto *mesh = visible_instances_[i].mesh;
+    const auto *material = visible_instances_[i].material;
+    auto &data = static_mesh_data[group];
+    data = StaticMeshRenderData{
+      .vertex_buffer = mesh->getVertexBuffer()->getHandle(),
+      .index_buffer = mesh->getIndexBuffer()->getHandle(),
+      .material_index = material->getMaterialIndex(),
       .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-      .transform_pco = transform_pco
+      .first_instance = static_cast<uint32_t>(i)
     };
+    float uv_per_pixel = std::numeric_limits<float>::max();
+    while (i < instance_count && visible_instances_[i].mesh == mesh &&
+           visible_instances_[i].material == material) {
+      uv_per_pixel = std::min(
+          uv_per_pixel, calcUVPerPixel(*visible_instances_[i].item, *mesh,
+                                       view_z, snapshot.near_plane,
+                                       pixels_per_unit));
+      ++i;
+    }
+    data.instance_count = static_cast<uint32_t>(i) - data.first_instance;
+    material->requestMips(uv_per_pixel);
 
-    for (auto &sub_mesh : mesh->getSubMeshs()) {
-      data.index_counts.push_back(sub_mesh.index_count);
-      data.first_index.push_back(sub_mesh.index_offset);
+    const auto &sub_meshes = mesh->getSubMeshs();
+    for (size_t j = 0; j < sub_meshes.size(); ++j) {
+      index_counts[sub_mesh + j] = sub_meshes[j].index_count;
+      first_indices[sub_mesh + j] = sub_meshes[j].index_offset;
     }
-    static_mesh_data.emplace_back(data);
+    data.index_counts = index_counts.subspan(sub_mesh, sub_meshes.size());
+    data.first_index = first_indices.subspan(sub_mesh, sub_meshes.size());
+    sub_mesh += sub_meshes.size();
   }
-  main_pass_->setRenderData(render_data);
+  render_data.instances = instances;
+  render_data.instance_aabbs = instance_aabbs;
+  render_data.object_buffer = object_buffer_.getHandle(cur_frame_index);
+  render_data.static_mesh_render_data = static_mesh_data;
+  main_pass_->setRenderData(&render_data);
 
-  // update light data
-  if(world->isLightingDirty())
-  {
-    g_engine.getResourceBindingMgr()->getLightingUbo()->update(&world->getLighting(), sizeof(ULighting), 0);
-    world->clearLightingDirty();
-  }
+  // light data, written to this frame's region of the uniform ring
+  render_data.lighting_offset =
+      g_engine.getResourceBindingMgr()->getUniformRing()->push(
+          &snapshot.lighting, sizeof(ULighting));
+
+  // bin point lights into view clusters
+  light_culler_.cull(snapshot.point_lights, view_mat, poj_mat,
+                     snapshot.near_plane, snapshot.far_plane, width, height);
+  render_data.cluster_params_offset = light_culler_.upload();
+}
+
+void RenderSystem::startRenderThread(uint32_t cmd_buffer_mgr_index) {
+  render_thread_ = std::thread([this]() {
+    while (true) {
+      sem_render_start_.acquire();
+      if (render_thread_exit_)
+        break;
+      renderFrame(*frame_snapshot_);
+      sem_render_finish_.release();
+    }
+  });
+  // bind before the first frame is handed over, the release of
+  // sem_render_start_ publishes it to the render thread
+  g_engine.getDriver()->setThreadLocalCommandBufferManagerTid(
+      cmd_buffer_mgr_index, render_thread_.get_id());
+}
+
+void RenderSystem::stopRenderThread() {
+  if (!render_thread_.joinable())
+    return;
+  sync();
+  render_thread_exit_ = true;
+  sem_render_start_.release();
+  render_thread_.join();
+  // frames in flight may still use retired assets
+  g_engine.getDriver()->getGraphicsQueue()->waitIdle();
+  for (auto &retired_assets : retired_assets_)
+    retired_assets.clear();
+  pending_retired_assets_.clear();
+}
+
+void RenderSystem::sync() {
+  if (!frame_in_flight_)
+    return;
+  sem_render_finish_.acquire();
+  frame_in_flight_ = false;
+#ifdef IMGUI_ENABLE_TEST_ENGINE
+  if (auto *te = static_cast<ImGuiTestEngine*>(ui_pass_->getTestEngine()))
+    ImGuiTestEngine_PostSwap(te);
+#endif
 }
 
 void RenderSystem::tick(float delta_time) {
-  // collect render datas
+  // the render thread is idle from here, ui may resize the 3d view
+  sync();
+
+  // commands recorded by the main thread, e.g. render target layout
+  // transitions, are submitted before the frame which uses them
+  auto driver = g_engine.getDriver();
+  auto &cmd_buffer_mgr = driver->getThreadLocalCommandBufferManager();
+  cmd_buffer_mgr.getCommandBufferAvailableFence()->wait();
+  cmd_buffer_mgr.resetCurFrameCommandPool();
+
+  ui_pass_->prepare(); // update ui region for rendering(3d view region)
+
+  // submitted to the graphics queue before the frame, submission order and
+  // the barriers they record order them before it
+  if (cmd_buffer_mgr.needCommit())
+    cmd_buffer_mgr.commitExecutableCommandBuffers(driver->getGraphicsQueue(),
+                                                  nullptr);
+  // texture mips requested by the last frame
+  texture_streamer_.update();
+  // uploads recorded by the main thread
+  driver->getUploadScheduler()->flush();
+
+  frame_snapshot_ = &g_engine.getWorld()->getRenderSnapshot();
+  frame_in_flight_ = true;
+  sem_render_start_.release();
+}
+
+void RenderSystem::renderFrame(const RenderSnapshot &snapshot) {
   auto driver = g_engine.getDriver();
+  // frames of earlier snapshots may still use them, kept even if this frame
+  // is skipped
+  pending_retired_assets_.insert(pending_retired_assets_.end(),
+                                 snapshot.retired_assets.begin(),
+                                 snapshot.retired_assets.end());
   if (!driver->waitFrame())
     return;
   auto cur_frame_index = driver->getCurFrameIndex();
-  releaseExecSemaphores(cur_frame_index);
+  // the last frame of this slot is done, and every frame before it. Assets
+  // retired before this frame live until its own fence is waited
+  retired_assets_[cur_frame_index].clear();
+  retired_assets_[cur_frame_index].swap(pending_retired_assets_);
 
-  collectRenderDatas();
-  ui_pass_->prepare(); // update ui region for rendering(3d view region)
+  // defragmentation moves, the recreated views of moved textures are written
+  // to the material set of every slot
+  const auto &resource_binding_mgr = g_engine.getResourceBindingMgr();
+  auto memory_pools = driver->getMemoryPools();
+  resource_binding_mgr->refreshTextures(memory_pools->beginFrame());
+  // materials of the snapshot were registered before it was written
+  resource_binding_mgr->syncMaterials(cur_frame_index);
+  resource_binding_mgr->getUniformAllocator()->retire(cur_frame_index);
+  resource_binding_mgr->getTransientDescAllocator()->beginFrame(cur_frame_index);
+  resource_binding_mgr->getUniformRing()->beginFrame(cur_frame_index);
+#ifdef IMGUI_ENABLE_TEST_ENGINE
+  auto *collect_probe = collect_probe_.load();
+  if (collect_probe != nullptr)
+    collect_probe(true);
+  collectRenderDatas(snapshot);
+  if (collect_probe != nullptr)
+    collect_probe(false);
+#else
+  collectRenderDatas(snapshot);
+#endif
 
   auto &cmd_buffer_mgr = driver->getThreadLocalCommandBufferManager();
   auto cmd_buffer = cmd_buffer_mgr.requestCommandBuffer(
       VkCommandBufferLevel::VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+  // take over the uploaded resources from the transfer queue
+  auto upload_scheduler = driver->getUploadScheduler();
+  const auto upload_wait =
+      upload_scheduler->acquire(cmd_buffer->getHandle(), upload_ticket_);
+  // the moved resources are copied before any draw reads them
+  memory_pools->recordMoves(cmd_buffer->getHandle());
   // render simulation 3d view
   // shadow pass
   main_pass_->render(cmd_buffer);
 
   // render ui
   ui_pass_->render(cmd_buffer);
+  resource_binding_mgr->getUniformRing()->flush();
   auto cmd_queue = driver->getGraphicsQueue();
 
   VkPipelineStageFlags wait_stage{
@@ -111,9 +379,18 @@ void RenderSystem::tick(float delta_time) {
   VkSemaphore render_result_available_semaphore_handle =
       driver->getRenderResultAvailableSemaphore()->getHandle();
 
-  auto waiting_semaphores = getPendingSemaphores(cur_frame_index, driver->getPrevFrameIndex());
-  waiting_semaphores.emplace_back(
-      driver->getImageAvailableSemaphore()->getHandle());
+  // the image available semaphore is binary, its value is ignored
+  VkSemaphore waiting_semaphores[2] = {
+      driver->getImageAvailableSemaphore()->getHandle(),
+      upload_scheduler->getSemaphore()};
+  const uint64_t wait_values[2] = {0, upload_wait};
+  VkPipelineStageFlags wait_stages[2] = {wait_stage,
+                                         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT};
+  const uint32_t wait_count = upload_wait != 0 ? 2 : 1;
+  VkTimelineSemaphoreSubmitInfo timeline_info{
+      .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+      .waitSemaphoreValueCount = wait_count,
+      .pWaitSemaphoreValues = wait_values};
 
   auto exec_cmd_buffers =
       std::move(cmd_buffer_mgr.getExecutableCommandBuffers());
@@ -121,18 +398,14 @@ void RenderSystem::tick(float delta_time) {
   cur_fence->reset();
   submit_info.commandBufferCount = exec_cmd_buffers.size();
   submit_info.pCommandBuffers = exec_cmd_buffers.data();
-  submit_info.waitSemaphoreCount = waiting_semaphores.size();
-  submit_info.pWaitSemaphores =
-      waiting_semaphores.data(); // semaphore from another queue/thread
-  submit_info.pWaitDstStageMask = &wait_stage;
+  submit_info.pNext = &timeline_info;
+  submit_info.waitSemaphoreCount = wait_count;
+  submit_info.pWaitSemaphores = waiting_semaphores;
+  submit_info.pWaitDstStageMask = wait_stages;
   submit_info.signalSemaphoreCount = 1;
   submit_info.pSignalSemaphores = &render_result_available_semaphore_handle;
   cmd_queue->submit({submit_info}, cur_fence->getHandle());
   driver->presentFrame();
-#ifdef IMGUI_ENABLE_TEST_ENGINE
-  if (auto *te = static_cast<ImGuiTestEngine*>(ui_pass_->getTestEngine()))
-    ImGuiTestEngine_PostSwap(te);
-#endif
 }
 
 std::shared_ptr<ImageView> RenderSystem::getColorImageView() const {
@@ -161,16 +434,6 @@ void RenderSystem::resize3DView(int width, int height) {
   main_pass_->setFrameBuffer(frame_buffer_, width, height);
 }
 
-std::shared_ptr<Semaphore>
-RenderSystem::getFreeSemaphore() {
-  auto driver = g_engine.getDriver();
-  std::lock_guard<std::mutex> lock(semaphores_mtx_);
-  if (free_semaphores_.empty())
-    return std::make_shared<Semaphore>(driver);
-  auto semaphore = free_semaphores_.front();
-  free_semaphores_.pop_front();
-  return semaphore;
-}
 // void Render::render(World *scene, Gui * gui)
 // {
 //   assert(scene != nullptr);
@@ -1,15 +1,25 @@
 #pragma once
 
+#include <engine/functional/render/frame_allocator.h>
+#include <engine/functional/render/frustum_culling.h>
+#include <engine/functional/render/light_culling.h>
+#include <engine/functional/render/object_buffer.h>
+#include <engine/functional/render/render_snapshot.h>
+#include <engine/functional/render/texture_streamer.h>
 #include <engine/functional/render/pass/main_pass.h>
 #include <engine/functional/render/pass/render_data.h>
 #include <engine/functional/render/pass/ui_pass.h>
 #include <engine/utils/vk/syncs.h>
+#include <engine/utils/vk/upload_scheduler.h>
+#include <atomic>
 #include <vector>
-#include <list>
-#include <mutex>
+#include <semaphore>
+#include <thread>
 
 namespace mango {
 class ImageView;
+class Material;
+class StaticMesh;
 class RenderSystem {
 public:
   RenderSystem() = default;
@@ -21,12 +31,39 @@ public:
    */
   void init();
 
+  /**
+   * @brief start the render thread, which records and submits frames from
+   * world render snapshots
+   * @param cmd_buffer_mgr_index command buffer manager of the render thread
+   */
+  void startRenderThread(uint32_t cmd_buffer_mgr_index);
+
+  void stopRenderThread();
+
+  /**
+   * @brief main thread: wait until the render thread finished the frame handed
+   * over by the last tick. Frame buffers, ui draw data and the graphics queue
+   * may be touched by the main thread after it.
+   */
+  void sync();
+
+  /**
+   * @brief main thread: build ui, then hand the world's latest render snapshot
+   * to the render thread and return, the next world tick runs while the frame
+   * is recorded
+   */
   void tick(float delta_time);
 
   std::shared_ptr<ImageView> getColorImageView() const;
 
 #ifdef IMGUI_ENABLE_TEST_ENGINE
   void* getTestEngine() const;
+
+  /**
+   * @brief test hook, called by the render thread with true before and false
+   * after collecting the render datas of a frame, nullptr to remove
+   */
+  void setCollectProbe(void (*probe)(bool begin)) { collect_probe_ = probe; }
 #endif
 
   /**
@@ -37,40 +74,40 @@ public:
    */
   void resize3DView(int width, int height);
 
-  std::shared_ptr<Semaphore> getFreeSemaphore();
+  /**
+   * @brief frustum culling counters of the last collected frame
+   */
+  const CullingStats &getCullingStats() const { return culling_stats_; }
 
+  /**
+   * @brief draw call counters of the main pass, with and without instancing
+   */
+  const DrawStats &getDrawStats() const { return main_pass_->getDrawStats(); }
 
   /**
-   * @brief release the exec semaphores from last commit   
+   * @brief gpu occlusion culling counters, a few frames behind
    */
-  void releaseExecSemaphores(uint32_t frame_index)
-  {
-    std::lock_guard<std::mutex> lock(semaphores_mtx_);
-    free_semaphores_.splice(free_semaphores_.end(), exec_semaphores_[frame_index]);
+  const OcclusionStats &getOcclusionStats() const {
+    return main_pass_->getOcclusionStats();
   }
-  
-  void addPendingSemaphore(uint32_t frame_index,
-                           const std::shared_ptr<Semaphore> &semaphore)
-  {
-    std::lock_guard<std::mutex> lock(semaphores_mtx_);
-    pending_semaphores_[frame_index].push_back(semaphore);
+
+  /**
+   * @brief clustered point light counters of the last collected frame
+   */
+  const LightCullingStats &getLightCullingStats() const {
+    return light_culler_.getStats();
   }
-  
+
   /**
-   * @brief Get the Pending Semaphores and add them to exec_semaphores
-   * 
-   * @param frame_index   
+   * @brief mip streaming of material textures, fed by the visible instances
+   * of each frame
    */
-  const std::vector<VkSemaphore> getPendingSemaphores(uint32_t cur_frame_index, uint32_t prev_frame_index)
-  {
-    std::lock_guard<std::mutex> lock(semaphores_mtx_);
-    exec_semaphores_[cur_frame_index].splice(exec_semaphores_[cur_frame_index].end(), pending_semaphores_[prev_frame_index]);
-    std::vector<VkSemaphore> waiting_semaphores;
-    waiting_semaphores.reserve(exec_semaphores_[cur_frame_index].size() + 1);
-    for (auto &semaphore : exec_semaphores_[cur_frame_index])
-      waiting_semaphores.emplace_back(semaphore->getHandle());
-    return waiting_semaphores;
+  TextureStreamer &getTextureStreamer() { return texture_streamer_; }
+
+  const TextureStreamingStats &getTextureStreamingStats() const {
+    return texture_streamer_.getStats();
   }
+
 private:
   /**
    * @brief update frame buffer's color attachment after swapchain image
@@ -78,15 +115,55 @@ private:
    */
   void onCreateSwapchainObjects(const std::shared_ptr<class Event> &event);
 
-  void collectRenderDatas();
+  /**
+   * @brief render thread: record and submit one frame
+   */
+  void renderFrame(const RenderSnapshot &snapshot);
+
+  void collectRenderDatas(const RenderSnapshot &snapshot);
 
   std::unique_ptr<UIPass> ui_pass_;
   std::unique_ptr<MainPass> main_pass_;
   std::shared_ptr<FrameBuffer> frame_buffer_; //!< 3d view's frame buffer
 
-  std::mutex semaphores_mtx_;
-  std::list<std::shared_ptr<Semaphore>> free_semaphores_;
-  std::list<std::shared_ptr<Semaphore>> pending_semaphores_[MAX_FRAMES_IN_FLIGHT];
-  std::list<std::shared_ptr<Semaphore>> exec_semaphores_[MAX_FRAMES_IN_FLIGHT];
+  FrustumCuller frustum_culler_;
+  std::vector<uint8_t> cull_visibility_;
+  CullingStats culling_stats_;
+
+  LightCuller light_culler_;
+  TextureStreamer texture_streamer_;
+
+  struct VisibleInstance {
+    const Material *material;
+    const StaticMesh *mesh;
+    const StaticMeshSnapshot *item;
+  };
+  std::vector<VisibleInstance> unsorted_instances_; //!< frustum culling order
+  std::vector<VisibleInstance> visible_instances_; //!< sorted into groups
+  std::vector<uint64_t> sort_keys_;
+  std::vector<uint32_t> sort_values_; //!< index into unsorted_instances_
+  std::vector<uint64_t> sort_keys_tmp_;
+  std::vector<uint32_t> sort_values_tmp_;
+
+  ObjectBuffer object_buffer_; //!< persistent per-object transforms
+  FrameAllocator frame_allocator_; //!< render packets
+  RenderData render_datas_[MAX_FRAMES_IN_FLIGHT];
+
+  UploadTicket upload_ticket_{0}; //!< latest upload drawn by the frame
+
+  std::thread render_thread_;
+  std::binary_semaphore sem_render_start_{0};
+  std::binary_semaphore sem_render_finish_{0};
+  bool render_thread_exit_{false};
+  bool frame_in_flight_{false}; //!< handed to the render thread, not synced
+  const RenderSnapshot *frame_snapshot_{nullptr};
+  //! assets retired by snapshots drawn in a frame slot, released once the
+  //! slot's fence is waited again
+  std::vector<std::shared_ptr<void>> retired_assets_[MAX_FRAMES_IN_FLIGHT];
+  //! retired by snapshots not drawn yet
+  std::vector<std::shared_ptr<void>> pending_retired_assets_;
+#ifdef IMGUI_ENABLE_TEST_ENGINE
+  std::atomic<void (*)(bool)> collect_probe_{nullptr};
+#endif
 };
 } // namespace mango
\ No newline at end of file
@@ -0,0 +1,168 @@
+#include <engine/functional/render/texture_streamer.h>
+
+#include <algorithm>
+
+#include <engine/asset/asset_texture.h>
+#include <engine/functional/global/engine_context.h>
+#include <engine/utils/vk/image.h>
+#include <engine/utils/vk/memory_pools.h>
+#include <engine/utils/vk/vk_driver.h>
+
+namespace mango {
+TextureStreamer::~TextureStreamer() {
+  // images of unfinished uploads are still written by the transfer queue
+  UploadTicket ticket = 0;
+  for (const auto &entry : entries_)
+    if (entry.pending_view != nullptr)
+      ticket = std::max(ticket, entry.pending_ticket);
+  for (const auto &retired : retired_)
+    ticket = std::max(ticket, retired.ticket);
+  const auto &driver = g_engine.getDriver();
+  if (ticket != 0 && driver != nullptr)
+    driver->getUploadScheduler()->wait(ticket);
+}
+
+void TextureStreamer::add(AssetTexture *texture) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  const uint32_t tail = texture->getMipTail();
+  entries_.emplace_back(Entry{.texture = texture,
+                              .wanted_mip = tail,
+                              .wanted_tick = tick_,
+                              .pending_mip = tail});
+}
+
+void TextureStreamer::remove(AssetTexture *texture) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto itr = std::find_if(
+      entries_.begin(), entries_.end(),
+      [texture](const Entry &entry) { return entry.texture == texture; });
+  if (itr == entries_.end())
+    return;
+  if (itr->pending_view != nullptr)
+    retired_.emplace_back(
+        Retired{itr->pending_ticket, std::move(itr->pending_view)});
+  *itr = std::move(entries_.back());
+  entries_.pop_back();
+}
+
+void TextureStreamer::update() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  ++tick_;
+  auto upload_scheduler = g_engine.getDriver()->getUploadScheduler();
+
+  // swap in the mips whose uploads completed
+  std::erase_if(retired_, [upload_scheduler](const Retired &retired) {
+    return upload_scheduler->isCompleted(retired.ticket);
+  });
+  for (auto &entry : entries_) {
+    if (entry.pending_view == nullptr ||
+        !upload_scheduler->isCompleted(entry.pending_ticket))
+      continue;
+    entry.texture->setResidentMips(std::move(entry.pending_view),
+                                   entry.pending_mip);
+    committed_ticket_ = std::max(committed_ticket_, entry.pending_ticket);
+    entry.pending_view = nullptr;
+  }
+
+  // finer requests apply at once, coarser ones only after kEvictTicks so a
+  // texture doesn't bounce between two levels
+  stats_.resident_bytes = 0;
+  for (auto &entry : entries_) {
+    auto *texture = entry.texture;
+    const uint32_t requested =
+        std::min(texture->takeRequestedMip(), texture->getMipTail());
+    if (requested <= entry.wanted_mip) {
+      entry.wanted_mip = requested;
+      entry.wanted_tick = tick_;
+    } else if (tick_ - entry.wanted_tick > kEvictTicks) {
+      entry.wanted_mip = requested;
+      entry.wanted_tick = tick_;
+    }
+    stats_.resident_bytes += texture->getMipBytes(texture->getResidentMip());
+  }
+
+  // coarsen all requests until they fit
+  const uint64_t budget = queryBudget();
+  uint32_t mip_bias = 0;
+  for (;; ++mip_bias) {
+    uint64_t bytes = 0;
+    bool coarsest = true;
+    for (const auto &entry : entries_) {
+      const uint32_t tail = entry.texture->getMipTail();
+      const uint32_t mip = std::min(entry.wanted_mip + mip_bias, tail);
+      bytes += entry.texture->getMipBytes(mip);
+      coarsest = coarsest && mip == tail;
+    }
+    if (bytes <= budget || coarsest)
+      break;
+  }
+
+  // upload the target levels of textures which differ, evictions are
+  // uploads of fewer levels
+  uint64_t uploaded_bytes = 0;
+  {
+    auto recorder = upload_scheduler->record();
+    for (auto &entry : entries_) {
+      if (entry.pending_view != nullptr)
+        continue;
+      auto *texture = entry.texture;
+      const uint32_t tail = texture->getMipTail();
+      const uint32_t mip =
+          entry.unreadable ? tail : std::min(entry.wanted_mip + mip_bias, tail);
+      const uint32_t resident_mip = texture->getResidentMip();
+      if (mip == resident_mip) {
+        entry.load = nullptr;
+        continue;
+      }
+      const uint64_t bytes = texture->getMipBytes(mip);
+      if (mip < resident_mip && uploaded_bytes != 0 &&
+          uploaded_bytes + bytes > kMaxUploadBytes)
+        continue;
+      // levels dropped from host memory are read by a job first, a load of
+      // finer levels serves coarser targets too
+      if (!texture->hasHostMips(mip)) {
+        if (entry.load == nullptr || entry.load->first_mip > mip) {
+          entry.load = texture->loadMips(mip);
+          continue;
+        }
+        if (!entry.load->done.isDone())
+          continue;
+        if (entry.load->levels.empty()) {
+          entry.unreadable = true;
+          entry.load = nullptr;
+          continue;
+        }
+      }
+      entry.pending_view = texture->uploadMips(mip, recorder, entry.load.get());
+      entry.pending_mip = mip;
+      entry.pending_ticket = recorder.getTicket();
+      entry.load = nullptr; // staged by the recorder
+      uploaded_bytes += bytes;
+    }
+  }
+
+  stats_.textures = static_cast<uint32_t>(entries_.size());
+  stats_.streaming = static_cast<uint32_t>(
+      std::count_if(entries_.begin(), entries_.end(), [](const Entry &entry) {
+        return entry.pending_view != nullptr;
+      }));
+  stats_.loading = static_cast<uint32_t>(
+      std::count_if(entries_.begin(), entries_.end(), [](const Entry &entry) {
+        return entry.load != nullptr;
+      }));
+  stats_.mip_bias = mip_bias;
+  stats_.budget_bytes = budget;
+  stats_.uploaded_bytes = uploaded_bytes;
+}
+
+uint64_t TextureStreamer::queryBudget() const {
+  // queried by the render thread once per frame
+  const auto [usage, budget] =
+      g_engine.getDriver()->getMemoryPools()->getDeviceBudget();
+  // streamed textures may use what the rest of the engine leaves
+  const auto allowed = static_cast<uint64_t>(budget * kBudgetFraction);
+  const uint64_t others =
+      usage > stats_.resident_bytes ? usage - stats_.resident_bytes : 0;
+  return allowed > others ? allowed - others : 0;
+}
+} // namespace mango
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <engine/utils/vk/upload_scheduler.h>
+#include <volk.h>
+
+namespace mango {
+class AssetTexture;
+class ImageView;
+struct TextureMipLoad;
+
+struct TextureStreamingStats {
+  uint32_t textures{0};         //!< streamed textures
+  uint32_t streaming{0};        //!< textures whose new mips are uploading
+  uint32_t loading{0};          //!< textures whose mips are read from source
+  uint32_t mip_bias{0};         //!< mips dropped from every request, budget
+  uint64_t resident_bytes{0};   //!< mips resident on the gpu
+  uint64_t budget_bytes{0};     //!< vram left for streamed textures
+  uint64_t uploaded_bytes{0};   //!< mips uploaded by the last update
+};
+
+/**
+ * @brief demand driven texture mip streaming under a vram budget.
+ *
+ * Streamed textures are resident with their mip tail only (levels not larger
+ * than kMipTailSize) after inflate, and keep only the tail in host memory if
+ * they have a TextureSource. Finer levels are read from it by a job before
+ * they are uploaded. The render thread requests a first mip per
+ * texture each frame from the screen space uv density of the visible
+ * instances using it (AssetTexture::requestMip). update() runs on the main
+ * thread between frames: the vram left by other resources is read from the
+ * heap budgets of the last frame (MemoryPools), requests are coarsened
+ * by a global mip bias until they fit, and textures whose resident levels
+ * differ from their target are uploaded again with the target levels. The new
+ * image replaces the old one in the bindless slot once its upload completes,
+ * the old one is released after all frame slots moved on. Textures not
+ * requested for kEvictTicks updates fall back to their mip tail.
+ */
+class TextureStreamer final {
+public:
+  //! largest mip kept resident by every streamed texture
+  static constexpr uint32_t kMipTailSize = 128;
+
+  TextureStreamer() = default;
+
+  ~TextureStreamer();
+
+  TextureStreamer(const TextureStreamer &) = delete;
+  TextureStreamer &operator=(const TextureStreamer &) = delete;
+
+  /**
+   * @brief stream texture, inflated with its mip tail resident. Thread safe.
+   */
+  void add(AssetTexture *texture);
+
+  /**
+   * @brief stop streaming texture, called by its destructor. Thread safe.
+   */
+  void remove(AssetTexture *texture);
+
+  /**
+   * @brief main thread: apply completed uploads, then schedule uploads and
+   * evictions for the requests of the last frame. Should be called while the
+   * render thread is idle, uploads are flushed by the caller.
+   */
+  void update();
+
+  /**
+   * @brief latest upload swapped in by update(), frames wait for it so the
+   * new images are visible to them even without an ownership transfer
+   */
+  UploadTicket getCommittedTicket() const { return committed_ticket_; }
+
+  const TextureStreamingStats &getStats() const { return stats_; }
+
+private:
+  //! updates without a request before a texture drops to its mip tail
+  static constexpr uint64_t kEvictTicks = 120;
+  //! fraction of the vram budget the engine allows itself
+  static constexpr double kBudgetFraction = 0.9;
+  //! bytes of mips uploaded by one update at most
+  static constexpr uint64_t kMaxUploadBytes = 32ull << 20;
+
+  struct Entry {
+    AssetTexture *texture;
+    uint32_t wanted_mip;  //!< first mip by the requests
+    uint64_t wanted_tick; //!< last update wanted_mip was requested
+    uint32_t pending_mip; //!< first mip uploading, valid with pending_view
+    UploadTicket pending_ticket{0};
+    std::shared_ptr<ImageView> pending_view;
+    //! levels below the mip tail read from the texture's source
+    std::shared_ptr<TextureMipLoad> load;
+    bool unreadable{false}; //!< source failed, the mip tail stays
+  };
+
+  //! an upload dropped before it completed, kept alive until then
+  struct Retired {
+    UploadTicket ticket;
+    std::shared_ptr<ImageView> view;
+  };
+
+  //! device local vram left for streamed textures
+  uint64_t queryBudget() const;
+
+  std::mutex mtx_;
+  std::vector<Entry> entries_;
+  std::vector<Retired> retired_;
+  uint64_t tick_{0};
+  UploadTicket committed_ticket_{0};
+  TextureStreamingStats stats_;
+};
+} // namespace mango
@@ -0,0 +1,464 @@
+#include <engine/functional/world/dynamic_aabb_tree.h>
+#include <algorithm>
+#include <cassert>
+#include <queue>
+
+#include <engine/functional/global/engine_context.h>
+#include <engine/utils/job/job_system.h>
+
+namespace mango {
+
+constexpr size_t kParallelBuildThreshold = 4096; //!< min leaves of a subtree built asynchronously
+constexpr int kMaxParallelBuildDepth = 4;        //!< at most 2^4 build tasks
+constexpr int kSAHBinCount = 16;
+
+DynamicAABBTree::DynamicAABBTree(float margin) : margin_(margin) {}
+
+void DynamicAABBTree::clear() {
+  nodes_.clear();
+  root_ = kNullNode;
+  free_list_ = kNullNode;
+  proxy_count_ = 0;
+}
+
+int32_t DynamicAABBTree::allocateNode() {
+  if (free_list_ == kNullNode) {
+    nodes_.emplace_back();
+    return static_cast<int32_t>(nodes_.size() - 1);
+  }
+  int32_t node_id = free_list_;
+  free_list_ = nodes_[node_id].parent;
+  nodes_[node_id] = Node{};
+  return node_id;
+}
+
+void DynamicAABBTree::freeNode(int32_t node_id) {
+  nodes_[node_id].parent = free_list_;
+  nodes_[node_id].height = -1;
+  free_list_ = node_id;
+}
+
+Eigen::AlignedBox3f
+DynamicAABBTree::fatten(const Eigen::AlignedBox3f &aabb) const {
+  Eigen::Vector3f r = Eigen::Vector3f::Constant(
+      margin_ * std::max(aabb.sizes().maxCoeff(), 1e-3f));
+  return Eigen::AlignedBox3f(aabb.min() - r, aabb.max() + r);
+}
+
+int32_t DynamicAABBTree::createProxy(const Eigen::AlignedBox3f &aabb,
+                                     uint32_t user_data) {
+  int32_t proxy_id = allocateNode();
+  Node &node = nodes_[proxy_id];
+  node.aabb = fatten(aabb);
+  node.user_data = user_data;
+  node.height = 0;
+  insertLeaf(proxy_id);
+  ++proxy_count_;
+  return proxy_id;
+}
+
+void DynamicAABBTree::destroyProxy(int32_t proxy_id) {
+  assert(proxy_id >= 0 && proxy_id < static_cast<int32_t>(nodes_.size()));
+  assert(nodes_[proxy_id].isLeaf());
+  removeLeaf(proxy_id);
+  freeNode(proxy_id);
+  --proxy_count_;
+}
+
+bool DynamicAABBTree::moveProxy(int32_t proxy_id,
+                                const Eigen::AlignedBox3f &aabb) {
+  assert(nodes_[proxy_id].isLeaf());
+  const auto &fat_aabb = nodes_[proxy_id].aabb;
+  if (fat_aabb.contains(aabb)) {
+    // still inside, unless the fat aabb is much larger than needed (shrinking
+    // objects)
+    Eigen::AlignedBox3f huge = aabb;
+    Eigen::Vector3f r = Eigen::Vector3f::Constant(
+        4.0f * margin_ * std::max(aabb.sizes().maxCoeff(), 1e-3f));
+    huge.min() -= r;
+    huge.max() += r;
+    if (huge.contains(fat_aabb))
+      return false;
+  }
+  removeLeaf(proxy_id);
+  nodes_[proxy_id].aabb = fatten(aabb);
+  insertLeaf(proxy_id);
+  return true;
+}
+
+void DynamicAABBTree::insertLeaf(int32_t leaf) {
+  if (root_ == kNullNode) {
+    root_ = leaf;
+    nodes_[root_].parent = kNullNode;
+    return;
+  }
+
+  // find the best sibling by surface area heuristic
+  const Eigen::AlignedBox3f leaf_aabb = nodes_[leaf].aabb;
+  int32_t index = root_;
+  while (!nodes_[index].isLeaf()) {
+    const Node &node = nodes_[index];
+    int32_t child1 = node.child1;
+    int32_t child2 = node.child2;
+    float area = surfaceArea(node.aabb);
+    float combined_area = surfaceArea(node.aabb.merged(leaf_aabb));
+    // cost of creating a new parent for this node and the new leaf
+    float cost = 2.0f * combined_area;
+    // minimum cost of pushing the leaf further down the tree
+    float inheritance_cost = 2.0f * (combined_area - area);
+
+    auto descend_cost = [&](int32_t child) {
+      const Node &c = nodes_[child];
+      float merged_area = surfaceArea(c.aabb.merged(leaf_aabb));
+      if (c.isLeaf())
+        return merged_area + inheritance_cost;
+      return merged_area - surfaceArea(c.aabb) + inheritance_cost;
+    };
+    float cost1 = descend_cost(child1);
+    float cost2 = descend_cost(child2);
+    if (cost < cost1 && cost < cost2)
+      break;
+    index = cost1 < cost2 ? child1 : child2;
+  }
+  int32_t sibling = index;
+
+  // create a new parent
+  int32_t old_parent = nodes_[sibling].parent;
+  int32_t new_parent = allocateNode();
+  nodes_[new_parent].parent = old_parent;
+  nodes_[new_parent].aabb = leaf_aabb.merged(nodes_[sibling].aabb);
+  nodes_[new_parent].height = nodes_[sibling].height + 1;
+  nodes_[new_parent].child1 = sibling;
+  nodes_[new_parent].child2 = leaf;
+  nodes_[sibling].parent = new_parent;
+  nodes_[leaf].parent = new_parent;
+  if (old_parent != kNullNode) {
+    if (nodes_[old_parent].child1 == sibling)
+      nodes_[old_parent].child1 = new_parent;
+    else
+      nodes_[old_parent].child2 = new_parent;
+  } else {
+    root_ = new_parent;
+  }
+
+  // walk back up fixing heights and aabbs
+  index = nodes_[leaf].parent;
+  while (index != kNullNode) {
+    index = balance(index);
+    Node &node = nodes_[index];
+    const Node &c1 = nodes_[node.child1];
+    const Node &c2 = nodes_[node.child2];
+    node.height = 1 + std::max(c1.height, c2.height);
+    node.aabb = c1.aabb.merged(c2.aabb);
+    index = node.parent;
+  }
+}
+
+void DynamicAABBTree::removeLeaf(int32_t leaf) {
+  if (leaf == root_) {
+    root_ = kNullNode;
+    return;
+  }
+  int32_t parent = nodes_[leaf].parent;
+  int32_t grand_parent = nodes_[parent].parent;
+  int32_t sibling = nodes_[parent].child1 == leaf ? nodes_[parent].child2
+                                                  : nodes_[parent].child1;
+  if (grand_parent == kNullNode) {
+    root_ = sibling;
+    nodes_[sibling].parent = kNullNode;
+    freeNode(parent);
+    return;
+  }
+
+  // replace parent by sibling
+  if (nodes_[grand_parent].child1 == parent)
+    nodes_[grand_parent].child1 = sibling;
+  else
+    nodes_[grand_parent].child2 = sibling;
+  nodes_[sibling].parent = grand_parent;
+  freeNode(parent);
+
+  int32_t index = grand_parent;
+  while (index != kNullNode) {
+    index = balance(index);
+    Node &node = nodes_[index];
+    const Node &c1 = nodes_[node.child1];
+    const Node &c2 = nodes_[node.child2];
+    node.aabb = c1.aabb.merged(c2.aabb);
+    node.height = 1 + std::max(c1.height, c2.height);
+    index = node.parent;
+  }
+}
+
+// rotate the higher child up if the subtree of node_id is unbalanced, return
+// the new root of the subtree
+int32_t DynamicAABBTree::balance(int32_t ia) {
+  Node &a = nodes_[ia];
+  if (a.isLeaf() || a.height < 2)
+    return ia;
+
+  int32_t ib = a.child1;
+  int32_t ic = a.child2;
+  Node &b = nodes_[ib];
+  Node &c = nodes_[ic];
+  int32_t balance = c.height - b.height;
+
+  auto replace_in_parent = [this](int32_t parent, int32_t old_child,
+                                  int32_t new_child) {
+    if (parent == kNullNode) {
+      root_ = new_child;
+      return;
+    }
+    if (nodes_[parent].child1 == old_child)
+      nodes_[parent].child1 = new_child;
+    else
+      nodes_[parent].child2 = new_child;
+  };
+
+  // rotate c up
+  if (balance > 1) {
+    int32_t if_ = c.child1;
+    int32_t ig = c.child2;
+    Node &f = nodes_[if_];
+    Node &g = nodes_[ig];
+
+    c.child1 = ia;
+    c.parent = a.parent;
+    a.parent = ic;
+    replace_in_parent(c.parent, ia, ic);
+
+    if (f.height > g.height) {
+      c.child2 = if_;
+      a.child2 = ig;
+      g.parent = ia;
+      a.aabb = b.aabb.merged(g.aabb);
+      c.aabb = a.aabb.merged(f.aabb);
+      a.height = 1 + std::max(b.height, g.height);
+      c.height = 1 + std::max(a.height, f.height);
+    } else {
+      c.child2 = ig;
+      a.child2 = if_;
+      f.parent = ia;
+      a.aabb = b.aabb.merged(f.aabb);
+      c.aabb = a.aabb.merged(g.aabb);
+      a.height = 1 + std::max(b.height, f.height);
+      c.height = 1 + std::max(a.height, g.height);
+    }
+    return ic;
+  }
+
+  // rotate b up
+  if (balance < -1) {
+    int32_t id = b.child1;
+    int32_t ie = b.child2;
+    Node &d = nodes_[id];
+    Node &e = nodes_[ie];
+
+    b.child1 = ia;
+    b.parent = a.parent;
+    a.parent = ib;
+    replace_in_parent(b.parent, ia, ib);
+
+    if (d.height > e.height) {
+      b.child2 = id;
+      a.child1 = ie;
+      e.parent = ia;
+      a.aabb = c.aabb.merged(e.aabb);
+      b.aabb = a.aabb.merged(d.aabb);
+      a.height = 1 + std::max(c.height, e.height);
+      b.height = 1 + std::max(a.height, d.height);
+    } else {
+      b.child2 = ie;
+      a.child1 = id;
+      d.parent = ia;
+      a.aabb = c.aabb.merged(d.aabb);
+      b.aabb = a.aabb.merged(e.aabb);
+      a.height = 1 + std::max(c.height, d.height);
+      b.height = 1 + std::max(a.height, e.height);
+    }
+    return ib;
+  }
+  return ia;
+}
+
+bool DynamicAABBTree::rayIntersect(const Eigen::AlignedBox3f &aabb,
+                                   const Eigen::Vector3f &origin,
+                                   const Eigen::Vector3f &inv_dir, float max_t,
+                                   float &t_enter) {
+  float t0 = 0.0f;
+  float t1 = max_t;
+  for (int i = 0; i < 3; ++i) {
+    float ta = (aabb.min()[i] - origin[i]) * inv_dir[i];
+    float tb = (aabb.max()[i] - origin[i]) * inv_dir[i];
+    if (ta > tb)
+      std::swap(ta, tb);
+    // NaN (origin on the slab of a parallel ray) keeps the current range
+    t0 = ta > t0 ? ta : t0;
+    t1 = tb < t1 ? tb : t1;
+    if (t0 > t1)
+      return false;
+  }
+  t_enter = t0;
+  return true;
+}
+
+int32_t DynamicAABBTree::queryNearest(const Eigen::Vector3f &p,
+                                      float max_dist) const {
+  if (root_ == kNullNode)
+    return kNullNode;
+  // best first search ordered by squared distance to node aabb
+  using Entry = std::pair<float, int32_t>;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+  float best_dist2 = max_dist == FLT_MAX ? FLT_MAX : max_dist * max_dist;
+  int32_t best = kNullNode;
+  queue.emplace(nodes_[root_].aabb.squaredExteriorDistance(p), root_);
+  while (!queue.empty()) {
+    auto [dist2, node_id] = queue.top();
+    queue.pop();
+    if (dist2 > best_dist2)
+      break;
+    const Node &node = nodes_[node_id];
+    if (node.isLeaf()) {
+      best_dist2 = dist2;
+      best = node_id;
+      break; // nearest since the queue is ordered
+    }
+    for (int32_t child : {node.child1, node.child2}) {
+      float d2 = nodes_[child].aabb.squaredExteriorDistance(p);
+      if (d2 <= best_dist2)
+        queue.emplace(d2, child);
+    }
+  }
+  return best;
+}
+
+void DynamicAABBTree::rebuild(const std::vector<Eigen::AlignedBox3f> &aabbs,
+                              const std::vector<uint32_t> &user_datas,
+                              std::vector<int32_t> &proxy_ids) {
+  assert(aabbs.size() == user_datas.size());
+  clear();
+  proxy_ids.resize(aabbs.size());
+  if (aabbs.empty())
+    return;
+
+  std::vector<BuildItem> items(aabbs.size());
+  for (size_t i = 0; i < aabbs.size(); ++i) {
+    items[i].aabb = fatten(aabbs[i]);
+    items[i].centroid = items[i].aabb.center();
+    items[i].user_data = user_datas[i];
+    items[i].index = static_cast<uint32_t>(i);
+  }
+  // a binary tree of n leaves has 2n-1 nodes, subtrees are laid out
+  // contiguously so that they can be built concurrently
+  nodes_.resize(2 * items.size() - 1);
+  buildRange(items.data(), items.size(), 0, kNullNode, proxy_ids, 0);
+  root_ = 0;
+  proxy_count_ = items.size();
+}
+
+void DynamicAABBTree::buildRange(BuildItem *items, size_t count,
+                                 int32_t node_id, int32_t parent,
+                                 std::vector<int32_t> &proxy_ids, int depth) {
+  if (count == 1) {
+    Node &leaf = nodes_[node_id];
+    leaf.aabb = items[0].aabb;
+    leaf.user_data = items[0].user_data;
+    leaf.parent = parent;
+    leaf.child1 = leaf.child2 = kNullNode;
+    leaf.height = 0;
+    proxy_ids[items[0].index] = node_id;
+    return;
+  }
+
+  // split along the largest centroid extent with binned SAH
+  Eigen::AlignedBox3f centroid_bounds;
+  for (size_t i = 0; i < count; ++i)
+    centroid_bounds.extend(items[i].centroid);
+  int axis;
+  centroid_bounds.sizes().maxCoeff(&axis);
+  float cmin = centroid_bounds.min()[axis];
+  float extent = centroid_bounds.sizes()[axis];
+
+  size_t mid = count / 2;
+  if (extent > 0.0f) {
+    Eigen::AlignedBox3f bin_bounds[kSAHBinCount];
+    size_t bin_counts[kSAHBinCount] = {};
+    float scale = kSAHBinCount / extent;
+    auto bin_of = [&](const BuildItem &item) {
+      int b = static_cast<int>((item.centroid[axis] - cmin) * scale);
+      return std::min(b, kSAHBinCount - 1);
+    };
+    for (size_t i = 0; i < count; ++i) {
+      int b = bin_of(items[i]);
+      ++bin_counts[b];
+      bin_bounds[b].extend(items[i].aabb);
+    }
+    // sweep from the right to get suffix areas
+    float right_area[kSAHBinCount];
+    size_t right_count[kSAHBinCount];
+    Eigen::AlignedBox3f acc;
+    size_t acc_count = 0;
+    for (int b = kSAHBinCount - 1; b > 0; --b) {
+      acc.extend(bin_bounds[b]);
+      acc_count += bin_counts[b];
+      right_area[b] = acc.isEmpty() ? 0.0f : surfaceArea(acc);
+      right_count[b] = acc_count;
+    }
+    float best_cost = FLT_MAX;
+    int best_split = -1;
+    acc.setEmpty();
+    acc_count = 0;
+    for (int b = 0; b < kSAHBinCount - 1; ++b) {
+      acc.extend(bin_bounds[b]);
+      acc_count += bin_counts[b];
+      if (acc_count == 0 || right_count[b + 1] == 0)
+        continue;
+      float cost = surfaceArea(acc) * acc_count +
+                   right_area[b + 1] * right_count[b + 1];
+      if (cost < best_cost) {
+        best_cost = cost;
+        best_split = b;
+      }
+    }
+    if (best_split >= 0) {
+      BuildItem *p = std::partition(
+          items, items + count,
+          [&](const BuildItem &item) { return bin_of(item) <= best_split; });
+      mid = static_cast<size_t>(p - items);
+    }
+  }
+  if (mid == 0 || mid == count) {
+    mid = count / 2;
+    std::nth_element(items, items + mid, items + count,
+                     [axis](const BuildItem &a, const BuildItem &b) {
+                       return a.centroid[axis] < b.centroid[axis];
+                     });
+  }
+
+  // left subtree takes 2*mid-1 nodes right after this node
+  int32_t left = node_id + 1;
+  int32_t right = node_id + static_cast<int32_t>(2 * mid);
+  if (count >= kParallelBuildThreshold && depth < kMaxParallelBuildDepth) {
+    auto job_system = g_engine.getJobSystem();
+    JobCounter left_done;
+    job_system->run(
+        [&]() { buildRange(items, mid, left, node_id, proxy_ids, depth + 1); },
+        &left_done);
+    buildRange(items + mid, count - mid, right, node_id, proxy_ids,
+               depth + 1);
+    job_system->wait(left_done);
+  } else {
+    buildRange(items, mid, left, node_id, proxy_ids, depth + 1);
+    buildRange(items + mid, count - mid, right, node_id, proxy_ids,
+               depth + 1);
+  }
+
+  Node &node = nodes_[node_id];
+  node.parent = parent;
+  node.child1 = left;
+  node.child2 = right;
+  node.aabb = nodes_[left].aabb.merged(nodes_[right].aabb);
+  node.height = 1 + std::max(nodes_[left].height, nodes_[right].height);
+}
+
+} // namespace mango
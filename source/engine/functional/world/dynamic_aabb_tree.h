@@ -0,0 +1,256 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+
+#include <engine/functional/render/frustum_culling.h>
+
+namespace mango {
+
+/**
+ * @brief dynamic aabb tree (bvh) over proxies' world bounds.
+ *
+ * Leaves store fattened aabbs, so small movements don't touch the tree.
+ * Insertion descends by surface area heuristic, and AVL style rotations keep
+ * the tree balanced. A bulk build path (binned SAH, parallel subtrees) is used
+ * for large imports.
+ */
+class DynamicAABBTree final {
+public:
+  static constexpr int32_t kNullNode = -1;
+
+  explicit DynamicAABBTree(float margin = 0.05f);
+
+  ~DynamicAABBTree() = default;
+
+  /**
+   * @brief insert a proxy, return proxy id (a leaf node index)
+   */
+  int32_t createProxy(const Eigen::AlignedBox3f &aabb, uint32_t user_data);
+
+  void destroyProxy(int32_t proxy_id);
+
+  /**
+   * @brief update proxy bounds, the leaf is only reinserted when the new aabb
+   * escapes the fattened one
+   * @return true if the tree structure changed
+   */
+  bool moveProxy(int32_t proxy_id, const Eigen::AlignedBox3f &aabb);
+
+  uint32_t getUserData(int32_t proxy_id) const {
+    return nodes_[proxy_id].user_data;
+  }
+
+  const Eigen::AlignedBox3f &getFatAABB(int32_t proxy_id) const {
+    return nodes_[proxy_id].aabb;
+  }
+
+  /**
+   * @brief rebuild the whole tree from scratch, existing proxies are dropped.
+   * Subtrees of large inputs are built in parallel.
+   *
+   * @param proxy_ids output, proxy id of each input aabb
+   */
+  void rebuild(const std::vector<Eigen::AlignedBox3f> &aabbs,
+               const std::vector<uint32_t> &user_datas,
+               std::vector<int32_t> &proxy_ids);
+
+  void clear();
+
+  size_t getProxyCount() const { return proxy_count_; }
+
+  int32_t getHeight() const {
+    return root_ == kNullNode ? 0 : nodes_[root_].height;
+  }
+
+  /**
+   * @brief report proxies whose fat aabb overlaps aabb
+   * @param callback bool(int32_t proxy_id), return false to stop the query
+   */
+  template <typename Callback>
+  void queryOverlap(const Eigen::AlignedBox3f &aabb,
+                    Callback &&callback) const;
+
+  /**
+   * @brief report proxies whose fat aabb intersects the frustum, subtrees
+   * fully inside the frustum are reported without further plane tests
+   * @param callback bool(int32_t proxy_id), return false to stop the query
+   */
+  template <typename Callback>
+  void queryFrustum(const Frustum &frustum, Callback &&callback) const;
+
+  /**
+   * @brief cast a ray o + t * d, t in [0, max_t]
+   * @param callback float(int32_t proxy_id, float t_enter), t_enter is the
+   * entering distance of fat aabb. Return 0 to terminate, a value in (0,
+   * max_t) to clip the ray, max_t to continue.
+   */
+  template <typename Callback>
+  void rayCast(const Eigen::Vector3f &origin, const Eigen::Vector3f &dir,
+               float max_t, Callback &&callback) const;
+
+  /**
+   * @brief proxy whose fat aabb is closest to p
+   * @return kNullNode if no proxy within max_dist
+   */
+  int32_t queryNearest(const Eigen::Vector3f &p,
+                       float max_dist = FLT_MAX) const;
+
+  /**
+   * @brief slab test of ray and aabb
+   * @return true if hit, t_enter is the entering distance (0 if inside)
+   */
+  static bool rayIntersect(const Eigen::AlignedBox3f &aabb,
+                           const Eigen::Vector3f &origin,
+                           const Eigen::Vector3f &inv_dir, float max_t,
+                           float &t_enter);
+
+  DynamicAABBTree(const DynamicAABBTree &) = delete;
+  DynamicAABBTree &operator=(const DynamicAABBTree &) = delete;
+
+private:
+  struct Node {
+    Eigen::AlignedBox3f aabb;
+    uint32_t user_data{0};
+    int32_t parent{kNullNode}; //!< parent, or next free node
+    int32_t child1{kNullNode};
+    int32_t child2{kNullNode};
+    int32_t height{-1}; //!< leaf: 0, free node: -1
+
+    bool isLeaf() const { return child1 == kNullNode; }
+  };
+
+  struct BuildItem {
+    Eigen::AlignedBox3f aabb;
+    Eigen::Vector3f centroid;
+    uint32_t user_data;
+    uint32_t index; //!< index in the input array
+  };
+
+  int32_t allocateNode();
+
+  void freeNode(int32_t node_id);
+
+  void insertLeaf(int32_t leaf);
+
+  void removeLeaf(int32_t leaf);
+
+  int32_t balance(int32_t node_id);
+
+  Eigen::AlignedBox3f fatten(const Eigen::AlignedBox3f &aabb) const;
+
+  void buildRange(BuildItem *items, size_t count, int32_t node_id,
+                  int32_t parent, std::vector<int32_t> &proxy_ids,
+                  int depth);
+
+  static float surfaceArea(const Eigen::AlignedBox3f &aabb) {
+    Eigen::Vector3f s = aabb.sizes();
+    return 2.0f * (s.x() * s.y() + s.y() * s.z() + s.z() * s.x());
+  }
+
+  std::vector<Node> nodes_;
+  int32_t root_{kNullNode};
+  int32_t free_list_{kNullNode};
+  size_t proxy_count_{0};
+  float margin_; //!< relative margin of fattened aabb
+};
+
+template <typename Callback>
+void DynamicAABBTree::queryOverlap(const Eigen::AlignedBox3f &aabb,
+                                   Callback &&callback) const {
+  if (root_ == kNullNode)
+    return;
+  std::vector<int32_t> stack;
+  stack.reserve(64);
+  stack.push_back(root_);
+  while (!stack.empty()) {
+    int32_t node_id = stack.back();
+    stack.pop_back();
+    const Node &node = nodes_[node_id];
+    if (!node.aabb.intersects(aabb))
+      continue;
+    if (node.isLeaf()) {
+      if (!callback(node_id))
+        return;
+    } else {
+      stack.push_back(node.child1);
+      stack.push_back(node.child2);
+    }
+  }
+}
+
+template <typename Callback>
+void DynamicAABBTree::queryFrustum(const Frustum &frustum,
+                                   Callback &&callback) const {
+  if (root_ == kNullNode)
+    return;
+  // second: node is fully inside the frustum
+  std::vector<std::pair<int32_t, bool>> stack;
+  stack.reserve(64);
+  stack.emplace_back(root_, false);
+  while (!stack.empty()) {
+    auto [node_id, inside] = stack.back();
+    stack.pop_back();
+    const Node &node = nodes_[node_id];
+    if (!inside) {
+      Eigen::Vector3f c = node.aabb.center();
+      Eigen::Vector3f e = node.aabb.sizes() * 0.5f;
+      bool outside = false;
+      inside = true;
+      for (const auto &plane : frustum.planes) {
+        float d = plane.head<3>().dot(c) + plane.w();
+        float r = plane.head<3>().cwiseAbs().dot(e);
+        if (d + r < 0.0f) {
+          outside = true;
+          break;
+        }
+        if (d - r < 0.0f)
+          inside = false;
+      }
+      if (outside)
+        continue;
+    }
+    if (node.isLeaf()) {
+      if (!callback(node_id))
+        return;
+    } else {
+      stack.emplace_back(node.child1, inside);
+      stack.emplace_back(node.child2, inside);
+    }
+  }
+}
+
+template <typename Callback>
+void DynamicAABBTree::rayCast(const Eigen::Vector3f &origin,
+                              const Eigen::Vector3f &dir, float max_t,
+                              Callback &&callback) const {
+  if (root_ == kNullNode)
+    return;
+  Eigen::Vector3f inv_dir = dir.cwiseInverse();
+  std::vector<int32_t> stack;
+  stack.reserve(64);
+  stack.push_back(root_);
+  while (!stack.empty()) {
+    int32_t node_id = stack.back();
+    stack.pop_back();
+    const Node &node = nodes_[node_id];
+    float t_enter;
+    if (!rayIntersect(node.aabb, origin, inv_dir, max_t, t_enter))
+      continue;
+    if (node.isLeaf()) {
+      float t = callback(node_id, t_enter);
+      if (t == 0.0f)
+        return;
+      if (t > 0.0f && t < max_t)
+        max_t = t;
+    } else {
+      stack.push_back(node.child1);
+      stack.push_back(node.child2);
+    }
+  }
+}
+
+} // namespace mango
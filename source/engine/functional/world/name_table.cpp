@@ -0,0 +1,14 @@
+#include <engine/functional/world/name_table.h>
+
+namespace mango {
+
+uint32_t NameTable::intern(std::string_view name) {
+  auto itr = ids_.find(name);
+  if (itr != ids_.end())
+    return itr->second;
+  const auto id = static_cast<uint32_t>(names_.size());
+  const auto &stored = names_.emplace_back(name);
+  ids_.emplace(stored, id);
+  return id;
+}
+} // namespace mango
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace mango {
+
+/**
+ * @brief interned entity names. Entities store a 4 byte NameComponent instead
+ * of a std::string, equal names share one copy.
+ */
+class NameTable final {
+public:
+  NameTable() = default;
+
+  ~NameTable() = default;
+
+  /**
+   * @brief return the id of name, the name is copied on first use
+   */
+  uint32_t intern(std::string_view name);
+
+  const std::string &get(uint32_t id) const { return names_[id]; }
+
+  size_t size() const { return names_.size(); }
+
+  NameTable(const NameTable &) = delete;
+  NameTable &operator=(const NameTable &) = delete;
+
+private:
+  std::deque<std::string> names_; //!< deque keeps the keys of ids_ valid
+  std::unordered_map<std::string_view, uint32_t> ids_;
+};
+} // namespace mango
@@ -1,10 +1,14 @@
 #include <engine/asset/assimp_importer.h>
 #include <engine/functional/global/engine_context.h>
+#include <engine/functional/render/render_system.h>
 #include <engine/functional/world/world.h>
+#include <engine/functional/world/world_archive.h>
 #include <engine/utils/base/macro.h>
 #include <engine/utils/event/event_system.h>
 #include <engine/utils/vk/vk_driver.h>
+#include <chrono>
 #include <queue>
+#include <unordered_map>
 
 // entt reference: https://skypjack.github.io/entt/md_docs_md_entity.html
 // https://github.com/skypjack/entt/wiki/Crash-Course:-core-functionalities#introduction
@@ -53,6 +57,10 @@ namespace mango {
 // }
 
 World::World() {
+  entities_.on_destroy<StaticMeshComponent>()
+      .connect<&World::retire<StaticMeshComponent>>(this);
+  entities_.on_destroy<MaterialComponent>()
+      .connect<&World::retire<MaterialComponent>>(this);
   g_engine.getEventSystem()->addListener(
       EEventType::ImportScene, [this](const EventPointer &event) {
         auto e = std::static_pointer_cast<ImportSceneEvent>(event);
@@ -69,64 +77,149 @@ World::World() {
   addComponent(default_camera_, camera);
 }
 
+World::~World() {
+  // nothing is retired while the registry is torn down
+  entities_.on_destroy<StaticMeshComponent>().disconnect(this);
+  entities_.on_destroy<MaterialComponent>().disconnect(this);
+}
+
+// entities created per batch, and the main thread time spent on creating
+// imported entities per frame
+static constexpr size_t kImportBatchSize = 256;
+static constexpr float kImportTimeBudgetMs = 2.0f;
+
 void World::loadedMesh2World() {
-  auto prev_frame_index = g_engine.getDriver()->getPrevFrameIndex();
-  auto &scene_data_list = imported_scene_datas_[prev_frame_index];
-  if (scene_data_list.empty())
-    return;
+  // scenes enqueued by the event thread during the last tick, their uploads
+  // are committed
+  auto &scene_data_list = imported_scene_datas_[g_engine.getPrevTickSlot()];
   for (auto &scene_data : scene_data_list) {
     scene_data.scene_root_tr->parent = root_tr_;
     scene_data.scene_root_tr->sibling = root_tr_->child;
     root_tr_->child = scene_data.scene_root_tr;
-    for (auto &mesh_entity_dat : scene_data.mesh_entity_datas) {
-      auto entity = createEntity(mesh_entity_dat.name);
-      addComponent(entity, mesh_entity_dat.tr);
-      addComponent(entity, mesh_entity_dat.mesh);
-      addComponent(entity, mesh_entity_dat.material);
+    pending_imports_.emplace_back(std::move(scene_data));
+  }
+  scene_data_list.clear();
+  if (pending_imports_.empty())
+    return;
+
+  const auto deadline =
+      std::chrono::steady_clock::now() +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<float, std::milli>(kImportTimeBudgetMs));
+  while (!pending_imports_.empty()) {
+    auto &scene_data = pending_imports_.front();
+    auto &mesh_entity_datas = scene_data.mesh_entity_datas;
+    if (import_cursor_ == 0)
+      reserveMeshEntities(mesh_entity_datas.size());
+    while (import_cursor_ < mesh_entity_datas.size()) {
+      const size_t count = std::min(kImportBatchSize,
+                                    mesh_entity_datas.size() - import_cursor_);
+      createMeshEntities(mesh_entity_datas.data() + import_cursor_, count);
+      import_cursor_ += count;
+      if (std::chrono::steady_clock::now() >= deadline)
+        return; // continue in the next frame
     }
+    createLightEntities(scene_data);
+    pending_imports_.pop_front();
+    import_cursor_ = 0;
+    focus_camera2world_ = true;
+    if (std::chrono::steady_clock::now() >= deadline)
+      return;
+  }
+}
 
-    //// for lighting
-    for (auto &light_entity_dat : scene_data.light_entity_datas) {
-      auto entity = createEntity(light_entity_dat.name);
-      addComponent(entity, light_entity_dat.tr);
-      auto light_type = light_entity_dat.light_type;
-      auto light_index = light_entity_dat.light_index;
-      assert(light_type < LightType::LIGHT_TYPE_NUM);
-      if (lighting_.light_num[light_index] < MAX_LIGHT_NUM[light_type]) {
-        light_index += lighting_.light_num[light_type];
-        addComponent(entity, light_index);
-        lighting_dirty_ = true; // need to update light ubo
+void World::reserveMeshEntities(size_t count) {
+  auto reserve = [count](auto &storage) {
+    storage.reserve(storage.size() + count);
+  };
+  reserve(entities_.storage<NameComponent>());
+  reserve(entities_.storage<TransformComponent>());
+  reserve(entities_.storage<StaticMeshComponent>());
+  reserve(entities_.storage<MaterialComponent>());
+  pending_spatial_entities_.reserve(pending_spatial_entities_.size() + count);
+}
+
+void World::createMeshEntities(MeshEntityData *datas, size_t count) {
+  std::vector<entt::entity> entities(count);
+  entities_.create(entities.begin(), entities.end());
+  {
+    std::vector<NameComponent> names(count);
+    for (size_t i = 0; i < count; ++i)
+      names[i].id = names_.intern(datas[i].name);
+    entities_.insert<NameComponent>(entities.begin(), entities.end(),
+                                    names.begin());
+  }
+  {
+    std::vector<TransformComponent> trs(count);
+    for (size_t i = 0; i < count; ++i)
+      trs[i] = std::move(datas[i].tr);
+    entities_.insert<TransformComponent>(entities.begin(), entities.end(),
+                                         trs.begin());
+  }
+  {
+    std::vector<StaticMeshComponent> meshes(count);
+    for (size_t i = 0; i < count; ++i)
+      meshes[i] = std::move(datas[i].mesh);
+    entities_.insert<StaticMeshComponent>(entities.begin(), entities.end(),
+                                          meshes.begin());
+  }
+  {
+    std::vector<MaterialComponent> materials(count);
+    for (size_t i = 0; i < count; ++i)
+      materials[i] = std::move(datas[i].material);
+    entities_.insert<MaterialComponent>(entities.begin(), entities.end(),
+                                        materials.begin());
+  }
+  pending_spatial_entities_.insert(pending_spatial_entities_.end(),
+                                   entities.begin(), entities.end());
+}
+
+void World::createLightEntities(ImportedSceneData &scene_data) {
+  // point light index is 16 bit in LightComponent
+  const size_t point_light_base = point_lights_.size();
+  const size_t point_light_num =
+      std::min(scene_data.point_lights.size(),
+               static_cast<size_t>(MAX_POINT_LIGHT_NUM) - point_light_base);
+  for (auto &light_entity_dat : scene_data.light_entity_datas) {
+    auto entity = createEntity(light_entity_dat.name);
+    addComponent(entity, light_entity_dat.tr);
+    auto light_type = light_entity_dat.light_type;
+    auto light_index = light_entity_dat.light_index;
+    assert(light_type < LightType::LIGHT_TYPE_NUM);
+    if (light_type == LightType::LIGHT_POINT) {
+      if (light_index < point_light_num) {
+        addComponent(entity,
+                     LightComponent{light_type,
+                                    static_cast<uint16_t>(point_light_base +
+                                                          light_index)});
       } else {
         LOGW("light num of light type {} exceed max limit", light_type);
       }
-    }
-
-    // copy lighting data to ubo
-    void *ptr[] = {lighting_.directional_lights +
-                       sizeof(UDirectionalLight) *
-                           lighting_.light_num[LightType::LIGHT_DIRECTIONAL],
-                   lighting_.point_lights +
-                       sizeof(UPointLight) *
-                           lighting_.light_num[LightType::LIGHT_POINT]};
-    size_t cp_size[] = {sizeof(UDirectionalLight), sizeof(UPointLight)};
-    static_assert(sizeof(ptr) / sizeof(void *) == LightType::LIGHT_TYPE_NUM,
-                  "light type num not match");
-    static_assert(sizeof(cp_size) / sizeof(size_t) == LightType::LIGHT_TYPE_NUM,
-                  "light type num not match");
-    for (auto light_type = 0; light_type < LightType::LIGHT_TYPE_NUM;
-         ++light_type) {
-      auto cp_num =
-          std::min(static_cast<uint>(MAX_LIGHT_NUM[light_type]) -
-                       lighting_.light_num[light_type],
-                   scene_data.lighting.light_num[light_type]);
-      memcpy(ptr[light_type], scene_data.lighting.directional_lights,
-             cp_size[light_type] * cp_num);
-      lighting_.light_num[light_type] += cp_num;
-      lighting_dirty_ = true;
+    } else if (lighting_.light_num[light_type] < MAX_LIGHT_NUM[light_type]) {
+      light_index += lighting_.light_num[light_type];
+      addComponent(entity, LightComponent{light_type, light_index});
+      lighting_dirty_ = true; // need to update light ubo
+    } else {
+      LOGW("light num of light type {} exceed max limit", light_type);
     }
   }
-  scene_data_list.clear();
-  focus_camera2world_ = true;
+
+  // copy directional lights to ubo
+  auto cp_num =
+      std::min(static_cast<uint>(MAX_DIRECTIONAL_LIGHT_NUM) -
+                   lighting_.light_num[LightType::LIGHT_DIRECTIONAL],
+               scene_data.lighting.light_num[LightType::LIGHT_DIRECTIONAL]);
+  memcpy(lighting_.directional_lights +
+             lighting_.light_num[LightType::LIGHT_DIRECTIONAL],
+         scene_data.lighting.directional_lights,
+         sizeof(UDirectionalLight) * cp_num);
+  lighting_.light_num[LightType::LIGHT_DIRECTIONAL] += cp_num;
+
+  point_lights_.insert(point_lights_.end(), scene_data.point_lights.begin(),
+                       scene_data.point_lights.begin() + point_light_num);
+  lighting_.light_num[LightType::LIGHT_POINT] =
+      static_cast<uint>(point_lights_.size());
+  lighting_dirty_ = true;
 }
 
 void World::updateTransform() {
@@ -141,9 +234,18 @@ void World::updateTransform() {
     q.pop();
     // visit node
     auto parent = node->parent;
-    node->gtransform = parent->gtransform * node->ltransform;
-    scene_aabb.extend(
-        node->aabb.transformed(Eigen::Affine3f(node->gtransform)));
+    const Eigen::Matrix4f gtransform = parent->gtransform * node->ltransform;
+    if (node->version == 0 || gtransform != node->gtransform) {
+      node->gtransform = gtransform;
+      node->version = ++transform_version_;
+      for (auto entity : node->spatial_entities)
+        moved_spatial_entities_.emplace_back(static_cast<entt::entity>(entity));
+    }
+    if (node->aabb.isEmpty())
+      node->waabb.setEmpty();
+    else
+      node->waabb = node->aabb.transformed(Eigen::Affine3f(node->gtransform));
+    scene_aabb.extend(node->waabb);
     // TODO update aabb for dynamic mesh
 
     // visit sibling
@@ -155,6 +257,171 @@ void World::updateTransform() {
       q.emplace(node->child);
     }
   }
+  updateSpatialTree();
+}
+
+// node without mesh bounds is indexed as a point at its origin
+static Eigen::AlignedBox3f spatialBounds(const TransformRelationship &tr) {
+  if (!tr.waabb.isEmpty())
+    return tr.waabb;
+  Eigen::Vector3f t = tr.gtransform.block<3, 1>(0, 3);
+  return Eigen::AlignedBox3f(t, t);
+}
+
+void World::updateSpatialTree() {
+  constexpr size_t kSpatialRebuildThreshold = 1024;
+  auto proxies = entities_.view<TransformComponent, SpatialProxyComponent>();
+  if (pending_spatial_entities_.size() >= kSpatialRebuildThreshold) {
+    // bulk import: rebuild the whole tree instead of inserting one by one
+    for (auto entity : pending_spatial_entities_) {
+      if (!entities_.valid(entity))
+        continue;
+      entities_.emplace_or_replace<SpatialProxyComponent>(entity);
+      entities_.get<TransformComponent>(entity)->spatial_entities.emplace_back(
+          static_cast<uint32_t>(entity));
+    }
+    pending_spatial_entities_.clear();
+    moved_spatial_entities_.clear();
+    std::vector<Eigen::AlignedBox3f> aabbs;
+    std::vector<uint32_t> user_datas;
+    std::vector<int32_t> proxy_ids;
+    aabbs.reserve(proxies.size_hint());
+    user_datas.reserve(proxies.size_hint());
+    for (auto [entity, tr, proxy] : proxies.each()) {
+      aabbs.emplace_back(spatialBounds(*tr));
+      user_datas.emplace_back(static_cast<uint32_t>(entity));
+    }
+    spatial_tree_.rebuild(aabbs, user_datas, proxy_ids);
+    size_t i = 0;
+    for (auto [entity, tr, proxy] : proxies.each())
+      proxy.proxy_id = proxy_ids[i++];
+    return;
+  }
+
+  // only the entities of moved nodes are visited, the cost follows the
+  // number of moves, not of proxies
+  for (auto entity : moved_spatial_entities_) {
+    if (!entities_.valid(entity))
+      continue;
+    if (auto *proxy = entities_.try_get<SpatialProxyComponent>(entity))
+      spatial_tree_.moveProxy(
+          proxy->proxy_id,
+          spatialBounds(*entities_.get<TransformComponent>(entity)));
+  }
+  moved_spatial_entities_.clear();
+  for (auto entity : pending_spatial_entities_) {
+    if (!entities_.valid(entity))
+      continue;
+    auto &tr = entities_.get<TransformComponent>(entity);
+    entities_.emplace_or_replace<SpatialProxyComponent>(
+        entity, spatial_tree_.createProxy(spatialBounds(*tr),
+                                          static_cast<uint32_t>(entity)));
+    tr->spatial_entities.emplace_back(static_cast<uint32_t>(entity));
+  }
+  pending_spatial_entities_.clear();
+}
+
+void World::queryFrustum(const Frustum &frustum,
+                         std::vector<entt::entity> &result) const {
+  spatial_tree_.queryFrustum(frustum, [&](int32_t proxy_id) {
+    result.emplace_back(
+        static_cast<entt::entity>(spatial_tree_.getUserData(proxy_id)));
+    return true;
+  });
+}
+
+void World::queryOverlap(const Eigen::AlignedBox3f &aabb,
+                         std::vector<entt::entity> &result) const {
+  spatial_tree_.queryOverlap(aabb, [&](int32_t proxy_id) {
+    auto entity =
+        static_cast<entt::entity>(spatial_tree_.getUserData(proxy_id));
+    const auto &tr = entities_.get<TransformComponent>(entity);
+    if (spatialBounds(*tr).intersects(aabb))
+      result.emplace_back(entity);
+    return true;
+  });
+}
+
+entt::entity World::rayCast(const Eigen::Vector3f &origin,
+                            const Eigen::Vector3f &dir, float max_t,
+                            float *hit_t) const {
+  entt::entity ret = entt::null;
+  Eigen::Vector3f inv_dir = dir.cwiseInverse();
+  spatial_tree_.rayCast(origin, dir, max_t, [&](int32_t proxy_id, float) {
+    auto entity =
+        static_cast<entt::entity>(spatial_tree_.getUserData(proxy_id));
+    const auto &tr = entities_.get<TransformComponent>(entity);
+    float t;
+    if (!DynamicAABBTree::rayIntersect(spatialBounds(*tr), origin, inv_dir,
+                                       max_t, t))
+      return max_t; // continue
+    max_t = t;
+    ret = entity;
+    return t; // clip the ray
+  });
+  if (hit_t != nullptr && ret != entt::null)
+    *hit_t = max_t;
+  return ret;
+}
+
+entt::entity World::queryNearest(const Eigen::Vector3f &p) const {
+  int32_t proxy_id = spatial_tree_.queryNearest(p);
+  if (proxy_id == DynamicAABBTree::kNullNode)
+    return entt::null;
+  return static_cast<entt::entity>(spatial_tree_.getUserData(proxy_id));
+}
+
+void World::updatePointLights() {
+  world_point_lights_.resize(point_lights_.size());
+  auto lights = entities_.view<TransformComponent, LightComponent>();
+  for (auto [entity, tr, light] : lights.each()) {
+    if (light.light_type != LightType::LIGHT_POINT)
+      continue;
+    const auto &local = point_lights_[light.light_index];
+    auto &l = world_point_lights_[light.light_index];
+    l = local;
+    l.position.head<3>() =
+        (tr->gtransform * Eigen::Vector4f(local.position.x(), local.position.y(),
+                                          local.position.z(), 1.0f))
+            .head<3>();
+  }
+}
+
+void World::publishRenderSnapshot() {
+  // the render thread reads the previous snapshot, the one written here is
+  // three ticks old
+  const auto slot = snapshot_count_ % MAX_FRAMES_IN_FLIGHT;
+  auto &snapshot = snapshots_[slot];
+  snapshot.frame = snapshot_count_;
+  // the render thread took its own references when it drew the old snapshot
+  // of this slot
+  snapshot.retired_assets.clear();
+  snapshot.retired_assets.swap(retired_assets_);
+
+  auto &camera = getDefaultCameraComp();
+  snapshot.view = camera.getViewMatrix();
+  snapshot.proj = camera.getProjMatrix();
+  snapshot.near_plane = -camera.getNear();
+  snapshot.far_plane = -camera.getFar();
+
+  if (lighting_dirty_) {
+    ++lighting_version_;
+    lighting_dirty_ = false;
+  }
+  snapshot.lighting = lighting_;
+  snapshot.lighting_version = lighting_version_;
+  snapshot.point_lights = world_point_lights_;
+
+  auto static_meshes = getStaticMeshes();
+  snapshot.static_meshes.clear();
+  snapshot.static_meshes.reserve(static_meshes.size_hint());
+  for (auto [entity, name, tr, mesh, material] : static_meshes.each())
+    snapshot.static_meshes.emplace_back(
+        StaticMeshSnapshot{mesh.get(), material.get(), tr->gtransform,
+                           tr->waabb,
+                           static_cast<uint32_t>(entt::to_entity(entity)),
+                           tr->version});
+  ++snapshot_count_;
 }
 
 void World::updateCamera() {
@@ -176,21 +443,361 @@ void World::updateCamera() {
 }
 
 void World::tick(const float seconds) {
-  // append new imported scene to root
+  // replace with opened world file, then append new imported scene to root
+  loadedWorld2World();
   loadedMesh2World();
   updateTransform();
+  updatePointLights();
   updateCamera();
+  publishRenderSnapshot();
 }
 
 void World::importScene(const std::string &url) {
+  if (g_engine.getFileSystem()->extension(url) == "world") {
+    loadWorld(url);
+    return;
+  }
   bool suc = AssimpImporter::import(url, this);
   if (!suc) {
     LOGE("import scene failed: {}", url.c_str());
   }
 }
 
-void World::saveAsWorld(const URL &url) {}
+void World::saveAsWorld(const URL &url) {
+  WorldArchive archive;
+
+  // hierarchy in breadth first order, so parent index < child index
+  std::unordered_map<const TransformRelationship *, uint32_t> node_ids;
+  std::queue<std::pair<TransformRelationship *, int32_t>> q;
+  for (auto child = root_tr_->child; child != nullptr; child = child->sibling)
+    q.emplace(child.get(), WorldArchive::kInvalidId);
+  while (!q.empty()) {
+    auto [node, parent] = q.front();
+    q.pop();
+    const auto node_id = static_cast<uint32_t>(archive.node_parents.size());
+    node_ids[node] = node_id;
+    archive.node_parents.emplace_back(parent);
+    archive.node_ltransforms.emplace_back(node->ltransform);
+    archive.node_aabbs.emplace_back(node->aabb);
+    for (auto child = node->child; child != nullptr; child = child->sibling)
+      q.emplace(child.get(), static_cast<int32_t>(node_id));
+  }
+
+  // asset tables, shared assets are stored once
+  std::unordered_map<AssetTexture *, int32_t> texture_ids;
+  std::unordered_map<const Material *, uint32_t> material_ids;
+  std::unordered_map<const StaticMesh *, uint32_t> mesh_ids;
+  std::vector<uint8_t> image_data;
+  auto add_texture = [&](const std::shared_ptr<AssetTexture> &texture) {
+    if (texture == nullptr)
+      return WorldArchive::kInvalidId;
+    auto itr = texture_ids.find(texture.get());
+    if (itr != texture_ids.end())
+      return itr->second;
+    // streamed textures read their pixels back from the source
+    if (!texture->readImageData(image_data))
+      return WorldArchive::kInvalidId;
+    itr = texture_ids
+              .emplace(texture.get(),
+                       static_cast<int32_t>(archive.textures.size()))
+              .first;
+    archive.textures.emplace_back(WorldArchive::TextureRecord{
+        .width = texture->getWidth(),
+        .height = texture->getHeight(),
+        .texture_type = static_cast<uint32_t>(texture->getTextureType()),
+        .padding = 0,
+        .data_offset = archive.texture_data.size(),
+        .data_size = image_data.size()});
+    archive.texture_data.insert(archive.texture_data.end(), image_data.begin(),
+                                image_data.end());
+    return itr->second;
+  };
+  auto add_material = [&](const std::shared_ptr<Material> &material) {
+    auto [itr, inserted] = material_ids.try_emplace(
+        material.get(), static_cast<uint32_t>(archive.materials.size()));
+    if (!inserted)
+      return itr->second;
+    WorldArchive::MaterialRecord record;
+    record.params = material->getUMaterial();
+    record.textures[0] = add_texture(material->getAlbedoTexture());
+    record.textures[1] = add_texture(material->getNormalTexture());
+    record.textures[2] = add_texture(material->getEmissiveTexture());
+    record.textures[3] =
+        add_texture(material->getMetallicRoughnessOcclutionTexture());
+    archive.materials.emplace_back(record);
+    return itr->second;
+  };
+  auto add_mesh = [&](const std::shared_ptr<StaticMesh> &mesh) {
+    auto [itr, inserted] = mesh_ids.try_emplace(
+        mesh.get(), static_cast<uint32_t>(archive.meshes.size()));
+    if (!inserted)
+      return itr->second;
+    const auto &vertices = mesh->getVertices();
+    const auto &indices = mesh->getIndices();
+    const auto &sub_meshes = mesh->getSubMeshs();
+    archive.meshes.emplace_back(WorldArchive::MeshRecord{
+        .vertex_offset = static_cast<uint32_t>(archive.vertices.size()),
+        .vertex_count = static_cast<uint32_t>(vertices.size()),
+        .index_offset = static_cast<uint32_t>(archive.indices.size()),
+        .index_count = static_cast<uint32_t>(indices.size()),
+        .sub_mesh_offset = static_cast<uint32_t>(archive.sub_meshes.size()),
+        .sub_mesh_count = static_cast<uint32_t>(sub_meshes.size())});
+    archive.vertices.insert(archive.vertices.end(), vertices.begin(),
+                            vertices.end());
+    archive.indices.insert(archive.indices.end(), indices.begin(),
+                           indices.end());
+    archive.sub_meshes.insert(archive.sub_meshes.end(), sub_meshes.begin(),
+                              sub_meshes.end());
+    return itr->second;
+  };
+
+  // entity columns
+  auto static_meshes = getStaticMeshes();
+  const auto mesh_entity_count = static_meshes.size_hint();
+  archive.mesh_entity_names.reserve(mesh_entity_count);
+  archive.mesh_entity_nodes.reserve(mesh_entity_count);
+  archive.mesh_entity_meshes.reserve(mesh_entity_count);
+  archive.mesh_entity_materials.reserve(mesh_entity_count);
+  for (auto [entity, name, tr, mesh, material] : static_meshes.each()) {
+    auto node_itr = node_ids.find(tr.get());
+    if (node_itr == node_ids.end() || mesh == nullptr || material == nullptr) {
+      LOGW("entity {} is not attached to the world, skipped", getName(name));
+      continue;
+    }
+    archive.mesh_entity_names.emplace_back(archive.addString(getName(name)));
+    archive.mesh_entity_nodes.emplace_back(node_itr->second);
+    archive.mesh_entity_meshes.emplace_back(add_mesh(mesh));
+    archive.mesh_entity_materials.emplace_back(add_material(material));
+  }
+  auto lights =
+      entities_.view<NameComponent, TransformComponent, LightComponent>();
+  for (auto [entity, name, tr, light] : lights.each()) {
+    auto node_itr = node_ids.find(tr.get());
+    if (node_itr == node_ids.end())
+      continue;
+    archive.light_entity_names.emplace_back(archive.addString(getName(name)));
+    archive.light_entity_nodes.emplace_back(node_itr->second);
+    archive.light_entity_types.emplace_back(light.light_type);
+    archive.light_entity_indices.emplace_back(light.light_index);
+  }
+  archive.lighting = lighting_;
+  archive.point_lights = point_lights_;
+
+  uint64_t texture_data_offset = 0;
+  if (!archive.save(url.getAbsolute(), &texture_data_offset)) {
+    LOGE("save world failed: {}", url.str());
+    return;
+  }
+  // the file may replace the one the textures were loaded from
+  for (const auto &[texture, id] : texture_ids) {
+    const auto &record = archive.textures[id];
+    texture->setSource(
+        TextureSource{.path = url.getAbsolute(),
+                      .offset = texture_data_offset + record.data_offset,
+                      .size = record.data_size});
+  }
+  url_ = url;
+  LOGI("save world: {}, {} mesh entities, {} meshes, {} materials",
+       url.str(), archive.mesh_entity_names.size(), archive.meshes.size(),
+       archive.materials.size());
+}
+
+void World::saveWorld() {
+  if (url_.empty()) {
+    LOGW("world has not been saved yet, use save as");
+    return;
+  }
+  saveAsWorld(url_);
+}
+
+void World::loadWorld(const URL &url) {
+  LoadedWorldData data;
+  data.archive = std::make_shared<WorldArchive>();
+  auto &archive = *data.archive;
+  try {
+    archive.load(url.getAbsolute());
+  } catch (const std::exception &e) {
+    LOGE("load world failed: {}", e.what());
+    return;
+  }
+
+  // assets
+  std::vector<std::shared_ptr<AssetTexture>> textures(archive.textures.size());
+  for (size_t i = 0; i < textures.size(); ++i) {
+    const auto &record = archive.textures[i];
+    textures[i] = std::make_shared<AssetTexture>();
+    textures[i]->setTextureType(static_cast<ETextureType>(record.texture_type));
+    // streamed textures read their finer mips back from the world file
+    textures[i]->load(
+        record.width, record.height,
+        archive.texture_data.data() + record.data_offset,
+        TextureSource{.path = url.getAbsolute(),
+                      .offset = archive.texture_data_offset + record.data_offset,
+                      .size = record.data_size});
+  }
+  auto get_texture =
+      [&textures](int32_t id) -> std::shared_ptr<AssetTexture> {
+    return id == WorldArchive::kInvalidId ? nullptr : textures[id];
+  };
+  data.materials.resize(archive.materials.size());
+  for (size_t i = 0; i < data.materials.size(); ++i) {
+    const auto &record = archive.materials[i];
+    auto material = std::make_shared<Material>();
+    material->getUMaterial() = record.params;
+    material->setAlbedoTexture(get_texture(record.textures[0]));
+    material->setNormalTexture(get_texture(record.textures[1]));
+    material->setEmissiveTexture(get_texture(record.textures[2]));
+    material->setMetallicRoughnessOcclutionTexture(
+        get_texture(record.textures[3]));
+    material->inflate();
+    data.materials[i] = material;
+  }
+  data.meshes.resize(archive.meshes.size());
+  for (size_t i = 0; i < data.meshes.size(); ++i) {
+    const auto &record = archive.meshes[i];
+    auto mesh = std::make_shared<StaticMesh>();
+    auto vertex_begin = archive.vertices.begin() + record.vertex_offset;
+    mesh->setVertices(std::vector<StaticVertex>(
+        vertex_begin, vertex_begin + record.vertex_count));
+    auto index_begin = archive.indices.begin() + record.index_offset;
+    mesh->setIndices(
+        std::vector<uint32_t>(index_begin, index_begin + record.index_count));
+    auto sub_mesh_begin = archive.sub_meshes.begin() + record.sub_mesh_offset;
+    mesh->setSubMeshs(std::vector<SubMesh>(
+        sub_mesh_begin, sub_mesh_begin + record.sub_mesh_count));
+    mesh->inflate();
+    data.meshes[i] = mesh;
+  }
+
+  // hierarchy, children keep the saved sibling order
+  const size_t node_count = archive.node_parents.size();
+  data.nodes.resize(node_count);
+  std::vector<TransformRelationship *> last_child(node_count, nullptr);
+  for (size_t i = 0; i < node_count; ++i) {
+    auto node = std::make_shared<TransformRelationship>();
+    node->ltransform = archive.node_ltransforms[i];
+    node->aabb = archive.node_aabbs[i];
+    const auto parent = archive.node_parents[i];
+    if (parent != WorldArchive::kInvalidId) {
+      node->parent = data.nodes[parent];
+      if (last_child[parent] == nullptr)
+        data.nodes[parent]->child = node;
+      else
+        last_child[parent]->sibling = node;
+      last_child[parent] = node.get();
+    }
+    data.nodes[i] = node;
+  }
+
+  loaded_world_datas_[g_engine.getTickSlot()].emplace_back(std::move(data));
+  url_ = url;
+  LOGI("load world: {}", url.str());
+}
+
+void World::loadedWorld2World() {
+  auto &world_data_list = loaded_world_datas_[g_engine.getPrevTickSlot()];
+  if (world_data_list.empty())
+    return;
+  // only the last opened world matters
+  LoadedWorldData data = std::move(world_data_list.back());
+  world_data_list.clear();
+  const auto &archive = *data.archive;
 
-void World::saveWorld() {}
+  // clear current world except the default camera, gpu may still use the
+  // meshes and materials of the frames in flight. The render thread submits
+  // to the graphics queue, wait for it first.
+  g_engine.getRenderSystem()->sync();
+  g_engine.getDriver()->getGraphicsQueue()->waitIdle();
+  std::vector<entt::entity> old_entities;
+  for (auto entity : entities_.view<NameComponent>()) {
+    if (entity != default_camera_)
+      old_entities.emplace_back(entity);
+  }
+  for (auto entity : old_entities)
+    if (auto *tr = entities_.try_get<TransformComponent>(entity))
+      (*tr)->spatial_entities.clear();
+  entities_.destroy(old_entities.begin(), old_entities.end());
+  spatial_tree_.clear();
+  pending_spatial_entities_.clear();
+  moved_spatial_entities_.clear();
+  pending_imports_.clear();
+  import_cursor_ = 0;
+  root_tr_->child = nullptr;
+  root_tr_->aabb.setEmpty();
+
+  // top level nodes are attached to root in saved order
+  TransformRelationship *last_top = nullptr;
+  for (size_t i = 0; i < data.nodes.size(); ++i) {
+    if (archive.node_parents[i] != WorldArchive::kInvalidId)
+      continue;
+    data.nodes[i]->parent = root_tr_;
+    if (last_top == nullptr)
+      root_tr_->child = data.nodes[i];
+    else
+      last_top->sibling = data.nodes[i];
+    last_top = data.nodes[i].get();
+  }
+
+  // static mesh entities, created and filled column by column
+  const size_t mesh_entity_count = archive.mesh_entity_names.size();
+  std::vector<entt::entity> mesh_entities(mesh_entity_count);
+  entities_.create(mesh_entities.begin(), mesh_entities.end());
+  {
+    std::vector<NameComponent> names(mesh_entity_count);
+    for (size_t i = 0; i < mesh_entity_count; ++i)
+      names[i].id =
+          names_.intern(archive.getString(archive.mesh_entity_names[i]));
+    entities_.insert<NameComponent>(mesh_entities.begin(), mesh_entities.end(),
+                                    names.begin());
+  }
+  {
+    std::vector<TransformComponent> trs(mesh_entity_count);
+    for (size_t i = 0; i < mesh_entity_count; ++i)
+      trs[i] = data.nodes[archive.mesh_entity_nodes[i]];
+    entities_.insert<TransformComponent>(mesh_entities.begin(),
+                                         mesh_entities.end(), trs.begin());
+  }
+  {
+    std::vector<StaticMeshComponent> meshes(mesh_entity_count);
+    for (size_t i = 0; i < mesh_entity_count; ++i)
+      meshes[i] = data.meshes[archive.mesh_entity_meshes[i]];
+    entities_.insert<StaticMeshComponent>(mesh_entities.begin(),
+                                          mesh_entities.end(), meshes.begin());
+  }
+  {
+    std::vector<MaterialComponent> materials(mesh_entity_count);
+    for (size_t i = 0; i < mesh_entity_count; ++i)
+      materials[i] = data.materials[archive.mesh_entity_materials[i]];
+    entities_.insert<MaterialComponent>(mesh_entities.begin(),
+                                        mesh_entities.end(), materials.begin());
+  }
+  pending_spatial_entities_ = std::move(mesh_entities);
+
+  // light entities
+  const size_t light_entity_count = archive.light_entity_names.size();
+  std::vector<entt::entity> light_entities(light_entity_count);
+  entities_.create(light_entities.begin(), light_entities.end());
+  std::vector<NameComponent> light_names(light_entity_count);
+  std::vector<TransformComponent> light_trs(light_entity_count);
+  std::vector<LightComponent> light_comps(light_entity_count);
+  for (size_t i = 0; i < light_entity_count; ++i) {
+    light_names[i].id =
+        names_.intern(archive.getString(archive.light_entity_names[i]));
+    light_trs[i] = data.nodes[archive.light_entity_nodes[i]];
+    light_comps[i] = LightComponent{archive.light_entity_types[i],
+                                    archive.light_entity_indices[i]};
+  }
+  entities_.insert<NameComponent>(light_entities.begin(),
+                                  light_entities.end(), light_names.begin());
+  entities_.insert<TransformComponent>(light_entities.begin(),
+                                       light_entities.end(), light_trs.begin());
+  entities_.insert<LightComponent>(light_entities.begin(),
+                                   light_entities.end(), light_comps.begin());
+
+  lighting_ = archive.lighting;
+  lighting_dirty_ = true;
+  point_lights_ = archive.point_lights;
+  focus_camera2world_ = true;
+}
 
 } // namespace mango
\ No newline at end of file
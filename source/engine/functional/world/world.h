@@ -1,11 +1,15 @@
 #pragma once
 
+#include <deque>
 #include <entt/entt.hpp>
 #include <mutex>
 
 #include <engine/functional/component/component_camera.h>
 #include <engine/functional/component/component_transform.h>
 #include <engine/functional/component/components.h>
+#include <engine/functional/render/render_snapshot.h>
+#include <engine/functional/world/dynamic_aabb_tree.h>
+#include <engine/functional/world/name_table.h>
 #include <engine/functional/global/engine_context.h>
 #include <engine/asset/asset_material.h>
 #include <engine/asset/url.h>
@@ -31,18 +35,32 @@ struct LightEntityData {
   uint16_t light_index;
 };
 
+struct WorldArchive;
+
+/**
+ * @brief world file parsed and its assets uploaded, waiting to replace the
+ * current world
+ */
+struct LoadedWorldData {
+  std::shared_ptr<WorldArchive> archive;
+  std::vector<std::shared_ptr<StaticMesh>> meshes;
+  std::vector<std::shared_ptr<Material>> materials;
+  std::vector<std::shared_ptr<TransformRelationship>> nodes;
+};
+
 struct ImportedSceneData {
   std::shared_ptr<TransformRelationship> scene_root_tr;
   std::vector<MeshEntityData> mesh_entity_datas;
   std::vector<LightEntityData> light_entity_datas;
-  ULighting lighting;
+  ULighting lighting; //!< directional lights
+  std::vector<UPointLight> point_lights; //!< position in light node space
 };
 
 class World final {
 public:
   World();
 
-  ~World() = default;
+  ~World();
 
   std::string getName() const { return name_; }
 
@@ -55,17 +73,45 @@ public:
    */
   void importScene(const std::string &url);
 
+  /**
+   * @brief open a binary world file (.world), the current world is replaced
+   * in the next tick
+   */
+  void loadWorld(const URL &url);
+
+  /**
+   * @brief save entities, hierarchy and assets referenced by them to a binary
+   * world file, see WorldArchive
+   */
   void saveAsWorld(const URL &url);
 
+  /**
+   * @brief save to the file the world is loaded from or last saved to
+   */
   void saveWorld();
 
-  entt::entity createEntity(const std::string &name) {    
+  entt::entity createEntity(const std::string &name) {
     auto ret = entities_.create();
-    entities_.emplace<std::string>(ret, name);
+    entities_.emplace<NameComponent>(ret, names_.intern(name));
     return ret;
   }
 
-  void removeEntity(entt::entity entity) { entities_.destroy(entity); }
+  const std::string &getEntityName(entt::entity entity) const {
+    return names_.get(entities_.get<NameComponent>(entity).id);
+  }
+
+  const std::string &getName(const NameComponent &name) const {
+    return names_.get(name.id);
+  }
+
+  void removeEntity(entt::entity entity) {
+    if (auto *proxy = entities_.try_get<SpatialProxyComponent>(entity)) {
+      spatial_tree_.destroyProxy(proxy->proxy_id);
+      std::erase(entities_.get<TransformComponent>(entity)->spatial_entities,
+                 static_cast<uint32_t>(entity));
+    }
+    entities_.destroy(entity);
+  }
 
   template<typename T>
   void addComponent(entt::entity entity, const T &comp) {
@@ -73,7 +119,7 @@ public:
   }
 
   auto getCameras() {
-    return entities_.view<std::string, std::shared_ptr<TransformRelationship>,
+    return entities_.view<NameComponent, TransformComponent,
                           CameraComponent>();
   }
 
@@ -83,27 +129,72 @@ public:
   }
 
   auto getStaticMeshes() {
-    return entities_.view<std::string, TransformComponent, StaticMeshComponent, MaterialComponent>();
+    return entities_.view<NameComponent, TransformComponent,
+                          StaticMeshComponent, MaterialComponent>();
   }
 
   void enqueue(const std::shared_ptr<TransformRelationship> &tr,
                std::vector<MeshEntityData> &&mesh_entity_datas,
                std::vector<LightEntityData> &&light_entity_datas,
-               const ULighting &lighting) {
-    auto driver = g_engine.getDriver();
-    auto &dat = imported_scene_datas_[driver->getCurFrameIndex()].emplace_back();
+               const ULighting &lighting,
+               std::vector<UPointLight> &&point_lights) {
+    auto &dat = imported_scene_datas_[g_engine.getTickSlot()].emplace_back();
     dat.scene_root_tr = tr;
     dat.mesh_entity_datas = std::move(mesh_entity_datas);
     dat.light_entity_datas = std::move(light_entity_datas);
     dat.lighting = lighting;
+    dat.point_lights = std::move(point_lights);
   }
 
   void focusCamera2World() { focus_camera2world_ = true; }
 
+  //// spatial queries, conservative: fat bounds of the spatial tree are used
+  //// unless noted
+
+  /**
+   * @brief static mesh entities intersecting the frustum
+   */
+  void queryFrustum(const Frustum &frustum,
+                    std::vector<entt::entity> &result) const;
+
+  /**
+   * @brief static mesh entities whose world aabb overlaps aabb
+   */
+  void queryOverlap(const Eigen::AlignedBox3f &aabb,
+                    std::vector<entt::entity> &result) const;
+
+  /**
+   * @brief closest static mesh entity whose world aabb is hit by the ray
+   * @return entt::null if nothing is hit
+   */
+  entt::entity rayCast(const Eigen::Vector3f &origin,
+                       const Eigen::Vector3f &dir, float max_t = FLT_MAX,
+                       float *hit_t = nullptr) const;
+
+  /**
+   * @brief static mesh entity nearest to p
+   * @return entt::null if the world is empty
+   */
+  entt::entity queryNearest(const Eigen::Vector3f &p) const;
+
+  const DynamicAABBTree &getSpatialTree() const { return spatial_tree_; }
+
   // Lighting data accessors
-  bool isLightingDirty() const { return lighting_dirty_; }
   const ULighting& getLighting() const { return lighting_; }
-  void clearLightingDirty() { lighting_dirty_ = false; }
+
+  //! point lights in world space, indexed by LightComponent::light_index
+  const std::vector<UPointLight> &getPointLights() const {
+    return world_point_lights_;
+  }
+
+  /**
+   * @brief snapshot written at the end of the last tick. Snapshots are triple
+   * buffered, the returned one stays valid while the next tick runs.
+   */
+  const RenderSnapshot &getRenderSnapshot() const {
+    return snapshots_[(snapshot_count_ + MAX_FRAMES_IN_FLIGHT - 1) %
+                      MAX_FRAMES_IN_FLIGHT];
+  }
 
   // disable copy/move
   World(const World &) = delete;
@@ -113,26 +204,99 @@ public:
 
 private:
   /**
-   * @brief 将预加载的mesh数据加载到世界中
+   * @brief 将预加载的mesh数据加载到世界中. Entities are created in batches,
+   * a large scene is spread over several frames within kImportTimeBudgetMs
+   * per frame.
    */
   void loadedMesh2World();
 
+  /**
+   * @brief reserve component pools for count more static mesh entities
+   */
+  void reserveMeshEntities(size_t count);
+
+  /**
+   * @brief create count static mesh entities with bulk registry insertion,
+   * datas are moved from
+   */
+  void createMeshEntities(MeshEntityData *datas, size_t count);
+
+  /**
+   * @brief create light entities of the scene, append its directional lights
+   * to the lighting ubo data and its point lights to point_lights_
+   */
+  void createLightEntities(ImportedSceneData &scene_data);
+
+  /**
+   * @brief replace the current world with the loaded world file, entities are
+   * created and their components inserted column by column
+   */
+  void loadedWorld2World();
+
   void updateTransform();
 
+  /**
+   * @brief refit the proxies of entities whose node moved in this
+   * updateTransform and insert new ones into the spatial tree, large batches
+   * trigger a parallel rebuild
+   */
+  void updateSpatialTree();
+
+  /**
+   * @brief transform point lights to world space by their light nodes
+   */
+  void updatePointLights();
+
   void updateCamera();
 
+  /**
+   * @brief copy camera, lights and static meshes into the next render snapshot
+   */
+  void publishRenderSnapshot();
+
+  /**
+   * @brief keep the asset of a destroyed entity alive, earlier snapshots may
+   * still refer to it. Handed to the render thread with the next snapshot.
+   */
+  template <typename T>
+  void retire(entt::registry &registry, entt::entity entity) {
+    retired_assets_.emplace_back(registry.get<T>(entity));
+  }
+
   std::string name_;
+  URL url_; //!< world file, empty if never saved
   entt::registry entities_;
   std::shared_ptr<TransformRelationship>
       root_tr_; // root transform relationship node
   std::vector<ImportedSceneData> imported_scene_datas_[MAX_FRAMES_IN_FLIGHT];
+  std::vector<LoadedWorldData> loaded_world_datas_[MAX_FRAMES_IN_FLIGHT];
+  std::deque<ImportedSceneData> pending_imports_; //!< scenes being created
+  size_t import_cursor_{0}; //!< next mesh entity of pending_imports_.front()
+  NameTable names_;
   entt::entity default_camera_;
   
   // light ubo data
   ULighting lighting_;
   bool lighting_dirty_{true};
+  uint64_t lighting_version_{0};
+  std::vector<UPointLight> point_lights_; //!< in light node space
+  std::vector<UPointLight> world_point_lights_;
   
   bool focus_camera2world_{false};
+
+  //! last TransformRelationship::version handed out
+  uint64_t transform_version_{0};
+
+  DynamicAABBTree spatial_tree_;
+  std::vector<entt::entity> pending_spatial_entities_; //!< waiting for insertion
+  //! proxied entities whose node moved since the last refit, gathered through
+  //! TransformRelationship::spatial_entities when a version is bumped
+  std::vector<entt::entity> moved_spatial_entities_;
+
+  RenderSnapshot snapshots_[MAX_FRAMES_IN_FLIGHT];
+  uint64_t snapshot_count_{0}; //!< snapshots published
+  //! meshes and materials of entities destroyed since the last snapshot
+  std::vector<std::shared_ptr<void>> retired_assets_;
 };
 
 } // namespace mango
\ No newline at end of file
@@ -0,0 +1,236 @@
+#include <engine/functional/world/world_archive.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+
+#include <engine/functional/global/engine_context.h>
+#include <engine/platform/file_system.h>
+
+namespace mango {
+
+enum class EWorldSection : uint32_t {
+  StringChars = 1,
+  StringOffsets,
+  Textures,
+  TextureData,
+  Materials,
+  Meshes,
+  Vertices,
+  Indices,
+  SubMeshes,
+  NodeParents,
+  NodeLTransforms,
+  NodeAABBs,
+  MeshEntityNames,
+  MeshEntityNodes,
+  MeshEntityMeshes,
+  MeshEntityMaterials,
+  LightEntityNames,
+  LightEntityNodes,
+  LightEntityTypes,
+  LightEntityIndices,
+  Lighting,
+  PointLights,
+};
+
+struct WorldFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t section_count;
+  uint32_t reserved;
+};
+
+struct WorldSectionHeader {
+  uint32_t tag;
+  uint32_t element_size; //!< checked on load, catches layout changes
+  uint64_t element_count;
+};
+
+/**
+ * @brief call f(tag, column) for every column of the archive, Archive is
+ * WorldArchive or const WorldArchive
+ */
+template <typename Archive, typename F>
+static void visitColumns(Archive &archive, F &&f) {
+  f(EWorldSection::StringChars, archive.string_chars);
+  f(EWorldSection::StringOffsets, archive.string_offsets);
+  f(EWorldSection::Textures, archive.textures);
+  f(EWorldSection::TextureData, archive.texture_data);
+  f(EWorldSection::Materials, archive.materials);
+  f(EWorldSection::Meshes, archive.meshes);
+  f(EWorldSection::Vertices, archive.vertices);
+  f(EWorldSection::Indices, archive.indices);
+  f(EWorldSection::SubMeshes, archive.sub_meshes);
+  f(EWorldSection::NodeParents, archive.node_parents);
+  f(EWorldSection::NodeLTransforms, archive.node_ltransforms);
+  f(EWorldSection::NodeAABBs, archive.node_aabbs);
+  f(EWorldSection::MeshEntityNames, archive.mesh_entity_names);
+  f(EWorldSection::MeshEntityNodes, archive.mesh_entity_nodes);
+  f(EWorldSection::MeshEntityMeshes, archive.mesh_entity_meshes);
+  f(EWorldSection::MeshEntityMaterials, archive.mesh_entity_materials);
+  f(EWorldSection::LightEntityNames, archive.light_entity_names);
+  f(EWorldSection::LightEntityNodes, archive.light_entity_nodes);
+  f(EWorldSection::LightEntityTypes, archive.light_entity_types);
+  f(EWorldSection::LightEntityIndices, archive.light_entity_indices);
+  f(EWorldSection::PointLights, archive.point_lights);
+}
+
+uint32_t WorldArchive::addString(const std::string &str) {
+  string_chars.insert(string_chars.end(), str.begin(), str.end());
+  string_offsets.emplace_back(static_cast<uint32_t>(string_chars.size()));
+  return static_cast<uint32_t>(string_offsets.size() - 2);
+}
+
+bool WorldArchive::save(const std::string &file_path,
+                        uint64_t *texture_data_offset) const {
+  // write to a temporary file first, a failed save keeps the old world
+  const std::string tmp_path = file_path + ".tmp";
+  std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+  if (!file.is_open())
+    return false;
+
+  WorldFileHeader header{kMagic, kVersion, 0, 0};
+  visitColumns(*this, [&header](EWorldSection, const auto &) {
+    ++header.section_count;
+  });
+  ++header.section_count; // lighting
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  auto write_section = [&file, texture_data_offset](
+                           EWorldSection tag, const void *data,
+                           uint32_t element_size, uint64_t count) {
+    WorldSectionHeader section{static_cast<uint32_t>(tag), element_size,
+                               count};
+    file.write(reinterpret_cast<const char *>(&section), sizeof(section));
+    if (tag == EWorldSection::TextureData && texture_data_offset != nullptr)
+      *texture_data_offset = static_cast<uint64_t>(file.tellp());
+    file.write(reinterpret_cast<const char *>(data), element_size * count);
+  };
+  visitColumns(*this, [&write_section](EWorldSection tag, const auto &column) {
+    using T = typename std::decay_t<decltype(column)>::value_type;
+    write_section(tag, column.data(), sizeof(T), column.size());
+  });
+  write_section(EWorldSection::Lighting, &lighting, sizeof(ULighting), 1);
+  file.close();
+  if (!file)
+    return false;
+
+  std::remove(file_path.c_str());
+  return std::rename(tmp_path.c_str(), file_path.c_str()) == 0;
+}
+
+void WorldArchive::load(const std::string &file_path) {
+  std::vector<uint8_t> buffer;
+  if (!g_engine.getFileSystem()->loadBinary(file_path, buffer))
+    throw std::runtime_error("failed to read world file " + file_path);
+
+  size_t offset = 0;
+  auto read = [&](void *dst, size_t size) {
+    if (offset + size > buffer.size())
+      throw std::runtime_error("world file truncated: " + file_path);
+    memcpy(dst, buffer.data() + offset, size);
+    offset += size;
+  };
+
+  WorldFileHeader header;
+  read(&header, sizeof(header));
+  if (header.magic != kMagic)
+    throw std::runtime_error("not a world file: " + file_path);
+  if (header.version != kVersion)
+    throw std::runtime_error("unsupported world file version " +
+                             std::to_string(header.version));
+
+  for (uint32_t i = 0; i < header.section_count; ++i) {
+    WorldSectionHeader section;
+    read(&section, sizeof(section));
+    const auto tag = static_cast<EWorldSection>(section.tag);
+    const uint64_t payload_size = section.element_size * section.element_count;
+    if (offset + payload_size > buffer.size())
+      throw std::runtime_error("world file truncated: " + file_path);
+
+    bool known = false;
+    if (tag == EWorldSection::Lighting) {
+      if (section.element_size != sizeof(ULighting) ||
+          section.element_count != 1)
+        throw std::runtime_error("world file lighting layout mismatch");
+      read(&lighting, sizeof(ULighting));
+      continue;
+    }
+    visitColumns(*this, [&](EWorldSection column_tag, auto &column) {
+      if (column_tag != tag)
+        return;
+      using T = typename std::decay_t<decltype(column)>::value_type;
+      if (section.element_size != sizeof(T))
+        throw std::runtime_error("world file column layout mismatch, tag " +
+                                 std::to_string(section.tag));
+      if (tag == EWorldSection::TextureData)
+        texture_data_offset = offset;
+      column.resize(section.element_count);
+      read(column.data(), payload_size);
+      known = true;
+    });
+    // sections from newer writers are skipped
+    if (!known)
+      offset += payload_size;
+  }
+
+  // validate references, so the world can index without checks
+  auto check = [&file_path](bool cond, const char *what) {
+    if (!cond)
+      throw std::runtime_error(std::string("broken world file ") + file_path +
+                               ": " + what);
+  };
+  check(!string_offsets.empty() &&
+            string_offsets.back() <= string_chars.size(),
+        "string table");
+  const size_t string_count = getStringCount();
+  for (const auto &texture : textures)
+    check(texture.data_offset + texture.data_size <= texture_data.size() &&
+              texture.data_size == 4ull * texture.width * texture.height,
+          "texture");
+  for (const auto &material : materials)
+    for (auto texture_id : material.textures)
+      check(texture_id == kInvalidId ||
+                (texture_id >= 0 &&
+                 static_cast<size_t>(texture_id) < textures.size()),
+            "material texture id");
+  for (const auto &mesh : meshes)
+    check(mesh.vertex_offset + mesh.vertex_count <= vertices.size() &&
+              mesh.index_offset + mesh.index_count <= indices.size() &&
+              mesh.sub_mesh_offset + mesh.sub_mesh_count <= sub_meshes.size(),
+          "mesh range");
+  const size_t node_count = node_parents.size();
+  check(node_ltransforms.size() == node_count &&
+            node_aabbs.size() == node_count,
+        "node columns");
+  for (size_t i = 0; i < node_count; ++i)
+    check(node_parents[i] >= -1 && node_parents[i] < static_cast<int32_t>(i),
+          "node parent order");
+  const size_t mesh_entity_count = mesh_entity_names.size();
+  check(mesh_entity_nodes.size() == mesh_entity_count &&
+            mesh_entity_meshes.size() == mesh_entity_count &&
+            mesh_entity_materials.size() == mesh_entity_count,
+        "mesh entity columns");
+  for (size_t i = 0; i < mesh_entity_count; ++i)
+    check(mesh_entity_names[i] < string_count &&
+              mesh_entity_nodes[i] < node_count &&
+              mesh_entity_meshes[i] < meshes.size() &&
+              mesh_entity_materials[i] < materials.size(),
+          "mesh entity reference");
+  const size_t light_entity_count = light_entity_names.size();
+  check(light_entity_nodes.size() == light_entity_count &&
+            light_entity_types.size() == light_entity_count &&
+            light_entity_indices.size() == light_entity_count,
+        "light entity columns");
+  for (size_t i = 0; i < light_entity_count; ++i)
+    check(light_entity_names[i] < string_count &&
+              light_entity_nodes[i] < node_count &&
+              light_entity_types[i] < LightType::LIGHT_TYPE_NUM &&
+              (light_entity_types[i] != LightType::LIGHT_POINT ||
+               light_entity_indices[i] < point_lights.size()),
+          "light entity reference");
+}
+} // namespace mango
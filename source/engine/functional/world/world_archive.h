@@ -0,0 +1,115 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <engine/asset/asset_mesh.h>
+#include <shaders/include/shader_structs.h>
+
+namespace mango {
+
+/**
+ * @brief binary world file (.world), little endian.
+ *
+ * header | section* , each section is {tag, element size, element count,
+ * payload}. Every section is a contiguous column of trivially copyable
+ * elements, so loading is a single file read plus one memcpy per column, and
+ * entity columns can be bulk inserted into the registry.
+ *
+ * Assets are referenced by index(asset id) into the mesh/material/texture
+ * tables stored in the same file. Hierarchy is stored as a parent index array
+ * in breadth first order (parent index < child index, -1 for top level nodes).
+ */
+struct WorldArchive {
+  static constexpr uint32_t kMagic = 0x444c5747; // "GWLD"
+  static constexpr uint32_t kVersion = 2;
+  static constexpr int32_t kInvalidId = -1;
+
+  struct TextureRecord {
+    uint32_t width;
+    uint32_t height;
+    uint32_t texture_type; //!< ETextureType
+    uint32_t padding;
+    uint64_t data_offset; //!< offset in texture_data, rgba8 pixels
+    uint64_t data_size;
+  };
+
+  struct MaterialRecord {
+    UMaterial params;
+    int32_t textures[4]; //!< albedo, normal, emissive,
+                         //!< metallic_roughness_occlution, -1 if none
+  };
+
+  struct MeshRecord {
+    uint32_t vertex_offset;
+    uint32_t vertex_count;
+    uint32_t index_offset;
+    uint32_t index_count;
+    uint32_t sub_mesh_offset;
+    uint32_t sub_mesh_count;
+  };
+
+  // string table, string i is [string_offsets[i], string_offsets[i+1])
+  std::vector<char> string_chars;
+  std::vector<uint32_t> string_offsets{0};
+
+  // asset tables
+  std::vector<TextureRecord> textures;
+  std::vector<uint8_t> texture_data;
+  std::vector<MaterialRecord> materials;
+  std::vector<MeshRecord> meshes;
+  std::vector<StaticVertex> vertices;
+  std::vector<uint32_t> indices;
+  std::vector<SubMesh> sub_meshes;
+
+  // transform hierarchy
+  std::vector<int32_t> node_parents;
+  std::vector<Eigen::Matrix4f> node_ltransforms;
+  std::vector<Eigen::AlignedBox3f> node_aabbs;
+
+  // static mesh entity columns
+  std::vector<uint32_t> mesh_entity_names; //!< string id
+  std::vector<uint32_t> mesh_entity_nodes; //!< node index
+  std::vector<uint32_t> mesh_entity_meshes; //!< mesh id
+  std::vector<uint32_t> mesh_entity_materials; //!< material id
+
+  // light entity columns
+  std::vector<uint32_t> light_entity_names;
+  std::vector<uint32_t> light_entity_nodes;
+  std::vector<uint16_t> light_entity_types;
+  std::vector<uint16_t> light_entity_indices;
+
+  ULighting lighting; //!< directional lights
+  std::vector<UPointLight> point_lights;
+
+  //! file offset of the texture_data payload set by load, the pixels of a
+  //! texture can be read back from there. Not a column.
+  uint64_t texture_data_offset{0};
+
+  uint32_t addString(const std::string &str);
+
+  std::string_view getString(uint32_t id) const {
+    return std::string_view(string_chars.data() + string_offsets[id],
+                            string_offsets[id + 1] - string_offsets[id]);
+  }
+
+  size_t getStringCount() const { return string_offsets.size() - 1; }
+
+  /**
+   * @brief write to file, return false if the file can't be written
+   * @param texture_data_offset output, file offset of the texture_data payload
+   */
+  bool save(const std::string &file_path,
+            uint64_t *texture_data_offset = nullptr) const;
+
+  /**
+   * @brief read from file, throw std::runtime_error if the file is broken or
+   * the version mismatches
+   */
+  void load(const std::string &file_path);
+};
+} // namespace mango
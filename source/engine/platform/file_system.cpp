@@ -23,6 +23,11 @@ void FileSystem::init() {
   if (!exists(cache_dir)) {
     createDir(cache_dir);
   }
+
+  std::string spv_dir = getSpvDir();
+  if (!exists(spv_dir)) {
+    createDir(spv_dir, true);
+  }
 }
 
 void FileSystem::destroy() {}
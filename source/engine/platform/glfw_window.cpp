@@ -21,6 +21,11 @@ GlfwWindow::GlfwWindow(const std::string &window_title, const int width,
   window_ =
       glfwCreateWindow(width, height, window_title.c_str(), nullptr, nullptr);
 
+  int window_width = 0, window_height = 0;
+  glfwGetWindowSize(window_, &window_width, &window_height);
+  width_ = static_cast<uint32_t>(window_width);
+  height_ = static_cast<uint32_t>(window_height);
+
   setupCallback();
 
   // set input mode
@@ -43,8 +48,9 @@ VkSurfaceKHR GlfwWindow::createSurface(VkInstance instance) {
 }
 
 void GlfwWindow::getWindowSize(uint32_t &width, uint32_t &height) {
-  glfwGetWindowSize(window_, reinterpret_cast<int *>(&width),
-                    reinterpret_cast<int *>(&height));
+  // glfw window functions are main thread only
+  width = width_.load();
+  height = height_.load();
 }
 
 void GlfwWindow::setupCallback() {
@@ -115,6 +121,9 @@ void GlfwWindow::dropCallback(GLFWwindow *window, int count,
 }
 
 void GlfwWindow::windowSizeCallback(GLFWwindow *window, int width, int height) {
+  auto *self = static_cast<GlfwWindow *>(glfwGetWindowUserPointer(window));
+  self->width_ = static_cast<uint32_t>(width);
+  self->height_ = static_cast<uint32_t>(height);
   g_engine.getEventSystem()->asyncDispatch(
       std::make_shared<WindowSizeEvent>(width, height));
 }
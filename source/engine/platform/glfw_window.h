@@ -2,6 +2,7 @@
 #include <GLFW/glfw3.h>
 #include <engine/platform/window.h>
 #include <engine/utils/vk/vk_config.h>
+#include <atomic>
 #include <memory>
 
 namespace mango {
@@ -25,6 +26,10 @@ public:
 
   void processEvents() override { glfwPollEvents(); }
 
+  /**
+   * @brief size of the last processed resize, safe to call from the render
+   * thread
+   */
   void getWindowSize(uint32_t &width, uint32_t &height) override;
 
   void getMousePos(int32_t &xpos, int32_t &ypos) override {
@@ -58,5 +63,7 @@ private:
 
   int32_t xpos_;
   int32_t ypos_;
+  std::atomic<uint32_t> width_{0};
+  std::atomic<uint32_t> height_{0};
 };
 } // namespace mango
\ No newline at end of file
@@ -0,0 +1,167 @@
+#include <engine/utils/base/memory.h>
+
+#include <cstring>
+
+namespace utils {
+
+// copy from filament
+// ------------------------------------------------------------------------------------------------
+
+LinearAllocator::LinearAllocator(void *begin, void *end) noexcept
+    : mBegin(begin), mSize(uint32_t(uintptr_t(end) - uintptr_t(begin))) {}
+
+LinearAllocator::LinearAllocator(LinearAllocator &&rhs) noexcept {
+  this->swap(rhs);
+}
+
+LinearAllocator &LinearAllocator::operator=(LinearAllocator &&rhs) noexcept {
+  if (this != &rhs) {
+    this->swap(rhs);
+  }
+  return *this;
+}
+
+void LinearAllocator::swap(LinearAllocator &rhs) noexcept {
+  std::swap(mBegin, rhs.mBegin);
+  std::swap(mSize, rhs.mSize);
+  std::swap(mCur, rhs.mCur);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+FreeList::Node *FreeList::init(void *begin, void *end, size_t elementSize,
+                               size_t alignment, size_t extra) noexcept {
+  void *const p = pointermath::align(begin, alignment, extra);
+  void *const n = pointermath::align(pointermath::add(p, elementSize),
+                                     alignment, extra);
+  assert(p >= begin && p < end);
+  assert(n >= begin && n < end && n > p);
+
+  const size_t d = uintptr_t(n) - uintptr_t(p);
+  const size_t num = (uintptr_t(end) - uintptr_t(p)) / d;
+
+  // set first entry
+  Node *head = static_cast<Node *>(p);
+
+  // next entry
+  Node *cur = head;
+  for (size_t i = 1; i < num; i++) {
+    Node *next = pointermath::add(cur, d);
+    cur->next = next;
+    cur = next;
+  }
+  assert(cur < end);
+  assert(pointermath::add(cur, d) <= end);
+  cur->next = nullptr;
+  return head;
+}
+
+FreeList::FreeList(void *begin, void *end, size_t elementSize,
+                   size_t alignment, size_t extra) noexcept
+    : mHead(init(begin, end, elementSize, alignment, extra))
+#ifndef NDEBUG
+      ,
+      mBegin(begin), mEnd(end)
+#endif
+{
+}
+
+AtomicFreeList::AtomicFreeList(void *begin, void *end, size_t elementSize,
+                               size_t alignment, size_t extra) noexcept {
+  void *const p = pointermath::align(begin, alignment, extra);
+  void *const n = pointermath::align(pointermath::add(p, elementSize),
+                                     alignment, extra);
+  assert(p >= begin && p < end);
+  assert(n >= begin && n < end && n > p);
+
+  const size_t d = uintptr_t(n) - uintptr_t(p);
+  const size_t num = (uintptr_t(end) - uintptr_t(p)) / d;
+
+  // set first entry
+  Node *head = static_cast<Node *>(p);
+  mStorage = head;
+
+  // next entry
+  Node *cur = head;
+  for (size_t i = 1; i < num; i++) {
+    Node *next = pointermath::add(cur, d);
+    cur->next = next;
+    cur = next;
+  }
+  assert(cur < end);
+  assert(pointermath::add(cur, d) <= end);
+  cur->next = nullptr;
+
+  mHead.store({int32_t(head - mStorage), 0});
+}
+
+// ------------------------------------------------------------------------------------------------
+
+namespace TrackingPolicy {
+
+HighWatermark::~HighWatermark() noexcept = default;
+
+void HighWatermark::onAlloc(void *p, size_t size, size_t alignment,
+                            size_t extra) noexcept {
+  (void)alignment, (void)extra;
+  if (p) {
+    mCurrent += uint32_t(size);
+    mHighWaterMark = mCurrent > mHighWaterMark ? mCurrent : mHighWaterMark;
+  }
+}
+
+void HighWatermark::onFree(void *p, size_t size) noexcept {
+  // FIXME: this code is incorrect with LinearAllocators because free() is a
+  // no-op for them
+  (void)p;
+  mCurrent -= uint32_t(size);
+}
+
+void HighWatermark::onReset() noexcept {
+  // we should never be here if mBase is nullptr because compilation would
+  // have failed when Arena::onReset() tries to call the underlying
+  // allocator's onReset()
+  assert(mBase);
+  mCurrent = 0;
+}
+
+void HighWatermark::onRewind(void const *addr) noexcept {
+  // we should never be here if mBase is nullptr because compilation would
+  // have failed when Arena::onRewind() tries to call the underlying
+  // allocator's onReset()
+  assert(mBase);
+  assert(addr >= mBase);
+  mCurrent = uint32_t(uintptr_t(addr) - uintptr_t(mBase));
+}
+
+void Debug::onAlloc(void *p, size_t size, size_t, size_t) noexcept {
+  if (p) {
+    memset(p, 0xeb, size);
+  }
+}
+
+void Debug::onFree(void *p, size_t size) noexcept {
+  if (p) {
+    memset(p, 0xef, size);
+  }
+}
+
+void Debug::onReset() noexcept {
+  // we should never be here if mBase is nullptr because compilation would
+  // have failed when Arena::onReset() tries to call the underlying
+  // allocator's onReset()
+  assert(mBase);
+  memset(mBase, 0xec, mSize);
+}
+
+void Debug::onRewind(void *addr) noexcept {
+  // we should never be here if mBase is nullptr because compilation would
+  // have failed when Arena::onRewind() tries to call the underlying
+  // allocator's onReset()
+  assert(mBase);
+  assert(addr >= mBase);
+  memset(addr, 0x55, uintptr_t(mBase) + mSize - uintptr_t(addr));
+}
+
+} // namespace TrackingPolicy
+} // namespace utils
@@ -2,8 +2,15 @@
 
 #include <atomic>
 #include <cassert>
-#include <engine/utils/compiler.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <engine/utils/base/compiler.h>
 #include <memory_resource>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace utils {
 
@@ -17,7 +24,7 @@ template <typename P, typename T> static inline P *add(P *a, T b) noexcept {
 
 template <typename P> static inline P *align(P *p, size_t alignment) noexcept {
   // alignment must be a power-of-two
-  assert(alignment && !(alignment & alignment - 1));
+  assert(alignment && !(alignment & (alignment - 1)));
   return (P *)((uintptr_t(p) + alignment - 1) & ~(alignment - 1));
 }
 
@@ -127,7 +134,12 @@ public:
               size_t extra = 0) {
     // this allocator doesn't support 'extra'
     assert(extra == 0);
-    return aligned_alloc(size, alignment);
+#if defined(WIN32)
+    return ::_aligned_malloc(size, alignment);
+#else
+    // aligned_alloc requires size to be a multiple of alignment
+    return ::aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
+#endif
   }
 
   void free(void *p) noexcept {
@@ -159,7 +171,7 @@ public:
     Node *const head = mHead;
     mHead = head ? head->next : nullptr;
     // this could indicate a use after free
-    assert(!mHead || mHead >= mBegin && mHead < mEnd);
+    assert(!mHead || (mHead >= mBegin && mHead < mEnd));
     return head;
   }
 
@@ -776,7 +788,7 @@ public:
 
   TYPE *allocate(std::size_t n) {
     auto p = static_cast<TYPE *>(mArena.alloc(n * sizeof(TYPE), alignof(TYPE)));
-    assert_invariant(p);
+    assert(p);
     return p;
   }
 
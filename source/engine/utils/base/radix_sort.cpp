@@ -0,0 +1,51 @@
+#include <engine/utils/base/radix_sort.h>
+
+#include <cassert>
+#include <cstddef>
+#include <utility>
+
+namespace mango {
+
+constexpr uint32_t kRadixBits = 8;
+constexpr uint32_t kRadixSize = 1u << kRadixBits;
+constexpr uint32_t kRadixPasses = 64 / kRadixBits;
+
+void radixSort(std::vector<uint64_t> &keys, std::vector<uint32_t> &values,
+               std::vector<uint64_t> &tmp_keys,
+               std::vector<uint32_t> &tmp_values) {
+  assert(keys.size() == values.size());
+  const size_t count = keys.size();
+  if (count <= 1)
+    return;
+
+  uint32_t histograms[kRadixPasses][kRadixSize] = {};
+  for (const uint64_t key : keys)
+    for (uint32_t pass = 0; pass < kRadixPasses; ++pass)
+      ++histograms[pass][(key >> (pass * kRadixBits)) & (kRadixSize - 1)];
+
+  tmp_keys.resize(count);
+  tmp_values.resize(count);
+  for (uint32_t pass = 0; pass < kRadixPasses; ++pass) {
+    auto &histogram = histograms[pass];
+    const uint32_t shift = pass * kRadixBits;
+    // all keys share this digit, the pass wouldn't move anything
+    if (histogram[(keys[0] >> shift) & (kRadixSize - 1)] == count)
+      continue;
+
+    // exclusive prefix sum, offsets of each digit in the output
+    uint32_t offset = 0;
+    for (auto &bucket : histogram) {
+      const uint32_t bucket_count = bucket;
+      bucket = offset;
+      offset += bucket_count;
+    }
+    for (size_t i = 0; i < count; ++i) {
+      const uint32_t dst = histogram[(keys[i] >> shift) & (kRadixSize - 1)]++;
+      tmp_keys[dst] = keys[i];
+      tmp_values[dst] = values[i];
+    }
+    keys.swap(tmp_keys);
+    values.swap(tmp_values);
+  }
+}
+} // namespace mango
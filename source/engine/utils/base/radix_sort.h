@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace mango {
+
+/**
+ * @brief stable LSD radix sort of 64 bit keys, 8 bits per pass. values are
+ * permuted along with the keys. The histograms of all passes are built in one
+ * sweep, passes whose digit is the same for every key are skipped, so keys
+ * with unused high bits cost fewer passes.
+ * @param keys, values sorted in place, same size
+ * @param tmp_keys, tmp_values scratch, resized to keys.size(), keep them
+ * between calls to avoid reallocating
+ */
+void radixSort(std::vector<uint64_t> &keys, std::vector<uint32_t> &values,
+               std::vector<uint64_t> &tmp_keys,
+               std::vector<uint32_t> &tmp_values);
+} // namespace mango
@@ -0,0 +1,339 @@
+#include <engine/utils/job/job_system.h>
+
+#include <cassert>
+#include <chrono>
+
+namespace mango {
+
+constexpr int64_t kDequeCapacity = 4096; //!< power of 2
+constexpr uint32_t kStealSpins = 64; //!< failed searches before sleeping
+//! jobs moved between a worker's free list and the shared pool at once, also
+//! the number of jobs allocated when the pool is empty
+constexpr uint32_t kJobBatch = 64;
+
+/**
+ * @brief Chase-Lev work stealing deque with a fixed capacity, see "Correct
+ * and Efficient Work-Stealing for Weak Memory Models" (Le et al. 2013).
+ */
+class WorkStealingDeque final {
+public:
+  /**
+   * @brief owner only, return false if the deque is full
+   */
+  bool push(Job *job) {
+    const int64_t b = bottom_.load(std::memory_order_relaxed);
+    const int64_t t = top_.load(std::memory_order_acquire);
+    if (b - t >= kDequeCapacity)
+      return false;
+    buffer_[b & (kDequeCapacity - 1)].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom_.store(b + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  /**
+   * @brief owner only, lifo
+   */
+  Job *pop() {
+    const int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top_.load(std::memory_order_relaxed);
+    if (t > b) {
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    Job *job = buffer_[b & (kDequeCapacity - 1)].load(std::memory_order_relaxed);
+    if (t == b) {
+      // last job, race against thieves
+      if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                        std::memory_order_relaxed))
+        job = nullptr;
+      bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+  }
+
+  /**
+   * @brief any thread, fifo
+   */
+  Job *steal() {
+    int64_t t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t b = bottom_.load(std::memory_order_acquire);
+    if (t >= b)
+      return nullptr;
+    Job *job = buffer_[t & (kDequeCapacity - 1)].load(std::memory_order_relaxed);
+    if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed))
+      return nullptr;
+    return job;
+  }
+
+private:
+  alignas(64) std::atomic<int64_t> top_{0};
+  alignas(64) std::atomic<int64_t> bottom_{0};
+  std::atomic<Job *> buffer_[kDequeCapacity];
+};
+
+struct alignas(64) JobSystem::Worker {
+  WorkStealingDeque deque;
+  std::thread thread;
+  std::atomic<uint64_t> jobs{0};
+  std::atomic<uint64_t> steals{0};
+  std::atomic<uint64_t> busy_ns{0};
+  Job *free_jobs{nullptr}; //!< owner only
+  uint32_t free_count{0};
+};
+
+static thread_local const JobSystem *t_job_system = nullptr;
+static thread_local uint32_t t_worker_index = 0;
+static thread_local uint32_t t_steal_seed = 1;
+
+JobSystem::JobSystem(uint32_t thread_count) {
+  if (thread_count == 0)
+    thread_count = std::max(1u, std::thread::hardware_concurrency());
+  workers_.reserve(thread_count + 1);
+  for (uint32_t i = 0; i <= thread_count; ++i)
+    workers_.emplace_back(std::make_unique<Worker>());
+
+  // the calling thread is worker 0
+  t_job_system = this;
+  t_worker_index = 0;
+  for (uint32_t i = 1; i < thread_count; ++i)
+    workers_[i]->thread = std::thread([this, i]() { workerLoop(i); });
+}
+
+JobSystem::~JobSystem() {
+  exit_.store(true);
+  epoch_.fetch_add(1);
+  epoch_.notify_all();
+  for (auto &worker : workers_)
+    if (worker->thread.joinable())
+      worker->thread.join();
+  if (t_job_system == this)
+    t_job_system = nullptr;
+
+  // jobs never run, e.g. waiting for a counter nobody finishes, are freed
+  // with the blocks
+}
+
+//! push the kJobBatch jobs of a block to the free list head
+static Job *linkJobs(Job *block, Job *head) {
+  for (uint32_t i = 0; i < kJobBatch; ++i) {
+    block[i].next = head;
+    head = &block[i];
+  }
+  return head;
+}
+
+Job *JobSystem::allocateJob() {
+  const uint32_t index = currentWorker();
+  if (index == getThreadCount()) {
+    // not a worker, workers_[index] is shared by all such threads
+    std::lock_guard<std::mutex> lock(pool_mtx_);
+    if (pooled_jobs_ == nullptr)
+      pooled_jobs_ = linkJobs(
+          job_blocks_.emplace_back(std::make_unique<Job[]>(kJobBatch)).get(),
+          nullptr);
+    Job *job = pooled_jobs_;
+    pooled_jobs_ = job->next;
+    return job;
+  }
+
+  auto &self = *workers_[index];
+  if (self.free_jobs == nullptr) {
+    std::lock_guard<std::mutex> lock(pool_mtx_);
+    while (self.free_count < kJobBatch && pooled_jobs_ != nullptr) {
+      Job *job = pooled_jobs_;
+      pooled_jobs_ = job->next;
+      job->next = self.free_jobs;
+      self.free_jobs = job;
+      ++self.free_count;
+    }
+    if (self.free_jobs == nullptr) {
+      self.free_jobs = linkJobs(
+          job_blocks_.emplace_back(std::make_unique<Job[]>(kJobBatch)).get(),
+          nullptr);
+      self.free_count = kJobBatch;
+    }
+  }
+  Job *job = self.free_jobs;
+  self.free_jobs = job->next;
+  --self.free_count;
+  return job;
+}
+
+void JobSystem::freeJob(Job *job) {
+  job->func.reset();
+  job->counter = nullptr;
+  const uint32_t index = currentWorker();
+  if (index == getThreadCount()) {
+    std::lock_guard<std::mutex> lock(pool_mtx_);
+    job->next = pooled_jobs_;
+    pooled_jobs_ = job;
+    return;
+  }
+
+  auto &self = *workers_[index];
+  job->next = self.free_jobs;
+  self.free_jobs = job;
+  if (++self.free_count < 2 * kJobBatch)
+    return;
+  // jobs run by this worker were allocated by others, hand a batch back
+  Job *first = self.free_jobs;
+  Job *last = first;
+  for (uint32_t i = 1; i < kJobBatch; ++i)
+    last = last->next;
+  self.free_jobs = last->next;
+  self.free_count -= kJobBatch;
+  std::lock_guard<std::mutex> lock(pool_mtx_);
+  last->next = pooled_jobs_;
+  pooled_jobs_ = first;
+}
+
+void JobSystem::submit(Job *job, JobCounter *dependency) {
+  if (job->counter != nullptr)
+    job->counter->value_.fetch_add(1, std::memory_order_relaxed);
+  if (dependency != nullptr) {
+    std::lock_guard<std::mutex> lock(dependency->mtx_);
+    if (dependency->value_.load(std::memory_order_acquire) != 0) {
+      dependency->continuations_.emplace_back(job);
+      return;
+    }
+  }
+  schedule(job);
+}
+
+void JobSystem::wait(JobCounter &counter) {
+  const uint32_t index = currentWorker();
+  uint32_t spins = 0;
+  while (!counter.isDone()) {
+    if (Job *job = findJob(index)) {
+      execute(job, index);
+      spins = 0;
+    } else if (++spins > kStealSpins) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+JobSystemStats JobSystem::getStats() const {
+  JobSystemStats stats;
+  uint64_t busy_ns = 0;
+  for (const auto &worker : workers_) {
+    stats.jobs += worker->jobs.load(std::memory_order_relaxed);
+    stats.steals += worker->steals.load(std::memory_order_relaxed);
+    busy_ns += worker->busy_ns.load(std::memory_order_relaxed);
+  }
+  stats.busy_seconds = static_cast<double>(busy_ns) * 1e-9;
+  stats.thread_count = getThreadCount();
+  return stats;
+}
+
+void JobSystem::workerLoop(uint32_t index) {
+  t_job_system = this;
+  t_worker_index = index;
+  t_steal_seed = index * 2654435761u + 1;
+  uint32_t spins = 0;
+  while (!exit_.load(std::memory_order_acquire)) {
+    if (Job *job = findJob(index)) {
+      execute(job, index);
+      spins = 0;
+      continue;
+    }
+    if (++spins < kStealSpins)
+      continue;
+    // read the epoch before the last search, a job pushed after the search
+    // bumps the epoch and wait() returns immediately
+    const uint32_t epoch = epoch_.load();
+    if (Job *job = findJob(index)) {
+      execute(job, index);
+      spins = 0;
+      continue;
+    }
+    if (exit_.load(std::memory_order_acquire))
+      break;
+    epoch_.wait(epoch);
+    spins = 0;
+  }
+}
+
+uint32_t JobSystem::currentWorker() const {
+  return t_job_system == this ? t_worker_index : getThreadCount();
+}
+
+void JobSystem::schedule(Job *job) {
+  const uint32_t index = currentWorker();
+  if (index == getThreadCount() || !workers_[index]->deque.push(job)) {
+    std::lock_guard<std::mutex> lock(shared_mtx_);
+    shared_jobs_.emplace_back(job);
+    shared_count_.fetch_add(1, std::memory_order_release);
+  }
+  epoch_.fetch_add(1);
+  epoch_.notify_one();
+}
+
+Job *JobSystem::findJob(uint32_t index) {
+  const uint32_t thread_count = getThreadCount();
+  auto &self = *workers_[index];
+  if (index < thread_count) {
+    if (Job *job = self.deque.pop())
+      return job;
+  }
+  if (shared_count_.load(std::memory_order_acquire) != 0) {
+    std::lock_guard<std::mutex> lock(shared_mtx_);
+    if (!shared_jobs_.empty()) {
+      Job *job = shared_jobs_.back();
+      shared_jobs_.pop_back();
+      shared_count_.fetch_sub(1, std::memory_order_relaxed);
+      return job;
+    }
+  }
+  // steal from a random victim first, then the others in order
+  t_steal_seed = t_steal_seed * 1664525u + 1013904223u;
+  const uint32_t start = (t_steal_seed >> 16) % thread_count;
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    const uint32_t victim = (start + i) % thread_count;
+    if (victim == index)
+      continue;
+    if (Job *job = workers_[victim]->deque.steal()) {
+      self.steals.fetch_add(1, std::memory_order_relaxed);
+      return job;
+    }
+  }
+  return nullptr;
+}
+
+void JobSystem::execute(Job *job, uint32_t index) {
+  auto &self = *workers_[index];
+  const auto start = std::chrono::steady_clock::now();
+  job->func();
+  const auto end = std::chrono::steady_clock::now();
+  self.busy_ns.fetch_add(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(),
+      std::memory_order_relaxed);
+  self.jobs.fetch_add(1, std::memory_order_relaxed);
+  finish(job);
+}
+
+void JobSystem::finish(Job *job) {
+  JobCounter *counter = job->counter;
+  freeJob(job);
+  if (counter == nullptr)
+    return;
+  // a waiter may destroy the counter as soon as it is done, finishing_ keeps
+  // it alive until the continuations are taken
+  counter->finishing_.fetch_add(1);
+  if (counter->value_.fetch_sub(1) == 1) {
+    std::vector<Job *> continuations;
+    {
+      std::lock_guard<std::mutex> lock(counter->mtx_);
+      continuations.swap(counter->continuations_);
+    }
+    for (Job *continuation : continuations)
+      schedule(continuation);
+  }
+  counter->finishing_.fetch_sub(1);
+}
+} // namespace mango
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace mango {
+class JobCounter;
+
+/**
+ * @brief type erased void() callable of a job. Callables up to kInlineSize
+ * bytes (lambdas capturing a few pointers or indices) are stored inline, so
+ * scheduling them doesn't allocate, larger ones are moved to the heap.
+ */
+class JobFunction final {
+public:
+  static constexpr size_t kInlineSize = 64;
+
+  JobFunction() = default;
+
+  ~JobFunction() { reset(); }
+
+  template <typename F> void emplace(F &&func) {
+    using T = std::decay_t<F>;
+    reset();
+    if constexpr (sizeof(T) <= kInlineSize &&
+                  alignof(T) <= alignof(std::max_align_t) &&
+                  std::is_nothrow_move_constructible_v<T>) {
+      new (storage_) T(std::forward<F>(func));
+      invoke_ = [](void *storage) { (*static_cast<T *>(storage))(); };
+      destroy_ = [](void *storage) { static_cast<T *>(storage)->~T(); };
+    } else {
+      *reinterpret_cast<T **>(storage_) = new T(std::forward<F>(func));
+      invoke_ = [](void *storage) { (**static_cast<T **>(storage))(); };
+      destroy_ = [](void *storage) { delete *static_cast<T **>(storage); };
+    }
+  }
+
+  void operator()() { invoke_(storage_); }
+
+  void reset() {
+    if (destroy_ != nullptr)
+      destroy_(storage_);
+    invoke_ = nullptr;
+    destroy_ = nullptr;
+  }
+
+  JobFunction(const JobFunction &) = delete;
+  JobFunction &operator=(const JobFunction &) = delete;
+
+private:
+  alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+  void (*invoke_)(void *){nullptr};
+  void (*destroy_)(void *){nullptr};
+};
+
+/**
+ * @brief pooled by the job system, never freed before it's destroyed
+ */
+struct Job {
+  JobFunction func;
+  JobCounter *counter{nullptr};
+  Job *next{nullptr}; //!< in a free list
+};
+
+/**
+ * @brief number of unfinished jobs attached to it. A job can also depend on a
+ * counter, it's started once the counter drops to zero.
+ */
+class JobCounter final {
+public:
+  JobCounter() = default;
+
+  bool isDone() const { return value_.load() == 0 && finishing_.load() == 0; }
+
+  JobCounter(const JobCounter &) = delete;
+  JobCounter &operator=(const JobCounter &) = delete;
+
+private:
+  friend class JobSystem;
+
+  std::atomic<uint32_t> value_{0};
+  //! jobs in JobSystem::finish, the counter may be destroyed once it's 0
+  std::atomic<uint32_t> finishing_{0};
+  std::mutex mtx_;
+  std::vector<Job *> continuations_; //!< jobs waiting for value_ == 0
+};
+
+struct JobSystemStats {
+  uint64_t jobs{0};           //!< jobs executed
+  uint64_t steals{0};         //!< jobs taken from another thread's deque
+  double busy_seconds{0.0};   //!< time spent in jobs, summed over threads
+  uint32_t thread_count{0};   //!< workers including the main thread
+};
+
+/**
+ * @brief work stealing job system.
+ *
+ * One worker per core, the thread creating the job system (main thread) is
+ * worker 0 and runs jobs while it waits. Each worker owns a lock free
+ * Chase-Lev deque: the owner pushes and pops at the bottom, idle workers steal
+ * from the top. Jobs submitted from threads which are not workers go to a
+ * shared queue. Jobs must not request command buffers from the thread local
+ * managers, which are bound to the engine's own threads, but may record
+ * secondary command buffers requested for them, see
+ * ThreadLocalCommandBufferManager::requestSecondaryCommandBuffer.
+ */
+class JobSystem final {
+public:
+  /**
+   * @param thread_count workers including the calling thread, 0 for
+   * std::thread::hardware_concurrency()
+   */
+  explicit JobSystem(uint32_t thread_count = 0);
+
+  ~JobSystem();
+
+  /**
+   * @brief schedule a job, the job comes from a pool and small callables are
+   * stored in it, see JobFunction
+   * @param counter incremented now and decremented when the job finishes
+   * @param dependency the job starts after dependency drops to zero
+   */
+  template <typename F>
+  void run(F &&func, JobCounter *counter = nullptr,
+           JobCounter *dependency = nullptr) {
+    if (isSerial() && (dependency == nullptr || dependency->isDone())) {
+      func();
+      return;
+    }
+    Job *job = allocateJob();
+    job->func.emplace(std::forward<F>(func));
+    job->counter = counter;
+    submit(job, dependency);
+  }
+
+  /**
+   * @brief execute other jobs until counter drops to zero
+   */
+  void wait(JobCounter &counter);
+
+  /**
+   * @brief call func(chunk_begin, chunk_end) over [begin, end) split into
+   * chunks of at least grain elements, returns when all chunks are done.
+   * The calling thread executes the first chunk.
+   */
+  template <typename F>
+  void parallelFor(size_t begin, size_t end, size_t grain, F &&func) {
+    if (end <= begin)
+      return;
+    const size_t count = end - begin;
+    const size_t max_chunks = static_cast<size_t>(getThreadCount()) * 4;
+    const size_t chunks =
+        std::min(max_chunks, (count + std::max<size_t>(grain, 1) - 1) /
+                                 std::max<size_t>(grain, 1));
+    if (chunks <= 1 || isSerial()) {
+      func(begin, end);
+      return;
+    }
+    JobCounter counter;
+    for (size_t c = 1; c < chunks; ++c) {
+      const size_t chunk_begin = begin + count * c / chunks;
+      const size_t chunk_end = begin + count * (c + 1) / chunks;
+      run([&func, chunk_begin, chunk_end]() { func(chunk_begin, chunk_end); },
+          &counter);
+    }
+    func(begin, begin + count / chunks);
+    wait(counter);
+  }
+
+  uint32_t getThreadCount() const {
+    return static_cast<uint32_t>(workers_.size()) - 1;
+  }
+
+  JobSystemStats getStats() const;
+
+  /**
+   * @brief serial mode for comparison and debugging: run() executes jobs
+   * without dependencies on the calling thread and parallelFor doesn't
+   * split, as the frame loop did before the job system. Jobs scheduled
+   * already still run on the workers.
+   */
+  void setSerial(bool serial) {
+    serial_.store(serial, std::memory_order_relaxed);
+  }
+
+  bool isSerial() const { return serial_.load(std::memory_order_relaxed); }
+
+  JobSystem(const JobSystem &) = delete;
+  JobSystem &operator=(const JobSystem &) = delete;
+
+private:
+  struct Worker;
+
+  void workerLoop(uint32_t index);
+
+  /**
+   * @brief take a job from the calling worker's free list, refilled a batch at
+   * a time from the shared pool, which grows by blocks of jobs
+   */
+  Job *allocateJob();
+
+  /**
+   * @brief return a finished job to the calling worker's free list, surplus
+   * jobs go back to the shared pool a batch at a time
+   */
+  void freeJob(Job *job);
+
+  /**
+   * @brief count the job on its counter, schedule it or park it on the
+   * dependency
+   */
+  void submit(Job *job, JobCounter *dependency);
+
+  /**
+   * @brief index of the calling thread's worker, getThreadCount() for
+   * threads which are not workers
+   */
+  uint32_t currentWorker() const;
+
+  /**
+   * @brief push a ready job to the calling thread's deque, or the shared
+   * queue, and wake an idle worker
+   */
+  void schedule(Job *job);
+
+  Job *findJob(uint32_t index);
+
+  void execute(Job *job, uint32_t index);
+
+  /**
+   * @brief decrement the job's counter and schedule its continuations
+   */
+  void finish(Job *job);
+
+  //! workers_[getThreadCount()] collects stats of non worker threads
+  std::vector<std::unique_ptr<Worker>> workers_;
+
+  std::mutex pool_mtx_;
+  Job *pooled_jobs_{nullptr}; //!< free jobs shared by all threads
+  std::vector<std::unique_ptr<Job[]>> job_blocks_; //!< storage of all jobs
+
+  std::mutex shared_mtx_;
+  std::vector<Job *> shared_jobs_; //!< jobs from non worker threads
+  std::atomic<uint32_t> shared_count_{0};
+
+  std::atomic<uint32_t> epoch_{0}; //!< bumped on new jobs, idle workers wait on it
+  std::atomic<bool> exit_{false};
+  std::atomic<bool> serial_{false};
+};
+} // namespace mango
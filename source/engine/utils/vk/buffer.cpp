@@ -2,7 +2,6 @@
 #include <engine/utils/base/error.h>
 #include <engine/utils/vk/buffer.h>
 #include <engine/utils/vk/commands.h>
-#include <engine/utils/vk/stage_pool.h>
 #include <engine/utils/vk/vk_driver.h>
 
 namespace mango {
@@ -11,10 +10,14 @@ Buffer::Buffer(const std::shared_ptr<VkDriver> &driver,
                VkBufferUsageFlags buffer_usage,
                VkBufferCreateFlags flags,               
                VmaAllocationCreateFlags allocation_flags,
-               VmaMemoryUsage memory_usage)
+               VmaMemoryUsage memory_usage,
+               MemoryClass memory_class)
     : driver_(driver), flags_(flags), size_(size), buffer_usage_(buffer_usage),
       allocation_flags_(allocation_flags), memory_usage_(memory_usage) {
   persistent_ = (allocation_flags & VMA_ALLOCATION_CREATE_MAPPED_BIT) != 0;
+  // defragmentation copies the buffer to its new place
+  if (memory_class == MemoryClass::Mesh)
+    buffer_usage_ |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
 
   VkBufferCreateInfo buffer_create_info = {
       VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, // VkStructureType        sType;
@@ -31,6 +34,10 @@ Buffer::Buffer(const std::shared_ptr<VkDriver> &driver,
       allocation_flags_, // VmaAllocationCreateFlags  flags;
       memory_usage_,     // VmaMemoryUsage            usage;
   };
+  alloc_create_info.pool = driver_->getMemoryPools()->getBufferPool(
+      memory_class, buffer_create_info, alloc_create_info);
+  // found by defragmentation moves
+  alloc_create_info.pUserData = this;
 
   VmaAllocationInfo allocation_info{};
   auto result = vmaCreateBuffer(driver_->getAllocator(), &buffer_create_info,
@@ -48,44 +55,41 @@ Buffer::Buffer(const std::shared_ptr<VkDriver> &driver,
 
 Buffer::~Buffer() {
   unmap();
-  vmaDestroyBuffer(driver_->getAllocator(), buffer_, allocation_);
+  // a buffer being moved is freed by the defragmentation pass
+  if (!driver_->getMemoryPools()->release(*this))
+    vmaDestroyBuffer(driver_->getAllocator(), buffer_, allocation_);
 }
 
 void Buffer::update(const void *data, size_t size, size_t offset) {
   if (persistent_) {
     memcpy(mapped_data_ + offset, data, size);
     // std::copy(data, data + size, mapped_data_ + offset);
-    flush();
+    flush(offset, size);
   } else {
     map();
     memcpy(mapped_data_ + offset, data, size);
     // std::copy(data, data + size, mapped_data_ + offset);
-    flush();
+    flush(offset, size);
     unmap();
   }
 }
 
-void Buffer::updateByStaging(void *data, size_t size, size_t offset,
-                             const std::shared_ptr<CommandBuffer> &cmd_buf) {
-  auto stage_pool = driver_->getStagePool();
-  auto stage = stage_pool->acquireStage(size);
-  // cpu data to stage
-  void *mapped;
-  vmaMapMemory(driver_->getAllocator(), stage->memory, &mapped);
-  memcpy(mapped, data, size);
-  vmaUnmapMemory(driver_->getAllocator(), stage->memory);
-  vmaFlushAllocation(driver_->getAllocator(), stage->memory, 0, size);
-
-  // stage buffer to gpu buffer
-  VkBufferCopy region{.srcOffset = 0, .dstOffset = offset, .size = size};
-
-  vkCmdCopyBuffer(cmd_buf->getHandle(), stage->buffer, buffer_, 1, &region);
+void Buffer::read(void *data, size_t size, size_t offset) {
+  // make device writes visible to host for non HOST_COHERENT memory
+  vmaInvalidateAllocation(driver_->getAllocator(), allocation_, offset, size);
+  if (persistent_) {
+    memcpy(data, mapped_data_ + offset, size);
+  } else {
+    map();
+    memcpy(data, mapped_data_ + offset, size);
+    unmap();
+  }
 }
 
-void Buffer::flush() {
+void Buffer::flush(VkDeviceSize offset, VkDeviceSize size) {
   // called after writing to a mapped memory for memory types that are not
   // HOST_COHERENT Unmap operation doesn't do that automatically.
-  vmaFlushAllocation(driver_->getAllocator(), allocation_, 0, size_);
+  vmaFlushAllocation(driver_->getAllocator(), allocation_, offset, size);
 }
 
 void Buffer::map() {
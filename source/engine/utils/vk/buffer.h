@@ -1,9 +1,12 @@
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include <vk_mem_alloc.h>
 #include <volk.h>
 
+#include <engine/utils/vk/memory_pools.h>
+#include <engine/utils/vk/upload_scheduler.h>
 #include <engine/utils/vk/vk_driver.h>
 
 namespace mango {
@@ -14,7 +17,8 @@ public:
   Buffer(const std::shared_ptr<VkDriver> &driver, VkDeviceSize size,
          VkBufferUsageFlags buffer_usage, VkBufferCreateFlags flags,
          VmaAllocationCreateFlags allocation_flags,
-         VmaMemoryUsage memory_usage);
+         VmaMemoryUsage memory_usage,
+         MemoryClass memory_class = MemoryClass::Default);
   ~Buffer();
 
   Buffer(const Buffer &) = delete;
@@ -25,12 +29,27 @@ public:
 
   void update(const void *data, size_t size, size_t offset = 0);
 
-  void updateByStaging(void *data, size_t size, size_t offset,
-                       const std::shared_ptr<CommandBuffer> &cmd_buf);
+  /**
+   * @brief read back host visible buffer, should be called after gpu writes
+   * finished (e.g. frame fence signaled)
+   */
+  void read(void *data, size_t size, size_t offset = 0);
 
-private:
-  void flush();
+  VkDeviceSize getSize() const { return size_; }
+
+  /**
+   * @brief mapped memory of a buffer created with
+   * VMA_ALLOCATION_CREATE_MAPPED_BIT, call flush() after writing to it
+   */
+  std::byte *getMappedData() const { return mapped_data_; }
+
+  /**
+   * @brief make host writes of [offset, offset + size) visible to the device
+   * for memory types that are not HOST_COHERENT
+   */
+  void flush(VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
 
+private:
   void map();
 
   void unmap();
@@ -50,5 +69,11 @@ private:
 
   VmaAllocationCreateFlags allocation_flags_;
   VmaMemoryUsage memory_usage_;
+
+  //! batch of the last upload, a buffer is only moved once it completed
+  std::atomic<UploadTicket> upload_ticket_{0};
+
+  friend class UploadScheduler;
+  friend class MemoryPools;
 };
 } // namespace mango
\ No newline at end of file
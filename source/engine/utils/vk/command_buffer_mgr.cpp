@@ -1,11 +1,14 @@
 #include "command_buffer_mgr.h"
 #include <engine/utils/vk/commands.h>
+#include <engine/utils/vk/framebuffer.h>
+#include <engine/utils/vk/render_pass.h>
 #include <engine/utils/vk/syncs.h>
 
 namespace mango {
 
 ThreadLocalCommandBufferManager::ThreadLocalCommandBufferManager(const std::shared_ptr<VkDriver> &driver,
                                   uint32_t queue_family_index)
+    : driver_(driver), queue_family_index_(queue_family_index)
 {  
   tid_ = std::this_thread::get_id();
   cur_frame_index_ = &driver->getCurFrameIndexRef();
@@ -27,15 +30,39 @@ ThreadLocalCommandBufferManager::requestCommandBuffer(
     }
     return cur_primary_command_buffer_;
   } else {
-    assert(false && "not support secondary command buffer");
-    // if (cur_secondary_command_buffer_ == nullptr) {
-    //     cur_secondary_command_buffer_ =
-    //     command_pool_[*cur_frame_index_]->requestCommandBuffer(level);
-    // }
-    // return cur_secondary_command_buffer_;
+    assert(false && "use requestSecondaryCommandBuffer");
+    return nullptr;
   }
 }
 
+void ThreadLocalCommandBufferManager::reserveSecondarySlots(uint32_t count) {
+  for (auto &pools : secondary_command_pools_) {
+    while (pools.size() < count)
+      pools.emplace_back(std::make_shared<CommandPool>(
+          driver_, queue_family_index_, CommandPool::CmbResetMode::ResetPool));
+  }
+}
+
+std::shared_ptr<CommandBuffer>
+ThreadLocalCommandBufferManager::requestSecondaryCommandBuffer(
+    uint32_t slot, const std::shared_ptr<RenderPass> &render_pass,
+    uint32_t subpass, const std::shared_ptr<FrameBuffer> &frame_buffer) {
+  auto &pools = secondary_command_pools_[*cur_frame_index_];
+  assert(slot < pools.size());
+  auto cmd_buffer =
+      pools[slot]->requestCommandBuffer(VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+  VkCommandBufferInheritanceInfo inheritance_info{
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+      .renderPass = render_pass->getHandle(),
+      .subpass = subpass,
+      .framebuffer = frame_buffer != nullptr ? frame_buffer->getHandle()
+                                             : VK_NULL_HANDLE};
+  cmd_buffer->begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+                        VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+                    &inheritance_info);
+  return cmd_buffer;
+}
+
 void ThreadLocalCommandBufferManager::enqueueCommandBuffer(
     const std::shared_ptr<CommandBuffer> &cmd_buf) {
   assert(cmd_buf == cur_primary_command_buffer_);
@@ -58,6 +85,8 @@ ThreadLocalCommandBufferManager::getExecutableCommandBuffers() {
 
 void ThreadLocalCommandBufferManager::resetCurFrameCommandPool() {
   command_pool_[*cur_frame_index_]->reset();
+  for (auto &pool : secondary_command_pools_[*cur_frame_index_])
+    pool->reset();
 }
 
 VkResult ThreadLocalCommandBufferManager::commitExecutableCommandBuffers(
@@ -14,6 +14,8 @@ class Fence;
 class CommandPool;
 class CommandQueue;
 class Semaphore;
+class RenderPass;
+class FrameBuffer;
 
 class ThreadLocalCommandBufferManager final {
 public:
@@ -41,6 +43,25 @@ public:
   std::shared_ptr<CommandBuffer>
   requestCommandBuffer(VkCommandBufferLevel level);
 
+  /**
+   * @brief make sure there are at least count secondary command pools per
+   * frame. Not thread safe, call it before recording in parallel.
+   */
+  void reserveSecondarySlots(uint32_t count);
+
+  /**
+   * @brief request a secondary command buffer continuing the subpass of
+   * render_pass, at recording state. Each slot has its own command pool per
+   * frame in flight, so different slots can be recorded from different threads
+   * at the same time. The command buffer should be ended by the caller and
+   * executed in this manager's primary command buffer.
+   */
+  std::shared_ptr<CommandBuffer>
+  requestSecondaryCommandBuffer(uint32_t slot,
+                                const std::shared_ptr<RenderPass> &render_pass,
+                                uint32_t subpass,
+                                const std::shared_ptr<FrameBuffer> &frame_buffer);
+
   /**
    * @brief push command buffer to candidate executable list. will call command
    * buffer's end() method.
@@ -61,17 +82,22 @@ public:
   }
 
   /**
-   * @brief reset command pool
+   * @brief reset command pool, and the secondary command pools of the frame
    */
   void resetCurFrameCommandPool();
 
 private:
+  std::shared_ptr<VkDriver> driver_;
+  uint32_t queue_family_index_{0};
   std::thread::id tid_;
   const uint32_t *cur_frame_index_{nullptr};
   std::shared_ptr<CommandBuffer> cur_primary_command_buffer_;
 
   std::shared_ptr<Fence> command_buffer_available_fence_[MAX_FRAMES_IN_FLIGHT];
   std::shared_ptr<CommandPool> command_pool_[MAX_FRAMES_IN_FLIGHT];
+  //! secondary command pools per frame, indexed by slot
+  std::vector<std::shared_ptr<CommandPool>>
+      secondary_command_pools_[MAX_FRAMES_IN_FLIGHT];
   std::vector<VkCommandBuffer> executable_command_buffers_;
 };
 } // namespace mango
\ No newline at end of file
@@ -5,6 +5,9 @@
 #include <engine/utils/vk/framebuffer.h>
 #include <engine/utils/vk/image.h>
 #include <engine/utils/vk/pipeline.h>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
 #include <iostream>
 
 namespace mango {
@@ -193,6 +196,7 @@ CommandBuffer::CommandBuffer(const std::shared_ptr<VkDriver> &driver,
   if (result != VK_SUCCESS) {
     throw VulkanException(result, "failed to allocate command buffers!");
   }
+  invalidateState();
 }
 
 CommandBuffer::~CommandBuffer() {
@@ -212,16 +216,23 @@ void CommandBuffer::reset() {
 
   vkResetCommandBuffer(command_buffer_,
                        VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
+  invalidateState();
+  stats_ = {};
 }
 
-void CommandBuffer::begin(VkCommandBufferUsageFlags flags) {
+void CommandBuffer::begin(
+    VkCommandBufferUsageFlags flags,
+    const VkCommandBufferInheritanceInfo *inheritance_info) {
   VkCommandBufferBeginInfo begin_info = {};
   begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
   begin_info.flags = flags;
-  begin_info.pInheritanceInfo = nullptr;
+  begin_info.pInheritanceInfo = inheritance_info;
 
   auto result = vkBeginCommandBuffer(command_buffer_, &begin_info);
   VK_THROW_IF_ERROR(result, "failed to begin recording command buffer!");
+  // pools reset with vkResetCommandPool don't go through reset()
+  invalidateState();
+  stats_ = {};
 }
 
 void CommandBuffer::end() {
@@ -231,7 +242,8 @@ void CommandBuffer::end() {
 
 void CommandBuffer::beginRenderPass(
     const std::shared_ptr<RenderPass> &render_pass,
-    const std::shared_ptr<FrameBuffer> &frame_buffer) {
+    const std::shared_ptr<FrameBuffer> &frame_buffer,
+    VkSubpassContents contents) {
   VkClearValue clear_values[2]; // 与render pass load store clear attachment对应
   clear_values[0].color = {0.0f, 0.0f, 0.0f, 1.0f};
   clear_values[1].depthStencil = {1.0f, 0};
@@ -246,8 +258,7 @@ void CommandBuffer::beginRenderPass(
   render_pass_begin_info.clearValueCount = 2;
   render_pass_begin_info.pClearValues = clear_values;
 
-  vkCmdBeginRenderPass(command_buffer_, &render_pass_begin_info,
-                       VK_SUBPASS_CONTENTS_INLINE);
+  vkCmdBeginRenderPass(command_buffer_, &render_pass_begin_info, contents);
 }
 
 void CommandBuffer::setViewPort(
@@ -260,14 +271,84 @@ void CommandBuffer::setScissor(
   vkCmdSetScissor(command_buffer_, 0, scissors.size(), scissors.begin());
 }
 
+static VkPipelineBindPoint
+getBindPoint(const std::shared_ptr<Pipeline> &pipeline) {
+  return pipeline->getType() == Pipeline::Type::GRAPHICS
+             ? VK_PIPELINE_BIND_POINT_GRAPHICS
+             : VK_PIPELINE_BIND_POINT_COMPUTE;
+}
+
+void CommandBuffer::invalidateState() {
+  std::fill_n(bound_.pipelines, kBindPointCount, VK_NULL_HANDLE);
+  for (uint32_t i = 0; i < kBindPointCount; ++i) {
+    std::fill_n(bound_.set_layouts[i], kMaxBoundSets, VK_NULL_HANDLE);
+    std::fill_n(bound_.sets[i], kMaxBoundSets, VK_NULL_HANDLE);
+  }
+  // ~0 is never a valid offset, null buffers may be bound with nullDescriptor
+  std::fill_n(bound_.vertex_buffers, kMaxVertexBindings, VK_NULL_HANDLE);
+  std::fill_n(bound_.vertex_offsets, kMaxVertexBindings, ~VkDeviceSize(0));
+  bound_.index_buffer = VK_NULL_HANDLE;
+  bound_.index_offset = ~VkDeviceSize(0);
+  bound_.index_type = VK_INDEX_TYPE_MAX_ENUM;
+  bound_.push_layout = VK_NULL_HANDLE;
+  bound_.push_stages = 0;
+  bound_.push_valid.reset();
+}
+
 void CommandBuffer::bindPipeline(
     const std::shared_ptr<Pipeline> &pipeline)
 {
-  auto pipeline_bind_point = pipeline->getType() == Pipeline::Type::GRAPHICS
-                                 ? VK_PIPELINE_BIND_POINT_GRAPHICS
-                                 : VK_PIPELINE_BIND_POINT_COMPUTE;
-  vkCmdBindPipeline(command_buffer_, pipeline_bind_point,
-                    pipeline->getHandle());
+  auto pipeline_bind_point = getBindPoint(pipeline);
+  auto handle = pipeline->getHandle();
+  if (bound_.pipelines[pipeline_bind_point] == handle) {
+    ++stats_.pipelines.skipped;
+    return;
+  }
+  bound_.pipelines[pipeline_bind_point] = handle;
+  ++stats_.pipelines.issued;
+  vkCmdBindPipeline(command_buffer_, pipeline_bind_point, handle);
+}
+
+void CommandBuffer::bindDescriptorSets(VkPipelineBindPoint bind_point,
+                                       VkPipelineLayout layout,
+                                       uint32_t first_set, uint32_t set_count,
+                                       const VkDescriptorSet *sets,
+                                       uint32_t dynamic_offset_count,
+                                       const uint32_t *dynamic_offsets) {
+  if (set_count == 0)
+    return;
+  assert(first_set + set_count <= kMaxBoundSets);
+  auto &bound_layouts = bound_.set_layouts[bind_point];
+  auto &bound_sets = bound_.sets[bind_point];
+  // dynamic offsets are not tracked, such binds are always issued
+  if (dynamic_offset_count == 0) {
+    bool redundant = true;
+    for (uint32_t i = 0; i < set_count && redundant; ++i)
+      redundant = bound_layouts[first_set + i] == layout &&
+                  bound_sets[first_set + i] == sets[i];
+    if (redundant) {
+      ++stats_.descriptor_sets.skipped;
+      return;
+    }
+  }
+
+  // sets bound with another layout may be disturbed, compatible layouts are
+  // not worth checking
+  for (uint32_t i = 0; i < kMaxBoundSets; ++i) {
+    if (bound_layouts[i] != layout) {
+      bound_layouts[i] = VK_NULL_HANDLE;
+      bound_sets[i] = VK_NULL_HANDLE;
+    }
+  }
+  for (uint32_t i = 0; i < set_count; ++i) {
+    bound_layouts[first_set + i] =
+        dynamic_offset_count == 0 ? layout : VK_NULL_HANDLE;
+    bound_sets[first_set + i] = sets[i];
+  }
+  ++stats_.descriptor_sets.issued;
+  vkCmdBindDescriptorSets(command_buffer_, bind_point, layout, first_set,
+                          set_count, sets, dynamic_offset_count,
+                          dynamic_offsets);
 }
 
 void CommandBuffer::bindDescriptorSets(
@@ -276,37 +357,90 @@ void CommandBuffer::bindDescriptorSets(
         &descriptor_sets,
     const std::initializer_list<uint32_t> &dynamic_offsets,
     const uint32_t first_set) {
-  if (descriptor_sets.size() == 0) return;
-  std::vector<VkDescriptorSet> ds(descriptor_sets.size());
+  assert(descriptor_sets.size() <= kMaxBoundSets);
+  VkDescriptorSet ds[kMaxBoundSets];
   for (auto i = 0; i < descriptor_sets.size(); ++i) {
     ds[i] = descriptor_sets.begin()[i]->getHandle();
   }
-  auto pipeline_bind_point = pipeline->getType() == Pipeline::Type::GRAPHICS
-                                 ? VK_PIPELINE_BIND_POINT_GRAPHICS
-                                 : VK_PIPELINE_BIND_POINT_COMPUTE;  
-  vkCmdBindDescriptorSets(command_buffer_, pipeline_bind_point,
-                          pipeline->getPipelineLayout()->getHandle(), first_set,
-                          descriptor_sets.size(), ds.data(),
-                          dynamic_offsets.size(), dynamic_offsets.begin());
+  bindDescriptorSets(getBindPoint(pipeline),
+                     pipeline->getPipelineLayout()->getHandle(), first_set,
+                     descriptor_sets.size(), ds, dynamic_offsets.size(),
+                     dynamic_offsets.begin());
+}
+
+void CommandBuffer::bindDescriptorSets(
+    const std::shared_ptr<Pipeline> &pipeline,
+    const std::initializer_list<VkDescriptorSet> &descriptor_sets,
+    const std::initializer_list<uint32_t> &dynamic_offsets,
+    const uint32_t first_set) {
+  bindDescriptorSets(getBindPoint(pipeline),
+                     pipeline->getPipelineLayout()->getHandle(), first_set,
+                     descriptor_sets.size(), descriptor_sets.begin(),
+                     dynamic_offsets.size(), dynamic_offsets.begin());
+}
+
+void CommandBuffer::bindVertexBuffers(uint32_t first_binding,
+                                      uint32_t binding_count,
+                                      const VkBuffer *buffers,
+                                      const VkDeviceSize *offsets) {
+  if (binding_count == 0)
+    return;
+  assert(first_binding + binding_count <= kMaxVertexBindings);
+  bool redundant = true;
+  for (uint32_t i = 0; i < binding_count && redundant; ++i)
+    redundant = bound_.vertex_buffers[first_binding + i] == buffers[i] &&
+                bound_.vertex_offsets[first_binding + i] == offsets[i];
+  if (redundant) {
+    ++stats_.vertex_buffers.skipped;
+    return;
+  }
+  std::copy_n(buffers, binding_count, bound_.vertex_buffers + first_binding);
+  std::copy_n(offsets, binding_count, bound_.vertex_offsets + first_binding);
+  ++stats_.vertex_buffers.issued;
+  vkCmdBindVertexBuffers(command_buffer_, first_binding, binding_count,
+                         buffers, offsets);
+}
+
+void CommandBuffer::bindVertexBuffers(
+    const std::initializer_list<VkBuffer> &buffers,
+    const std::initializer_list<VkDeviceSize> &offsets,
+    const uint32_t first_binding) {
+  assert(buffers.size() == offsets.size());
+  bindVertexBuffers(first_binding, buffers.size(), buffers.begin(),
+                    offsets.begin());
+}
+
+void CommandBuffer::bindIndexBuffer(VkBuffer buffer, const VkDeviceSize offset,
+                                    const VkIndexType index_type) {
+  if (bound_.index_buffer == buffer && bound_.index_offset == offset &&
+      bound_.index_type == index_type) {
+    ++stats_.index_buffers.skipped;
+    return;
+  }
+  bound_.index_buffer = buffer;
+  bound_.index_offset = offset;
+  bound_.index_type = index_type;
+  ++stats_.index_buffers.issued;
+  vkCmdBindIndexBuffer(command_buffer_, buffer, offset, index_type);
 }
 
 void CommandBuffer::bindVertexBuffers(
     const std::initializer_list<std::shared_ptr<Buffer>> &buffers,
     const std::initializer_list<VkDeviceSize> &offsets,
     const uint32_t first_binding) {
-  std::vector<VkBuffer> bs(buffers.size());
+  assert(buffers.size() <= kMaxVertexBindings &&
+         buffers.size() == offsets.size());
+  VkBuffer bs[kMaxVertexBindings];
   for (auto i = 0; i < buffers.size(); ++i) {
     bs[i] = buffers.begin()[i]->getHandle();
   }
-  vkCmdBindVertexBuffers(command_buffer_, first_binding, buffers.size(),
-                         bs.data(), offsets.begin());
+  bindVertexBuffers(first_binding, buffers.size(), bs, offsets.begin());
 }
 
 void CommandBuffer::bindIndexBuffer(const std::shared_ptr<Buffer> &buffer,
                                     const VkDeviceSize offset,
                                     const VkIndexType index_type) {
-  vkCmdBindIndexBuffer(command_buffer_, buffer->getHandle(), offset,
-                       index_type);
+  bindIndexBuffer(buffer->getHandle(), offset, index_type);
 }
 
 void CommandBuffer::draw(const uint32_t vertex_count,
@@ -326,8 +460,65 @@ void CommandBuffer::drawIndexed(const uint32_t index_count,
                    vertex_offset, first_instance);
 }
 
+void CommandBuffer::drawIndexedIndirectCount(
+    const std::shared_ptr<Buffer> &buffer, const VkDeviceSize offset,
+    const std::shared_ptr<Buffer> &count_buffer,
+    const VkDeviceSize count_offset, const uint32_t max_draw_count,
+    const uint32_t stride) {
+  vkCmdDrawIndexedIndirectCountKHR(command_buffer_, buffer->getHandle(), offset,
+                                count_buffer->getHandle(), count_offset,
+                                max_draw_count, stride);
+}
+
+void CommandBuffer::dispatch(const uint32_t group_count_x,
+                             const uint32_t group_count_y,
+                             const uint32_t group_count_z) {
+  vkCmdDispatch(command_buffer_, group_count_x, group_count_y, group_count_z);
+}
+
+void CommandBuffer::fillBuffer(const std::shared_ptr<Buffer> &buffer,
+                               const VkDeviceSize offset,
+                               const VkDeviceSize size, const uint32_t data) {
+  vkCmdFillBuffer(command_buffer_, buffer->getHandle(), offset, size, data);
+}
+
+void CommandBuffer::copyBuffer(const std::shared_ptr<Buffer> &src,
+                               const VkDeviceSize src_offset,
+                               const std::shared_ptr<Buffer> &dst,
+                               const VkDeviceSize dst_offset,
+                               const VkDeviceSize size) {
+  VkBufferCopy region{
+      .srcOffset = src_offset, .dstOffset = dst_offset, .size = size};
+  vkCmdCopyBuffer(command_buffer_, src->getHandle(), dst->getHandle(), 1,
+                  &region);
+}
+
+void CommandBuffer::memoryBarrier(const VkPipelineStageFlags src_stage_mask,
+                                  const VkPipelineStageFlags dst_stage_mask,
+                                  const VkAccessFlags src_access_mask,
+                                  const VkAccessFlags dst_access_mask) {
+  VkMemoryBarrier barrier{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                          .pNext = nullptr,
+                          .srcAccessMask = src_access_mask,
+                          .dstAccessMask = dst_access_mask};
+  vkCmdPipelineBarrier(command_buffer_, src_stage_mask, dst_stage_mask, 0, 1,
+                       &barrier, 0, nullptr, 0, nullptr);
+}
+
 void CommandBuffer::endRenderPass() { vkCmdEndRenderPass(command_buffer_); }
 
+void CommandBuffer::executeCommands(
+    const std::vector<std::shared_ptr<CommandBuffer>> &cmd_buffers) {
+  if (cmd_buffers.empty())
+    return;
+  std::vector<VkCommandBuffer> handles(cmd_buffers.size());
+  for (auto i = 0; i < cmd_buffers.size(); ++i)
+    handles[i] = cmd_buffers[i]->getHandle();
+  vkCmdExecuteCommands(command_buffer_, handles.size(), handles.data());
+  // state bound by the secondaries is left undefined
+  invalidateState();
+}
+
 void CommandBuffer::imageMemoryBarrier(
     const ImageMemoryBarrier &image_memory_barrier,
     const std::shared_ptr<ImageView> &image_view) {
@@ -404,8 +595,27 @@ void CommandBuffer::pushConstants(const std::shared_ptr<Pipeline> &pipeline,
                                   const VkShaderStageFlags stage_flags,
                                   const uint32_t offset, const uint32_t size,
                                   const void *data) {
-  vkCmdPushConstants(command_buffer_,
-                     pipeline->getPipelineLayout()->getHandle(), stage_flags,
-                     offset, size, data);
+  assert(offset + size <= kMaxPushConstantSize);
+  auto layout = pipeline->getPipelineLayout()->getHandle();
+  const auto *bytes = static_cast<const uint8_t *>(data);
+  if (bound_.push_layout == layout && bound_.push_stages == stage_flags) {
+    bool redundant = true;
+    for (uint32_t i = offset; i < offset + size && redundant; ++i)
+      redundant = bound_.push_valid[i];
+    if (redundant &&
+        std::memcmp(bound_.push_data + offset, bytes, size) == 0) {
+      ++stats_.push_constants.skipped;
+      return;
+    }
+  } else {
+    bound_.push_layout = layout;
+    bound_.push_stages = stage_flags;
+    bound_.push_valid.reset();
+  }
+  std::memcpy(bound_.push_data + offset, bytes, size);
+  for (uint32_t i = offset; i < offset + size; ++i)
+    bound_.push_valid.set(i);
+  ++stats_.push_constants.issued;
+  vkCmdPushConstants(command_buffer_, layout, stage_flags, offset, size, data);
 }
 } // namespace mango
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <engine/utils/vk/barriers.h>
 #include <engine/utils/vk/vk_driver.h>
+#include <bitset>
 #include <memory>
 
 namespace mango {
@@ -43,7 +44,7 @@ private:
                VkBool32 can_present, uint32_t index)
       : family_index_(family_index), flags_(flags), index_(index),
         can_present_(can_present) {
-    vkGetDeviceQueue(device, family_index, 0, &handle_);
+    vkGetDeviceQueue(device, family_index, index, &handle_);
   }
 
   VkQueue handle_{VK_NULL_HANDLE};
@@ -105,6 +106,31 @@ private:
   uint32_t active_secondary_command_buffer_count_{0};
 };
 
+struct StateCounter {
+  uint32_t issued{0};  //!< forwarded to vulkan
+  uint32_t skipped{0}; //!< filtered, the state was already bound
+};
+
+/**
+ * @brief state changes recorded in a command buffer since begin()
+ */
+struct CommandBufferStats {
+  StateCounter pipelines;
+  StateCounter descriptor_sets; //!< per vkCmdBindDescriptorSets call
+  StateCounter vertex_buffers;  //!< per vkCmdBindVertexBuffers call
+  StateCounter index_buffers;
+  StateCounter push_constants;
+};
+
+/**
+ * @brief wrapper of VkCommandBuffer.
+ *
+ * Pipeline, descriptor set, vertex/index buffer and push constant binds are
+ * checked against a shadow of the bound state, binds which wouldn't change
+ * anything are skipped. The shadow is cleared by begin() and
+ * executeCommands(); call invalidateState() after recording through
+ * getHandle() directly, e.g. ImGui's backend.
+ */
 class CommandBuffer final {
 public:
   CommandBuffer(const CommandBuffer &) = delete;
@@ -117,15 +143,27 @@ public:
 
   VkCommandBuffer getHandle() const { return command_buffer_; }
 
-  void begin(VkCommandBufferUsageFlags flags);
+  /**
+   * @param inheritance_info required for secondary command buffers
+   */
+  void begin(VkCommandBufferUsageFlags flags,
+             const VkCommandBufferInheritanceInfo *inheritance_info = nullptr);
 
   void end();
 
+  /**
+   * @param contents VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS if the
+   * subpass is recorded in secondary command buffers
+   */
   void beginRenderPass(const std::shared_ptr<RenderPass> &render_pass,
-                       const std::shared_ptr<FrameBuffer> &frame_buffer);
+                       const std::shared_ptr<FrameBuffer> &frame_buffer,
+                       VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
 
   void endRenderPass();
 
+  void executeCommands(
+      const std::vector<std::shared_ptr<CommandBuffer>> &cmd_buffers);
+
   void setViewPort(const std::initializer_list<VkViewport> &viewports);
 
   void setScissor(const std::initializer_list<VkRect2D> &scissors);
@@ -138,7 +176,21 @@ public:
                          &descriptor_sets,
                      const std::initializer_list<uint32_t> &dynamic_offsets,
                      const uint32_t first_set);
-  
+
+  void bindDescriptorSets(const std::shared_ptr<Pipeline> &pipeline,
+                          const std::initializer_list<VkDescriptorSet>
+                              &descriptor_sets,
+                          const std::initializer_list<uint32_t> &dynamic_offsets,
+                          const uint32_t first_set);
+
+  void bindVertexBuffers(
+      const std::initializer_list<VkBuffer> &buffers,
+      const std::initializer_list<VkDeviceSize> &offsets,
+      const uint32_t first_binding);
+
+  void bindIndexBuffer(VkBuffer buffer, const VkDeviceSize offset,
+                       const VkIndexType index_type);
+
   void bindVertexBuffers(
       const std::initializer_list<std::shared_ptr<Buffer>> &buffer,
       const std::initializer_list<VkDeviceSize> &offsets,
@@ -152,6 +204,13 @@ public:
                      const uint32_t offset, const uint32_t size,
                      const void *data);
 
+  /**
+   * @brief forget the shadow state, the next binds are all issued
+   */
+  void invalidateState();
+
+  const CommandBufferStats &getStats() const { return stats_; }
+
   void draw(const uint32_t vertex_count, const uint32_t instance_count,
             const uint32_t first_vertex, const uint32_t first_instance);
 
@@ -159,6 +218,38 @@ public:
                    const uint32_t first_index, const int32_t vertex_offset,
                    const uint32_t first_instance);
 
+  /**
+   * @brief draw with VkDrawIndexedIndirectCommands in buffer, the actual
+   * draw count is read from count_buffer, requires VK_KHR_draw_indirect_count
+   */
+  void drawIndexedIndirectCount(const std::shared_ptr<Buffer> &buffer,
+                                const VkDeviceSize offset,
+                                const std::shared_ptr<Buffer> &count_buffer,
+                                const VkDeviceSize count_offset,
+                                const uint32_t max_draw_count,
+                                const uint32_t stride);
+
+  void dispatch(const uint32_t group_count_x, const uint32_t group_count_y,
+                const uint32_t group_count_z);
+
+  void fillBuffer(const std::shared_ptr<Buffer> &buffer,
+                  const VkDeviceSize offset, const VkDeviceSize size,
+                  const uint32_t data);
+
+  void copyBuffer(const std::shared_ptr<Buffer> &src,
+                  const VkDeviceSize src_offset,
+                  const std::shared_ptr<Buffer> &dst,
+                  const VkDeviceSize dst_offset, const VkDeviceSize size);
+
+  /**
+   * @brief global memory barrier, for buffers and images without layout
+   * transition
+   */
+  void memoryBarrier(const VkPipelineStageFlags src_stage_mask,
+                     const VkPipelineStageFlags dst_stage_mask,
+                     const VkAccessFlags src_access_mask,
+                     const VkAccessFlags dst_access_mask);
+
   void imageMemoryBarrier(const ImageMemoryBarrier &image_memory_barrier,
                           const std::shared_ptr<ImageView> &image_view);
 
@@ -170,8 +261,43 @@ public:
       const std::vector<std::shared_ptr<ImageView>> &image_views);
 
 private:
+  static constexpr uint32_t kMaxBoundSets = 8;
+  static constexpr uint32_t kMaxVertexBindings = 16;
+  static constexpr uint32_t kMaxPushConstantSize = 256;
+  static constexpr uint32_t kBindPointCount = 2; //!< graphics, compute
+
   CommandBuffer(const std::shared_ptr<VkDriver> &driver,
                 CommandPool &command_pool, VkCommandBufferLevel level);
+
+  void bindDescriptorSets(VkPipelineBindPoint bind_point,
+                          VkPipelineLayout layout, uint32_t first_set,
+                          uint32_t set_count, const VkDescriptorSet *sets,
+                          uint32_t dynamic_offset_count,
+                          const uint32_t *dynamic_offsets);
+
+  void bindVertexBuffers(uint32_t first_binding, uint32_t binding_count,
+                         const VkBuffer *buffers, const VkDeviceSize *offsets);
+
+  /**
+   * @brief shadow of the state bound in the command buffer
+   */
+  struct BoundState {
+    VkPipeline pipelines[kBindPointCount];
+    VkPipelineLayout set_layouts[kBindPointCount][kMaxBoundSets];
+    VkDescriptorSet sets[kBindPointCount][kMaxBoundSets];
+    VkBuffer vertex_buffers[kMaxVertexBindings];
+    VkDeviceSize vertex_offsets[kMaxVertexBindings];
+    VkBuffer index_buffer;
+    VkDeviceSize index_offset;
+    VkIndexType index_type;
+    VkPipelineLayout push_layout;
+    VkShaderStageFlags push_stages;
+    std::bitset<kMaxPushConstantSize> push_valid; //!< bytes pushed
+    uint8_t push_data[kMaxPushConstantSize];
+  };
+  BoundState bound_;
+  CommandBufferStats stats_;
+
   std::shared_ptr<VkDriver> driver_;
   VkCommandPool command_pool_;
   VkCommandBuffer command_buffer_{VK_NULL_HANDLE};
@@ -1,7 +1,6 @@
 #include <cassert>
 #include <engine/functional/global/engine_context.h>
 #include <engine/utils/base/data_reshaper.hpp>
-#include <engine/utils/vk/commands.h>
 #include <engine/utils/vk/data_uploader.hpp>
 #include <engine/utils/vk/image.h>
 #include <engine/utils/vk/vk_driver.h>
@@ -11,28 +10,56 @@ namespace mango {
 std::shared_ptr<ImageView>
 uploadImage(const uint8_t *data, const uint32_t width, const uint32_t height,
             const uint32_t mipmap_level, const uint32_t layers,
-            const VkFormat format,
-            const std::shared_ptr<CommandBuffer> &cmd_buf) {
-  assert(cmd_buf != nullptr);
+            const VkFormat format, UploadScheduler::Recorder &recorder) {
   VkExtent3D extent{width, height, 1};
   auto driver = g_engine.getDriver();
   auto image = std::make_shared<Image>(
       driver, 0, format, extent, mipmap_level, layers, VK_SAMPLE_COUNT_1_BIT,
       VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
       VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
-  image->updateByStaging(data, cmd_buf);
   VkImageSubresourceRange range = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
                                    .baseMipLevel = 0,
                                    .levelCount = mipmap_level,
                                    .baseArrayLayer = 0,
                                    .layerCount = layers};
-  image->transitionLayout(cmd_buf->getHandle(), range,
-                          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  recorder.uploadImage(*image, data, range);
+  // sampled by fragment shaders of the graphics queue
+  recorder.releaseImage(*image, range, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                        VK_ACCESS_SHADER_READ_BIT);
   auto img_v = std::make_shared<ImageView>(
-      image, VK_IMAGE_VIEW_TYPE_2D, VK_FORMAT_R8G8B8A8_SRGB,
-      VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1, 1);
+      image, VK_IMAGE_VIEW_TYPE_2D, format, VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1,
+      1);
   return img_v;
 }
+
+std::shared_ptr<ImageView>
+uploadImage(const std::vector<const uint8_t *> &mips, const uint32_t width,
+            const uint32_t height, const VkFormat format,
+            UploadScheduler::Recorder &recorder, MemoryClass memory_class) {
+  VkExtent3D extent{width, height, 1};
+  const auto mip_levels = static_cast<uint32_t>(mips.size());
+  auto driver = g_engine.getDriver();
+  auto image = std::make_shared<Image>(
+      driver, 0, format, extent, mip_levels, 1, VK_SAMPLE_COUNT_1_BIT,
+      VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+      VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, VK_IMAGE_LAYOUT_UNDEFINED,
+      memory_class);
+  VkImageSubresourceRange range = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                   .baseMipLevel = 0,
+                                   .levelCount = mip_levels,
+                                   .baseArrayLayer = 0,
+                                   .layerCount = 1};
+  for (uint32_t level = 0; level < mip_levels; ++level)
+    recorder.uploadImage(*image, mips[level], range, level);
+  // sampled by fragment shaders of the graphics queue
+  recorder.releaseImage(*image, range, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                        VK_ACCESS_SHADER_READ_BIT);
+  return std::make_shared<ImageView>(image, VK_IMAGE_VIEW_TYPE_2D, format,
+                                     VK_IMAGE_ASPECT_COLOR_BIT, 0, 0,
+                                     mip_levels, 1);
+}
 // std::shared_ptr<ImageView>
 // uploadRGBA(const uint8_t *img_data, uint32_t width, uint32_t height,
 //            uint32_t channel, const std::shared_ptr<CommandBuffer> &cmd_buf) {
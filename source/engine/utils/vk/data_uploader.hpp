@@ -1,19 +1,31 @@
 #pragma once
 #include <memory>
 #include <string>
+#include <vector>
+#include <engine/utils/vk/memory_pools.h>
+#include <engine/utils/vk/upload_scheduler.h>
 
 namespace mango {
-class CommandBuffer;
 class ImageView;
 
 std::shared_ptr<ImageView>
 uploadImage(const uint8_t *data, const uint32_t width, const uint32_t height,
             const uint32_t mipmap_level, const uint32_t layers,
-            const VkFormat format,
-            const std::shared_ptr<CommandBuffer> &cmd_buf);
+            const VkFormat format, UploadScheduler::Recorder &recorder);
+
+/**
+ * @brief upload a mip chain, mips[i] holds the tightly packed texels of level
+ * i of a width x height image. The view covers all levels, the image is
+ * allocated from the pools of memory_class.
+ */
+std::shared_ptr<ImageView>
+uploadImage(const std::vector<const uint8_t *> &mips, const uint32_t width,
+            const uint32_t height, const VkFormat format,
+            UploadScheduler::Recorder &recorder,
+            MemoryClass memory_class = MemoryClass::Default);
 
 std::shared_ptr<ImageView>
 uploadImage(const float *data, const uint32_t width, const uint32_t height,
             const uint32_t mipmap_level, const uint32_t layers, VkFormat format,
-            const std::shared_ptr<CommandBuffer> &cmd_buf);
+            UploadScheduler::Recorder &recorder);
 } // namespace mango
\ No newline at end of file
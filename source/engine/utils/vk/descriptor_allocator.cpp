@@ -0,0 +1,182 @@
+#include <engine/utils/vk/descriptor_allocator.h>
+
+#include <algorithm>
+
+#include <engine/utils/base/error.h>
+#include <engine/utils/base/hash_combine.h>
+#include <engine/utils/vk/descriptor_set_layout.h>
+#include <engine/utils/vk/vk_driver.h>
+
+namespace mango {
+constexpr uint32_t kMaxSetsPerPool = 1024;
+
+DescriptorAllocator::DescriptorAllocator(
+    const std::shared_ptr<VkDriver> &driver, VkDescriptorPoolCreateFlags flags,
+    uint32_t sets_per_pool)
+    : driver_(driver), flags_(flags),
+      sets_per_pool_(std::max(sets_per_pool, 1u)) {}
+
+DescriptorAllocator::~DescriptorAllocator() {
+  for (auto &[layout, layout_pools] : layout_pools_)
+    for (auto pool : layout_pools.pools)
+      vkDestroyDescriptorPool(driver_->getDevice(), pool, nullptr);
+}
+
+VkDescriptorSet
+DescriptorAllocator::allocate(const DescriptorSetLayout &layout) {
+  auto layout_handle = layout.getHandle();
+  auto [itr, inserted] = layout_pools_.try_emplace(layout_handle);
+  auto &layout_pools = itr->second;
+  if (inserted) {
+    // pool sizes of one set, summed per descriptor type
+    for (const auto &binding : layout.getBindings()) {
+      auto size = std::find_if(layout_pools.set_sizes.begin(),
+                               layout_pools.set_sizes.end(),
+                               [&binding](const VkDescriptorPoolSize &size) {
+                                 return size.type == binding.descriptorType;
+                               });
+      if (size == layout_pools.set_sizes.end())
+        layout_pools.set_sizes.emplace_back(VkDescriptorPoolSize{
+            binding.descriptorType, binding.descriptorCount});
+      else
+        size->descriptorCount += binding.descriptorCount;
+    }
+    layout_pools.next_sets = sets_per_pool_;
+  }
+
+  VkDescriptorSetAllocateInfo alloc_info{
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+      .descriptorSetCount = 1,
+      .pSetLayouts = &layout_handle};
+  VkDescriptorSet descriptor_set{VK_NULL_HANDLE};
+  while (true) {
+    if (layout_pools.current == layout_pools.pools.size())
+      layout_pools.pools.emplace_back(createPool(layout_pools));
+    alloc_info.descriptorPool = layout_pools.pools[layout_pools.current];
+    auto result = vkAllocateDescriptorSets(driver_->getDevice(), &alloc_info,
+                                           &descriptor_set);
+    if (result == VK_SUCCESS)
+      break;
+    if (result != VK_ERROR_OUT_OF_POOL_MEMORY &&
+        result != VK_ERROR_FRAGMENTED_POOL)
+      throw VulkanException(result, "failed to allocate descriptor set!");
+    // the pool is full, try the next one
+    ++layout_pools.current;
+  }
+  ++set_count_;
+  return descriptor_set;
+}
+
+void DescriptorAllocator::reset() {
+  for (auto &[layout, layout_pools] : layout_pools_) {
+    for (auto pool : layout_pools.pools)
+      vkResetDescriptorPool(driver_->getDevice(), pool, 0);
+    layout_pools.current = 0;
+  }
+  set_count_ = 0;
+}
+
+DescriptorAllocatorStats DescriptorAllocator::getStats() const {
+  DescriptorAllocatorStats stats;
+  stats.layouts = static_cast<uint32_t>(layout_pools_.size());
+  for (const auto &[layout, layout_pools] : layout_pools_)
+    stats.pools += static_cast<uint32_t>(layout_pools.pools.size());
+  stats.sets = set_count_;
+  return stats;
+}
+
+VkDescriptorPool DescriptorAllocator::createPool(LayoutPools &layout_pools) {
+  const uint32_t sets = layout_pools.next_sets;
+  layout_pools.next_sets = std::min(sets * 2, kMaxSetsPerPool);
+  std::vector<VkDescriptorPoolSize> pool_sizes = layout_pools.set_sizes;
+  for (auto &pool_size : pool_sizes)
+    pool_size.descriptorCount *= sets;
+  VkDescriptorPoolCreateInfo pool_info{
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+      .flags = flags_,
+      .maxSets = sets,
+      .poolSizeCount = static_cast<uint32_t>(pool_sizes.size()),
+      .pPoolSizes = pool_sizes.data()};
+  VkDescriptorPool pool{VK_NULL_HANDLE};
+  auto result =
+      vkCreateDescriptorPool(driver_->getDevice(), &pool_info, nullptr, &pool);
+  if (result != VK_SUCCESS)
+    throw VulkanException(result, "failed to create descriptor pool!");
+  return pool;
+}
+
+TransientDescriptorAllocator::TransientDescriptorAllocator(
+    const std::shared_ptr<VkDriver> &driver)
+    : driver_(driver) {
+  for (auto &frame : frames_)
+    frame.allocator = std::make_unique<DescriptorAllocator>(driver);
+}
+
+TransientDescriptorAllocator::~TransientDescriptorAllocator() = default;
+
+void TransientDescriptorAllocator::beginFrame(uint32_t frame_index) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  frame_index_ = frame_index;
+  auto &frame = frames_[frame_index];
+  frame.allocator->reset();
+  frame.cache.clear();
+  requests_ = cache_hits_ = 0;
+}
+
+VkDescriptorSet
+TransientDescriptorAllocator::request(const DescriptorSetLayout &layout,
+                                      std::vector<VkWriteDescriptorSet> &writes) {
+  SetKey key;
+  key.emplace_back(reinterpret_cast<uint64_t>(layout.getHandle()));
+  for (const auto &write : writes) {
+    key.emplace_back(static_cast<uint64_t>(write.dstBinding) << 32 |
+                     write.dstArrayElement);
+    key.emplace_back(static_cast<uint64_t>(write.descriptorType) << 32 |
+                     write.descriptorCount);
+    for (uint32_t i = 0; i < write.descriptorCount; ++i) {
+      if (write.pBufferInfo != nullptr) {
+        const auto &info = write.pBufferInfo[i];
+        key.emplace_back(reinterpret_cast<uint64_t>(info.buffer));
+        key.emplace_back(info.offset);
+        key.emplace_back(info.range);
+      } else if (write.pImageInfo != nullptr) {
+        const auto &info = write.pImageInfo[i];
+        key.emplace_back(reinterpret_cast<uint64_t>(info.sampler));
+        key.emplace_back(reinterpret_cast<uint64_t>(info.imageView));
+        key.emplace_back(info.imageLayout);
+      }
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto &frame = frames_[frame_index_];
+  ++requests_;
+  auto itr = frame.cache.find(key);
+  if (itr != frame.cache.end()) {
+    ++cache_hits_;
+    return itr->second;
+  }
+  auto descriptor_set = frame.allocator->allocate(layout);
+  for (auto &write : writes)
+    write.dstSet = descriptor_set;
+  driver_->update(writes);
+  frame.cache.emplace(std::move(key), descriptor_set);
+  return descriptor_set;
+}
+
+TransientDescriptorStats TransientDescriptorAllocator::getStats() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return TransientDescriptorStats{
+      .requests = requests_,
+      .cache_hits = cache_hits_,
+      .allocator = frames_[frame_index_].allocator->getStats()};
+}
+
+size_t TransientDescriptorAllocator::SetKeyHash::operator()(
+    const SetKey &key) const {
+  size_t seed = key.size();
+  for (auto value : key)
+    hash_combine(seed, std::hash<uint64_t>{}(value));
+  return seed;
+}
+} // namespace mango
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <volk.h>
+
+#include <engine/utils/vk/vk_constants.h>
+
+namespace mango {
+class VkDriver;
+class DescriptorSetLayout;
+
+struct DescriptorAllocatorStats {
+  uint32_t layouts{0}; //!< layouts with pools
+  uint32_t pools{0};   //!< descriptor pools of all layouts
+  uint32_t sets{0};    //!< sets allocated since the last reset
+};
+
+/**
+ * @brief pool of descriptor pools.
+ *
+ * Each layout gets its own chain of pools sized for its bindings, so pools
+ * never fragment across layouts. When a pool is exhausted the next one is
+ * tried, and a new pool with twice the sets of the last one is chained when
+ * all are full. Sets are never freed one by one, they live until reset() or
+ * the allocator is destroyed.
+ */
+class DescriptorAllocator final {
+public:
+  /**
+   * @param flags pool create flags, e.g. UPDATE_AFTER_BIND for layouts with
+   * update after bind bindings
+   * @param sets_per_pool sets of the first pool of a layout
+   */
+  DescriptorAllocator(const std::shared_ptr<VkDriver> &driver,
+                      VkDescriptorPoolCreateFlags flags = 0,
+                      uint32_t sets_per_pool = 16);
+
+  ~DescriptorAllocator();
+
+  VkDescriptorSet allocate(const DescriptorSetLayout &layout);
+
+  /**
+   * @brief return all sets to their pools, the sets must not be in use
+   */
+  void reset();
+
+  DescriptorAllocatorStats getStats() const;
+
+  DescriptorAllocator(const DescriptorAllocator &) = delete;
+  DescriptorAllocator &operator=(const DescriptorAllocator &) = delete;
+
+private:
+  struct LayoutPools {
+    std::vector<VkDescriptorPoolSize> set_sizes; //!< descriptors of one set
+    std::vector<VkDescriptorPool> pools;
+    uint32_t current{0};   //!< pools before it are full
+    uint32_t next_sets{0}; //!< sets of the next chained pool
+  };
+
+  VkDescriptorPool createPool(LayoutPools &layout_pools);
+
+  std::shared_ptr<VkDriver> driver_;
+  VkDescriptorPoolCreateFlags flags_;
+  uint32_t sets_per_pool_;
+  std::unordered_map<VkDescriptorSetLayout, LayoutPools> layout_pools_;
+  uint32_t set_count_{0};
+};
+
+struct TransientDescriptorStats {
+  uint32_t requests{0}; //!< request() calls of the current frame
+  uint32_t cache_hits{0}; //!< requests served by an identical set
+  DescriptorAllocatorStats allocator; //!< of the current frame slot
+};
+
+/**
+ * @brief descriptor sets living for one frame.
+ *
+ * One DescriptorAllocator per frame slot, its pools are reset as a whole by
+ * beginFrame once the slot's fence is waited. Sets requested with their
+ * writes are deduplicated within the frame: a request whose layout and
+ * writes equal an earlier one returns the earlier set without allocating or
+ * updating. Thread safe.
+ */
+class TransientDescriptorAllocator final {
+public:
+  explicit TransientDescriptorAllocator(const std::shared_ptr<VkDriver> &driver);
+
+  ~TransientDescriptorAllocator();
+
+  /**
+   * @brief reset the sets of frame slot and allocate from it until the next
+   * call. Should be called after the frame fence is waited.
+   */
+  void beginFrame(uint32_t frame_index);
+
+  /**
+   * @brief a set of layout with writes applied, dstSet of writes is ignored
+   */
+  VkDescriptorSet request(const DescriptorSetLayout &layout,
+                          std::vector<VkWriteDescriptorSet> &writes);
+
+  TransientDescriptorStats getStats();
+
+  TransientDescriptorAllocator(const TransientDescriptorAllocator &) = delete;
+  TransientDescriptorAllocator &
+  operator=(const TransientDescriptorAllocator &) = delete;
+
+private:
+  //! layout and every field of the writes which affects the set
+  using SetKey = std::vector<uint64_t>;
+
+  struct SetKeyHash {
+    size_t operator()(const SetKey &key) const;
+  };
+
+  struct Frame {
+    std::unique_ptr<DescriptorAllocator> allocator;
+    std::unordered_map<SetKey, VkDescriptorSet, SetKeyHash> cache;
+  };
+
+  std::shared_ptr<VkDriver> driver_;
+  std::mutex mtx_;
+  Frame frames_[MAX_FRAMES_IN_FLIGHT];
+  uint32_t frame_index_{0};
+  uint32_t requests_{0};
+  uint32_t cache_hits_{0};
+};
+} // namespace mango
@@ -22,6 +22,10 @@ public:
 
   VkDescriptorSetLayout getHandle() const noexcept { return handle_; }
 
+  const std::vector<VkDescriptorSetLayoutBinding> &getBindings() const noexcept {
+    return bindings_;
+  }
+
 private:
   std::shared_ptr<VkDriver> driver_;
   VkDescriptorSetLayout handle_{VK_NULL_HANDLE};
@@ -112,7 +112,8 @@ RenderTarget::RenderTarget(const std::shared_ptr<VkDriver> &driver,
   if (ds_format_ != VK_FORMAT_UNDEFINED) {
     auto image = std::make_shared<Image>(
         driver_, 0, ds_format_, extent, 1, 1, VK_SAMPLE_COUNT_1_BIT,
-        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+            VK_IMAGE_USAGE_SAMPLED_BIT, // sampled for depth pyramid
         VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, VK_IMAGE_LAYOUT_UNDEFINED);
     images_.push_back(image);
     auto image_view = std::make_shared<ImageView>(
@@ -1,18 +1,43 @@
 #include <engine/utils/base/error.h>
 #include <engine/utils/vk/commands.h>
 #include <engine/utils/vk/image.h>
-#include <engine/utils/vk/stage_pool.h>
 
 namespace mango {
 
+uint32_t getTexelSize(VkFormat format) {
+  switch (format) {
+  case VK_FORMAT_R8_UNORM:
+    return 1;
+  case VK_FORMAT_R16_SFLOAT:
+    return 2;
+  case VK_FORMAT_R8G8B8_SRGB:
+    return 3;
+  case VK_FORMAT_R8G8B8A8_UNORM:
+  case VK_FORMAT_R8G8B8A8_SRGB:
+  case VK_FORMAT_R16G16_SFLOAT:
+  case VK_FORMAT_R32_SFLOAT:
+    return 4;
+  case VK_FORMAT_R16G16B16A16_SFLOAT:
+    return 8;
+  case VK_FORMAT_R32G32B32A32_SFLOAT:
+    return 16;
+  default:
+    return 0;
+  }
+}
+
 Image::Image(const std::shared_ptr<VkDriver> &driver, VkImageCreateFlags flags,
              VkFormat format, const VkExtent3D &extent, uint32_t mip_levels,
              uint32_t array_layers, VkSampleCountFlagBits sample_count,
              VkImageUsageFlags image_usage, VmaMemoryUsage memory_usage,
-             VkImageLayout layout)
+             VkImageLayout layout, MemoryClass memory_class)
     : driver_(driver), flags_(flags), format_(format), extent_(extent),
+      mip_levels_(mip_levels), array_layers_(array_layers),
       sample_count_(sample_count), image_usage_(image_usage),
       memory_usage_(memory_usage) {
+  // defragmentation copies the image to its new place
+  if (memory_class == MemoryClass::Texture)
+    image_usage_ |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
   VkImageCreateInfo image_info = {};
   image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
   image_info.flags = flags;
@@ -34,6 +59,10 @@ Image::Image(const std::shared_ptr<VkDriver> &driver, VkImageCreateFlags flags,
   if (image_usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) {
     alloc_create_info.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
   }
+  alloc_create_info.pool = driver_->getMemoryPools()->getImagePool(
+      memory_class, image_info, alloc_create_info);
+  // found by defragmentation moves
+  alloc_create_info.pUserData = this;
 
   auto result =
       vmaCreateImage(driver_->getAllocator(), &image_info, &alloc_create_info,
@@ -53,70 +82,19 @@ Image::Image(const std::shared_ptr<VkDriver> &driver, VkImage vk_image,
   own_image_ = own_image;
   format_ = format;
   extent_ = extent;
+  mip_levels_ = mip_levels;
+  array_layers_ = array_layers;
   sample_count_ = sample_count;
   image_usage_ = image_usage;
   layout_ = layout;
 }
 
 Image::~Image() {
-  if (own_image_)
+  // an image being moved is freed by the defragmentation pass
+  if (own_image_ && !driver_->getMemoryPools()->release(*this))
     vmaDestroyImage(driver_->getAllocator(), image_, allocation_);
 }
 
-void Image::updateByStaging(const void *data,
-                            const std::shared_ptr<CommandBuffer> &cmd_buf) {
-  uint32_t pixel_size = 0;
-  if (format_ == VK_FORMAT_R8G8B8_SRGB) {
-    pixel_size = 3;
-  } else if (format_ == VK_FORMAT_R8G8B8A8_SRGB) {
-    pixel_size = 4;
-  } else if (format_ == VK_FORMAT_R8_UNORM) {
-    pixel_size = 1;
-  } else if (format_ == VK_FORMAT_R32G32B32A32_SFLOAT) {
-    pixel_size = 16;
-  }
-
-  if (pixel_size == 0) {
-    throw std::runtime_error("Unsupported image format for update by staging.");
-  }
-  auto data_size = extent_.width * extent_.height * pixel_size;
-  auto stage_pool = driver_->getStagePool();
-  auto stage = stage_pool->acquireStage(data_size);
-
-  // cpu data to staging
-  void *mapped;
-  vmaMapMemory(driver_->getAllocator(), stage->memory, &mapped);
-  memcpy(mapped, data, data_size);
-  vmaUnmapMemory(driver_->getAllocator(), stage->memory);
-  vmaFlushAllocation(driver_->getAllocator(), stage->memory, 0, data_size);
-
-  // staging buffer to image
-  VkBufferImageCopy copyRegion = {
-      .bufferOffset = {},
-      .bufferRowLength = {},
-      .bufferImageHeight = {},
-      .imageSubresource = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                           .mipLevel = 0,
-                           .baseArrayLayer = 0,
-                           .layerCount = 1},
-      .imageOffset = {0, 0, 0},
-      .imageExtent = extent_};
-
-  VkImageSubresourceRange transitionRange = {.aspectMask =
-                                                 VK_IMAGE_ASPECT_COLOR_BIT,
-                                             .baseMipLevel = 0,
-                                             .levelCount = 1,
-                                             .baseArrayLayer = 0,
-                                             .layerCount = 1};
-
-  auto cmd_buf_handle = cmd_buf->getHandle();
-  transitionLayout(cmd_buf_handle, transitionRange,
-                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-  vkCmdCopyBufferToImage(cmd_buf_handle, stage->buffer, image_,
-                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
-}
-
 void getAccessMaskAndStageFlags(const VkImageLayout layout,
                                 VkAccessFlags &access_mask,
                                 VkPipelineStageFlags &stage) {
@@ -148,6 +126,17 @@ void getAccessMaskAndStageFlags(const VkImageLayout layout,
     access_mask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
     stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
     break;
+  case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+    access_mask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                  VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+            VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    break;
+  case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:
+    access_mask = VK_ACCESS_SHADER_READ_BIT;
+    stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    break;
   default:
     throw std::runtime_error("Unsupported layout transition.");
   }
@@ -207,7 +196,6 @@ ImageView::ImageView(const std::shared_ptr<Image> &image,
     : driver_(image->getDriver()), image_ptr_(image) {
   VkImageViewCreateInfo view_info = {};
   view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-  view_info.image = image->getHandle();
   view_info.viewType = view_type;
   view_info.format = format;
   view_info.subresourceRange.aspectMask = aspect_flags;
@@ -221,21 +209,42 @@ ImageView::ImageView(const std::shared_ptr<Image> &image,
   view_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
   view_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
 
-#ifndef NDEBUG
   view_type_ = view_type;
   format_ = format;
-#endif
   subresource_range_ = view_info.subresourceRange;
 
+  // the image may be moved by defragmentation while the view is created
+  std::lock_guard<std::mutex> lock(image->views_mtx_);
+  view_info.image = image->getHandle();
   auto result = vkCreateImageView(image->getDriver()->getDevice(), &view_info,
                                   nullptr, &image_view_);
   if (result != VK_SUCCESS) {
     throw VulkanException(result, "failed to create image view!");
   }
+  image->views_.emplace_back(this);
 }
 
 ImageView::~ImageView() {
+  std::lock_guard<std::mutex> lock(image_ptr_->views_mtx_);
+  std::erase(image_ptr_->views_, this);
   vkDestroyImageView(driver_->getDevice(), image_view_, nullptr);
 }
 
+VkImageView ImageView::recreate() {
+  VkImageViewCreateInfo view_info{
+      .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+      .image = image_ptr_->getHandle(),
+      .viewType = view_type_,
+      .format = format_,
+      .subresourceRange = subresource_range_};
+  const VkImageView old_view = image_view_;
+  auto result =
+      vkCreateImageView(driver_->getDevice(), &view_info, nullptr, &image_view_);
+  if (result != VK_SUCCESS) {
+    image_view_ = old_view;
+    throw VulkanException(result, "failed to recreate image view!");
+  }
+  return old_view;
+}
+
 } // namespace mango
\ No newline at end of file
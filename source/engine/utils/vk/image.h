@@ -1,19 +1,32 @@
 #pragma once
 
+#include <atomic>
+#include <engine/utils/vk/memory_pools.h>
+#include <engine/utils/vk/upload_scheduler.h>
 #include <engine/utils/vk/vk_driver.h>
 #include <memory>
+#include <mutex>
+#include <vector>
 #include <vk_mem_alloc.h>
 
 namespace mango {
 class StagePool;
 class CommandBuffer;
+
+/**
+ * @brief bytes per texel of the uncompressed formats uploaded from cpu, 0 if
+ * not supported
+ */
+uint32_t getTexelSize(VkFormat format);
+
 class Image final {
 public:
   Image(const std::shared_ptr<VkDriver> &driver, VkImageCreateFlags flags,
         VkFormat format, const VkExtent3D &extent, uint32_t mip_levels,
         uint32_t array_layers, VkSampleCountFlagBits sample_count,
         VkImageUsageFlags image_usage, VmaMemoryUsage memory_usage,
-        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED);
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED,
+        MemoryClass memory_class = MemoryClass::Default);
 
   Image(const std::shared_ptr<VkDriver> &driver, VkImage vk_image,
         bool own_image, VkFormat format, const VkExtent3D &extent,
@@ -29,12 +42,9 @@ public:
 
   VkImage getHandle() const { return image_; }
 
-  /**
-   * update image from cpu to gpu, data should be compatiable with image format,
-   * and tightly packed.
-   */
-  void updateByStaging(const void *data,
-                       const std::shared_ptr<CommandBuffer> &cmd_buf);
+  VkFormat getFormat() const { return format_; }
+
+  const VkExtent3D &getExtent() const { return extent_; }
 
   std::shared_ptr<VkDriver> getDriver() const { return driver_; }
 
@@ -50,6 +60,8 @@ private:
   VkImageCreateFlags flags_;
   VkFormat format_;
   VkExtent3D extent_;
+  uint32_t mip_levels_{1};
+  uint32_t array_layers_{1};
   VkSampleCountFlagBits sample_count_;
   VkImageUsageFlags image_usage_;
   VmaMemoryUsage memory_usage_;
@@ -58,8 +70,16 @@ private:
   VkImage image_{VK_NULL_HANDLE};
   VkImageLayout layout_{VK_IMAGE_LAYOUT_UNDEFINED};
 
+  //! batch of the last upload, an image is only moved once it completed
+  std::atomic<UploadTicket> upload_ticket_{0};
+
+  std::mutex views_mtx_;
+  std::vector<ImageView *> views_; //!< recreated when the image is moved
+
   friend class ImageView;
   friend class CommandBuffer;
+  friend class UploadScheduler;
+  friend class MemoryPools;
 };
 
 class ImageView final {
@@ -89,15 +109,21 @@ public:
 
 private:
   void updateLayout(VkImageLayout layout) { image_ptr_->updateLayout(layout); }
-#ifndef NDEBUG
+
+  /**
+   * @brief create the view again for the current handle of the image
+   * @return the old view, destroyed by the caller
+   */
+  VkImageView recreate();
+
   VkImageViewType view_type_;
   VkFormat format_;
-#endif
   VkImageSubresourceRange subresource_range_;
   VkImageView image_view_{VK_NULL_HANDLE};
 
   std::shared_ptr<VkDriver> driver_;
   std::shared_ptr<Image> image_ptr_; //!< used to keep image alive
   friend class CommandBuffer;
+  friend class MemoryPools;
 };
 } // namespace mango
\ No newline at end of file
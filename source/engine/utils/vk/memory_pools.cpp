@@ -0,0 +1,467 @@
+#include <engine/utils/vk/memory_pools.h>
+
+#include <algorithm>
+
+#include <engine/utils/base/error.h>
+#include <engine/utils/vk/buffer.h>
+#include <engine/utils/vk/image.h>
+#include <engine/utils/vk/upload_scheduler.h>
+#include <engine/utils/vk/vk_constants.h>
+#include <engine/utils/vk/vk_driver.h>
+
+namespace mango {
+static uint32_t classIndex(MemoryClass memory_class) {
+  return static_cast<uint32_t>(memory_class);
+}
+
+MemoryPools::MemoryPools(const std::shared_ptr<VkDriver> &driver)
+    : driver_(driver) {
+  queryBudgetLocked();
+}
+
+MemoryPools::~MemoryPools() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (pass_active_)
+    endPassLocked();
+  if (defrag_ctx_ != VK_NULL_HANDLE)
+    endDefragmentationLocked();
+  for (const auto &[key, pool] : pools_)
+    vmaDestroyPool(driver_->getAllocator(), pool);
+}
+
+VmaPool MemoryPools::getBufferPool(MemoryClass memory_class,
+                                   const VkBufferCreateInfo &buffer_info,
+                                   const VmaAllocationCreateInfo &alloc_info) {
+  // dedicated allocations don't live in blocks
+  if (memory_class == MemoryClass::Default ||
+      (alloc_info.flags & VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT) != 0)
+    return VK_NULL_HANDLE;
+  uint32_t memory_type_index = 0;
+  auto result = vmaFindMemoryTypeIndexForBufferInfo(
+      driver_->getAllocator(), &buffer_info, &alloc_info, &memory_type_index);
+  VK_THROW_IF_ERROR(result, "failed to find memory type of buffer!");
+  std::lock_guard<std::mutex> lock(mtx_);
+  return getPoolLocked(memory_class, memory_type_index);
+}
+
+VmaPool MemoryPools::getImagePool(MemoryClass memory_class,
+                                  const VkImageCreateInfo &image_info,
+                                  const VmaAllocationCreateInfo &alloc_info) {
+  if (memory_class == MemoryClass::Default ||
+      (alloc_info.flags & VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT) != 0)
+    return VK_NULL_HANDLE;
+  uint32_t memory_type_index = 0;
+  auto result = vmaFindMemoryTypeIndexForImageInfo(
+      driver_->getAllocator(), &image_info, &alloc_info, &memory_type_index);
+  VK_THROW_IF_ERROR(result, "failed to find memory type of image!");
+  std::lock_guard<std::mutex> lock(mtx_);
+  return getPoolLocked(memory_class, memory_type_index);
+}
+
+void MemoryPools::queryBudgetLocked() {
+  // VK_EXT_memory_budget if supported, else estimated by VMA
+  const VkPhysicalDeviceMemoryProperties *memory_properties = nullptr;
+  vmaGetMemoryProperties(driver_->getAllocator(), &memory_properties);
+  VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+  vmaGetHeapBudgets(driver_->getAllocator(), budgets);
+  device_budget_ = {};
+  for (uint32_t i = 0; i < memory_properties->memoryHeapCount; ++i) {
+    if ((memory_properties->memoryHeaps[i].flags &
+         VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) == 0)
+      continue;
+    device_budget_.usage += budgets[i].usage;
+    device_budget_.budget += budgets[i].budget;
+  }
+}
+
+VmaPool MemoryPools::getPoolLocked(MemoryClass memory_class,
+                                   uint32_t memory_type_index) {
+  const auto key = std::make_pair(memory_class, memory_type_index);
+  auto itr = pools_.find(key);
+  if (itr != pools_.end())
+    return itr->second;
+  VmaPoolCreateInfo pool_info{.memoryTypeIndex = memory_type_index};
+  VmaPool pool = VK_NULL_HANDLE;
+  auto result = vmaCreatePool(driver_->getAllocator(), &pool_info, &pool);
+  VK_THROW_IF_ERROR(result, "failed to create memory pool!");
+  pools_.emplace(key, pool);
+  return pool;
+}
+
+std::vector<ImageView *> MemoryPools::beginFrame() {
+  std::vector<ImageView *> moved_views;
+  std::lock_guard<std::mutex> lock(mtx_);
+  ++frame_;
+  const auto allocator = driver_->getAllocator();
+  vmaSetCurrentFrameIndex(allocator, static_cast<uint32_t>(frame_));
+
+  // the budget is queried once per frame
+  queryBudgetLocked();
+
+  // every frame slot was waited since the copies of the pass were submitted,
+  // so the old places and handles are no longer used
+  if (pass_active_ && frame_ - pass_frame_ >= MAX_FRAMES_IN_FLIGHT)
+    endPassLocked();
+  if (pass_active_)
+    return moved_views;
+  if (defrag_ctx_ == VK_NULL_HANDLE &&
+      (defrag_requested_ || frame_ % kCheckFrames == 0)) {
+    defrag_requested_ = false;
+    startDefragmentationLocked();
+  }
+  if (defrag_ctx_ != VK_NULL_HANDLE)
+    beginPassLocked(moved_views);
+  return moved_views;
+}
+
+void MemoryPools::requestDefragmentation() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  defrag_requested_ = true;
+}
+
+void MemoryPools::startDefragmentationLocked() {
+  // the movable pool whose free space is split the most
+  const auto allocator = driver_->getAllocator();
+  VmaPool defrag_pool = VK_NULL_HANDLE;
+  float max_fragmentation = kFragmentationThreshold;
+  for (const auto &[key, pool] : pools_) {
+    if (key.first != MemoryClass::Mesh && key.first != MemoryClass::Texture)
+      continue;
+    VmaDetailedStatistics stats;
+    vmaCalculatePoolStatistics(allocator, pool, &stats);
+    const uint64_t free_bytes =
+        stats.statistics.blockBytes - stats.statistics.allocationBytes;
+    if (free_bytes < kMinFreeBytes)
+      continue;
+    const float fragmentation =
+        1.0f - static_cast<float>(stats.unusedRangeSizeMax) / free_bytes;
+    if (fragmentation > max_fragmentation) {
+      max_fragmentation = fragmentation;
+      defrag_pool = pool;
+      defrag_class_ = key.first;
+    }
+  }
+  if (defrag_pool == VK_NULL_HANDLE)
+    return;
+
+  VmaDefragmentationInfo defrag_info{
+      .flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT,
+      .pool = defrag_pool,
+      .maxBytesPerPass = kMaxBytesPerPass,
+      .maxAllocationsPerPass = kMaxMovesPerPass};
+  auto result = vmaBeginDefragmentation(allocator, &defrag_info, &defrag_ctx_);
+  VK_THROW_IF_ERROR(result, "failed to begin defragmentation!");
+}
+
+void MemoryPools::endDefragmentationLocked() {
+  vmaEndDefragmentation(driver_->getAllocator(), defrag_ctx_, nullptr);
+  defrag_ctx_ = VK_NULL_HANDLE;
+}
+
+void MemoryPools::beginPassLocked(std::vector<ImageView *> &moved_views) {
+  const auto allocator = driver_->getAllocator();
+  auto result = vmaBeginDefragmentationPass(allocator, defrag_ctx_, &pass_);
+  if (result == VK_SUCCESS) {
+    // nothing left to move
+    endDefragmentationLocked();
+    return;
+  }
+  if (result != VK_INCOMPLETE)
+    throw VulkanException(result, "failed to begin defragmentation pass!");
+
+  for (uint32_t i = 0; i < pass_.moveCount; ++i) {
+    VmaAllocationInfo allocation_info;
+    vmaGetAllocationInfo(allocator, pass_.pMoves[i].srcAllocation,
+                         &allocation_info);
+    bool moved = false;
+    if (allocation_info.pUserData != nullptr) {
+      moved = defrag_class_ == MemoryClass::Mesh
+                  ? moveBufferLocked(
+                        i, *static_cast<Buffer *>(allocation_info.pUserData))
+                  : moveImageLocked(
+                        i, *static_cast<Image *>(allocation_info.pUserData),
+                        moved_views);
+    }
+    if (!moved) {
+      pass_.pMoves[i].operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+      continue;
+    }
+    ++moved_count_[classIndex(defrag_class_)];
+    moved_bytes_[classIndex(defrag_class_)] += allocation_info.size;
+  }
+  pass_active_ = true;
+  pass_recorded_ = false;
+  pass_frame_ = frame_;
+}
+
+bool MemoryPools::isUploaded(uint64_t ticket) const {
+  return ticket != 0 && driver_->getUploadScheduler()->isCompleted(ticket);
+}
+
+bool MemoryPools::moveBufferLocked(uint32_t index, Buffer &buffer) {
+  // written by the host or by a pending upload
+  if (buffer.mapped_ ||
+      !isUploaded(buffer.upload_ticket_.load(std::memory_order_acquire)))
+    return false;
+  VkBufferCreateInfo buffer_info{.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                                 .flags = buffer.flags_,
+                                 .size = buffer.size_,
+                                 .usage = buffer.buffer_usage_,
+                                 .sharingMode = VK_SHARING_MODE_EXCLUSIVE};
+  VkBuffer dst_buffer = VK_NULL_HANDLE;
+  auto result = vkCreateBuffer(driver_->getDevice(), &buffer_info, nullptr,
+                               &dst_buffer);
+  VK_THROW_IF_ERROR(result, "failed to create moved buffer!");
+  result = vmaBindBufferMemory(driver_->getAllocator(),
+                               pass_.pMoves[index].dstTmpAllocation,
+                               dst_buffer);
+  if (result != VK_SUCCESS) {
+    vkDestroyBuffer(driver_->getDevice(), dst_buffer, nullptr);
+    throw VulkanException(result, "failed to bind moved buffer!");
+  }
+  moves_.emplace_back(Move{.index = index,
+                           .src_buffer = buffer.buffer_,
+                           .dst_buffer = dst_buffer,
+                           .size = buffer.size_});
+  retired_buffers_.emplace_back(buffer.buffer_);
+  buffer.buffer_ = dst_buffer;
+  return true;
+}
+
+bool MemoryPools::moveImageLocked(uint32_t index, Image &image,
+                                  std::vector<ImageView *> &moved_views) {
+  if (image.layout_ != VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL ||
+      !isUploaded(image.upload_ticket_.load(std::memory_order_acquire)))
+    return false;
+  VkImageCreateInfo image_info{.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                               .flags = image.flags_,
+                               .imageType = VK_IMAGE_TYPE_2D,
+                               .format = image.format_,
+                               .extent = image.extent_,
+                               .mipLevels = image.mip_levels_,
+                               .arrayLayers = image.array_layers_,
+                               .samples = image.sample_count_,
+                               .tiling = VK_IMAGE_TILING_OPTIMAL,
+                               .usage = image.image_usage_,
+                               .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                               .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+  VkImage dst_image = VK_NULL_HANDLE;
+  auto result =
+      vkCreateImage(driver_->getDevice(), &image_info, nullptr, &dst_image);
+  VK_THROW_IF_ERROR(result, "failed to create moved image!");
+  result = vmaBindImageMemory(driver_->getAllocator(),
+                              pass_.pMoves[index].dstTmpAllocation, dst_image);
+  if (result != VK_SUCCESS) {
+    vkDestroyImage(driver_->getDevice(), dst_image, nullptr);
+    throw VulkanException(result, "failed to bind moved image!");
+  }
+  moves_.emplace_back(Move{.index = index,
+                           .src_image = image.image_,
+                           .dst_image = dst_image,
+                           .extent = image.extent_,
+                           .mip_levels = image.mip_levels_,
+                           .array_layers = image.array_layers_});
+  retired_images_.emplace_back(image.image_);
+  image.image_ = dst_image;
+
+  // the views of the image are recreated in place, frames in flight keep
+  // using the old ones until the pass ends
+  std::lock_guard<std::mutex> views_lock(image.views_mtx_);
+  for (auto *view : image.views_) {
+    retired_views_.emplace_back(view->recreate());
+    moved_views.emplace_back(view);
+  }
+  return true;
+}
+
+void MemoryPools::recordMoves(VkCommandBuffer cmd_buf) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (!pass_active_ || pass_recorded_)
+    return;
+  pass_recorded_ = true;
+
+  // resources destroyed since beginFrame() are not copied
+  std::vector<const Move *> moves;
+  for (const auto &move : moves_)
+    if (pass_.pMoves[move.index].operation ==
+        VMA_DEFRAGMENTATION_MOVE_OPERATION_COPY)
+      moves.emplace_back(&move);
+  if (moves.empty())
+    return;
+
+  auto image_barrier = [](VkImage image, const Move &move,
+                          VkAccessFlags src_access, VkAccessFlags dst_access,
+                          VkImageLayout old_layout, VkImageLayout new_layout) {
+    return VkImageMemoryBarrier{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = src_access,
+        .dstAccessMask = dst_access,
+        .oldLayout = old_layout,
+        .newLayout = new_layout,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = image,
+        .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                             .baseMipLevel = 0,
+                             .levelCount = move.mip_levels,
+                             .baseArrayLayer = 0,
+                             .layerCount = move.array_layers}};
+  };
+
+  // one barrier before all copies and one after, like the upload batches
+  std::vector<VkImageMemoryBarrier> image_barriers;
+  for (const auto *move : moves) {
+    if (move->src_image == VK_NULL_HANDLE)
+      continue;
+    image_barriers.emplace_back(image_barrier(
+        move->src_image, *move, VK_ACCESS_MEMORY_WRITE_BIT,
+        VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL));
+    image_barriers.emplace_back(image_barrier(
+        move->dst_image, *move, 0, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL));
+  }
+  VkMemoryBarrier memory_barrier{
+      .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT,
+      .dstAccessMask =
+          VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT};
+  vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memory_barrier, 0,
+                       nullptr, static_cast<uint32_t>(image_barriers.size()),
+                       image_barriers.data());
+
+  std::vector<VkImageCopy> regions;
+  for (const auto *move : moves) {
+    if (move->src_buffer != VK_NULL_HANDLE) {
+      const VkBufferCopy region{.srcOffset = 0, .dstOffset = 0,
+                                .size = move->size};
+      vkCmdCopyBuffer(cmd_buf, move->src_buffer, move->dst_buffer, 1, &region);
+      continue;
+    }
+    regions.clear();
+    for (uint32_t level = 0; level < move->mip_levels; ++level) {
+      const VkImageSubresourceLayers layers{
+          .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+          .mipLevel = level,
+          .baseArrayLayer = 0,
+          .layerCount = move->array_layers};
+      regions.emplace_back(VkImageCopy{
+          .srcSubresource = layers,
+          .srcOffset = {0, 0, 0},
+          .dstSubresource = layers,
+          .dstOffset = {0, 0, 0},
+          .extent = {std::max(move->extent.width >> level, 1u),
+                     std::max(move->extent.height >> level, 1u),
+                     std::max(move->extent.depth >> level, 1u)}});
+    }
+    vkCmdCopyImage(cmd_buf, move->src_image,
+                   VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, move->dst_image,
+                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                   static_cast<uint32_t>(regions.size()), regions.data());
+  }
+
+  image_barriers.clear();
+  for (const auto *move : moves)
+    if (move->dst_image != VK_NULL_HANDLE)
+      image_barriers.emplace_back(image_barrier(
+          move->dst_image, *move, VK_ACCESS_TRANSFER_WRITE_BIT,
+          VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+  memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  memory_barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+  vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1,
+                       &memory_barrier, 0, nullptr,
+                       static_cast<uint32_t>(image_barriers.size()),
+                       image_barriers.data());
+}
+
+void MemoryPools::endPassLocked() {
+  // the old handles go before their memory
+  const auto device = driver_->getDevice();
+  for (auto buffer : retired_buffers_)
+    vkDestroyBuffer(device, buffer, nullptr);
+  for (auto image : retired_images_)
+    vkDestroyImage(device, image, nullptr);
+  for (auto view : retired_views_)
+    vkDestroyImageView(device, view, nullptr);
+  retired_buffers_.clear();
+  retired_images_.clear();
+  retired_views_.clear();
+  moves_.clear();
+  pass_active_ = false;
+
+  auto result = vmaEndDefragmentationPass(driver_->getAllocator(),
+                                          defrag_ctx_, &pass_);
+  if (result == VK_SUCCESS)
+    endDefragmentationLocked();
+  else if (result != VK_INCOMPLETE)
+    throw VulkanException(result, "failed to end defragmentation pass!");
+}
+
+bool MemoryPools::release(Buffer &buffer) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (!releaseLocked(buffer.allocation_))
+    return false;
+  retired_buffers_.emplace_back(buffer.buffer_);
+  return true;
+}
+
+bool MemoryPools::release(Image &image) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (!releaseLocked(image.allocation_))
+    return false;
+  retired_images_.emplace_back(image.image_);
+  return true;
+}
+
+bool MemoryPools::releaseLocked(VmaAllocation allocation) {
+  // allocations of the current pass are freed by vmaEndDefragmentationPass
+  if (!pass_active_)
+    return false;
+  for (uint32_t i = 0; i < pass_.moveCount; ++i) {
+    if (pass_.pMoves[i].srcAllocation != allocation)
+      continue;
+    pass_.pMoves[i].operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_DESTROY;
+    return true;
+  }
+  return false;
+}
+
+MemoryBudget MemoryPools::getDeviceBudget() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return device_budget_;
+}
+
+MemoryStats MemoryPools::getStats() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  MemoryStats stats{.device = device_budget_,
+                    .defragmenting = defrag_ctx_ != VK_NULL_HANDLE};
+  VkDeviceSize max_free_range[classIndex(MemoryClass::Count)]{};
+  for (const auto &[key, pool] : pools_) {
+    VmaDetailedStatistics pool_stats;
+    vmaCalculatePoolStatistics(driver_->getAllocator(), pool, &pool_stats);
+    auto &class_stats = stats.classes[classIndex(key.first)];
+    ++class_stats.pools;
+    class_stats.blocks += pool_stats.statistics.blockCount;
+    class_stats.allocations += pool_stats.statistics.allocationCount;
+    class_stats.block_bytes += pool_stats.statistics.blockBytes;
+    class_stats.allocation_bytes += pool_stats.statistics.allocationBytes;
+    max_free_range[classIndex(key.first)] =
+        std::max(max_free_range[classIndex(key.first)],
+                 pool_stats.unusedRangeSizeMax);
+  }
+  for (uint32_t i = 0; i < classIndex(MemoryClass::Count); ++i) {
+    auto &class_stats = stats.classes[i];
+    const uint64_t free_bytes =
+        class_stats.block_bytes - class_stats.allocation_bytes;
+    if (free_bytes != 0)
+      class_stats.fragmentation =
+          1.0f - static_cast<float>(max_free_range[i]) / free_bytes;
+    class_stats.moves = moved_count_[i];
+    class_stats.bytes_moved = moved_bytes_[i];
+  }
+  return stats;
+}
+} // namespace mango
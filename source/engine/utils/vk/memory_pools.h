@@ -0,0 +1,194 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <vk_mem_alloc.h>
+#include <volk.h>
+
+namespace mango {
+class VkDriver;
+class Buffer;
+class Image;
+class ImageView;
+
+//! resource classes, each allocated from its own VMA pools
+enum class MemoryClass : uint32_t {
+  Default,  //!< VMA default pools, never moved
+  Mesh,     //!< vertex and index buffers, defragmented
+  Texture,  //!< sampled images of material textures, defragmented
+  Staging,  //!< host visible upload memory
+  PerFrame, //!< host visible data rewritten every frame
+  Count
+};
+
+struct MemoryPoolStats {
+  uint32_t pools{0};             //!< one per memory type used by the class
+  uint32_t blocks{0};            //!< device memory blocks of the pools
+  uint32_t allocations{0};
+  uint64_t block_bytes{0};
+  uint64_t allocation_bytes{0};
+  float fragmentation{0.0f};     //!< 1 - largest free range / free bytes
+  uint64_t moves{0};             //!< allocations moved by defragmentation
+  uint64_t bytes_moved{0};
+};
+
+struct MemoryBudget {
+  uint64_t usage{0};  //!< bytes used in device local heaps
+  uint64_t budget{0}; //!< bytes the process may use in device local heaps
+};
+
+struct MemoryStats {
+  MemoryBudget device;
+  MemoryPoolStats classes[static_cast<uint32_t>(MemoryClass::Count)];
+  bool defragmenting{false};
+};
+
+/**
+ * @brief custom VMA pools per resource class, the per frame memory budget and
+ * incremental defragmentation of the Mesh and Texture pools.
+ *
+ * Buffers and images get the pool of their MemoryClass and memory type when
+ * created. beginFrame() reads the heap budgets once per frame. Every
+ * kCheckFrames frames the pool with the most fragmented free space above
+ * kFragmentationThreshold is defragmented by VMA, one pass of at most
+ * kMaxBytesPerPass at a time. The allocations of a pass get new handles bound
+ * to their new place right away, recordMoves() copies them in the frame command
+ * buffer, and the old memory and handles are freed once all frame slots moved
+ * on. Resources which are mapped or whose upload is not complete are skipped.
+ * The views of moved images are recreated in place, the caller of
+ * beginFrame() updates the descriptors using them.
+ */
+class MemoryPools final {
+public:
+  explicit MemoryPools(const std::shared_ptr<VkDriver> &driver);
+
+  ~MemoryPools();
+
+  MemoryPools(const MemoryPools &) = delete;
+  MemoryPools &operator=(const MemoryPools &) = delete;
+
+  /**
+   * @brief pool of a buffer of memory_class, VK_NULL_HANDLE for the default
+   * pools. Thread safe.
+   */
+  VmaPool getBufferPool(MemoryClass memory_class,
+                        const VkBufferCreateInfo &buffer_info,
+                        const VmaAllocationCreateInfo &alloc_info);
+
+  /**
+   * @brief pool of an image of memory_class, VK_NULL_HANDLE for the default
+   * pools. Thread safe.
+   */
+  VmaPool getImagePool(MemoryClass memory_class,
+                       const VkImageCreateInfo &image_info,
+                       const VmaAllocationCreateInfo &alloc_info);
+
+  /**
+   * @brief render thread, after the frame fence is waited: query the budget,
+   * finish the pass all frame slots moved past and begin the next one.
+   * @return image views recreated for the moved images
+   */
+  std::vector<ImageView *> beginFrame();
+
+  /**
+   * @brief check the Mesh and Texture pools at the next beginFrame() instead of
+   * waiting for the next kCheckFrames, e.g. after many resources were freed.
+   * Thread safe.
+   */
+  void requestDefragmentation();
+
+  /**
+   * @brief render thread: copy the allocations moved by beginFrame() of this
+   * frame, after the upload acquires and before any draw
+   */
+  void recordMoves(VkCommandBuffer cmd_buf);
+
+  /**
+   * @brief called by the destructor of a buffer or image before freeing its
+   * allocation. If the allocation is part of the current pass, the pass frees
+   * it and destroys the handle, and true is returned.
+   */
+  bool release(Buffer &buffer);
+
+  bool release(Image &image);
+
+  /**
+   * @brief budget of the device local heaps, as of the last beginFrame()
+   */
+  MemoryBudget getDeviceBudget();
+
+  MemoryStats getStats();
+
+private:
+  //! frames between fragmentation checks
+  static constexpr uint64_t kCheckFrames = 600;
+  //! defragment a pool whose free space is more fragmented than this
+  static constexpr float kFragmentationThreshold = 0.5f;
+  //! and which has at least this many free bytes
+  static constexpr uint64_t kMinFreeBytes = 16ull << 20;
+  static constexpr uint64_t kMaxBytesPerPass = 32ull << 20;
+  static constexpr uint32_t kMaxMovesPerPass = 64;
+
+  //! a move of the current pass which got a new handle, copied by
+  //! recordMoves() unless its resource is destroyed before
+  struct Move {
+    uint32_t index; //!< in pass_.pMoves
+    VkBuffer src_buffer{VK_NULL_HANDLE};
+    VkBuffer dst_buffer{VK_NULL_HANDLE};
+    VkDeviceSize size{0};
+    VkImage src_image{VK_NULL_HANDLE};
+    VkImage dst_image{VK_NULL_HANDLE};
+    VkExtent3D extent{};
+    uint32_t mip_levels{0};
+    uint32_t array_layers{0};
+  };
+
+  //! whether a buffer or image was written by its upload, ticket 0 for none
+  bool isUploaded(uint64_t ticket) const;
+
+  void queryBudgetLocked();
+
+  VmaPool getPoolLocked(MemoryClass memory_class, uint32_t memory_type_index);
+
+  void startDefragmentationLocked();
+
+  void endDefragmentationLocked();
+
+  void beginPassLocked(std::vector<ImageView *> &moved_views);
+
+  bool moveBufferLocked(uint32_t index, Buffer &buffer);
+
+  bool moveImageLocked(uint32_t index, Image &image,
+                       std::vector<ImageView *> &moved_views);
+
+  void endPassLocked();
+
+  bool releaseLocked(VmaAllocation allocation);
+
+  std::shared_ptr<VkDriver> driver_;
+
+  std::mutex mtx_; //!< guards the members below
+  std::map<std::pair<MemoryClass, uint32_t>, VmaPool> pools_;
+  MemoryBudget device_budget_;
+  uint64_t frame_{0};
+  bool defrag_requested_{false}; //!< check at the next beginFrame()
+  uint64_t moved_count_[static_cast<uint32_t>(MemoryClass::Count)]{};
+  uint64_t moved_bytes_[static_cast<uint32_t>(MemoryClass::Count)]{};
+
+  // defragmentation of one pool
+  VmaDefragmentationContext defrag_ctx_{VK_NULL_HANDLE};
+  MemoryClass defrag_class_{MemoryClass::Default};
+  VmaDefragmentationPassMoveInfo pass_{};
+  bool pass_active_{false};
+  bool pass_recorded_{false};
+  uint64_t pass_frame_{0};
+  std::vector<Move> moves_;
+  std::vector<VkBuffer> retired_buffers_; //!< destroyed when the pass ends
+  std::vector<VkImage> retired_images_;
+  std::vector<VkImageView> retired_views_;
+};
+} // namespace mango
@@ -43,13 +43,17 @@ PhysicalDevice::getPhysicalDevices(VkInstance instance) {
           (p.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
           (p.queueFlags & VK_QUEUE_COMPUTE_BIT)) {
         physical_devices[i].graphics_queue_family_index_ = j;
-      } else if (p.queueFlags & VK_QUEUE_TRANSFER_BIT) {
+      } else if ((p.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+                 (physical_devices[i].transfer_queue_family_index_ ==
+                      0xFFFFFFFF ||
+                  !(p.queueFlags & VK_QUEUE_COMPUTE_BIT))) {
+        // prefer a transfer only family, its queues are the dma engines
         physical_devices[i].transfer_queue_family_index_ = j;
       }
-      if (physical_devices[i].transfer_queue_family_index_ == 0xFFFFFFFF) {      
-        physical_devices[i].transfer_queue_family_index_ 
-          = physical_devices[i].graphics_queue_family_index_;
-      }
+    }
+    if (physical_devices[i].transfer_queue_family_index_ == 0xFFFFFFFF) {
+      physical_devices[i].transfer_queue_family_index_ =
+          physical_devices[i].graphics_queue_family_index_;
     }
   }
   return physical_devices;
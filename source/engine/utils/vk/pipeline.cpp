@@ -81,6 +81,15 @@ GraphicsPipeline::GraphicsPipeline(
   pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
   pipeline_info.basePipelineIndex = -1;
 
+  // creation time and cache hits, see ResourceCache::getPipelineCacheStats
+  VkPipelineCreationFeedback feedback{};
+  VkPipelineCreationFeedbackCreateInfo feedback_info{
+      VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO};
+  feedback_info.pPipelineCreationFeedback = &feedback;
+  if (driver->isDeviceExtensionEnabled(
+          VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME))
+    pipeline_info.pNext = &feedback_info;
+
   assert(cache->getPipelineCache() !=
          nullptr); // pipeline cache should always exist
   auto result =
@@ -88,6 +97,7 @@ GraphicsPipeline::GraphicsPipeline(
                                 1, &pipeline_info, nullptr, &pipeline_);
   if (result != VK_SUCCESS)
     throw VulkanException(result, "failed to create graphics pipeline!");
+  cache->recordPipelineCreation(feedback);
 
   cleanDirtyFlag();
 }
@@ -95,4 +105,47 @@ GraphicsPipeline::GraphicsPipeline(
 GraphicsPipeline::~GraphicsPipeline() {
   vkDestroyPipeline(driver_->getDevice(), pipeline_, nullptr);
 }
+
+ComputePipeline::ComputePipeline(
+    const std::shared_ptr<VkDriver> &driver,
+    const std::shared_ptr<ResourceCache> &cache,
+    const std::shared_ptr<ShaderModule> &shader_module)
+    : Pipeline(driver, Pipeline::Type::COMPUTE) {
+  assert(cache != nullptr);
+  assert(shader_module->getStage() == VK_SHADER_STAGE_COMPUTE_BIT);
+  auto shader = cache->requestShader(driver, shader_module);
+  pipeline_layout_ = cache->requestPipelineLayout(driver, {shader_module});
+
+  VkComputePipelineCreateInfo pipeline_info{
+      VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
+  pipeline_info.stage.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipeline_info.stage.module = shader->getHandle();
+  pipeline_info.stage.pName = "main";
+  pipeline_info.layout = pipeline_layout_->getHandle();
+  pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+  pipeline_info.basePipelineIndex = -1;
+
+  // creation time and cache hits, see ResourceCache::getPipelineCacheStats
+  VkPipelineCreationFeedback feedback{};
+  VkPipelineCreationFeedbackCreateInfo feedback_info{
+      VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO};
+  feedback_info.pPipelineCreationFeedback = &feedback;
+  if (driver->isDeviceExtensionEnabled(
+          VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME))
+    pipeline_info.pNext = &feedback_info;
+
+  assert(cache->getPipelineCache() != nullptr);
+  auto result =
+      vkCreateComputePipelines(driver->getDevice(), cache->getPipelineCache(),
+                               1, &pipeline_info, nullptr, &pipeline_);
+  if (result != VK_SUCCESS)
+    throw VulkanException(result, "failed to create compute pipeline!");
+  cache->recordPipelineCreation(feedback);
+}
+
+ComputePipeline::~ComputePipeline() {
+  vkDestroyPipeline(driver_->getDevice(), pipeline_, nullptr);
+}
 } // namespace mango
\ No newline at end of file
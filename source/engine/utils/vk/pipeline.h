@@ -56,4 +56,13 @@ public:
 private:
   std::unique_ptr<GPipelineState> pipeline_state_;
 };
+
+class ComputePipeline : public Pipeline {
+public:
+  ComputePipeline(const std::shared_ptr<VkDriver> &driver,
+                  const std::shared_ptr<ResourceCache> &cache,
+                  const std::shared_ptr<ShaderModule> &shader_module);
+
+  ~ComputePipeline() override;
+};
 } // namespace mango
\ No newline at end of file
@@ -1,12 +1,29 @@
+#include <cstring>
+#include <engine/platform/file_system.h>
+#include <engine/utils/base/error.h>
 #include <engine/utils/base/hash_combine.h>
+#include <engine/utils/base/macro.h>
 #include <engine/utils/vk/resource_cache.h>
 #include <engine/utils/vk/sampler.h>
+#include <filesystem>
+#include <fstream>
+#include <string_view>
 
 namespace mango {
 
+ResourceCache::~ResourceCache() {
+  // a periodic save may still use the pipeline cache
+  const auto &job_system = g_engine.getJobSystem();
+  if (!pipeline_cache_saved_.isDone() && job_system != nullptr)
+    job_system->wait(pipeline_cache_saved_);
+}
+
 void ResourceCache::init(const std::shared_ptr<VkDriver> &driver) {
-  state_.pipeline_cache =
-      std::make_unique<VkPipelineCacheWraper>(driver->getDevice());
+  auto file_system = g_engine.getFileSystem();
+  state_.pipeline_cache = std::make_unique<VkPipelineCacheWraper>(
+      driver,
+      file_system->combine(file_system->getCacheDir(),
+                           std::string("pipeline_cache.bin")));
 }
 
 std::shared_ptr<ShaderModule>
@@ -14,7 +31,8 @@ ResourceCache::requestShaderModule(VkShaderStageFlagBits stage,
                                    const std::string &glsl_source,
                                    const ShaderVariant &variant) {
   std::unique_lock<std::mutex> lock(state_.shader_modules_mtx);
-  auto hash_code = ShaderModule::hash(glsl_source, stage);
+  auto hash_code =
+      ShaderModule::hash(glsl_source, variant.getPreamble(), stage);
   auto iter = state_.shader_modules.find(hash_code);
   if (iter != state_.shader_modules.end())
     return iter->second;
@@ -153,7 +171,24 @@ void ResourceCache::clear() {
   state_.samplers.clear();
 }
 
+void ResourceCache::savePipelineCache() {
+  if (!pipeline_cache_saved_.isDone())
+    g_engine.getJobSystem()->wait(pipeline_cache_saved_);
+  if (state_.pipeline_cache != nullptr)
+    state_.pipeline_cache->save();
+}
+
 void ResourceCache::gc() {
+  // so a crash loses at most the pipelines of the last minute or so. Reading
+  // the cache data and writing the file are done by a job, the main thread
+  // isn't blocked
+  if ((current_frame_ + 1) % kPipelineCacheSaveFrames == 0 &&
+      state_.pipeline_cache != nullptr && pipeline_cache_saved_.isDone())
+    g_engine.getJobSystem()->run(
+        [pipeline_cache = state_.pipeline_cache.get()]() {
+          pipeline_cache->save();
+        },
+        &pipeline_cache_saved_);
   if (++current_frame_ < DATA_RESOURCE_TIME_BEFORE_EVICTION)
     return;
   auto data_resource = state_.data_resources;
@@ -168,11 +203,140 @@ void ResourceCache::gc() {
   }
 }
 
-VkPipelineCacheWraper::VkPipelineCacheWraper(VkDevice device)
-    : device_(device) {
+//! compares the cache data with the file without reading the file
+static uint64_t hashPipelineCacheData(const std::vector<uint8_t> &data) {
+  return std::hash<std::string_view>{}(std::string_view(
+      reinterpret_cast<const char *>(data.data()), data.size()));
+}
+
+/**
+ * @brief whether data was written by a driver compatible with properties, the
+ * header is little endian like the hosts the engine runs on
+ */
+static bool isPipelineCacheCompatible(const std::vector<uint8_t> &data,
+                                      const VkPhysicalDeviceProperties &props) {
+  VkPipelineCacheHeaderVersionOne header{};
+  if (data.size() < sizeof(header))
+    return false;
+  std::memcpy(&header, data.data(), sizeof(header));
+  return header.headerSize >= sizeof(header) &&
+         header.headerSize <= data.size() &&
+         header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         header.vendorID == props.vendorID &&
+         header.deviceID == props.deviceID &&
+         std::memcmp(header.pipelineCacheUUID, props.pipelineCacheUUID,
+                     VK_UUID_SIZE) == 0;
+}
+
+VkPipelineCacheWraper::VkPipelineCacheWraper(
+    const std::shared_ptr<VkDriver> &driver, const std::string &path)
+    : device_(driver->getDevice()), path_(path) {
+  std::vector<uint8_t> data;
+  auto file_system = g_engine.getFileSystem();
+  if (file_system->exists(path_) && file_system->loadBinary(path_, data)) {
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(driver->getPhysicalDevice(), &props);
+    if (!isPipelineCacheCompatible(data, props)) {
+      LOGW("pipeline cache {} is from another device or driver, discarded",
+           path_);
+      data.clear();
+    }
+  }
+
   VkPipelineCacheCreateInfo create_info{
       VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO};
-  vkCreatePipelineCache(device, &create_info, nullptr, &handle_);
+  create_info.initialDataSize = data.size();
+  create_info.pInitialData = data.empty() ? nullptr : data.data();
+  auto result = vkCreatePipelineCache(device_, &create_info, nullptr, &handle_);
+  if (result != VK_SUCCESS && !data.empty()) {
+    LOGW("failed to create pipeline cache from {}, starting empty", path_);
+    data.clear();
+    create_info.initialDataSize = 0;
+    create_info.pInitialData = nullptr;
+    result = vkCreatePipelineCache(device_, &create_info, nullptr, &handle_);
+  }
+  VK_THROW_IF_ERROR(result, "failed to create pipeline cache!");
+  if (!data.empty())
+    saved_hash_ = hashPipelineCacheData(data);
+  stats_.loaded_bytes = data.size();
+  if (!data.empty())
+    LOGI("pipeline cache loaded from {}, {} bytes", path_, data.size());
+}
+
+void VkPipelineCacheWraper::save() {
+  std::lock_guard<std::mutex> save_lock(save_mtx_);
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!dirty_)
+      return;
+    // pipelines created from here on are saved next time
+    dirty_ = false;
+  }
+  auto mark_dirty = [this]() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    dirty_ = true;
+  };
+
+  size_t size = 0;
+  if (vkGetPipelineCacheData(device_, handle_, &size, nullptr) != VK_SUCCESS ||
+      size == 0)
+    return;
+  std::vector<uint8_t> data(size);
+  auto result = vkGetPipelineCacheData(device_, handle_, &size, data.data());
+  if (result != VK_SUCCESS && result != VK_INCOMPLETE) {
+    LOGW("failed to get pipeline cache data: {}", static_cast<int>(result));
+    mark_dirty();
+    return;
+  }
+  data.resize(size);
+  // the same pipelines were created again, e.g. cache hits
+  const uint64_t hash = hashPipelineCacheData(data);
+  if (hash == saved_hash_)
+    return;
+
+  // write a temporary file and rename it over the cache, the rename is atomic
+  const std::string tmp_path = path_ + ".tmp";
+  std::error_code ec;
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(data.data()), data.size());
+    file.close();
+    if (!file) {
+      LOGW("failed to write pipeline cache {}", tmp_path);
+      std::filesystem::remove(tmp_path, ec);
+      mark_dirty();
+      return;
+    }
+  }
+  std::filesystem::rename(tmp_path, path_, ec);
+  if (ec) {
+    LOGW("failed to rename pipeline cache {}: {}", tmp_path, ec.message());
+    std::filesystem::remove(tmp_path, ec);
+    mark_dirty();
+    return;
+  }
+  saved_hash_ = hash;
+  std::lock_guard<std::mutex> lock(mtx_);
+  stats_.saved_bytes = size;
+}
+
+void VkPipelineCacheWraper::recordCreation(
+    const VkPipelineCreationFeedback &feedback) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  dirty_ = true;
+  if ((feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT) == 0)
+    return;
+  ++stats_.pipelines;
+  if (feedback.flags &
+      VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT)
+    ++stats_.cache_hits;
+  stats_.creation_ns += feedback.duration;
+  stats_.last_creation_ns = feedback.duration;
+}
+
+PipelineCacheStats VkPipelineCacheWraper::getStats() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return stats_;
 }
 
 } // namespace mango
@@ -1,6 +1,7 @@
 #pragma once
 #include <cassert>
 #include <engine/functional/global/engine_context.h>
+#include <engine/utils/job/job_system.h>
 #include <engine/utils/vk/commands.h>
 #include <engine/utils/vk/descriptor_set_layout.h>
 #include <engine/utils/vk/pipeline_layout.h>
@@ -12,9 +13,25 @@
 namespace mango {
 class Sampler;
 
+struct PipelineCacheStats {
+  uint64_t loaded_bytes{0}; //!< blob loaded at startup, 0 if none or rejected
+  uint64_t saved_bytes{0};  //!< blob written by the last save
+  uint32_t pipelines{0};    //!< pipelines created with creation feedback
+  uint32_t cache_hits{0};   //!< of which were found in the pipeline cache
+  uint64_t creation_ns{0};  //!< creation time of all of them
+  uint64_t last_creation_ns{0};
+};
+
+/**
+ * @brief VkPipelineCache persisted to a file. The file is loaded at startup if
+ * its header matches the vendor, device and pipelineCacheUUID of the physical
+ * device, and written back by save() through a temporary file renamed over
+ * it, so a crash never leaves a truncated cache behind.
+ */
 class VkPipelineCacheWraper {
 public:
-  VkPipelineCacheWraper(VkDevice device);
+  VkPipelineCacheWraper(const std::shared_ptr<VkDriver> &driver,
+                        const std::string &path);
 
   VkPipelineCacheWraper(const VkPipelineCacheWraper &) = delete;
   VkPipelineCacheWraper &operator=(const VkPipelineCacheWraper &) = delete;
@@ -27,9 +44,35 @@ public:
 
   VkPipelineCache getHandle() const { return handle_; }
 
+  /**
+   * @brief write the cache data to the file if pipelines were created since
+   * the last save and the data differs from the file. Thread safe, pipelines
+   * can be created while it runs. Errors are logged, not thrown.
+   */
+  void save();
+
+  /**
+   * @brief mark the cache dirty and account a pipeline created with
+   * VK_EXT_pipeline_creation_feedback, the stats ignore invalid feedback.
+   * Thread safe.
+   */
+  void recordCreation(const VkPipelineCreationFeedback &feedback);
+
+  PipelineCacheStats getStats();
+
 private:
   VkPipelineCache handle_{VK_NULL_HANDLE};
   VkDevice device_{VK_NULL_HANDLE};
+  std::string path_;
+
+  std::mutex save_mtx_; //!< serializes save()
+  uint64_t saved_hash_{0}; //!< of the data in the file, guarded by save_mtx_
+
+  std::mutex mtx_; //!< guards the members below
+  //! pipelines created since the last save. Starts set, pipelines created
+  //! outside the engine (ImGui) are not recorded
+  bool dirty_{true};
+  PipelineCacheStats stats_;
 };
 
 struct Resource {
@@ -70,7 +113,7 @@ struct ResourceCacheState {
 class ResourceCache final {
 public:
   ResourceCache() = default;
-  ~ResourceCache() = default;
+  ~ResourceCache();
 
   ResourceCache(const ResourceCache &) = delete;
   ResourceCache &operator=(const ResourceCache &) = delete;
@@ -199,6 +242,26 @@ public:
                : state_.pipeline_cache->getHandle();
   }
 
+  /**
+   * @brief account a pipeline creation, see VkPipelineCacheWraper
+   */
+  void recordPipelineCreation(const VkPipelineCreationFeedback &feedback) {
+    if (state_.pipeline_cache != nullptr)
+      state_.pipeline_cache->recordCreation(feedback);
+  }
+
+  PipelineCacheStats getPipelineCacheStats() const {
+    return (state_.pipeline_cache == nullptr)
+               ? PipelineCacheStats{}
+               : state_.pipeline_cache->getStats();
+  }
+
+  /**
+   * @brief write the pipeline cache to disk at shutdown, after a periodic
+   * save started by gc() finished
+   */
+  void savePipelineCache();
+
   // void
   // setPipelineCache(std::unique_ptr<VkPipelineCacheWraper> &&pipeline_cache) {
   //   state_.pipeline_cache = std::move(pipeline_cache);
@@ -209,7 +272,12 @@ public:
   void gc();
 
 private:
+  //! frames between two saves of the pipeline cache
+  static constexpr uint64_t kPipelineCacheSaveFrames = 3600;
+
   ResourceCacheState state_;
   uint64_t current_frame_{0};
+  //! periodic save of the pipeline cache, run by a job off the main thread
+  JobCounter pipeline_cache_saved_;
 };
 } // namespace mango
\ No newline at end of file
@@ -23,7 +23,7 @@ Sampler::Sampler(const std::shared_ptr<VkDriver> &driver, VkFilter mag_filter,
       .compareEnable = VK_FALSE,
       .compareOp = VK_COMPARE_OP_ALWAYS,
       .minLod = 0.0f,
-      .maxLod = 0.0f,
+      .maxLod = VK_LOD_CLAMP_NONE, // streamed textures change their levels
       .borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK,
       .unnormalizedCoordinates = VK_FALSE,
   };
@@ -1,5 +1,6 @@
 #include "shader_module.h"
 #include "DirStackFileIncluder.h"
+#include <algorithm>
 #include <cassert>
 #include <fstream>
 #include <functional>
@@ -12,9 +13,27 @@
 
 #include <engine/utils/base/hash_combine.h>
 #include <engine/utils/base/macro.h>
+#include <engine/utils/vk/spirv_cache.h>
 #include <engine/utils/vk/spirv_reflection.h>
 
 namespace mango {
+// settings of compile2spirv, described by compileOptions() for the spirv cache
+static constexpr const char *kShaderIncludeDir = "shaders/include";
+static constexpr int kDefaultGlslVersion = 100; // 110 for desktop, 100 for es
+static constexpr EShMessages kShaderMessages = static_cast<EShMessages>(
+    EShMsgVulkanRules | EShMsgSpvRules | EShMsgDebugInfo);
+#ifndef NDEBUG
+static constexpr bool kSpirvDebugInfo = true;
+#else
+static constexpr bool kSpirvDebugInfo = false;
+#endif
+
+static std::string compileOptions() {
+  return std::string("include=") + kShaderIncludeDir +
+         ";version=" + std::to_string(kDefaultGlslVersion) +
+         ";messages=" + std::to_string(static_cast<int>(kShaderMessages)) +
+         ";debug=" + (kSpirvDebugInfo ? "1" : "0");
+}
 
 size_t ShaderResource::hash(const ShaderResource &resource) noexcept {
   size_t hash_code = 0;
@@ -60,19 +79,45 @@ void ShaderModule::setGlsl(const std::string &glsl_code,
   glsl_code_ = glsl_code;
   stage_ = stage;
 
-  compile2spirv(glsl_code_, variant_.getPreamble(), stage_, spirv_code_);
-
-  // update shader resources
-  SPIRVReflection spirv_reflection;
-
-  // Reflect all shader resouces
-  if (!spirv_reflection.reflect_shader_resources(stage_, spirv_code_,
-                                                 resources_)) {
-    throw std::runtime_error("Failed to reflect shader resources");
+  // compiled and reflected modules are cached on disk, glslang only runs if
+  // the source, preamble, options or an included file changed
+  const auto cache_key = SpirvCache::key(glsl_code_, variant_.getPreamble(),
+                                         stage_, compileOptions());
+  if (!SpirvCache::load(cache_key, spirv_code_, resources_)) {
+    std::set<std::string> included_files;
+    compile2spirv(glsl_code_, variant_.getPreamble(), stage_, spirv_code_,
+                  &included_files);
+
+    // update shader resources
+    SPIRVReflection spirv_reflection;
+
+    // Reflect all shader resouces
+    resources_.clear();
+    if (!spirv_reflection.reflect_shader_resources(stage_, spirv_code_,
+                                                   resources_)) {
+      throw std::runtime_error("Failed to reflect shader resources");
+    }
+    SpirvCache::store(cache_key, included_files, spirv_code_, resources_);
   }
 
   // update hash code
-  hash_code_ = hash(glsl_code_, stage_);
+  hash_code_ = hash(glsl_code_, variant_.getPreamble(), stage_);
+}
+
+void ShaderModule::setResourceMode(const std::string &name,
+                                   ShaderResourceMode mode) {
+  auto itr = std::find_if(resources_.begin(), resources_.end(),
+                          [&name](const ShaderResource &resource) {
+                            return resource.name == name;
+                          });
+  if (itr == resources_.end()) {
+    LOGW("shader resource {} not found, mode not set", name);
+    return;
+  }
+  itr->mode = mode;
+  // pipeline layouts are cached by module hash
+  hash_combine(hash_code_, std::hash<std::string>{}(name));
+  hash_combine(hash_code_, std::hash<int>{}(static_cast<int>(mode)));
 }
 
 EShLanguage findShaderLanguage(VkShaderStageFlagBits stage);
@@ -80,7 +125,8 @@ EShLanguage findShaderLanguage(VkShaderStageFlagBits stage);
 void ShaderModule::compile2spirv(const std::string &glsl_code,
                                  const std::string &preamble,
                                  VkShaderStageFlagBits stage,
-                                 std::vector<uint32_t> &spirv_code) {
+                                 std::vector<uint32_t> &spirv_code,
+                                 std::set<std::string> *included_files) {
   // if(stage == VkShaderStageFlagBits::VK_SHADER_STAGE_FRAGMENT_BIT)
   // {
   //   std::ifstream inputFile("debug/debug_frag.spv", std::ifstream::binary);
@@ -110,7 +156,7 @@ void ShaderModule::compile2spirv(const std::string &glsl_code,
   glslang::InitializeProcess();
 
   DirStackFileIncluder includer;
-  includer.pushExternalLocalDirectory("shaders/include");
+  includer.pushExternalLocalDirectory(kShaderIncludeDir);
 
   EShLanguage lang = findShaderLanguage(stage);
   glslang::TShader shader(lang);
@@ -127,11 +173,9 @@ void ShaderModule::compile2spirv(const std::string &glsl_code,
   // glslang::EShTargetLanguageVersion::EShTargetSpv_1_6);
   // shader.setDebugInfo(true);
   // EShMsgDebugInfo for debug in renderdoc
-  EShMessages messages = static_cast<EShMessages>(
-      EShMsgVulkanRules | EShMsgSpvRules | EShMsgDebugInfo);
-  if (!shader.parse(GetDefaultResources(), 100, false, messages,
-                    includer)) // 110 for desktop, 100 for es
-  {
+  EShMessages messages = kShaderMessages;
+  if (!shader.parse(GetDefaultResources(), kDefaultGlslVersion, false,
+                    messages, includer)) {
     auto error_msg = std::string(shader.getInfoLog()) + "\n" +
                      std::string(shader.getInfoDebugLog());
     throw std::runtime_error("compile glsl to spirv error: " + error_msg);
@@ -153,6 +197,9 @@ void ShaderModule::compile2spirv(const std::string &glsl_code,
   if (strlen(program_log))
     LOGI(program_log);
 
+  if (included_files != nullptr)
+    *included_files = includer.getIncludedFiles();
+
   glslang::TIntermediate *intermediate = program.getIntermediate(lang);
   if (!intermediate) {
     throw std::runtime_error("failed to get shader intermediate code");
@@ -215,10 +262,12 @@ void ShaderModule::readGlsl(const std::string &file_path,
 }
 
 size_t ShaderModule::hash(const std::string &glsl_code,
+                          const std::string &preamble,
                           VkShaderStageFlagBits stage) noexcept {
   auto hash_code = std::hash<VkShaderStageFlagBits>{}(stage);
   auto value = std::hash<std::string>{}(glsl_code);
   hash_combine(hash_code, value);
+  hash_combine(hash_code, std::hash<std::string>{}(preamble));
   return hash_code;
 }
 
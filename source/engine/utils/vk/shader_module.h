@@ -1,6 +1,7 @@
 #pragma once
 #include <cstdint>
 #include <memory>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -133,13 +134,28 @@ public:
     return resources_;
   }
 
-  static size_t hash(const std::string &glsl_code,
+  /**
+   * @brief set the mode of the resource named name, e.g. Dynamic for a
+   * uniform buffer bound with dynamic offsets. The mode is part of the hash,
+   * call it before the module is used by a pipeline.
+   */
+  void setResourceMode(const std::string &name, ShaderResourceMode mode);
+
+  /**
+   * @brief hash of a module, variants of the same source differ by preamble
+   */
+  static size_t hash(const std::string &glsl_code, const std::string &preamble,
                      VkShaderStageFlagBits stage) noexcept;
 
+  /**
+   * @brief compile with glslang, not cached
+   * @param[out] included_files files resolved by the includer, if not null
+   */
   static void compile2spirv(const std::string &glsl_code,
                             const std::string &preamble,
                             VkShaderStageFlagBits stage,
-                            std::vector<uint32_t> &spirv_code);
+                            std::vector<uint32_t> &spirv_code,
+                            std::set<std::string> *included_files = nullptr);
   static void readGlsl(const std::string &file_path,
                        VkShaderStageFlagBits &stage, std::string &glsl_code);
 
@@ -0,0 +1,234 @@
+#include <engine/utils/vk/spirv_cache.h>
+
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <utility>
+
+#include <engine/functional/global/engine_context.h>
+#include <engine/platform/file_system.h>
+#include <engine/utils/base/macro.h>
+#include <engine/utils/vk/shader_module.h>
+
+namespace mango {
+//! 'MSPV', first word of an entry
+static constexpr uint32_t kSpirvCacheMagic = 0x5650534D;
+//! bump when the layout of an entry, ShaderResource or glslang changes
+static constexpr uint32_t kSpirvCacheVersion = 1;
+
+static constexpr uint64_t kFnvOffsetBasis = 14695981039346656037ull;
+
+//! 64 bit FNV-1a, unlike std::hash the same on every platform and run
+static uint64_t fnv1a(const void *data, size_t size,
+                      uint64_t hash = kFnvOffsetBasis) {
+  const auto *bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+//! length prefixed, so "ab" + "c" and "a" + "bc" hash differently
+static uint64_t fnv1a(const std::string &str, uint64_t hash) {
+  const uint64_t size = str.size();
+  hash = fnv1a(&size, sizeof(size), hash);
+  return fnv1a(str.data(), str.size(), hash);
+}
+
+//! content hash of a file, false if it can't be read
+static bool hashFile(const std::string &path, uint64_t &hash) {
+  std::ifstream ifs(path, std::ifstream::binary);
+  if (!ifs)
+    return false;
+  std::string content((std::istreambuf_iterator<char>(ifs)),
+                      std::istreambuf_iterator<char>());
+  hash = fnv1a(content, kFnvOffsetBasis);
+  return true;
+}
+
+static std::string entryPath(uint64_t key) {
+  std::ostringstream name;
+  name << std::hex << std::setw(16) << std::setfill('0') << key << ".spvc";
+  auto file_system = g_engine.getFileSystem();
+  return file_system->combine(file_system->getSpvDir(), name.str());
+}
+
+template <typename T> static void writeValue(std::ostream &os, const T &value) {
+  os.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+static void writeString(std::ostream &os, const std::string &str) {
+  writeValue(os, static_cast<uint32_t>(str.size()));
+  os.write(str.data(), str.size());
+}
+
+template <typename T> static bool readValue(std::istream &is, T &value) {
+  return static_cast<bool>(
+      is.read(reinterpret_cast<char *>(&value), sizeof(T)));
+}
+
+static bool readString(std::istream &is, std::string &str) {
+  uint32_t size = 0;
+  if (!readValue(is, size))
+    return false;
+  str.resize(size);
+  return static_cast<bool>(is.read(str.data(), size));
+}
+
+static void writeResource(std::ostream &os, const ShaderResource &resource) {
+  writeValue(os, resource.stages);
+  writeValue(os, static_cast<int32_t>(resource.type));
+  writeValue(os, static_cast<int32_t>(resource.mode));
+  writeValue(os, resource.set);
+  writeValue(os, resource.binding);
+  writeValue(os, resource.location);
+  writeValue(os, resource.input_attachment_index);
+  writeValue(os, resource.vec_size);
+  writeValue(os, resource.columns);
+  writeValue(os, resource.array_size);
+  writeValue(os, resource.offset);
+  writeValue(os, resource.size);
+  writeValue(os, resource.constant_id);
+  writeValue(os, resource.qualifiers);
+  writeString(os, resource.name);
+}
+
+static bool readResource(std::istream &is, ShaderResource &resource) {
+  int32_t type = 0;
+  int32_t mode = 0;
+  bool ok = readValue(is, resource.stages) && readValue(is, type) &&
+            readValue(is, mode) && readValue(is, resource.set) &&
+            readValue(is, resource.binding) &&
+            readValue(is, resource.location) &&
+            readValue(is, resource.input_attachment_index) &&
+            readValue(is, resource.vec_size) &&
+            readValue(is, resource.columns) &&
+            readValue(is, resource.array_size) &&
+            readValue(is, resource.offset) && readValue(is, resource.size) &&
+            readValue(is, resource.constant_id) &&
+            readValue(is, resource.qualifiers) &&
+            readString(is, resource.name);
+  resource.type = static_cast<ShaderResourceType>(type);
+  resource.mode = static_cast<ShaderResourceMode>(mode);
+  return ok;
+}
+
+uint64_t SpirvCache::key(const std::string &glsl_code,
+                         const std::string &preamble,
+                         VkShaderStageFlagBits stage,
+                         const std::string &options) {
+  const auto stage_value = static_cast<uint32_t>(stage);
+  uint64_t hash = fnv1a(&kSpirvCacheVersion, sizeof(kSpirvCacheVersion));
+  hash = fnv1a(&stage_value, sizeof(stage_value), hash);
+  hash = fnv1a(glsl_code, hash);
+  hash = fnv1a(preamble, hash);
+  return fnv1a(options, hash);
+}
+
+bool SpirvCache::load(uint64_t key, std::vector<uint32_t> &spirv_code,
+                      std::vector<ShaderResource> &resources) {
+  std::ifstream ifs(entryPath(key), std::ifstream::binary);
+  if (!ifs)
+    return false;
+
+  uint32_t magic = 0;
+  uint32_t version = 0;
+  uint64_t entry_key = 0;
+  if (!readValue(ifs, magic) || !readValue(ifs, version) ||
+      !readValue(ifs, entry_key) || magic != kSpirvCacheMagic ||
+      version != kSpirvCacheVersion || entry_key != key)
+    return false;
+
+  // stale if an included file changed
+  uint32_t include_count = 0;
+  if (!readValue(ifs, include_count))
+    return false;
+  for (uint32_t i = 0; i < include_count; ++i) {
+    std::string path;
+    uint64_t hash = 0;
+    uint64_t cur_hash = 0;
+    if (!readString(ifs, path) || !readValue(ifs, hash) ||
+        !hashFile(path, cur_hash) || cur_hash != hash)
+      return false;
+  }
+
+  uint32_t word_count = 0;
+  if (!readValue(ifs, word_count) || word_count == 0)
+    return false;
+  std::vector<uint32_t> code(word_count);
+  if (!ifs.read(reinterpret_cast<char *>(code.data()),
+                word_count * sizeof(uint32_t)))
+    return false;
+
+  uint32_t resource_count = 0;
+  if (!readValue(ifs, resource_count))
+    return false;
+  std::vector<ShaderResource> entry_resources(resource_count);
+  for (auto &resource : entry_resources)
+    if (!readResource(ifs, resource))
+      return false;
+
+  spirv_code = std::move(code);
+  resources = std::move(entry_resources);
+  return true;
+}
+
+void SpirvCache::store(uint64_t key,
+                       const std::set<std::string> &included_files,
+                       const std::vector<uint32_t> &spirv_code,
+                       const std::vector<ShaderResource> &resources) {
+  // modules may be compiled by several threads, guards the temporary files
+  static std::mutex mtx;
+  std::lock_guard<std::mutex> lock(mtx);
+
+  // includes are hashed before the temporary file is created, so a missing
+  // one leaves nothing behind
+  std::vector<std::pair<const std::string *, uint64_t>> include_hashes;
+  include_hashes.reserve(included_files.size());
+  for (const auto &included_file : included_files) {
+    uint64_t hash = 0;
+    if (!hashFile(included_file, hash)) {
+      LOGW("can't read shader include {}, spirv not cached", included_file);
+      return;
+    }
+    include_hashes.emplace_back(&included_file, hash);
+  }
+
+  const std::string path = entryPath(key);
+  const std::string tmp_path = path + ".tmp";
+  std::error_code ec;
+  {
+    std::ofstream ofs(tmp_path, std::ofstream::binary | std::ofstream::trunc);
+    writeValue(ofs, kSpirvCacheMagic);
+    writeValue(ofs, kSpirvCacheVersion);
+    writeValue(ofs, key);
+    writeValue(ofs, static_cast<uint32_t>(include_hashes.size()));
+    for (const auto &[included_file, hash] : include_hashes) {
+      writeString(ofs, *included_file);
+      writeValue(ofs, hash);
+    }
+    writeValue(ofs, static_cast<uint32_t>(spirv_code.size()));
+    ofs.write(reinterpret_cast<const char *>(spirv_code.data()),
+              spirv_code.size() * sizeof(uint32_t));
+    writeValue(ofs, static_cast<uint32_t>(resources.size()));
+    for (const auto &resource : resources)
+      writeResource(ofs, resource);
+    ofs.close();
+    if (!ofs) {
+      LOGW("failed to write spirv cache {}", tmp_path);
+      std::filesystem::remove(tmp_path, ec);
+      return;
+    }
+  }
+
+  std::filesystem::rename(tmp_path, path, ec);
+  if (ec) {
+    LOGW("failed to rename spirv cache {}: {}", tmp_path, ec.message());
+    std::filesystem::remove(tmp_path, ec);
+  }
+}
+} // namespace mango
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+#include <volk.h>
+
+namespace mango {
+struct ShaderResource;
+
+/**
+ * @brief on-disk cache of compiled shaders, one file per entry under
+ * FileSystem::getSpvDir().
+ *
+ * An entry is addressed by the hash of the glsl source, the variant preamble,
+ * the stage and the compiler options. It holds the spirv, its reflected
+ * resources and the content hash of every file the source included, and only
+ * hits if all included files still hash the same, so editing a header
+ * recompiles the shaders including it. Entries are written to a temporary
+ * file renamed over the entry. All functions are thread safe.
+ */
+class SpirvCache final {
+public:
+  /**
+   * @brief key of a shader, stable across runs and platforms
+   * @param options description of the compiler settings
+   */
+  static uint64_t key(const std::string &glsl_code,
+                      const std::string &preamble, VkShaderStageFlagBits stage,
+                      const std::string &options);
+
+  /**
+   * @brief read the entry of key, outputs are only written on a hit
+   */
+  static bool load(uint64_t key, std::vector<uint32_t> &spirv_code,
+                   std::vector<ShaderResource> &resources);
+
+  /**
+   * @brief write the entry of key, errors are logged, not thrown
+   * @param included_files files resolved by the includer, as passed to it
+   */
+  static void store(uint64_t key, const std::set<std::string> &included_files,
+                    const std::vector<uint32_t> &spirv_code,
+                    const std::vector<ShaderResource> &resources);
+};
+} // namespace mango
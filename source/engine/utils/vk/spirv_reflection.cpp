@@ -1,6 +1,7 @@
 #include <algorithm>
 #include <engine/utils/base/macro.h>
 #include <engine/utils/vk/spirv_reflection.h>
+#include <engine/utils/vk/vk_constants.h>
 #include <limits>
 #include <spirv_glsl.hpp>
 
@@ -26,6 +27,14 @@ void read_resource_array_size(const spirv_cross::Compiler &compiler,
   const auto &spirv_type = compiler.get_type_from_variable(resource.id);
   shader_resource.array_size =
       spirv_type.array.size() ? spirv_type.array[0] : 1;
+  // runtime sized descriptor arrays are the bindless arrays, partially bound
+  // and updated after bind
+  if (spirv_type.array.size() && spirv_type.array[0] == 0 &&
+      (shader_resource.type == ShaderResourceType::Image ||
+       shader_resource.type == ShaderResourceType::ImageSampler)) {
+    shader_resource.array_size = MAX_BINDLESS_TEXTURE_NUM;
+    shader_resource.mode = ShaderResourceMode::UpdateAfterBind;
+  }
 }
 
 template <spv::Decoration T>
@@ -1,20 +1,138 @@
 #include <engine/utils/base/compiler.h>
 #include <engine/utils/base/error.h>
+#include <engine/utils/vk/memory_pools.h>
 #include <engine/utils/vk/stage_pool.h>
 #include <engine/utils/vk/vk_common.h>
 #include <engine/utils/vk/vk_constants.h>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
 
 namespace mango {
+// Bytes of the staging ring, uploads larger than a quarter of it get a
+// dedicated stage.
+constexpr VkDeviceSize kStagingRingSize = 64 * 1024 * 1024;
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+void StagingRing::reset(VkDeviceSize size) {
+  size_ = size;
+  head_ = tail_ = 0;
+  ranges_.clear();
+}
+
+bool StagingRing::allocate(VkDeviceSize size, VkDeviceSize alignment,
+                           UploadTicket ticket, VkDeviceSize &offset) {
+  if (ranges_.empty())
+    head_ = tail_ = 0;
+  const VkDeviceSize start = alignUp(head_, alignment);
+  if (ranges_.empty() || head_ > tail_) {
+    // free: [head, ring end) and [0, tail)
+    if (start + size <= size_)
+      offset = start;
+    else if (size <= tail_)
+      offset = 0; // wrap, [head, ring end) is reclaimed with this range
+    else
+      return false;
+  } else if (head_ < tail_ && start + size <= tail_) {
+    offset = start;
+  } else {
+    // head == tail with ranges in use: full
+    return false;
+  }
+  assert(ranges_.empty() || ranges_.back().ticket <= ticket);
+  head_ = offset + size;
+  ranges_.push_back(Range{.end = head_, .ticket = ticket});
+  return true;
+}
+
+void StagingRing::reclaim(UploadTicket completed) {
+  while (!ranges_.empty() && ranges_.front().ticket <= completed) {
+    tail_ = ranges_.front().end;
+    ranges_.pop_front();
+  }
+}
+
+VkDeviceSize StagingRing::getUsed() const {
+  if (ranges_.empty())
+    return 0;
+  return head_ > tail_ ? head_ - tail_ : size_ - tail_ + head_;
+}
+
+StagingRegion StagePool::upload(const void *data, VkDeviceSize size,
+                                UploadTicket ticket, VkDeviceSize alignment) {
+  alignment = std::max<VkDeviceSize>(alignment, 1);
+  VmaAllocation memory;
+  std::byte *mapped;
+  StagingRegion region;
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (ring_buffer_ == VK_NULL_HANDLE) {
+      VkBufferCreateInfo bufferInfo{
+          .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+          .size = kStagingRingSize,
+          .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      };
+      VmaAllocationCreateInfo allocInfo{
+          .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT |
+                   VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+          .usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+      };
+      allocInfo.pool = driver_->getMemoryPools()->getBufferPool(
+          MemoryClass::Staging, bufferInfo, allocInfo);
+      VmaAllocationInfo info;
+      VkResult result =
+          vmaCreateBuffer(driver_->getAllocator(), &bufferInfo, &allocInfo,
+                          &ring_buffer_, &ring_memory_, &info);
+      VK_THROW_IF_ERROR(result, "Create staging ring failed!");
+      ring_mapped_ = static_cast<std::byte *>(info.pMappedData);
+      ring_.reset(kStagingRingSize);
+      ++vma_allocations_;
+    }
+
+    VkDeviceSize offset;
+    if (size <= ring_.getSize() / 4 &&
+        ring_.allocate(size, alignment, ticket, offset)) {
+      memory = ring_memory_;
+      mapped = ring_mapped_ + offset;
+      region = {.buffer = ring_buffer_, .offset = offset};
+      ++ring_uploads_;
+    } else {
+      auto stage = acquireStageLocked(static_cast<uint32_t>(size), ticket);
+      memory = stage->memory;
+      mapped = stage->mapped;
+      region = {.buffer = stage->buffer, .offset = 0};
+      ++dedicated_uploads_;
+    }
+  }
+
+  // the range is reserved, copy without holding the lock
+  memcpy(mapped, data, size);
+  vmaFlushAllocation(driver_->getAllocator(), memory, region.offset, size);
+  return region;
+}
+
 // Finds or creates a stage whose capacity is at least the given number of
-// bytes. The stage is automatically released back to the pool after
-// TIME_BEFORE_EVICTION frames.
-VulkanStage const *StagePool::acquireStage(uint32_t numBytes) {
+// bytes. The stage is released back to the pool once the upload batch of
+// ticket has been executed.
+VulkanStage const *StagePool::acquireStage(uint32_t numBytes,
+                                           UploadTicket ticket) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return acquireStageLocked(numBytes, ticket);
+}
+
+VulkanStage const *StagePool::acquireStageLocked(uint32_t numBytes,
+                                                 UploadTicket ticket) {
   // First check if a stage exists whose capacity is greater than or equal to
   // the requested size.
   auto iter = free_stages_.lower_bound(numBytes);
   if (iter != free_stages_.end()) {
     auto stage = iter->second;
     free_stages_.erase(iter);
+    stage->lastAccessed = current_frame_;
+    stage->ticket = ticket;
     used_stages_.insert(stage);
     return stage;
   }
@@ -24,6 +142,8 @@ VulkanStage const *StagePool::acquireStage(uint32_t numBytes) {
       .buffer = VK_NULL_HANDLE,
       .capacity = numBytes,
       .lastAccessed = current_frame_,
+      .mapped = nullptr,
+      .ticket = ticket,
   });
 
   // Create the VkBuffer.
@@ -37,11 +157,16 @@ VulkanStage const *StagePool::acquireStage(uint32_t numBytes) {
     .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
     .usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
   };
+  allocInfo.pool = driver_->getMemoryPools()->getBufferPool(
+      MemoryClass::Staging, bufferInfo, allocInfo);
+  VmaAllocationInfo info;
   UTILS_UNUSED_IN_RELEASE VkResult result =
       vmaCreateBuffer(driver_->getAllocator(), &bufferInfo, &allocInfo,
-                      &stage->buffer, &stage->memory, nullptr);
+                      &stage->buffer, &stage->memory, &info);
 
   VK_THROW_IF_ERROR(result, "Create Staging buffer failed!");
+  stage->mapped = static_cast<std::byte *>(info.pMappedData);
+  ++vma_allocations_;
 
   return stage;
 }
@@ -51,13 +176,14 @@ VulkanStage const *StagePool::acquireStage(uint32_t numBytes) {
 VulkanStageImage const *StagePool::acquireImage(VkFormat format, uint32_t width,
                                                 uint32_t height,
                                                 VkCommandBuffer cmd_buf) {
-  for (auto image : free_images_) {
-    if (image->format == format && image->width == width &&
-        image->height == height) {
-      free_images_.erase(image);
-      used_images_.insert(image);
-      return image;
-    }
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto iter = free_images_.find(ImageKey{format, width, height});
+  if (iter != free_images_.end()) {
+    auto image = iter->second;
+    free_images_.erase(iter);
+    image->lastAccessed = current_frame_;
+    used_images_.insert(image);
+    return image;
   }
 
   VulkanStageImage *image = new VulkanStageImage({
@@ -90,6 +216,7 @@ VulkanStageImage const *StagePool::acquireImage(VkFormat format, uint32_t width,
                      &image->image, &image->memory, nullptr);
 
   VK_THROW_IF_ERROR(result, "Create staging image failed!");
+  ++vma_allocations_;
 
   VkImageAspectFlags aspectFlags = isDepthFormat(format)
                                        ? VK_IMAGE_ASPECT_DEPTH_BIT
@@ -111,8 +238,27 @@ VulkanStageImage const *StagePool::acquireImage(VkFormat format, uint32_t width,
   return image;
 }
 
-// Evicts old unused stages and bumps the current frame number.
+// Reclaims the staging memory of completed uploads, evicts old unused stages
+// and bumps the current frame number.
 void StagePool::gc() noexcept {
+  // read before locking, the upload scheduler calls upload() under its lock
+  const UploadTicket completed =
+      driver_->getUploadScheduler()->getCompletedTicket();
+  std::lock_guard<std::mutex> lock(mtx_);
+
+  // Reclaim ring ranges and stages whose copies have been executed.
+  ring_.reclaim(completed);
+  decltype(used_stages_) usedStages;
+  usedStages.swap(used_stages_);
+  for (auto stage : usedStages) {
+    if (stage->ticket <= completed) {
+      stage->lastAccessed = current_frame_;
+      free_stages_.insert(std::make_pair(stage->capacity, stage));
+    } else {
+      used_stages_.insert(stage);
+    }
+  }
+
   // If this is one of the first few frames, return early to avoid wrapping
   // unsigned integers.
   if (++current_frame_ <= TIME_BEFORE_EVICTION) {
@@ -133,27 +279,16 @@ void StagePool::gc() noexcept {
     }
   }
 
-  // Reclaim buffers that are no longer being used by any command buffer.
-  decltype(used_stages_) usedStages;
-  usedStages.swap(used_stages_);
-  for (auto stage : usedStages) {
-    if (stage->lastAccessed < evictionTime) {
-      stage->lastAccessed = current_frame_;
-      free_stages_.insert(std::make_pair(stage->capacity, stage));
-    } else {
-      used_stages_.insert(stage);
-    }
-  }
-
   // Destroy images that have not been used for several frames.
   decltype(free_images_) freeImages;
   freeImages.swap(free_images_);
-  for (auto image : freeImages) {
-    if (image->lastAccessed < evictionTime) {
-      vmaDestroyImage(driver_->getAllocator(), image->image, image->memory);
-      delete image;
+  for (auto pair : freeImages) {
+    if (pair.second->lastAccessed < evictionTime) {
+      vmaDestroyImage(driver_->getAllocator(), pair.second->image,
+                      pair.second->memory);
+      delete pair.second;
     } else {
-      free_images_.insert(image);
+      free_images_.insert(pair);
     }
   }
 
@@ -163,7 +298,8 @@ void StagePool::gc() noexcept {
   for (auto image : usedImages) {
     if (image->lastAccessed < evictionTime) {
       image->lastAccessed = current_frame_;
-      free_images_.insert(image);
+      free_images_.insert(std::make_pair(
+          ImageKey{image->format, image->width, image->height}, image));
     } else {
       used_images_.insert(image);
     }
@@ -173,6 +309,15 @@ void StagePool::gc() noexcept {
 // Destroys all unused stages and asserts that there are no stages currently in
 // use. This should be called while the context's VkDevice is still alive.
 void StagePool::reset() noexcept {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (ring_buffer_ != VK_NULL_HANDLE) {
+    vmaDestroyBuffer(driver_->getAllocator(), ring_buffer_, ring_memory_);
+    ring_buffer_ = VK_NULL_HANDLE;
+    ring_memory_ = VK_NULL_HANDLE;
+    ring_mapped_ = nullptr;
+    ring_.reset(0);
+  }
+
   for (auto stage : used_stages_) {
     vmaDestroyBuffer(driver_->getAllocator(), stage->buffer, stage->memory);
     delete stage;
@@ -192,10 +337,20 @@ void StagePool::reset() noexcept {
   }
   used_images_.clear();
 
-  for (auto image : free_images_) {
-    vmaDestroyImage(driver_->getAllocator(), image->image, image->memory);
-    delete image;
+  for (auto pair : free_images_) {
+    vmaDestroyImage(driver_->getAllocator(), pair.second->image,
+                    pair.second->memory);
+    delete pair.second;
   }
   free_images_.clear();
 }
+
+StagePoolStats StagePool::getStats() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return StagePoolStats{.ring_capacity = ring_.getSize(),
+                        .ring_used = ring_.getUsed(),
+                        .ring_uploads = ring_uploads_,
+                        .dedicated_uploads = dedicated_uploads_,
+                        .vma_allocations = vma_allocations_};
+}
 } // namespace mango
\ No newline at end of file
@@ -1,7 +1,11 @@
 #pragma once
 
 #include <engine/utils/vk/buffer.h>
+#include <engine/utils/vk/upload_scheduler.h>
+#include <deque>
 #include <map>
+#include <mutex>
+#include <tuple>
 #include <unordered_set>
 
 namespace mango {
@@ -11,6 +15,8 @@ struct VulkanStage {
   VkBuffer buffer;
   uint32_t capacity;
   mutable uint64_t lastAccessed;
+  std::byte *mapped; // persistently mapped
+  mutable UploadTicket ticket; // batch copying from the stage
 };
 
 struct VulkanStageImage {
@@ -22,19 +28,84 @@ struct VulkanStageImage {
   VkImage image;
 };
 
+// Source of a copy command: the uploaded bytes start at offset in buffer.
+struct StagingRegion {
+  VkBuffer buffer{VK_NULL_HANDLE};
+  VkDeviceSize offset{0};
+};
+
+struct StagePoolStats {
+  VkDeviceSize ring_capacity{0};
+  VkDeviceSize ring_used{0};     // bytes not yet reclaimed, including padding
+  uint64_t ring_uploads{0};      // uploads served by the ring
+  uint64_t dedicated_uploads{0}; // uploads which fell back to a stage
+  uint64_t vma_allocations{0};   // staging buffers and images created
+};
+
+// Bookkeeping of the staging ring, no Vulkan calls. Ranges are reserved in
+// order and reclaimed in order, once the upload ticket of the batch copying
+// from them is completed. Not thread safe.
+class StagingRing final {
+public:
+  explicit StagingRing(VkDeviceSize size = 0) : size_(size) {}
+
+  // Forgets all ranges.
+  void reset(VkDeviceSize size);
+
+  // Reserves size bytes at a multiple of alignment, which need not be a power
+  // of 2. Tickets must not decrease. Returns false if the ring has no room.
+  bool allocate(VkDeviceSize size, VkDeviceSize alignment, UploadTicket ticket,
+                VkDeviceSize &offset);
+
+  // Reclaims the ranges whose ticket is at most completed.
+  void reclaim(UploadTicket completed);
+
+  VkDeviceSize getSize() const { return size_; }
+
+  // Bytes not reclaimed yet, including alignment padding.
+  VkDeviceSize getUsed() const;
+
+private:
+  // A range reclaimed up to end once ticket is completed.
+  struct Range {
+    VkDeviceSize end;
+    UploadTicket ticket;
+  };
+
+  VkDeviceSize size_;
+  VkDeviceSize head_{0}; // next byte to write
+  VkDeviceSize tail_{0}; // first byte which may be in use
+  std::deque<Range> ranges_; // in use, oldest first
+};
+
 // Manages a pool of stages, periodically releasing stages that have been unused
 // for a while. This class manages two types of host-mappable staging areas:
 // buffer stages and image stages.
+//
+// Buffer uploads are sub-allocated from one large persistently mapped ring
+// buffer. Every upload names the UploadScheduler ticket of the batch which
+// copies from it; ring ranges and dedicated stages are reclaimed by gc() once
+// the transfer timeline reached that ticket, however far the transfer queue
+// runs behind the frames. Uploads larger than a quarter of the ring, or which
+// don't fit while the ring is full, fall back to a dedicated stage. Thread
+// safe.
 class StagePool final {
 public:
   StagePool(const std::shared_ptr<VkDriver> &driver) : driver_(driver) {}
 
   ~StagePool() { reset(); }
 
+  // Copies size bytes of data to host visible staging memory and flushes it.
+  // The returned region stays valid until the upload batch of ticket has been
+  // executed. offset is a multiple of alignment, which need not be a power
+  // of 2 (texel sizes of 3 bytes).
+  StagingRegion upload(const void *data, VkDeviceSize size,
+                       UploadTicket ticket, VkDeviceSize alignment = 16);
+
   // Finds or creates a stage whose capacity is at least the given number of
-  // bytes. The stage is automatically released back to the pool after
-  // TIME_BEFORE_EVICTION frames.
-  VulkanStage const *acquireStage(uint32_t numBytes);
+  // bytes. The stage is released back to the pool once the upload batch of
+  // ticket has been executed.
+  VulkanStage const *acquireStage(uint32_t numBytes, UploadTicket ticket);
 
   // Images have VK_IMAGE_LAYOUT_GENERAL and must not be transitioned to any
   // other layout
@@ -42,15 +113,29 @@ public:
                                        uint32_t height,
                                        VkCommandBuffer cmd_buf);
 
-  // Evicts old unused stages and bumps the current frame number.
+  // Reclaims the ring ranges and stages of completed uploads, evicts old
+  // unused stages and bumps the current frame number.
   void gc() noexcept;
 
   // Destroys all unused stages and asserts that there are no stages currently
   // in use. This should be called while the context's VkDevice is still alive.
   void reset() noexcept;
 
+  StagePoolStats getStats();
+
 private:
+  VulkanStage const *acquireStageLocked(uint32_t numBytes,
+                                        UploadTicket ticket);
+
   std::shared_ptr<VkDriver> driver_;
+  std::mutex mtx_;
+
+  // The staging ring, created on first upload.
+  VkBuffer ring_buffer_{VK_NULL_HANDLE};
+  VmaAllocation ring_memory_{VK_NULL_HANDLE};
+  std::byte *ring_mapped_{nullptr};
+  StagingRing ring_;
+
   // Use an ordered multimap for quick (capacity => stage) lookups using
   // lower_bound().
   std::multimap<uint32_t, VulkanStage const *> free_stages_;
@@ -59,11 +144,17 @@ private:
   // reclaimed later.
   std::unordered_set<VulkanStage const *> used_stages_;
 
-  std::unordered_set<VulkanStageImage const *> free_images_;
+  // (format, width, height) => image, for exact lookups.
+  using ImageKey = std::tuple<VkFormat, uint32_t, uint32_t>;
+  std::multimap<ImageKey, VulkanStageImage const *> free_images_;
   std::unordered_set<VulkanStageImage const *> used_images_;
 
   // Store the current "time" (really just a frame count) and LRU eviction
   // parameters.
   uint64_t current_frame_{0};
+
+  uint64_t ring_uploads_{0};
+  uint64_t dedicated_uploads_{0};
+  uint64_t vma_allocations_{0};
 };
-} // namespace mango
\ No newline at end of file
+} // namespace mango
@@ -45,4 +45,42 @@ Semaphore::~Semaphore() {
   if(handle_ != VK_NULL_HANDLE && driver_ != nullptr)
     vkDestroySemaphore(driver_->getDevice(), handle_, nullptr);
 }
+
+TimelineSemaphore::TimelineSemaphore(const std::shared_ptr<VkDriver> &driver,
+                                     uint64_t initial_value)
+    : driver_(driver) {
+  VkSemaphoreTypeCreateInfo type_info{};
+  type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+  type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  type_info.initialValue = initial_value;
+
+  VkSemaphoreCreateInfo semaphoreCreateInfo{};
+  semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  semaphoreCreateInfo.pNext = &type_info;
+
+  if (vkCreateSemaphore(driver->getDevice(), &semaphoreCreateInfo, nullptr,
+                        &handle_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create timeline semaphore!");
+  }
+}
+
+TimelineSemaphore::~TimelineSemaphore() {
+  if (handle_ != VK_NULL_HANDLE && driver_ != nullptr)
+    vkDestroySemaphore(driver_->getDevice(), handle_, nullptr);
+}
+
+uint64_t TimelineSemaphore::getValue() const {
+  uint64_t value = 0;
+  vkGetSemaphoreCounterValue(driver_->getDevice(), handle_, &value);
+  return value;
+}
+
+void TimelineSemaphore::wait(uint64_t value, const uint64_t timeout) const {
+  VkSemaphoreWaitInfo wait_info{};
+  wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  wait_info.semaphoreCount = 1;
+  wait_info.pSemaphores = &handle_;
+  wait_info.pValues = &value;
+  vkWaitSemaphores(driver_->getDevice(), &wait_info, timeout);
+}
 } // namespace mango
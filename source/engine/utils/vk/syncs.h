@@ -49,6 +49,40 @@ public:
 
   VkSemaphore getHandle() const { return handle_; }
 
+private:
+  std::shared_ptr<VkDriver> driver_;
+  VkSemaphore handle_{VK_NULL_HANDLE};
+};
+
+/**
+ * @brief Vulkan timeline semaphore, a monotonically increasing 64 bit value
+ * signaled and waited by queue submits or the host
+ */
+class TimelineSemaphore final {
+public:
+  TimelineSemaphore(const std::shared_ptr<VkDriver> &driver,
+                    uint64_t initial_value = 0);
+
+  TimelineSemaphore(const TimelineSemaphore &) = delete;
+  TimelineSemaphore(TimelineSemaphore &&) = delete;
+  TimelineSemaphore &operator=(const TimelineSemaphore &) = delete;
+  TimelineSemaphore &operator=(TimelineSemaphore &&) = delete;
+
+  ~TimelineSemaphore();
+
+  /**
+   * @brief the value last reached on the device
+   */
+  uint64_t getValue() const;
+
+  /**
+   * @brief block until the semaphore reaches value
+   */
+  void wait(uint64_t value, const uint64_t timeout =
+                                std::numeric_limits<uint64_t>::max()) const;
+
+  VkSemaphore getHandle() const { return handle_; }
+
 private:
   std::shared_ptr<VkDriver> driver_;
   VkSemaphore handle_{VK_NULL_HANDLE};
@@ -0,0 +1,196 @@
+#include <engine/utils/vk/uniform_allocator.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iterator>
+#include <limits>
+
+#include <engine/utils/vk/buffer.h>
+#include <engine/utils/vk/vk_driver.h>
+
+namespace mango {
+//! frame slots a freed block waits for
+constexpr uint32_t kAllFrames = (1u << MAX_FRAMES_IN_FLIGHT) - 1;
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+UniformFreeList::UniformFreeList(VkDeviceSize page_size,
+                                 VkDeviceSize min_alignment)
+    : min_alignment_(std::max<VkDeviceSize>(min_alignment, 1)) {
+  page_size_ = alignUp(page_size, min_alignment_);
+}
+
+void UniformFreeList::allocate(VkDeviceSize &size, VkDeviceSize alignment,
+                               uint32_t &page_index, VkDeviceSize &offset) {
+  assert(size > 0);
+  // sizes are multiples of the min alignment, so are all free ranges
+  size = alignUp(size, min_alignment_);
+  alignment = std::max(alignment, min_alignment_);
+
+  // best fit over all pages: the range wasting the fewest bytes after
+  // alignment padding
+  uint32_t best_page = std::numeric_limits<uint32_t>::max();
+  VkDeviceSize best_offset = 0, best_waste = 0;
+  for (uint32_t p = 0; p < pages_.size(); ++p) {
+    for (const auto &[range_offset, range_size] : pages_[p].free_ranges) {
+      const VkDeviceSize start = alignUp(range_offset, alignment);
+      if (start + size > range_offset + range_size)
+        continue;
+      const VkDeviceSize waste = range_size - size;
+      if (best_page == std::numeric_limits<uint32_t>::max() ||
+          waste < best_waste) {
+        best_page = p;
+        best_offset = range_offset;
+        best_waste = waste;
+      }
+    }
+  }
+
+  if (best_page == std::numeric_limits<uint32_t>::max()) {
+    // chain a new page, existing blocks never move
+    Page page;
+    page.capacity = std::max(page_size_, alignUp(size, alignment));
+    page.free_ranges.emplace(0, page.capacity);
+    pages_.emplace_back(std::move(page));
+    best_page = static_cast<uint32_t>(pages_.size() - 1);
+    best_offset = 0;
+  }
+
+  // split the range into alignment padding | block | tail
+  auto &page = pages_[best_page];
+  auto range = page.free_ranges.find(best_offset);
+  const VkDeviceSize range_size = range->second;
+  const VkDeviceSize start = alignUp(best_offset, alignment);
+  page.free_ranges.erase(range);
+  if (start > best_offset)
+    page.free_ranges.emplace(best_offset, start - best_offset);
+  if (best_offset + range_size > start + size)
+    page.free_ranges.emplace(start + size,
+                             best_offset + range_size - start - size);
+
+  ++blocks_;
+  used_ += size;
+  page_index = best_page;
+  offset = start;
+}
+
+void UniformFreeList::free(uint32_t page, VkDeviceSize offset,
+                           VkDeviceSize size) {
+  pending_.emplace_back(PendingFree{page, offset, size, kAllFrames});
+  --blocks_;
+  used_ -= size;
+}
+
+void UniformFreeList::retire(uint32_t frame_index) {
+  for (auto &pending : pending_) {
+    pending.frame_mask &= ~(1u << frame_index);
+    if (pending.frame_mask == 0)
+      insertFreeRange(pages_[pending.page], pending.offset, pending.size);
+  }
+  pending_.erase(std::remove_if(pending_.begin(), pending_.end(),
+                                [](const PendingFree &pending) {
+                                  return pending.frame_mask == 0;
+                                }),
+                 pending_.end());
+}
+
+UniformAllocatorStats UniformFreeList::getStats() const {
+  UniformAllocatorStats stats;
+  stats.pages = static_cast<uint32_t>(pages_.size());
+  stats.blocks = blocks_;
+  stats.used = used_;
+  for (const auto &page : pages_) {
+    stats.capacity += page.capacity;
+    stats.free_ranges += static_cast<uint32_t>(page.free_ranges.size());
+    for (const auto &[offset, size] : page.free_ranges)
+      stats.largest_free = std::max(stats.largest_free, size);
+  }
+  for (const auto &pending : pending_)
+    stats.pending += pending.size;
+  return stats;
+}
+
+void UniformFreeList::insertFreeRange(Page &page, VkDeviceSize offset,
+                                      VkDeviceSize size) {
+  auto &ranges = page.free_ranges;
+  auto next = ranges.lower_bound(offset);
+  if (next != ranges.begin()) {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second == offset) {
+      offset = prev->first;
+      size += prev->second;
+      ranges.erase(prev);
+    }
+  }
+  if (next != ranges.end() && offset + size == next->first) {
+    size += next->second;
+    ranges.erase(next);
+  }
+  ranges.emplace(offset, size);
+}
+
+UniformAllocator::UniformAllocator(const std::shared_ptr<VkDriver> &driver,
+                                   VkDeviceSize page_size)
+    : driver_(driver),
+      free_list_(page_size,
+                 std::max<VkDeviceSize>(driver->getMinUboAlignSize(), 1)) {}
+
+UniformAllocator::~UniformAllocator() = default;
+
+UniformBlock UniformAllocator::allocate(VkDeviceSize size,
+                                        VkDeviceSize alignment) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  uint32_t page = 0;
+  VkDeviceSize offset = 0;
+  free_list_.allocate(size, alignment, page, offset);
+  // a chained page gets its buffer
+  while (pages_.size() < free_list_.getPageCount())
+    pages_.emplace_back(std::make_shared<Buffer>(
+        driver_, free_list_.getPageCapacity(
+                     static_cast<uint32_t>(pages_.size())),
+        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 0,
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+            VMA_ALLOCATION_CREATE_MAPPED_BIT,
+        VMA_MEMORY_USAGE_AUTO_PREFER_HOST));
+
+  const auto &buffer = pages_[page];
+  return UniformBlock{.buffer = buffer->getHandle(),
+                      .offset = offset,
+                      .size = size,
+                      .data = buffer->getMappedData() + offset,
+                      .page = page};
+}
+
+void UniformAllocator::free(const UniformBlock &block) {
+  if (!block.isValid())
+    return;
+  std::lock_guard<std::mutex> lock(mtx_);
+  free_list_.free(block.page, block.offset, block.size);
+}
+
+void UniformAllocator::update(const UniformBlock &block, const void *data,
+                              size_t size, size_t offset) {
+  assert(offset + size <= block.size);
+  std::memcpy(block.data + offset, data, size);
+  // pages_ may grow on another thread
+  std::shared_ptr<Buffer> buffer;
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    buffer = pages_[block.page];
+  }
+  buffer->flush(block.offset + offset, size);
+}
+
+void UniformAllocator::retire(uint32_t frame_index) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  free_list_.retire(frame_index);
+}
+
+UniformAllocatorStats UniformAllocator::getStats() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return free_list_.getStats();
+}
+} // namespace mango
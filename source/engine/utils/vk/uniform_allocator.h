@@ -0,0 +1,178 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <volk.h>
+
+#include <engine/utils/vk/vk_constants.h>
+
+namespace mango {
+class Buffer;
+class VkDriver;
+
+/**
+ * @brief a uniform block sub-allocated from a UniformAllocator page, bound
+ * with (buffer, offset, size)
+ */
+struct UniformBlock {
+  VkBuffer buffer{VK_NULL_HANDLE};
+  VkDeviceSize offset{0};
+  VkDeviceSize size{0}; //!< rounded up to minUniformBufferOffsetAlignment
+  std::byte *data{nullptr}; //!< persistently mapped, flush after writing
+  uint32_t page{0};
+
+  bool isValid() const { return buffer != VK_NULL_HANDLE; }
+};
+
+struct UniformAllocatorStats {
+  uint32_t pages{0};
+  uint32_t blocks{0};          //!< live blocks
+  uint32_t free_ranges{0};     //!< free list entries of all pages
+  VkDeviceSize capacity{0};    //!< bytes of all pages
+  VkDeviceSize used{0};        //!< bytes of live blocks
+  VkDeviceSize pending{0};     //!< freed bytes waiting for frames in flight
+  VkDeviceSize largest_free{0};
+
+  //! used / capacity
+  float occupancy() const {
+    return capacity == 0 ? 0.0f : static_cast<float>(used) / capacity;
+  }
+
+  //! 1 - largest free range / free bytes, 0 if free space is contiguous
+  float fragmentation() const {
+    const VkDeviceSize free = capacity - used - pending;
+    return free == 0 ? 0.0f
+                     : 1.0f - static_cast<float>(largest_free) / free;
+  }
+};
+
+/**
+ * @brief bookkeeping of UniformAllocator pages, no Vulkan calls.
+ *
+ * Blocks are carved by best fit over per page free lists which are ordered by
+ * offset and coalesced when a block is reclaimed. A page is chained when no
+ * free range fits. Freed blocks are reclaimed once every frame slot retired
+ * after the free. Not thread safe.
+ */
+class UniformFreeList final {
+public:
+  /**
+   * @param min_alignment alignment of every offset and size, power of 2
+   */
+  UniformFreeList(VkDeviceSize page_size, VkDeviceSize min_alignment);
+
+  /**
+   * @brief reserve size bytes at a multiple of alignment, chaining a page if
+   * none has room
+   * @param alignment power of 2, raised to the min alignment
+   * @param size output, the reserved size, rounded up to the min alignment
+   */
+  void allocate(VkDeviceSize &size, VkDeviceSize alignment, uint32_t &page,
+                VkDeviceSize &offset);
+
+  /**
+   * @brief release a block returned by allocate, it's reused after all frame
+   * slots retired
+   */
+  void free(uint32_t page, VkDeviceSize offset, VkDeviceSize size);
+
+  /**
+   * @brief frame slot's fence was waited, reclaim the blocks freed before
+   * every slot retired
+   */
+  void retire(uint32_t frame_index);
+
+  uint32_t getPageCount() const {
+    return static_cast<uint32_t>(pages_.size());
+  }
+
+  VkDeviceSize getPageCapacity(uint32_t page) const {
+    return pages_[page].capacity;
+  }
+
+  UniformAllocatorStats getStats() const;
+
+private:
+  struct Page {
+    VkDeviceSize capacity;
+    std::map<VkDeviceSize, VkDeviceSize> free_ranges; //!< offset -> size
+  };
+
+  struct PendingFree {
+    uint32_t page;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    uint32_t frame_mask; //!< frame slots which haven't retired yet
+  };
+
+  //! return [offset, offset + size) to the page's free list, merged with
+  //! adjacent ranges
+  void insertFreeRange(Page &page, VkDeviceSize offset, VkDeviceSize size);
+
+  VkDeviceSize page_size_;
+  VkDeviceSize min_alignment_;
+  std::vector<Page> pages_;
+  std::vector<PendingFree> pending_;
+  uint32_t blocks_{0};
+  VkDeviceSize used_{0};
+};
+
+/**
+ * @brief sub-allocator of persistently mapped, host visible uniform buffers.
+ *
+ * Offsets honour minUniformBufferOffsetAlignment and any larger alignment
+ * requested. Pages are never moved so blocks keep their buffer and offset.
+ * Freed blocks may still be read by frames in flight, they are reclaimed once
+ * every frame slot called retire after the free, see UniformFreeList. Thread
+ * safe.
+ */
+class UniformAllocator final {
+public:
+  /**
+   * @param page_size bytes of a page, larger blocks get a page of their own
+   */
+  explicit UniformAllocator(const std::shared_ptr<VkDriver> &driver,
+                            VkDeviceSize page_size = 64 * 1024);
+
+  ~UniformAllocator();
+
+  /**
+   * @param alignment of the offset, 0 for minUniformBufferOffsetAlignment,
+   * power of 2
+   */
+  UniformBlock allocate(VkDeviceSize size, VkDeviceSize alignment = 0);
+
+  /**
+   * @brief release block, it's reused after all frames in flight retired
+   */
+  void free(const UniformBlock &block);
+
+  /**
+   * @brief copy data to the block and flush it
+   */
+  void update(const UniformBlock &block, const void *data, size_t size,
+              size_t offset = 0);
+
+  /**
+   * @brief frames recorded before the fence of frame slot was waited are
+   * done, reclaim the blocks they may have used. Should be called once per
+   * frame after the frame fence is waited.
+   */
+  void retire(uint32_t frame_index);
+
+  UniformAllocatorStats getStats();
+
+  UniformAllocator(const UniformAllocator &) = delete;
+  UniformAllocator &operator=(const UniformAllocator &) = delete;
+
+private:
+  std::shared_ptr<VkDriver> driver_;
+
+  std::mutex mtx_;
+  UniformFreeList free_list_;
+  std::vector<std::shared_ptr<Buffer>> pages_; //!< buffer per free list page
+};
+} // namespace mango
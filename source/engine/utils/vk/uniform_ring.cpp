@@ -0,0 +1,59 @@
+#include <engine/utils/vk/uniform_ring.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <engine/utils/vk/buffer.h>
+#include <engine/utils/vk/vk_driver.h>
+
+namespace mango {
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+UniformRing::UniformRing(const std::shared_ptr<VkDriver> &driver,
+                         VkDeviceSize frame_size)
+    : min_alignment_(std::max<VkDeviceSize>(driver->getMinUboAlignSize(), 1)) {
+  // regions start at aligned offsets
+  frame_size_ = alignUp(frame_size, min_alignment_);
+  buffer_ = std::make_shared<Buffer>(
+      driver, frame_size_ * MAX_FRAMES_IN_FLIGHT,
+      VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 0,
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+          VMA_ALLOCATION_CREATE_MAPPED_BIT,
+      VMA_MEMORY_USAGE_AUTO_PREFER_HOST, MemoryClass::PerFrame);
+}
+
+UniformRing::~UniformRing() = default;
+
+void UniformRing::beginFrame(uint32_t frame_index) {
+  frame_begin_ = frame_index * frame_size_;
+  head_.store(frame_begin_);
+}
+
+UniformSlice UniformRing::allocate(VkDeviceSize size) {
+  // aligned sizes keep every offset aligned
+  size = alignUp(size, min_alignment_);
+  const VkDeviceSize offset = head_.fetch_add(size);
+  if (offset + size > frame_begin_ + frame_size_)
+    throw std::runtime_error("uniform ring frame region is full");
+  return UniformSlice{.offset = static_cast<uint32_t>(offset),
+                      .data = buffer_->getMappedData() + offset};
+}
+
+uint32_t UniformRing::push(const void *data, size_t size) {
+  auto slice = allocate(size);
+  std::memcpy(slice.data, data, size);
+  return slice.offset;
+}
+
+void UniformRing::flush() {
+  const VkDeviceSize end =
+      std::min(head_.load(), frame_begin_ + frame_size_);
+  if (end > frame_begin_)
+    buffer_->flush(frame_begin_, end - frame_begin_);
+}
+
+VkBuffer UniformRing::getHandle() const { return buffer_->getHandle(); }
+} // namespace mango
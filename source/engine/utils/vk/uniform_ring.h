@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <volk.h>
+
+#include <engine/utils/vk/vk_constants.h>
+
+namespace mango {
+class Buffer;
+class VkDriver;
+
+/**
+ * @brief a slice of the current frame's region of a UniformRing, bound as a
+ * dynamic offset of the ring buffer
+ */
+struct UniformSlice {
+  uint32_t offset{0};       //!< dynamic offset in the ring buffer
+  std::byte *data{nullptr}; //!< persistently mapped, flushed by UniformRing
+
+  bool isValid() const { return data != nullptr; }
+};
+
+/**
+ * @brief per frame uniform data without write-after-read hazards.
+ *
+ * One persistently mapped, host visible buffer split into a region per frame
+ * in flight. A frame writes only the region of its slot, which the gpu no
+ * longer reads once the slot's fence is waited, so there is no extra
+ * synchronization. Allocation is an atomic pointer bump with offsets aligned
+ * to minUniformBufferOffsetAlignment; the written range is flushed once per
+ * frame. Descriptors point at the buffer with offset 0 and the slice's offset
+ * is passed as a dynamic offset at bind time. Thread safe.
+ */
+class UniformRing final {
+public:
+  /**
+   * @param frame_size bytes of a frame's region
+   */
+  explicit UniformRing(const std::shared_ptr<VkDriver> &driver,
+                       VkDeviceSize frame_size = 256 * 1024);
+
+  ~UniformRing();
+
+  /**
+   * @brief start allocating from the region of frame slot, discarding what an
+   * earlier frame wrote there. Should be called after the frame fence is
+   * waited.
+   */
+  void beginFrame(uint32_t frame_index);
+
+  /**
+   * @brief reserve size bytes of the current frame's region, throw if the
+   * region is full
+   */
+  UniformSlice allocate(VkDeviceSize size);
+
+  /**
+   * @brief allocate and copy data
+   * @return dynamic offset of the data
+   */
+  uint32_t push(const void *data, size_t size);
+
+  /**
+   * @brief make the bytes written in the current frame visible to the device,
+   * called once before the frame is submitted
+   */
+  void flush();
+
+  VkBuffer getHandle() const;
+
+  //! bytes allocated in the current frame
+  VkDeviceSize getUsed() const { return head_.load() - frame_begin_; }
+
+  VkDeviceSize getFrameSize() const { return frame_size_; }
+
+  UniformRing(const UniformRing &) = delete;
+  UniformRing &operator=(const UniformRing &) = delete;
+
+private:
+  std::shared_ptr<Buffer> buffer_;
+  VkDeviceSize min_alignment_;
+  VkDeviceSize frame_size_;
+  VkDeviceSize frame_begin_{0}; //!< start of the current frame's region
+  std::atomic<VkDeviceSize> head_{0};
+};
+} // namespace mango
@@ -0,0 +1,336 @@
+#include <engine/utils/vk/upload_scheduler.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <engine/utils/base/error.h>
+#include <engine/utils/vk/buffer.h>
+#include <engine/utils/vk/commands.h>
+#include <engine/utils/vk/image.h>
+#include <engine/utils/vk/stage_pool.h>
+#include <engine/utils/vk/syncs.h>
+#include <engine/utils/vk/vk_driver.h>
+
+namespace mango {
+// resources recorded into a batch before it is flushed on its own
+constexpr uint32_t kFlushResources = 32;
+
+UploadScheduler::Recorder::Recorder(UploadScheduler &scheduler)
+    : scheduler_(scheduler), lock_(scheduler.mtx_) {
+  // a full batch goes to the gpu before more is recorded
+  if (scheduler_.cur_resources_ >= kFlushResources)
+    scheduler_.flushLocked();
+}
+
+void UploadScheduler::Recorder::uploadBuffer(const Buffer &buffer,
+                                             const void *data,
+                                             VkDeviceSize size,
+                                             VkDeviceSize offset) {
+  auto stage =
+      scheduler_.driver_->getStagePool()->upload(data, size, getTicket());
+  scheduler_.cur_copies_.buffer_copies.emplace_back(BufferCopy{
+      .src = stage.buffer,
+      .dst = buffer.getHandle(),
+      .region = {.srcOffset = stage.offset, .dstOffset = offset, .size = size}});
+}
+
+void UploadScheduler::Recorder::uploadImage(
+    Image &image, const void *data, const VkImageSubresourceRange &range,
+    uint32_t mip_level) {
+  const uint32_t texel_size = getTexelSize(image.getFormat());
+  if (texel_size == 0)
+    throw std::runtime_error("Unsupported image format for upload.");
+  const auto &image_extent = image.getExtent();
+  const VkExtent3D extent{std::max(image_extent.width >> mip_level, 1u),
+                          std::max(image_extent.height >> mip_level, 1u), 1};
+  // the buffer offset must be a multiple of the texel size and of 4
+  const VkDeviceSize alignment =
+      texel_size % 4 == 0 ? texel_size : texel_size * 4;
+  auto stage = scheduler_.driver_->getStagePool()->upload(
+      data, VkDeviceSize{extent.width} * extent.height * texel_size,
+      getTicket(), alignment);
+
+  auto &copies = scheduler_.cur_copies_;
+  if (image.layout_ != VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
+    copies.images.emplace_back(VkImageMemoryBarrier{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = 0,
+        .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .oldLayout = image.layout_,
+        .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = image.getHandle(),
+        .subresourceRange = range});
+    image.updateLayout(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+  }
+  copies.image_copies.emplace_back(ImageCopy{
+      .src = stage.buffer,
+      .dst = image.getHandle(),
+      .region = {.bufferOffset = stage.offset,
+                 .bufferRowLength = 0,
+                 .bufferImageHeight = 0,
+                 .imageSubresource = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                      .mipLevel = mip_level,
+                                      .baseArrayLayer = 0,
+                                      .layerCount = 1},
+                 .imageOffset = {0, 0, 0},
+                 .imageExtent = extent}});
+}
+
+void UploadScheduler::Recorder::releaseBuffer(Buffer &buffer,
+                                              VkPipelineStageFlags dst_stage,
+                                              VkAccessFlags dst_access) {
+  ++scheduler_.cur_resources_;
+  buffer.upload_ticket_.store(getTicket(), std::memory_order_release);
+  // same family: the copy is made visible by the semaphore wait
+  if (scheduler_.transfer_family_ == scheduler_.graphics_family_)
+    return;
+  auto &transfers = scheduler_.cur_transfers_;
+  transfers.dst_stages |= dst_stage;
+  transfers.buffers.emplace_back(VkBufferMemoryBarrier{
+      .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+      .dstAccessMask = dst_access,
+      .srcQueueFamilyIndex = scheduler_.transfer_family_,
+      .dstQueueFamilyIndex = scheduler_.graphics_family_,
+      .buffer = buffer.getHandle(),
+      .offset = 0,
+      .size = VK_WHOLE_SIZE});
+}
+
+void UploadScheduler::Recorder::releaseImage(
+    Image &image, const VkImageSubresourceRange &range, VkImageLayout layout,
+    VkPipelineStageFlags dst_stage, VkAccessFlags dst_access) {
+  ++scheduler_.cur_resources_;
+  // the layout transition is part of the release, and of the acquire
+  const bool same_family =
+      scheduler_.transfer_family_ == scheduler_.graphics_family_;
+  auto &transfers = scheduler_.cur_transfers_;
+  transfers.dst_stages |= dst_stage;
+  transfers.images.emplace_back(VkImageMemoryBarrier{
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+      .dstAccessMask = dst_access,
+      .oldLayout = image.layout_,
+      .newLayout = layout,
+      .srcQueueFamilyIndex =
+          same_family ? VK_QUEUE_FAMILY_IGNORED : scheduler_.transfer_family_,
+      .dstQueueFamilyIndex =
+          same_family ? VK_QUEUE_FAMILY_IGNORED : scheduler_.graphics_family_,
+      .image = image.getHandle(),
+      .subresourceRange = range});
+  image.updateLayout(layout);
+  image.upload_ticket_.store(getTicket(), std::memory_order_release);
+}
+
+UploadTicket UploadScheduler::Recorder::getTicket() const {
+  return scheduler_.submitted_.load(std::memory_order_relaxed) + 1;
+}
+
+UploadScheduler::UploadScheduler(const std::shared_ptr<VkDriver> &driver)
+    : driver_(driver),
+      timeline_(std::make_unique<TimelineSemaphore>(driver)),
+      transfer_family_(driver->getTransferQueue()->getFamilyIndex()),
+      graphics_family_(driver->getGraphicsQueue()->getFamilyIndex()) {}
+
+UploadScheduler::~UploadScheduler() {
+  timeline_->wait(submitted_.load(std::memory_order_acquire));
+}
+
+std::shared_ptr<CommandPool> UploadScheduler::requestPoolLocked() {
+  if (!in_flight_pools_.empty()) {
+    const auto completed = timeline_->getValue();
+    while (!in_flight_pools_.empty() &&
+           in_flight_pools_.front().ticket <= completed) {
+      in_flight_pools_.front().pool->reset();
+      free_pools_.emplace_back(std::move(in_flight_pools_.front().pool));
+      in_flight_pools_.pop_front();
+    }
+  }
+  if (free_pools_.empty())
+    return std::make_shared<CommandPool>(driver_, transfer_family_,
+                                         CommandPool::CmbResetMode::ResetPool);
+  auto pool = std::move(free_pools_.back());
+  free_pools_.pop_back();
+  return pool;
+}
+
+void UploadScheduler::recordCopies(VkCommandBuffer cmd_buf) {
+  auto &copies = cur_copies_;
+  if (!copies.images.empty()) {
+    vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                         nullptr, static_cast<uint32_t>(copies.images.size()),
+                         copies.images.data());
+    ++barriers_;
+  }
+
+  // regions with the same source and destination share one command
+  auto &buffer_copies = copies.buffer_copies;
+  std::stable_sort(buffer_copies.begin(), buffer_copies.end(),
+                   [](const BufferCopy &a, const BufferCopy &b) {
+                     return a.dst != b.dst ? a.dst < b.dst : a.src < b.src;
+                   });
+  std::vector<VkBufferCopy> buffer_regions;
+  for (size_t i = 0; i < buffer_copies.size();) {
+    const auto src = buffer_copies[i].src;
+    const auto dst = buffer_copies[i].dst;
+    buffer_regions.clear();
+    for (; i < buffer_copies.size() && buffer_copies[i].src == src &&
+           buffer_copies[i].dst == dst;
+         ++i)
+      buffer_regions.emplace_back(buffer_copies[i].region);
+    vkCmdCopyBuffer(cmd_buf, src, dst,
+                    static_cast<uint32_t>(buffer_regions.size()),
+                    buffer_regions.data());
+    ++copies_;
+  }
+
+  auto &image_copies = copies.image_copies;
+  std::stable_sort(image_copies.begin(), image_copies.end(),
+                   [](const ImageCopy &a, const ImageCopy &b) {
+                     return a.dst != b.dst ? a.dst < b.dst : a.src < b.src;
+                   });
+  std::vector<VkBufferImageCopy> image_regions;
+  for (size_t i = 0; i < image_copies.size();) {
+    const auto src = image_copies[i].src;
+    const auto dst = image_copies[i].dst;
+    image_regions.clear();
+    for (; i < image_copies.size() && image_copies[i].src == src &&
+           image_copies[i].dst == dst;
+         ++i)
+      image_regions.emplace_back(image_copies[i].region);
+    vkCmdCopyBufferToImage(cmd_buf, src, dst,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           static_cast<uint32_t>(image_regions.size()),
+                           image_regions.data());
+    ++copies_;
+  }
+}
+
+UploadTicket UploadScheduler::flushLocked() {
+  const auto submitted = submitted_.load(std::memory_order_relaxed);
+  if (cur_resources_ == 0 && cur_copies_.buffer_copies.empty() &&
+      cur_copies_.image_copies.empty())
+    return submitted;
+  const UploadTicket ticket = submitted + 1;
+  auto pool = requestPoolLocked();
+  auto cmd_buf = pool->requestCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+  cmd_buf->begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+  auto cmd_buf_handle = cmd_buf->getHandle();
+  recordCopies(cmd_buf_handle);
+
+  // release barriers, the destination access belongs to the acquire
+  auto &transfers = cur_transfers_;
+  if (!transfers.buffers.empty() || !transfers.images.empty()) {
+    auto buffers = transfers.buffers;
+    for (auto &barrier : buffers)
+      barrier.dstAccessMask = 0;
+    auto images = transfers.images;
+    for (auto &barrier : images)
+      barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(cmd_buf_handle, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+                         static_cast<uint32_t>(buffers.size()), buffers.data(),
+                         static_cast<uint32_t>(images.size()), images.data());
+    ++barriers_;
+  }
+  cmd_buf->end();
+
+  VkSemaphore semaphore = timeline_->getHandle();
+  VkTimelineSemaphoreSubmitInfo timeline_info{
+      .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+      .signalSemaphoreValueCount = 1,
+      .pSignalSemaphoreValues = &ticket};
+  VkSubmitInfo submit_info{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+  submit_info.pNext = &timeline_info;
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers = &cmd_buf_handle;
+  submit_info.signalSemaphoreCount = 1;
+  submit_info.pSignalSemaphores = &semaphore;
+  auto result =
+      driver_->getTransferQueue()->submit({submit_info}, VK_NULL_HANDLE);
+  VK_THROW_IF_ERROR(result, "failed to submit uploads!");
+
+  cmd_buf.reset();
+  in_flight_pools_.emplace_back(InFlightPool{ticket, std::move(pool)});
+  // an ownership transfer is completed by the graphics queue, a layout
+  // transition within the family is already done by the release
+  if (transfer_family_ != graphics_family_ &&
+      (!transfers.buffers.empty() || !transfers.images.empty())) {
+    for (auto &barrier : transfers.buffers)
+      barrier.srcAccessMask = 0;
+    for (auto &barrier : transfers.images)
+      barrier.srcAccessMask = 0;
+    transfers.ticket = ticket;
+    pending_acquires_.emplace_back(std::move(transfers));
+  }
+  cur_copies_ = Copies{};
+  cur_transfers_ = Transfers{};
+  cur_resources_ = 0;
+  submitted_.store(ticket, std::memory_order_release);
+  return ticket;
+}
+
+UploadTicket UploadScheduler::flush() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return flushLocked();
+}
+
+UploadTicket UploadScheduler::acquire(VkCommandBuffer cmd_buf,
+                                      UploadTicket ticket) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  ticket = std::min(ticket, submitted_.load(std::memory_order_relaxed));
+  if (pending_acquires_.empty())
+    return ticket;
+  // completed batches are taken over too, waiting for them costs nothing
+  const auto limit = std::max(ticket, timeline_->getValue());
+  VkPipelineStageFlags dst_stages = 0;
+  std::vector<VkBufferMemoryBarrier> buffers;
+  std::vector<VkImageMemoryBarrier> images;
+  while (!pending_acquires_.empty() &&
+         pending_acquires_.front().ticket <= limit) {
+    auto &transfers = pending_acquires_.front();
+    dst_stages |= transfers.dst_stages;
+    buffers.insert(buffers.end(), transfers.buffers.begin(),
+                   transfers.buffers.end());
+    images.insert(images.end(), transfers.images.begin(),
+                  transfers.images.end());
+    ticket = std::max(ticket, transfers.ticket);
+    pending_acquires_.pop_front();
+  }
+  if (dst_stages != 0)
+    vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         dst_stages, 0, 0, nullptr,
+                         static_cast<uint32_t>(buffers.size()), buffers.data(),
+                         static_cast<uint32_t>(images.size()), images.data());
+  return ticket;
+}
+
+UploadTicket UploadScheduler::getCompletedTicket() const {
+  return timeline_->getValue();
+}
+
+void UploadScheduler::wait(UploadTicket ticket) {
+  if (!isSubmitted(ticket))
+    flush();
+  timeline_->wait(ticket);
+}
+
+VkSemaphore UploadScheduler::getSemaphore() const {
+  return timeline_->getHandle();
+}
+
+UploadSchedulerStats UploadScheduler::getStats() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return UploadSchedulerStats{
+      .submitted = submitted_.load(std::memory_order_relaxed),
+      .completed = timeline_->getValue(),
+      .pending_acquires = static_cast<uint32_t>(pending_acquires_.size()),
+      .command_pools =
+          static_cast<uint32_t>(in_flight_pools_.size() + free_pools_.size()),
+      .barriers = barriers_,
+      .copies = copies_};
+}
+} // namespace mango
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <volk.h>
+
+namespace mango {
+class VkDriver;
+class Buffer;
+class Image;
+class CommandPool;
+class TimelineSemaphore;
+
+//! upload timeline value signaled once an upload is done, 0 for none
+using UploadTicket = uint64_t;
+
+struct UploadSchedulerStats {
+  UploadTicket submitted{0}; //!< value of the last submitted batch
+  UploadTicket completed{0}; //!< value reached on the device
+  uint32_t pending_acquires{0}; //!< batches not acquired by the graphics queue
+  uint32_t command_pools{0};    //!< in flight and free
+  uint64_t barriers{0};         //!< vkCmdPipelineBarrier calls of all batches
+  uint64_t copies{0};           //!< copy commands of all batches
+};
+
+/**
+ * @brief records uploads from any thread into batches submitted to the
+ * transfer queue, each signaling the next value of a timeline semaphore.
+ *
+ * An upload is recorded through a Recorder, which holds the scheduler lock
+ * while it lives, and is identified by the ticket of its batch. Uploaded
+ * resources are released to the graphics queue family when the batch is
+ * flushed; the render thread records the matching acquires with acquire() and
+ * makes its frame wait for the returned value, so a frame only waits for the
+ * batches of the resources it draws. Resources whose ticket is not submitted
+ * yet are skipped, not waited for.
+ *
+ * Uploads are staged right away but their commands are only recorded when
+ * the batch is flushed, coalesced: one barrier moves all images of the batch
+ * to TRANSFER_DST, the copies follow (one vkCmdCopyBuffer per destination
+ * buffer), and one barrier releases everything. A batch is flushed once
+ * enough resources were recorded into it, so large imports reach the gpu
+ * while they are still being loaded, and by flush() at the end of each tick.
+ */
+class UploadScheduler final {
+public:
+  /**
+   * @brief scope of an upload, the scheduler is locked until it is destroyed
+   */
+  class Recorder final {
+  public:
+    Recorder(const Recorder &) = delete;
+    Recorder &operator=(const Recorder &) = delete;
+
+    ~Recorder() = default;
+
+    /**
+     * @brief stage size bytes of data, copied to buffer at offset by the batch
+     */
+    void uploadBuffer(const Buffer &buffer, const void *data,
+                      VkDeviceSize size, VkDeviceSize offset = 0);
+
+    /**
+     * @brief stage the tightly packed texels of mip_level, layer 0, copied to
+     * image by the batch. range is moved to TRANSFER_DST before the copy.
+     */
+    void uploadImage(Image &image, const void *data,
+                     const VkImageSubresourceRange &range,
+                     uint32_t mip_level = 0);
+
+    /**
+     * @brief hand a buffer written by the batch over to the graphics queue
+     * @param dst_stage, dst_access first use of the buffer on the graphics
+     * queue
+     */
+    void releaseBuffer(Buffer &buffer, VkPipelineStageFlags dst_stage,
+                       VkAccessFlags dst_access);
+
+    /**
+     * @brief hand an image written by the batch over to the graphics queue,
+     * transitioning range to layout
+     */
+    void releaseImage(Image &image, const VkImageSubresourceRange &range,
+                      VkImageLayout layout, VkPipelineStageFlags dst_stage,
+                      VkAccessFlags dst_access);
+
+    /**
+     * @brief ticket of everything recorded into the open batch
+     */
+    UploadTicket getTicket() const;
+
+  private:
+    explicit Recorder(UploadScheduler &scheduler);
+
+    UploadScheduler &scheduler_;
+    std::lock_guard<std::mutex> lock_;
+
+    friend class UploadScheduler;
+  };
+
+  explicit UploadScheduler(const std::shared_ptr<VkDriver> &driver);
+
+  ~UploadScheduler();
+
+  UploadScheduler(const UploadScheduler &) = delete;
+  UploadScheduler &operator=(const UploadScheduler &) = delete;
+
+  Recorder record() { return Recorder(*this); }
+
+  /**
+   * @brief submit the open batch, if any
+   * @return the last submitted ticket
+   */
+  UploadTicket flush();
+
+  /**
+   * @brief graphics queue: take over the resources of all submitted batches
+   * up to ticket, and of those already completed, recording the acquire
+   * barriers into cmd_buf.
+   * @return timeline value the submit of cmd_buf must wait for, 0 for none
+   */
+  UploadTicket acquire(VkCommandBuffer cmd_buf, UploadTicket ticket);
+
+  /**
+   * @brief whether the batch of ticket was submitted, a queue may wait for it
+   */
+  bool isSubmitted(UploadTicket ticket) const {
+    return ticket <= submitted_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief whether the batch of ticket was executed by the transfer queue
+   */
+  bool isCompleted(UploadTicket ticket) const {
+    return ticket <= getCompletedTicket();
+  }
+
+  /**
+   * @brief value reached by the timeline, every batch up to it was executed
+   */
+  UploadTicket getCompletedTicket() const;
+
+  /**
+   * @brief host: flush if needed and block until ticket is done
+   */
+  void wait(UploadTicket ticket);
+
+  VkSemaphore getSemaphore() const;
+
+  UploadSchedulerStats getStats();
+
+private:
+  struct BufferCopy {
+    VkBuffer src;
+    VkBuffer dst;
+    VkBufferCopy region;
+  };
+
+  struct ImageCopy {
+    VkBuffer src;
+    VkImage dst;
+    VkBufferImageCopy region;
+  };
+
+  //! commands of the open batch, recorded by flush
+  struct Copies {
+    std::vector<VkImageMemoryBarrier> images; //!< to TRANSFER_DST
+    std::vector<BufferCopy> buffer_copies;
+    std::vector<ImageCopy> image_copies;
+  };
+
+  //! release barriers of a batch, with the access of the acquiring queue
+  struct Transfers {
+    UploadTicket ticket{0};
+    VkPipelineStageFlags dst_stages{0};
+    std::vector<VkBufferMemoryBarrier> buffers;
+    std::vector<VkImageMemoryBarrier> images;
+  };
+
+  struct InFlightPool {
+    UploadTicket ticket;
+    std::shared_ptr<CommandPool> pool;
+  };
+
+  std::shared_ptr<CommandPool> requestPoolLocked();
+
+  void recordCopies(VkCommandBuffer cmd_buf);
+
+  UploadTicket flushLocked();
+
+  std::shared_ptr<VkDriver> driver_;
+  std::unique_ptr<TimelineSemaphore> timeline_;
+  uint32_t transfer_family_;
+  uint32_t graphics_family_;
+
+  std::mutex mtx_;
+  Copies cur_copies_;
+  Transfers cur_transfers_; //!< released by the open batch
+  uint32_t cur_resources_{0};
+  std::deque<InFlightPool> in_flight_pools_; //!< oldest first
+  std::vector<std::shared_ptr<CommandPool>> free_pools_;
+  std::deque<Transfers> pending_acquires_;   //!< oldest first
+  std::atomic<UploadTicket> submitted_{0};
+  uint64_t barriers_{0};
+  uint64_t copies_{0};
+};
+} // namespace mango
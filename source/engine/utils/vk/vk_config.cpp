@@ -5,6 +5,14 @@
 
 namespace mango {
 
+bool VkConfig::isDeviceExtensionEnabled(const char *extension_name) const {
+  for (const auto &ext : enabled_device_extensions_) {
+    if (strcmp(ext, extension_name) == 0)
+      return true;
+  }
+  return false;
+}
+
 uint32_t Vk13Config::checkSelectAndUpdate(
     const std::vector<PhysicalDevice> &physical_devices,
     VkDeviceCreateInfo &create_info, VkSurfaceKHR surface) {
@@ -43,6 +51,10 @@ uint32_t Vk13Config::checkSelectAndUpdate(
     ext_feature->sType =
         VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
     ext_feature->descriptorBindingPartiallyBound = VK_TRUE;
+    // bindless texture array, see ResourceBindingMgr
+    ext_feature->runtimeDescriptorArray = VK_TRUE;
+    ext_feature->shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    ext_feature->descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
     ext_feature->pNext = extension_features_list_;
     extension_features_list_ = ext_feature.get();
   }
@@ -66,69 +78,96 @@ uint32_t Vk13Config::checkSelectAndUpdate(
     device_features_.robustBufferAccess = VK_TRUE;
   }
 
+  // timeline semaphores are core since vulkan 1.2, only the feature has to be
+  // enabled. Used by the upload scheduler.
+  {
+    auto ext_feature =
+        std::make_shared<VkPhysicalDeviceTimelineSemaphoreFeatures>();
+    extension_features_.emplace(
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES,
+        ext_feature);
+    ext_feature->sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    ext_feature->timelineSemaphore = VK_TRUE;
+    ext_feature->pNext = extension_features_list_;
+    extension_features_list_ = ext_feature.get();
+  }
+
   uint32_t selected_physical_device_index = -1;
   enabled_device_extensions_.reserve(request_device_extensions_.size());
-  for (uint32_t device_index = 0; device_index < physical_devices.size();
-       ++device_index) {
-    enabled_device_extensions_.clear();
-    auto &pd = physical_devices[device_index];
-    auto handle = pd.getHandle();
-    uint32_t graphics_queue_family_index = pd.getGraphicsQueueFamilyIndex();
-    if (graphics_queue_family_index == 0XFFFFFFFF)
-      continue;
-    VkBool32 surface_support = (surface == nullptr);
-    if (!surface_support)
-      vkGetPhysicalDeviceSurfaceSupportKHR(handle, graphics_queue_family_index,
-                                           surface, &surface_support);
-    if (!surface_support || (pd.getProperties().deviceType != device_type_))
-      continue;
-
-    const auto &device_extensions = pd.getExtensionProperties();
+  for (uint32_t round = 0; round < 2 && selected_physical_device_index == -1;
+       ++round) {
+    for (uint32_t device_index = 0; device_index < physical_devices.size();
+         ++device_index) {
+      enabled_device_extensions_.clear();
+      auto &pd = physical_devices[device_index];
+      auto handle = pd.getHandle();
+      uint32_t graphics_queue_family_index = pd.getGraphicsQueueFamilyIndex();
+      if (graphics_queue_family_index == 0XFFFFFFFF)
+        continue;
+      VkBool32 surface_support = (surface == nullptr);
+      if (!surface_support)
+        vkGetPhysicalDeviceSurfaceSupportKHR(
+            handle, graphics_queue_family_index, surface, &surface_support);
+      // prefer the configured device type, accept others (e.g. lavapipe) in
+      // the second round
+      if (!surface_support ||
+          (round == 0 && pd.getProperties().deviceType != device_type_))
+        continue;
+
+      const auto &device_extensions = pd.getExtensionProperties();
 #ifndef NDEBUG
-    LOGD("device name: {}", pd.getProperties().deviceName);
-    for (const auto &ext : device_extensions)
-      LOGD("device extension: {}", ext.extensionName);
+      LOGD("device name: {}", pd.getProperties().deviceName);
+      for (const auto &ext : device_extensions)
+        LOGD("device extension: {}", ext.extensionName);
 
-    LOGD("---------requested extension begin-------");
-    for (const auto &ext : request_device_extensions_) {
-      LOGD("{}", ext.first);
-    }
-    LOGD("---------requested extension end---------");
+      LOGD("---------requested extension begin-------");
+      for (const auto &ext : request_device_extensions_) {
+        LOGD("{}", ext.first);
+      }
+      LOGD("---------requested extension end---------");
 #endif
-    bool extension_support = true;
-    for (const auto &req_ext : request_device_extensions_) {
-      bool is_find = false;
-      for (const auto &ext : device_extensions) {
-        if (strcmp(ext.extensionName, req_ext.first) == 0) {
-          is_find = true;
+      bool extension_support = true;
+      for (const auto &req_ext : request_device_extensions_) {
+        bool is_find = false;
+        for (const auto &ext : device_extensions) {
+          if (strcmp(ext.extensionName, req_ext.first) == 0) {
+            is_find = true;
+            break;
+          }
+        }
+        if (is_find) {
+          enabled_device_extensions_.emplace_back(req_ext.first);
+          continue;
+        }
+        if (req_ext.second == EnableState::REQUIRED) {
+          extension_support = false;
           break;
         }
       }
-      if (is_find) {
-        enabled_device_extensions_.emplace_back(req_ext.first);
-        continue;
-      }
-      if (req_ext.second == EnableState::REQUIRED) {
-        extension_support = false;
-        break;
-      }
-    }
 
-    if (!extension_support)
-      continue;
+      if (!extension_support)
+        continue;
 
-    // feature extension support
-    if (extension_features_list_ != nullptr) {
-      pd.getExtensionFeatures(extension_features_list_);
+      // feature extension support
+      if (extension_features_list_ != nullptr) {
+        pd.getExtensionFeatures(extension_features_list_);
+      }
+      selected_physical_device_index = device_index;
+      break;
     }
-    selected_physical_device_index = device_index;
-    break;
   }
 
   if (selected_physical_device_index == -1)
     return selected_physical_device_index;
 
   // TODO setup device features
+  // occlusion culled draws start at the group's instances, enabled if
+  // supported, see MainPass
+  device_features_.drawIndirectFirstInstance =
+      physical_devices[selected_physical_device_index]
+          .getFeatures()
+          .drawIndirectFirstInstance;
 
   // update device create info
   create_info.pEnabledFeatures = &device_features_;
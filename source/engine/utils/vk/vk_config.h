@@ -35,7 +35,10 @@ constexpr char const * kFeatureExtensionNames[] = {
     VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME,           // 16
     VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME,          // 17
     VK_KHR_DEVICE_GROUP_EXTENSION_NAME,                   // 18
-    "DEVICE_EXTENSION_END_PIVOT",                         // 19
+    VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME,            // 19
+    VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,                  // 20
+    VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME,     // 21
+    "DEVICE_EXTENSION_END_PIVOT",                         // 22
 };
 class VkConfig {
 public:
@@ -68,7 +71,10 @@ public:
     KHR_DEDICATED_ALLOCATION = 16,
     KHR_BUFFER_DEVICE_ADDRESS = 17,
     KHR_DEVICE_GROUP = 18,
-    DEVICE_EXTENSION_END_PIVOT = 19,
+    KHR_DRAW_INDIRECT_COUNT = 19, // gpu driven culling
+    EXT_MEMORY_BUDGET = 20,       // texture streaming budget
+    EXT_PIPELINE_CREATION_FEEDBACK = 21, // pipeline cache hit metrics
+    DEVICE_EXTENSION_END_PIVOT = 22,
 
     //// Device features
     MAX_FEATURE_EXTENSION_COUNT
@@ -118,6 +124,19 @@ public:
     return enableds_;
   }
 
+  /**
+   * \brief whether the device extension is enabled on the created device,
+   * including optional extensions which are supported.
+   */
+  bool isDeviceExtensionEnabled(const char *extension_name) const;
+
+  /**
+   * \brief core features enabled on the created device
+   */
+  const VkPhysicalDeviceFeatures &getEnabledFeatures() const noexcept {
+    return device_features_;
+  }
+
 protected:
   virtual void checkAndUpdateLayers(VkInstanceCreateInfo &create_info) = 0;
   virtual void checkAndUpdateExtensions(VkInstanceCreateInfo &create_info) = 0;
@@ -172,6 +191,16 @@ public:
         EnableState::REQUIRED;
     enableds_[static_cast<uint32_t>(FeatureExtension::VK_EXT_ROBUSTNESS_2)] =
         EnableState::REQUIRED;
+    // for gpu occlusion culling, fallback to cpu culling only if not supported
+    enableds_[static_cast<uint32_t>(
+        FeatureExtension::KHR_DRAW_INDIRECT_COUNT)] = EnableState::OPTIONAL;
+    // vram budget of texture streaming, vma estimates it if not supported
+    enableds_[static_cast<uint32_t>(FeatureExtension::EXT_MEMORY_BUDGET)] =
+        EnableState::OPTIONAL;
+    // creation time and cache hits of pipelines, not measured if not supported
+    enableds_[static_cast<uint32_t>(
+        FeatureExtension::EXT_PIPELINE_CREATION_FEEDBACK)] =
+        EnableState::OPTIONAL;
   }
 
   ~Vk13Config() override = default;
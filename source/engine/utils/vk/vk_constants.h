@@ -13,7 +13,6 @@ constexpr uint32_t CONFIG_SAMPLER_BINDING_COUNT =
 constexpr uint32_t DESCRIPTOR_TYPE_COUNT = 3;
 
 constexpr uint32_t MAX_MAT_DESC_SET = 100;
-constexpr uint32_t MAX_GLOBAL_DESC_SET = 100;
 constexpr uint32_t MAX_TEXTURE_NUM_COUNT =
     4; // average max texture number for one descriptor set
 
@@ -15,10 +15,12 @@
 #include <engine/utils/vk/commands.h>
 #include <engine/utils/vk/descriptor_set.h>
 #include <engine/utils/vk/framebuffer.h>
+#include <engine/utils/vk/memory_pools.h>
 #include <engine/utils/vk/physical_device.h>
 #include <engine/utils/vk/stage_pool.h>
 #include <engine/utils/vk/swapchain.h>
 #include <engine/utils/vk/syncs.h>
+#include <engine/utils/vk/upload_scheduler.h>
 #include <engine/utils/vk/vk_constants.h>
 #include <engine/utils/vk/vk_driver.h>
 #include <engine/utils/vk/syncs.h>
@@ -103,18 +105,26 @@ void VkDriver::initDevice() {
   }
 #endif
 
-  // queue info
-  VkDeviceQueueCreateInfo queue_info{};
+  // queue info, uploads go to the dedicated transfer family if there is one,
+  // otherwise to a second queue of the graphics family
+  auto transfer_queue_family_index = ph_device.getTransferQueueFamilyIndex();
+  const bool dedicated_transfer =
+      transfer_queue_family_index != graphics_queue_family_index;
+  VkDeviceQueueCreateInfo queue_infos[2]{};
   float queue_priority[2] = {1.0f, 1.0f};
-  queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-  queue_info.queueFamilyIndex = graphics_queue_family_index;
-  queue_info.queueCount = 2;
-  queue_info.pQueuePriorities = queue_priority;
+  queue_infos[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+  queue_infos[0].queueFamilyIndex = graphics_queue_family_index;
+  queue_infos[0].queueCount = dedicated_transfer ? 1 : 2;
+  queue_infos[0].pQueuePriorities = queue_priority;
+  queue_infos[1].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+  queue_infos[1].queueFamilyIndex = transfer_queue_family_index;
+  queue_infos[1].queueCount = 1;
+  queue_infos[1].pQueuePriorities = queue_priority;
 
   // logical device
   device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-  device_info.pQueueCreateInfos = &queue_info;
-  device_info.queueCreateInfoCount = 1;
+  device_info.pQueueCreateInfos = queue_infos;
+  device_info.queueCreateInfoCount = dedicated_transfer ? 2 : 1;
 
   VK_THROW_IF_ERROR(
       vkCreateDevice(physical_device_, &device_info, nullptr, &device_),
@@ -125,7 +135,8 @@ void VkDriver::initDevice() {
       VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_TRANSFER_BIT | VK_QUEUE_COMPUTE_BIT,
       VK_TRUE, 0);
   transfer_cmd_queue_ = new CommandQueue(
-      device_, graphics_queue_family_index, VK_QUEUE_TRANSFER_BIT, VK_TRUE, 0);
+      device_, transfer_queue_family_index, VK_QUEUE_TRANSFER_BIT, VK_FALSE,
+      dedicated_transfer ? 0 : 1);
 }
 
 void VkDriver::initThreadLocalCommandBufferManagers(const std::initializer_list<uint32_t> & queue_family_indices)
@@ -154,10 +165,13 @@ void VkDriver::init(const std::shared_ptr<VkConfig> &config) {
   assert(g_engine.getWindow() != nullptr);
   initDevice();
   initAllocator();
+  // resources created from here on take their pools from it
+  memory_pools_ = new MemoryPools(shared_from_this());
 
   createSwapchain();
   createFramesData();
   stage_pool_ = new StagePool(shared_from_this());
+  upload_scheduler_ = new UploadScheduler(shared_from_this());
   #if !NDEBUG
     setupDebugMessenger();
   #endif
@@ -253,14 +267,12 @@ void VkDriver::presentFrame() {
 //       pool_size, sizeof(pool_size) / sizeof(pool_size[0]), MAX_GLOBAL_DESC_SET);
 // }
 
-bool VkDriver::isDeviceExtensionEnabled(const char *extension_name) {
-  const auto &enables = config_->getEnableds();
-  for (auto i = 0; i < enables.size(); ++i) {
-    auto e = enables[i];
-    if (e == VkConfig::EnableState::REQUIRED && strcmp(extension_name, kFeatureExtensionNames[i])==0)
-      return true;
-  }
-  return false;
+bool VkDriver::isDeviceExtensionEnabled(const char *extension_name) const {
+  return config_->isDeviceExtensionEnabled(extension_name);
+}
+
+const VkPhysicalDeviceFeatures &VkDriver::getEnabledFeatures() const {
+  return config_->getEnabledFeatures();
 }
 
 static VKAPI_ATTR VkBool32 VKAPI_CALL
@@ -425,6 +437,10 @@ void VkDriver::initAllocator() {
     allocator_info.flags |= VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
   }
 
+  if (isDeviceExtensionEnabled(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+    allocator_info.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+  }
+
   auto result = vmaCreateAllocator(&allocator_info, &allocator_);
   if (result != VK_SUCCESS) {
     throw VulkanException(result, "failed to create vma allocator");
@@ -436,8 +452,11 @@ void VkDriver::destroy() {
   frames_data_.destroy();
   delete swapchain_;
   delete descriptor_pool_;
+  delete upload_scheduler_;
   delete stage_pool_;
+  delete memory_pools_;
   delete graphics_cmd_queue_;
+  delete transfer_cmd_queue_;
   if (allocator_) {
     // VmaTotalStatistics stats;
     // vmaCalculateStatistics(allocator_, &stats);
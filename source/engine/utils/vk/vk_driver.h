@@ -12,6 +12,8 @@ class Swapchain;
 class RenderTarget;
 class DescriptorPool;
 class StagePool;
+class UploadScheduler;
+class MemoryPools;
 class CommandPool;
 class CommandBuffer;
 class Semaphore;
@@ -120,7 +122,29 @@ public:
 
   StagePool *getStagePool() const { return stage_pool_; }
 
+  /**
+   * @brief schedules gpu uploads on the transfer queue, see UploadScheduler
+   */
+  UploadScheduler *getUploadScheduler() const { return upload_scheduler_; }
+
+  /**
+   * @brief VMA pools per resource class, budget and defragmentation, see
+   * MemoryPools
+   */
+  MemoryPools *getMemoryPools() const { return memory_pools_; }
+
   uint32_t getMinUboAlignSize() const { return min_ubo_align_size_; }
+
+  /**
+   * @brief whether the extension is enabled on the logical device, optional
+   * extensions are only enabled when supported
+   */
+  bool isDeviceExtensionEnabled(const char *extension_name) const;
+
+  /**
+   * @brief core features enabled on the logical device
+   */
+  const VkPhysicalDeviceFeatures &getEnabledFeatures() const;
   
 private:
 
@@ -149,8 +173,6 @@ private:
   void setupDebugMessenger();
 
   void destroyDebugMessenger();
-
-  bool isDeviceExtensionEnabled(const char *extension_name);
   
   std::shared_ptr<VkConfig> config_;
   
@@ -174,5 +196,7 @@ private:
   Swapchain *swapchain_{nullptr};  
   DescriptorPool *descriptor_pool_{nullptr};
   StagePool *stage_pool_{nullptr};
+  UploadScheduler *upload_scheduler_{nullptr};
+  MemoryPools *memory_pools_{nullptr};
 };
 } // namespace mango
\ No newline at end of file
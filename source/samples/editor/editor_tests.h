@@ -3,4 +3,5 @@
 #ifdef IMGUI_ENABLE_TEST_ENGINE
 struct ImGuiTestEngine;
 void RegisterEditorTests(ImGuiTestEngine* engine);
+void RegisterEngineTests(ImGuiTestEngine* engine);
 #endif
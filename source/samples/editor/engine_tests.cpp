@@ -0,0 +1,945 @@
+#ifdef IMGUI_ENABLE_TEST_ENGINE
+#include "editor_tests.h"
+#include <imgui_te_engine.h>
+#include <imgui_te_context.h>
+#include <imgui/imgui.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <random>
+#include <stdexcept>
+
+#include <engine/asset/asset_texture.h>
+#include <engine/functional/global/engine_context.h>
+#include <engine/functional/render/render_system.h>
+#include <engine/functional/world/dynamic_aabb_tree.h>
+#include <engine/functional/world/world.h>
+#include <engine/functional/world/world_archive.h>
+#include <engine/platform/file_system.h>
+#include <engine/utils/base/radix_sort.h>
+#include <engine/utils/job/job_system.h>
+#include <engine/utils/vk/buffer.h>
+#include <engine/utils/vk/memory_pools.h>
+#include <engine/utils/vk/stage_pool.h>
+#include <engine/utils/vk/uniform_allocator.h>
+#include <engine/utils/vk/uniform_ring.h>
+#include <engine/utils/vk/vk_driver.h>
+
+// ── Allocation counting ──
+// Only in builds configured with MANGO_COUNT_ALLOCATIONS: replaces the global
+// operator new of the editor, allocations are counted on threads which set
+// g_count_allocations.
+#ifdef MANGO_COUNT_ALLOCATIONS
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+static thread_local bool g_count_allocations = false;
+static std::atomic<uint32_t> g_allocations{ 0 };
+
+void* operator new(std::size_t size)
+{
+    if (g_count_allocations)
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    if (g_count_allocations)
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+    const auto align = static_cast<std::size_t>(alignment);
+    size = (std::max<std::size_t>(size, 1) + align - 1) / align * align;
+#ifdef _WIN32
+    if (void* p = _aligned_malloc(size, align))
+        return p;
+#else
+    if (void* p = std::aligned_alloc(align, size))
+        return p;
+#endif
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(p, alignment);
+}
+#endif
+
+// ── Fixtures ──
+// A forest: side x side unit cubes on a grid, all sharing one mesh of two sub
+// meshes and one material, so the renderer sees a single instanced group.
+// The first light_count trees get a point light above them.
+static mango::WorldArchive MakeForestArchive(uint32_t side, uint32_t light_count = 0)
+{
+    mango::WorldArchive archive;
+    archive.lighting = {}; // no directional lights
+
+    for (int face = 0; face < 6; ++face) {
+        const int axis = face / 2;
+        const float sign = (face % 2 == 0) ? 1.0f : -1.0f;
+        Eigen::Vector3f n = Eigen::Vector3f::Zero();
+        n[axis] = sign;
+        const Eigen::Vector3f u = Eigen::Vector3f::Unit((axis + 1) % 3);
+        const Eigen::Vector3f v = Eigen::Vector3f::Unit((axis + 2) % 3);
+        const auto base = static_cast<uint32_t>(archive.vertices.size());
+        for (int c = 0; c < 4; ++c) {
+            const float a = (c & 1) ? 0.5f : -0.5f;
+            const float b = (c & 2) ? 0.5f : -0.5f;
+            archive.vertices.push_back(mango::StaticVertex{ n * 0.5f + u * a + v * b, n, Eigen::Vector2f(a + 0.5f, b + 0.5f) });
+        }
+        for (uint32_t i : { 0u, 1u, 2u, 2u, 1u, 3u })
+            archive.indices.push_back(base + i);
+    }
+    archive.sub_meshes = { mango::SubMesh{ 18, 0 }, mango::SubMesh{ 18, 18 } };
+    archive.meshes.push_back(mango::WorldArchive::MeshRecord{ 0, static_cast<uint32_t>(archive.vertices.size()), 0, static_cast<uint32_t>(archive.indices.size()), 0, 2 });
+
+    mango::WorldArchive::MaterialRecord material{};
+    material.params.albedo_color = Eigen::Vector4f(0.2f, 0.6f, 0.2f, 1.0f);
+    std::fill(std::begin(material.textures), std::end(material.textures), mango::WorldArchive::kInvalidId);
+    archive.materials.push_back(material);
+
+    const uint32_t name = archive.addString("tree");
+    const Eigen::AlignedBox3f cube(Eigen::Vector3f::Constant(-0.5f), Eigen::Vector3f::Constant(0.5f));
+    for (uint32_t i = 0; i < side * side; ++i) {
+        Eigen::Matrix4f m = Eigen::Matrix4f::Identity();
+        m(0, 3) = 2.0f * static_cast<float>(i % side);
+        m(2, 3) = 2.0f * static_cast<float>(i / side);
+        archive.node_parents.push_back(mango::WorldArchive::kInvalidId);
+        archive.node_ltransforms.push_back(m);
+        archive.node_aabbs.push_back(cube);
+        archive.mesh_entity_names.push_back(name);
+        archive.mesh_entity_nodes.push_back(i);
+        archive.mesh_entity_meshes.push_back(0);
+        archive.mesh_entity_materials.push_back(0);
+    }
+
+    const uint32_t light_name = archive.addString("firefly");
+    for (uint32_t i = 0; i < light_count && i < side * side; ++i) {
+        Eigen::Matrix4f m = archive.node_ltransforms[i];
+        m(1, 3) = 1.5f;
+        archive.node_parents.push_back(mango::WorldArchive::kInvalidId);
+        archive.node_ltransforms.push_back(m);
+        archive.node_aabbs.push_back(Eigen::AlignedBox3f(Eigen::Vector3f::Zero(), Eigen::Vector3f::Zero()));
+        archive.light_entity_names.push_back(light_name);
+        archive.light_entity_nodes.push_back(side * side + i);
+        archive.light_entity_types.push_back(LightType::LIGHT_POINT);
+        archive.light_entity_indices.push_back(static_cast<uint16_t>(i));
+        UPointLight light;
+        light.position = Eigen::Vector4f(0.0f, 0.0f, 0.0f, 3.0f);
+        light.luminous_intensity = Eigen::Vector4f(1.0f, 0.8f, 0.4f, 0.0f);
+        archive.point_lights.push_back(light);
+    }
+    archive.lighting.light_num[LightType::LIGHT_POINT] = static_cast<uint32_t>(archive.point_lights.size());
+    return archive;
+}
+
+static size_t CountStaticMeshes()
+{
+    size_t count = 0;
+    for ([[maybe_unused]] auto entity : mango::g_engine.getWorld()->getStaticMeshes())
+        ++count;
+    return count;
+}
+
+// Save the archive and open it as the current world, false if it isn't loaded
+// within a few hundred frames.
+static bool LoadArchiveWorld(ImGuiTestContext* ctx, const mango::WorldArchive& archive, const char* file_name)
+{
+    auto file_system = mango::g_engine.getFileSystem();
+    const std::string path = file_system->combine(file_system->getCacheDir(), std::string(file_name));
+    IM_CHECK_RETV(archive.save(path), false);
+    mango::g_engine.getWorld()->loadWorld(mango::URL(path));
+    for (int frame = 0; frame < 300 && CountStaticMeshes() != archive.mesh_entity_names.size(); ++frame)
+        ctx->Yield();
+    return CountStaticMeshes() == archive.mesh_entity_names.size();
+}
+
+// Columns of trivially copyable elements are equal byte for byte.
+template <typename T>
+static bool SameColumn(const std::vector<T>& a, const std::vector<T>& b)
+{
+    return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+}
+
+// Host side logic of the engine, run inside the editor like the ui tests.
+void RegisterEngineTests(ImGuiTestEngine* engine) {
+    // ── StagePool: ring ranges stay disjoint and aligned until reclaimed ──
+    {
+        ImGuiTest* t = IM_REGISTER_TEST(engine, "engine/stage_pool", "staging_ring_invariants");
+        t->TestFunc = [](ImGuiTestContext* ctx) {
+            constexpr VkDeviceSize k_ring_size = 4096;
+            static const VkDeviceSize k_alignments[] = { 1, 3, 4, 12, 16, 256 };
+            struct Live { VkDeviceSize offset; VkDeviceSize size; mango::UploadTicket ticket; };
+
+            mango::StagingRing ring(k_ring_size);
+            std::deque<Live> live;
+            std::mt19937 rng(7);
+            mango::UploadTicket ticket = 1;    // open batch
+            mango::UploadTicket completed = 0; // reached by the timeline
+            uint32_t rejected = 0;
+            for (int i = 0; i < 20000; ++i) {
+                if (rng() % 4 == 0)
+                    ++ticket; // the batch was flushed
+                if (rng() % 3 == 0 && completed + 1 < ticket) {
+                    completed += 1 + rng() % (ticket - 1 - completed);
+                    ring.reclaim(completed);
+                    std::erase_if(live, [completed](const Live& l) { return l.ticket <= completed; });
+                }
+
+                const VkDeviceSize size = 1 + rng() % 1024;
+                const VkDeviceSize alignment = k_alignments[rng() % IM_ARRAYSIZE(k_alignments)];
+                VkDeviceSize offset = 0;
+                if (!ring.allocate(size, alignment, ticket, offset)) {
+                    // an empty ring always has room
+                    IM_CHECK(!live.empty());
+                    ++rejected;
+                    continue;
+                }
+                IM_CHECK(offset % alignment == 0);
+                IM_CHECK(offset + size <= k_ring_size);
+                const bool disjoint = std::all_of(live.begin(), live.end(), [&](const Live& l) {
+                    return offset + size <= l.offset || l.offset + l.size <= offset;
+                });
+                IM_CHECK(disjoint);
+                live.push_back(Live{ offset, size, ticket });
+                IM_CHECK(ring.getUsed() <= k_ring_size);
+            }
+            ctx->LogInfo("staging ring: %u of 20000 allocations rejected while full", rejected);
+
+            // ranges of a ticket that is not reached stay in use
+            ring.reclaim(completed);
+            IM_CHECK(ring.getUsed() > 0 || live.empty());
+            ring.reclaim(ticket);
+            IM_CHECK(ring.getUsed() == 0);
+        };
+    }
+
+    // ── Render: a forest of one mesh is drawn with one draw per sub mesh ──
+    // Reports the draw calls against the draw calls the scene needs without
+    // instancing, and the mean frame time of the editor rendering it.
+    {
+        ImGuiTest* t = IM_REGISTER_TEST(engine, "engine/render", "forest_draw_calls");
+        t->TestFunc = [](ImGuiTestContext* ctx) {
+            constexpr uint32_t k_side = 64;
+            constexpr int k_frames = 120;
+            IM_CHECK_NO_RET(LoadArchiveWorld(ctx, MakeForestArchive(k_side), "test_forest.world"));
+            mango::g_engine.getWorld()->focusCamera2World();
+            ctx->Yield(10); // uploads and the first culling phase settle
+
+            const auto begin = std::chrono::steady_clock::now();
+            ctx->Yield(k_frames);
+            const float frame_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - begin).count() / k_frames;
+
+            const auto render_system = mango::g_engine.getRenderSystem();
+            const mango::DrawStats draw = render_system->getDrawStats();
+            const mango::OcclusionStats occlusion = render_system->getOcclusionStats();
+            ctx->LogInfo("forest %ux%u: %u visible instances in %u groups, %u draw calls (%u without instancing), %u secondary cmd buffers, %.3f ms/frame",
+                         k_side, k_side, draw.instances, draw.groups, draw.draw_calls, draw.draw_calls_uninstanced, draw.secondary_cmd_buffers, frame_ms);
+            ctx->LogInfo("occlusion: %u tested, %u occluded, %u disoccluded", occlusion.tested, occlusion.occluded, occlusion.disoccluded);
+
+            // one mesh and one material, two sub meshes, at most two culling phases
+            IM_CHECK(draw.groups <= 1);
+            IM_CHECK(draw.draw_calls <= 2 * 2 * draw.groups);
+            if (draw.instances > 1)
+                IM_CHECK(draw.draw_calls < draw.draw_calls_uninstanced);
+        };
+    }
+
+    // ── JobSystem: frame time and worker utilization against the serial loop ──
+    // Renders a forest with enough objects and point lights for the object
+    // buffer and the light binning to fan out, with the job system and in
+    // serial mode, where
+    // jobs run on the thread submitting them as the frame loop did before.
+    // Utilization is the time spent in jobs over the time all workers had.
+    {
+        ImGuiTest* t = IM_REGISTER_TEST(engine, "engine/job", "frame_benchmark");
+        t->TestFunc = [](ImGuiTestContext* ctx) {
+            constexpr int k_frames = 120;
+            IM_CHECK_NO_RET(LoadArchiveWorld(ctx, MakeForestArchive(128, 8192), "test_forest_jobs.world"));
+            mango::g_engine.getWorld()->focusCamera2World();
+            ctx->Yield(10);
+
+            const auto job_system = mango::g_engine.getJobSystem();
+            struct Result { float frame_ms; float utilization; uint64_t jobs; uint64_t steals; };
+            auto measure = [&](bool serial) {
+                job_system->setSerial(serial);
+                ctx->Yield(10); // frames recorded before the switch are done
+                const mango::JobSystemStats before = job_system->getStats();
+                const auto begin = std::chrono::steady_clock::now();
+                ctx->Yield(k_frames);
+                const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+                const mango::JobSystemStats after = job_system->getStats();
+                return Result{ static_cast<float>(seconds * 1000.0 / k_frames),
+                               static_cast<float>((after.busy_seconds - before.busy_seconds) / (seconds * after.thread_count)),
+                               after.jobs - before.jobs, after.steals - before.steals };
+            };
+            const Result parallel = measure(false);
+            const Result serial = measure(true);
+            job_system->setSerial(false);
+
+            ctx->LogInfo("job system, %u threads: %.3f ms/frame, %.1f%% worker utilization, %llu jobs, %llu steals",
+                         job_system->getThreadCount(), parallel.frame_ms, parallel.utilization * 100.0f,
+                         static_cast<unsigned long long>(parallel.jobs), static_cast<unsigned long long>(parallel.steals));
+            ctx->LogInfo("serial loop: %.3f ms/frame, speedup %.2fx", serial.frame_ms, serial.frame_ms / parallel.frame_ms);
+
+            // serial mode runs nothing on the workers
+            IM_CHECK(serial.jobs == 0);
+            if (job_system->getThreadCount() > 1)
+                IM_CHECK(parallel.jobs > 0);
+        };
+    }
+
+    // ── Render: collecting a steady frame doesn't allocate ──
+    // Counts the allocations of the render thread between the begin and end of
+    // collectRenderDatas once the buffers of the forest reached their size.
+    // Jobs run by workers during the frame are not counted. Registered in
+    // builds configured with MANGO_COUNT_ALLOCATIONS only.
+#ifdef MANGO_COUNT_ALLOCATIONS
+    {
+        ImGuiTest* t = IM_REGISTER_TEST(engine, "engine/render", "collect_render_datas_no_alloc");
+        t->TestFunc = [](ImGuiTestContext* ctx) {
+            static std::atomic<uint32_t> s_frames{ 0 };
+            IM_CHECK_NO_RET(LoadArchiveWorld(ctx, MakeForestArchive(32), "test_forest_alloc.world"));
+            mango::g_engine.getWorld()->focusCamera2World();
+            ctx->Yield(30); // uploads, culling phases and buffer growth settle
+
+            const auto render_system = mango::g_engine.getRenderSystem();
+            g_allocations = 0;
+            s_frames = 0;
+            render_system->setCollectProbe([](bool begin) {
+                g_count_allocations = begin;
+                if (begin)
+                    s_frames.fetch_add(1, std::memory_order_relaxed);
+            });
+            ctx->Yield(60);
+            render_system->setCollectProbe(nullptr);
+            ctx->Yield(); // the frame in flight may still call the probe
+
+            ctx->LogInfo("collectRenderDatas: %u allocations over %u frames", g_allocations.load(), s_frames.load());
+            IM_CHECK(s_frames.load() > 0);
+            IM_CHECK(g_allocations.load() == 0);
+        };
+    }
+#endif
+
+    // ── Sort: radix sort orders like a stable comparison sort ──
+    // Keys cover full 64 bit values, unused high bits (skipped passes), few
+    // distinct keys and a single key. The scratch vectors are reused.
+    {
+        ImGuiTest* t = IM_REGISTER_TEST(engine, "engine/sort", "radix_sort_matches_std_sort");
+        t->TestFunc = [](ImGuiTestContext* ctx) {
+            std::mt19937_64 rng(37);
+            std::vector<uint64_t> keys, tmp_keys;
+            std::vector<uint32_t> values, tmp_values;
+            std::vector<std::pair<uint64_t, uint32_t>> expected;
+            const uint64_t k_masks[] = { ~0ull, 0xFFFFFull, 0xFF00000000000000ull, 0x3ull, 0ull };
+            for (const uint64_t mask : k_masks) {
+                for (const size_t count : { 0u, 1u, 2u, 255u, 4096u }) {
+                    keys.resize(count);
+                    values.resize(count);
+                    expected.resize(count);
+                    for (size_t i = 0; i < count; ++i) {
+                        keys[i] = rng() & mask;
+                        values[i] = static_cast<uint32_t>(i);
+                        expected[i] = { keys[i], values[i] };
+                    }
+                    std::stable_sort(expected.begin(), expected.end(),
+                                     [](const auto& a, const auto& b) { return a.first < b.first; });
+                    mango::radixSort(keys, values, tmp_keys, tmp_values);
+
+                    IM_CHECK(keys.size() == count && values.size() == count);
+                    bool same = true;
+                    for (size_t i = 0; i < count; ++i)
+                        same &= keys[i] == expected[i].first && values[i] == expected[i].second;
+                    IM_CHECK(same);
+                }
+            }
+            ctx->LogInfo("radix sort: %d key patterns checked", IM_ARRAYSIZE(k_masks));
+        };
+    }
+
+    // ── UniformRing: slices stay aligned, disjoint and inside their frame ──
+    // Fills each frame region with pushes of random size until it throws, then
+    // checks the data of an earlier slot wasn't overwritten by the next one.
+    {
+        ImGuiTest* t = IM_REGISTER_TEST(engine, "engine/uniform_ring", "uniform_ring_invariants");
+        t->TestFunc = [](ImGuiTestContext* ctx) {
+            const auto driver = mango::g_engine.getDriver();
+            const VkDeviceSize alignment = std::max<VkDeviceSize>(driver->getMinUboAlignSize(), 1);
+            mango::UniformRing ring(driver, 4096);
+            const VkDeviceSize frame_size = ring.getFrameSize();
+            IM_CHECK(frame_size >= 4096 && frame_size % alignment == 0);
+
+            struct Slice { VkDeviceSize offset; size_t size; std::byte* data; uint8_t value; };
+            std::vector<Slice> slices;
+            std::mt19937 rng(41);
+            std::vector<uint8_t> payload;
+            for (uint32_t slot = 0; slot < mango::MAX_FRAMES_IN_FLIGHT; ++slot) {
+                ring.beginFrame(slot);
+                IM_CHECK(ring.getUsed() == 0);
+                const VkDeviceSize frame_begin = slot * frame_size;
+                VkDeviceSize end = frame_begin;
+                bool full = false;
+                while (!full) {
+                    const size_t size = 1 + rng() % 300;
+                    payload.assign(size, static_cast<uint8_t>(slices.size()));
+                    try {
+                        const mango::UniformSlice slice = ring.allocate(size);
+                        std::memcpy(slice.data, payload.data(), size);
+                        IM_CHECK(slice.offset % alignment == 0);
+                        // pointer bump, so later slices start after earlier ones
+                        IM_CHECK(slice.offset >= end);
+                        IM_CHECK(slice.offset + size <= frame_begin + frame_size);
+                        end = slice.offset + size;
+                        slices.push_back(Slice{ slice.offset, size, slice.data, payload[0] });
+                    } catch (const std::runtime_error&) {
+                        full = true;
+                    }
+                }
+                // a full region only leaves less than one aligned request of room
+                IM_CHECK(end + 300 + 2 * alignment > frame_begin + frame_size);
+            }
+
+            const bool intact = std::all_of(slices.begin(), slices.end(), [](const Slice& s) {
+                return std::all_of(s.data, s.data + s.size, [&s](std::byte b) { return static_cast<uint8_t>(b) == s.value; });
+            });
+            IM_CHECK(intact);
+
+            // reusing a slot starts at its region again
+            ring.beginFrame(1);
+            IM_CHECK(ring.getUsed() == 0);
+            IM_CHECK(ring.allocate(16).offset == frame_size);
+            ctx->LogInfo("uniform ring: %d slices in %u regions of %llu bytes, alignment %llu",
+                         static_cast<int>(slices.size()), mango::MAX_FRAMES_IN_FLIGHT,
+                         static_cast<unsigned long long>(frame_size), static_cast<unsigned long long>(alignment));
+        };
+    }
+
+    // ── WorldArchive: save and load round trip every column ──
+    {
+        ImGuiTest* t = IM_REGISTER_TEST(engine, "engine/world", "archive_round_trip");
+        t->TestFunc = [](ImGuiTestContext* ctx) {
+            mango::WorldArchive archive = MakeForestArchive(8, 4);
+            // a 2x2 texture referenced by the material
+            archive.textures.push_back(mango::WorldArchive::TextureRecord{ 2, 2, 0, 0, 0, 16 });
+            for (uint8_t i = 0; i < 16; ++i)
+                archive.texture_data.push_back(static_cast<uint8_t>(i * 13));
+            archive.materials[0].textures[0] = 0;
+
+            auto file_system = mango::g_engine.getFileSystem();
+            const std::string path = file_system->combine(file_system->getCacheDir(), std::string("test_round_trip.world"));
+            uint64_t texture_data_offset = 0;
+            IM_CHECK(archive.save(path, &texture_data_offset));
+
+            mango::WorldArchive loaded;
+            bool load_ok = true;
+            try {
+                loaded.load(path);
+            } catch (const std::runtime_error& e) {
+                ctx->LogError("%s", e.what());
+                load_ok = false;
+            }
+            IM_CHECK(load_ok);
+            IM_CHECK(SameColumn(loaded.string_chars, archive.string_chars));
+            IM_CHECK(SameColumn(loaded.string_offsets, archive.string_offsets));
+            IM_CHECK(loaded.getString(0) == "tree");
+            IM_CHECK(SameColumn(loaded.textures, archive.textures));
+            IM_CHECK(SameColumn(loaded.texture_data, archive.texture_data));
+            IM_CHECK(SameColumn(loaded.materials, archive.materials));
+            IM_CHECK(SameColumn(loaded.meshes, archive.meshes));
+            IM_CHECK(SameColumn(loaded.vertices, archive.vertices));
+            IM_CHECK(SameColumn(loaded.indices, archive.indices));
+            IM_CHECK(SameColumn(loaded.sub_meshes, archive.sub_meshes));
+            IM_CHECK(SameColumn(loaded.node_parents, archive.node_parents));
+            IM_CHECK(SameColumn(loaded.node_ltransforms, archive.node_ltransforms));
+            IM_CHECK(SameColumn(loaded.node_aabbs, archive.node_aabbs));
+            IM_CHECK(SameColumn(loaded.mesh_entity_names, archive.mesh_entity_names));
+            IM_CHECK(SameColumn(loaded.mesh_entity_nodes, archive.mesh_entity_nodes));
+            IM_CHECK(SameColumn(loaded.mesh_entity_meshes, archive.mesh_entity_meshes));
+            IM_CHECK(SameColumn(loaded.mesh_entity_materials, archive.mesh_entity_materials));
+            IM_CHECK(SameColumn(loaded.light_entity_names, archive.light_entity_names));
+            IM_CHECK(SameColumn(loaded.light_entity_nodes, archive.light_entity_nodes));
+            IM_CHECK(SameColumn(loaded.light_entity_types, archive.light_entity_types));
+            IM_CHECK(SameColumn(loaded.light_entity_indices, archive.light_entity_indices));
+            IM_CHECK(SameColumn(loaded.point_lights, archive.point_lights));
+            IM_CHECK(std::memcmp(&loaded.lighting, &archive.lighting, sizeof(ULighting)) == 0);
+
+            // texture pixels can be read back from the reported file offset
+            IM_CHECK(loaded.texture_data_offset == texture_data_offset);
+            std::ifstream ifs(path, std::ifstream::binary);
+            std::vector<uint8_t> pixels(archive.texture_data.size());
+            ifs.seekg(static_cast<std::streamoff>(texture_data_offset));
+            IM_CHECK(ifs.read(reinterpret_cast<char*>(pixels.data()), pixels.size()).good());
+            IM_CHECK(SameColumn(pixels, archive.texture_data));
+            ifs.close();
+
+            // a truncated file is reported, not read past its end
+            std::filesystem::resize_file(path, std::filesystem::file_size(path) / 2);
+            bool thrown = false;
+            try {
+                mango::WorldArchive broken;
+                broken.load(path);
+            } catch (const std::runtime_error&) {
+                thrown = true;
+            }
+            IM_CHECK(thrown);
+            ctx->LogInfo("world archive: %d nodes, %d entities round tripped",
+                         static_cast<int>(archive.node_parents.size()),
+                         static_cast<int>(archive.mesh_entity_names.size() + archive.light_entity_names.size()));
+        };
+    }
+
+    // ── UniformAllocator: free lists stay aligned, disjoint and coalesce ──
+    // Random allocations, frees and frame retirements on the bookkeeping of
+    // UniformAllocator. A freed block isn't handed out again before every
+    // frame slot retired, and freeing everything coalesces each page back into
+    // one free range.
+    {
+        ImGuiTest* t = IM_REGISTER_TEST(engine, "engine/uniform_allocator", "free_list_invariants");
+        t->TestFunc = [](ImGuiTestContext* ctx) {
+            constexpr VkDeviceSize k_page_size = 4096;
+            constexpr VkDeviceSize k_min_alignment = 64;
+            constexpr uint32_t k_all_frames = (1u << mango::MAX_FRAMES_IN_FLIGHT) - 1;
+            static const VkDeviceSize k_alignments[] = { 0, 64, 256, 1024 };
+            struct Block { uint32_t page; VkDeviceSize offset; VkDeviceSize size; uint32_t frame_mask; };
+            auto overlaps = [](const Block& b, uint32_t page, VkDeviceSize offset, VkDeviceSize size) {
+                return b.page == page && offset < b.offset + b.size && b.offset < offset + size;
+            };
+
+            mango::UniformFreeList free_list(k_page_size, k_min_alignment);
+            std::vector<Block> live;
+            std::vector<Block> pending; // freed, frame_mask holds the slots not retired yet
+            std::mt19937 rng(43);
+            uint32_t frame = 0;
+            for (int i = 0; i < 10000; ++i) {
+                const uint32_t op = rng() % 8;
+                if (op < 4 || live.empty()) {
+                    // a few blocks are larger than a page and get one of their own
+                    const VkDeviceSize requested = (rng() % 50 == 0) ? k_page_size + 1 + rng() % k_page_size : 1 + rng() % 700;
+                    const VkDeviceSize alignment = k_alignments[rng() % IM_ARRAYSIZE(k_alignments)];
+                    VkDeviceSize size = requested;
+                    uint32_t page = 0;
+                    VkDeviceSize offset = 0;
+                    free_list.allocate(size, alignment, page, offset);
+                    IM_CHECK(size >= requested && size % k_min_alignment == 0);
+                    IM_CHECK(offset % std::max(alignment, k_min_alignment) == 0);
+                    IM_CHECK(page < free_list.getPageCount());
+                    IM_CHECK(offset + size <= free_list.getPageCapacity(page));
+                    const bool disjoint = std::none_of(live.begin(), live.end(), [&](const Block& b) { return overlaps(b, page, offset, size); });
+                    IM_CHECK(disjoint);
+                    const bool not_pending = std::none_of(pending.begin(), pending.end(), [&](const Block& b) { return overlaps(b, page, offset, size); });
+                    IM_CHECK(not_pending);
+                    live.push_back(Block{ page, offset, size, 0 });
+                } else if (op < 7) {
+                    const size_t index = rng() % live.size();
+                    Block block = live[index];
+                    live[index] = live.back();
+                    live.pop_back();
+                    free_list.free(block.page, block.offset, block.size);
+                    block.frame_mask = k_all_frames;
+                    pending.push_back(block);
+                } else {
+                    const uint32_t slot = frame++ % mango::MAX_FRAMES_IN_FLIGHT;
+                    free_list.retire(slot);
+                    for (auto& block : pending)
+                        block.frame_mask &= ~(1u << slot);
+                    std::erase_if(pending, [](const Block& b) { return b.frame_mask == 0; });
+                }
+
+                const mango::UniformAllocatorStats stats = free_list.getStats();
+                VkDeviceSize used = 0, pending_bytes = 0;
+                for (const auto& block : live)
+                    used += block.size;
+                for (const auto& block : pending)
+                    pending_bytes += block.size;
+                IM_CHECK(stats.blocks == live.size());
+                IM_CHECK(stats.used == used && stats.pending == pending_bytes);
+                IM_CHECK(stats.used + stats.pending <= stats.capacity);
+            }
+
+            // more than a page is live, pages were chained
+            const mango::UniformAllocatorStats busy = free_list.getStats();
+            IM_CHECK(busy.pages > 1);
+            ctx->LogInfo("uniform free list: %u pages, %u blocks, occupancy %.2f, fragmentation %.2f, %u free ranges",
+                         busy.pages, busy.blocks, busy.occupancy(), busy.fragmentation(), busy.free_ranges);
+
+            // free everything, a block is only reclaimed after all slots retired
+            for (const auto& block : live)
+                free_list.free(block.page, block.offset, block.size);
+            for (uint32_t slot = 0; slot + 1 < mango::MAX_FRAMES_IN_FLIGHT; ++slot)
+                free_list.retire(slot);
+            IM_CHECK(free_list.getStats().pending > 0);
+            free_list.retire(mango::MAX_FRAMES_IN_FLIGHT - 1);
+
+            const mango::UniformAllocatorStats idle = free_list.getStats();
+            VkDeviceSize largest_page = 0;
+            for (uint32_t page = 0; page < free_list.getPageCount(); ++page)
+                largest_page = std::max(largest_page, free_list.getPageCapacity(page));
+            IM_CHECK(idle.blocks == 0 && idle.used == 0 && idle.pending == 0);
+            IM_CHECK(idle.pages == busy.pages);
+            IM_CHECK(idle.free_ranges == idle.pages); // each page coalesced into one range
+            IM_CHECK(idle.largest_free == largest_page);
+            IM_CHECK(idle.occupancy() == 0.0f);
+
+            // reclaimed space is reused before a page is chained
+            VkDeviceSize size = 256;
+            uint32_t page = 0;
+            VkDeviceSize offset = 0;
+            free_list.allocate(size, 0, page, offset);
+            IM_CHECK(free_list.getPageCount() == idle.pages);
+        };
+    }
+
+    // ── DynamicAABBTree: queries match a brute force scan over fat aabbs ──
+    // Random boxes are inserted, moved and destroyed one by one (SAH insert,
+    // rotations), then rebuilt in bulk above the parallel build threshold.
+    // After each phase overlap, frustum, ray and nearest queries are compared
+    // with a scan of every live proxy's fat aabb.
+    {
+        ImGuiTest* t = IM_REGISTER_TEST(engine, "engine/spatial", "aabb_tree_matches_brute_force");
+        t->TestFunc = [](ImGuiTestContext* ctx) {
+            std::mt19937 rng(7);
+            std::uniform_real_distribution<float> coord(-100.0f, 100.0f);
+            std::uniform_real_distribution<float> extent(0.1f, 4.0f);
+            std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+            auto random_box = [&]() {
+                const Eigen::Vector3f c(coord(rng), coord(rng), coord(rng));
+                const Eigen::Vector3f e(extent(rng), extent(rng), extent(rng));
+                return Eigen::AlignedBox3f(c - e, c + e);
+            };
+            auto random_dir = [&]() {
+                Eigen::Vector3f d;
+                do
+                    d = Eigen::Vector3f(unit(rng), unit(rng), unit(rng));
+                while (d.squaredNorm() < 0.01f);
+                return Eigen::Vector3f(d.normalized());
+            };
+
+            mango::DynamicAABBTree tree;
+            std::vector<int32_t> live; // proxy ids
+            std::vector<Eigen::AlignedBox3f> boxes; // tight box of each proxy, by user data
+
+            // checks tree queries against a scan, returns false on the first mismatch
+            auto matches_brute_force = [&]() -> bool {
+                std::vector<int32_t> expected, found;
+                auto same = [&]() {
+                    std::sort(expected.begin(), expected.end());
+                    std::sort(found.begin(), found.end());
+                    return expected == found;
+                };
+                IM_CHECK_RETV(tree.getProxyCount() == live.size(), false);
+                for (int32_t id : live)
+                    IM_CHECK_RETV(tree.getFatAABB(id).contains(boxes[tree.getUserData(id)]), false);
+
+                for (int query = 0; query < 64; ++query) {
+                    // overlap
+                    Eigen::AlignedBox3f region = random_box();
+                    region.extend(region.center() + Eigen::Vector3f::Constant(20.0f));
+                    expected.clear();
+                    found.clear();
+                    for (int32_t id : live)
+                        if (tree.getFatAABB(id).intersects(region))
+                            expected.push_back(id);
+                    tree.queryOverlap(region, [&](int32_t id) { found.push_back(id); return true; });
+                    IM_CHECK_RETV(same(), false);
+
+                    // frustum, six planes enclosing a sphere around a random point
+                    mango::Frustum frustum;
+                    const Eigen::Vector3f center(coord(rng), coord(rng), coord(rng));
+                    for (auto& plane : frustum.planes) {
+                        const Eigen::Vector3f n = random_dir();
+                        plane << n, -n.dot(center) + 40.0f;
+                    }
+                    expected.clear();
+                    found.clear();
+                    for (int32_t id : live) {
+                        const Eigen::AlignedBox3f& fat = tree.getFatAABB(id);
+                        const Eigen::Vector3f c = fat.center();
+                        const Eigen::Vector3f e = fat.sizes() * 0.5f;
+                        bool outside = false;
+                        for (const auto& plane : frustum.planes)
+                            outside |= plane.head<3>().dot(c) + plane.w() + plane.head<3>().cwiseAbs().dot(e) < 0.0f;
+                        if (!outside)
+                            expected.push_back(id);
+                    }
+                    tree.queryFrustum(frustum, [&](int32_t id) { found.push_back(id); return true; });
+                    IM_CHECK_RETV(same(), false);
+
+                    // ray, every hit and then the closest one by clipping
+                    const Eigen::Vector3f origin = random_dir() * 200.0f;
+                    const Eigen::Vector3f dir = (Eigen::Vector3f(coord(rng), coord(rng), coord(rng)) * 0.5f - origin).normalized();
+                    const Eigen::Vector3f inv_dir = dir.cwiseInverse();
+                    constexpr float k_max_t = 400.0f;
+                    float closest = k_max_t;
+                    expected.clear();
+                    found.clear();
+                    for (int32_t id : live) {
+                        float t_enter;
+                        if (mango::DynamicAABBTree::rayIntersect(tree.getFatAABB(id), origin, inv_dir, k_max_t, t_enter)) {
+                            expected.push_back(id);
+                            closest = std::min(closest, t_enter);
+                        }
+                    }
+                    tree.rayCast(origin, dir, k_max_t, [&](int32_t id, float) { found.push_back(id); return k_max_t; });
+                    IM_CHECK_RETV(same(), false);
+                    float clipped = k_max_t;
+                    tree.rayCast(origin, dir, k_max_t, [&](int32_t, float t_enter) {
+                        clipped = std::min(clipped, t_enter);
+                        return clipped;
+                    });
+                    IM_CHECK_RETV(clipped == closest, false);
+
+                    // nearest, ties may pick any proxy at the same distance
+                    const Eigen::Vector3f p(coord(rng), coord(rng), coord(rng));
+                    float nearest = FLT_MAX;
+                    for (int32_t id : live)
+                        nearest = std::min(nearest, tree.getFatAABB(id).squaredExteriorDistance(p));
+                    const int32_t id = tree.queryNearest(p);
+                    IM_CHECK_RETV(id != mango::DynamicAABBTree::kNullNode, false);
+                    IM_CHECK_RETV(tree.getFatAABB(id).squaredExteriorDistance(p) == nearest, false);
+                }
+                return true;
+            };
+
+            // incremental: insert, move (small moves stay in the fat aabb), destroy
+            constexpr uint32_t k_incremental = 2000;
+            for (uint32_t i = 0; i < k_incremental; ++i) {
+                boxes.push_back(random_box());
+                live.push_back(tree.createProxy(boxes.back(), i));
+            }
+            for (int step = 0; step < 4000; ++step) {
+                const size_t index = rng() % live.size();
+                const int32_t id = live[index];
+                Eigen::AlignedBox3f& box = boxes[tree.getUserData(id)];
+                if (step % 4 == 3) {
+                    tree.destroyProxy(id);
+                    live[index] = live.back();
+                    live.pop_back();
+                    boxes.push_back(random_box());
+                    live.push_back(tree.createProxy(boxes.back(), static_cast<uint32_t>(boxes.size() - 1)));
+                } else {
+                    const float scale = step % 2 ? 0.01f : 10.0f;
+                    box.translate(random_dir() * scale);
+                    tree.moveProxy(id, box);
+                }
+            }
+            // AVL rotations keep the height logarithmic
+            const int32_t max_height = 2 * static_cast<int32_t>(std::ceil(std::log2(float(live.size())))) + 2;
+            ctx->LogInfo("aabb tree: %zu proxies, height %d after incremental updates", live.size(), tree.getHeight());
+            IM_CHECK(tree.getHeight() <= max_height);
+            IM_CHECK(matches_brute_force());
+
+            // bulk rebuild above the parallel build threshold
+            constexpr uint32_t k_bulk = 20000;
+            boxes.clear();
+            std::vector<uint32_t> user_datas(k_bulk);
+            for (uint32_t i = 0; i < k_bulk; ++i) {
+                boxes.push_back(random_box());
+                user_datas[i] = i;
+            }
+            tree.rebuild(boxes, user_datas, live);
+            IM_CHECK(live.size() == k_bulk);
+            for (uint32_t i = 0; i < k_bulk; ++i)
+                IM_CHECK_NO_RET(tree.getUserData(live[i]) == i);
+            ctx->LogInfo("aabb tree: %zu proxies, height %d after rebuild", live.size(), tree.getHeight());
+            IM_CHECK(matches_brute_force());
+
+            // the rebuilt tree keeps working incrementally
+            for (int step = 0; step < 1000; ++step) {
+                const int32_t id = live[rng() % live.size()];
+                Eigen::AlignedBox3f& box = boxes[tree.getUserData(id)];
+                box.translate(random_dir() * 10.0f);
+                tree.moveProxy(id, box);
+            }
+            IM_CHECK(matches_brute_force());
+        };
+    }
+
+    // ── TextureStreamer: mips stream in on request and fall back when unused ──
+    // A 512x512 texture backed by a raw pixel file keeps only its mip tail on
+    // the cpu and gpu after inflate. Requesting full resolution every frame
+    // reads the finer levels back from the file, and they are evicted again
+    // once the requests stop. A changed file is caught by the source hash.
+    {
+        ImGuiTest* t = IM_REGISTER_TEST(engine, "engine/texture_streamer", "stream_in_and_evict");
+        t->TestFunc = [](ImGuiTestContext* ctx) {
+            constexpr uint32_t k_size = 512;
+            std::vector<uint8_t> pixels(k_size * k_size * 4);
+            std::mt19937 rng(11);
+            for (auto& byte : pixels)
+                byte = static_cast<uint8_t>(rng());
+
+            auto file_system = mango::g_engine.getFileSystem();
+            const std::string path = file_system->combine(file_system->getCacheDir(), std::string("test_streamed.pixels"));
+            {
+                std::ofstream file(path, std::ios::binary | std::ios::trunc);
+                file.write(reinterpret_cast<const char*>(pixels.data()), static_cast<std::streamsize>(pixels.size()));
+                IM_CHECK(file.good());
+            }
+
+            auto texture = std::make_shared<mango::AssetTexture>();
+            mango::TextureSource source;
+            source.path = path;
+            source.size = pixels.size();
+            texture->load(k_size, k_size, pixels.data(), std::move(source));
+
+            // levels up to 128 px are the tail: 512 -> 256 -> 128
+            const uint32_t tail = texture->getMipTail();
+            IM_CHECK(texture->getMipLevels() == 10);
+            IM_CHECK(tail == 2);
+            IM_CHECK(texture->getResidentMip() == tail);
+            uint64_t tail_bytes = 0;
+            for (uint32_t level = tail; level < texture->getMipLevels(); ++level)
+                tail_bytes += 4ull * std::max(k_size >> level, 1u) * std::max(k_size >> level, 1u);
+            IM_CHECK(texture->getMipBytes(tail) == tail_bytes);
+
+            // the first level was dropped from host memory, it's read back from the file
+            std::vector<uint8_t> read_back;
+            IM_CHECK(texture->readImageData(read_back));
+            IM_CHECK(read_back == pixels);
+
+            // one texel per pixel asks for the first level, the budget may coarsen it
+            const auto render_system = mango::g_engine.getRenderSystem();
+            auto wanted = [&]() { return std::min(render_system->getTextureStreamingStats().mip_bias, tail); };
+            bool streamed_in = false;
+            for (int frame = 0; frame < 120 && !streamed_in; ++frame) {
+                texture->requestMip(1.0f / k_size);
+                ctx->Yield();
+                streamed_in = texture->getResidentMip() == wanted();
+            }
+            const mango::TextureStreamingStats stats = render_system->getTextureStreamingStats();
+            ctx->LogInfo("texture streaming: resident mip %u, mip bias %u, %u textures, %llu resident bytes, budget %llu",
+                         texture->getResidentMip(), stats.mip_bias, stats.textures,
+                         static_cast<unsigned long long>(stats.resident_bytes), static_cast<unsigned long long>(stats.budget_bytes));
+            IM_CHECK(streamed_in);
+
+            // unrequested levels are evicted after the hysteresis
+            bool evicted = false;
+            for (int frame = 0; frame < 400 && !evicted; ++frame) {
+                ctx->Yield();
+                evicted = texture->getResidentMip() == tail;
+            }
+            IM_CHECK(evicted);
+
+            // a file changed behind the texture's back isn't read
+            {
+                std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+                file.seekp(0);
+                file.put(static_cast<char>(pixels[0] ^ 0xff));
+            }
+            IM_CHECK(!texture->readImageData(read_back));
+
+            texture.reset();
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+        };
+    }
+
+    // ── MemoryPools: class stats track allocations, holes are defragmented ──
+    // Fills the Mesh pool with 1 MB buffers, frees every other one so the free
+    // space is split into holes, then requests a defragmentation and waits for
+    // its passes to move the remaining buffers together.
+    {
+        ImGuiTest* t = IM_REGISTER_TEST(engine, "engine/memory_pools", "mesh_pool_defragmentation");
+        t->TestFunc = [](ImGuiTestContext* ctx) {
+            constexpr VkDeviceSize k_buffer_size = 1 << 20;
+            constexpr size_t k_max_buffers = 1024;
+            constexpr uint32_t k_mesh = static_cast<uint32_t>(mango::MemoryClass::Mesh);
+            const auto driver = mango::g_engine.getDriver();
+            mango::MemoryPools* memory_pools = driver->getMemoryPools();
+
+            const mango::MemoryStats initial = memory_pools->getStats();
+            IM_CHECK(initial.device.budget > 0);
+
+            // allocate until the pool's blocks are full, at least 64 buffers
+            std::vector<std::shared_ptr<mango::Buffer>> buffers;
+            std::vector<uint8_t> header(256);
+            mango::UploadTicket ticket = 0;
+            for (;;) {
+                const mango::MemoryPoolStats mesh = memory_pools->getStats().classes[k_mesh];
+                if ((buffers.size() >= 64 && mesh.block_bytes - mesh.allocation_bytes < k_buffer_size) ||
+                    buffers.size() == k_max_buffers)
+                    break;
+                auto buffer = std::make_shared<mango::Buffer>(
+                    driver, k_buffer_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 0, 0,
+                    VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, mango::MemoryClass::Mesh);
+                // buffers are only moved once their upload completed
+                std::fill(header.begin(), header.end(), static_cast<uint8_t>(buffers.size()));
+                auto recorder = driver->getUploadScheduler()->record();
+                recorder.uploadBuffer(*buffer, header.data(), header.size());
+                recorder.releaseBuffer(*buffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+                ticket = recorder.getTicket();
+                buffers.push_back(std::move(buffer));
+            }
+            const mango::MemoryPoolStats full = memory_pools->getStats().classes[k_mesh];
+            IM_CHECK(full.pools >= 1 && full.blocks >= 1);
+            IM_CHECK(full.allocations >= initial.classes[k_mesh].allocations + buffers.size());
+            IM_CHECK(full.allocation_bytes >= initial.classes[k_mesh].allocation_bytes + buffers.size() * k_buffer_size);
+            IM_CHECK(full.allocation_bytes <= full.block_bytes);
+            for (int frame = 0; frame < 120 && !driver->getUploadScheduler()->isCompleted(ticket); ++frame)
+                ctx->Yield();
+            IM_CHECK(driver->getUploadScheduler()->isCompleted(ticket));
+
+            // every other buffer freed, the free space is split into holes
+            const size_t freed = (buffers.size() + 1) / 2;
+            for (size_t i = 0; i < buffers.size(); i += 2)
+                buffers[i] = nullptr;
+            std::erase(buffers, nullptr);
+            const mango::MemoryPoolStats holes = memory_pools->getStats().classes[k_mesh];
+            IM_CHECK(holes.allocations == full.allocations - freed);
+            IM_CHECK(holes.allocation_bytes <= full.allocation_bytes - freed * k_buffer_size);
+            IM_CHECK(holes.fragmentation > 0.5f);
+
+            memory_pools->requestDefragmentation();
+            bool started = false, finished = false;
+            for (int frame = 0; frame < 600 && !finished; ++frame) {
+                ctx->Yield();
+                const mango::MemoryStats stats = memory_pools->getStats();
+                started = started || stats.defragmenting;
+                finished = started && !stats.defragmenting;
+            }
+            const mango::MemoryPoolStats packed = memory_pools->getStats().classes[k_mesh];
+            ctx->LogInfo("mesh pool: %u buffers, %u blocks, fragmentation %.2f -> %.2f, %llu moves (%llu MB)",
+                         static_cast<uint32_t>(buffers.size()), packed.blocks, holes.fragmentation, packed.fragmentation,
+                         static_cast<unsigned long long>(packed.moves - holes.moves),
+                         static_cast<unsigned long long>((packed.bytes_moved - holes.bytes_moved) >> 20));
+            IM_CHECK(finished);
+            IM_CHECK(packed.moves > holes.moves);
+            IM_CHECK(packed.bytes_moved > holes.bytes_moved);
+            IM_CHECK(packed.allocations == holes.allocations); // moved, not duplicated
+            IM_CHECK(packed.fragmentation < holes.fragmentation);
+        };
+    }
+}
+#endif
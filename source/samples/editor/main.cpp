@@ -30,6 +30,7 @@ int main(int argc, char **argv) {
 #ifdef IMGUI_ENABLE_TEST_ENGINE
     ImGuiTestEngine* engine = static_cast<ImGuiTestEngine*>(mango::g_engine.getTestEngine());
     RegisterEditorTests(engine);
+    RegisterEngineTests(engine);
 
     // ── CLI-driven test execution ────────────────────────────────────────────
     // Usage: